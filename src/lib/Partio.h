@@ -77,7 +77,8 @@ public:
     virtual int numAttributes() const=0;
 
     //! Number of per-particle attributes.
-    virtual int numParticles() const=0;
+    //! Counts are 64 bit so sets past 2^31 particles can be addressed.
+    virtual int64_t numParticles() const=0;
 
     //! Lookup an attribute by name and store a handle to the attribute.
     virtual bool attributeInfo(const char* attributeName,ParticleAttribute& attribute) const=0;
@@ -86,6 +87,27 @@ public:
     virtual bool attributeInfo(const int attributeInfo,ParticleAttribute& attribute) const=0;
 };
 
+//! Receives the results of ParticlesData::visitPointsInRadius() one at a time
+class PointVisitor
+{
+public:
+    virtual ~PointVisitor() {}
+
+    //! Called for each particle found. Return false to stop the search.
+    virtual bool visit(const ParticleIndex particleIndex,const float distanceSquared)=0;
+};
+
+//! Decides which particles a filtered ParticlesData::findNPoints() may return
+class PointFilter
+{
+public:
+    virtual ~PointFilter() {}
+
+    //! Called during the search for particles within the current search
+    //! radius. Return false to leave the particle out of the result.
+    virtual bool accept(const ParticleIndex particleIndex) const=0;
+};
+
 // Particle Data Interface
 //!  Particle Data Interface
 /*!
@@ -117,6 +139,25 @@ public:
         return static_cast<T*>(dataInternal(attribute,particleIndex));
     }
 
+    //! Fill the user supplied values array with the attribute values of the
+    //! count particles starting at start, packed one particle after another.
+    //! note if T is void, then type checking is disabled.
+    template<class T> inline void getRange(const ParticleAttribute& attribute,
+        const ParticleIndex start,const int64_t count,T* values) const
+    {
+        assert(typeCheck<T>(attribute.type));
+        dataInternalRange(attribute,start,count,(char*)values);
+    }
+
+    //! Returns the attribute values of all particles as one packed array,
+    //! or null if this particle set does not store them contiguously.
+    //! The pointer is invalidated by anything that reallocates particles.
+    template<class T> inline const T* contiguousPointer(const ParticleAttribute& attribute) const
+    {
+        assert(typeCheck<T>(attribute.type));
+        return static_cast<const T*>(dataInternalContiguous(attribute));
+    }
+
     /// All indexed strings for an attribute
     virtual const std::vector<std::string>& indexedStrs(const ParticleAttribute& attr) const=0;
 
@@ -136,6 +177,15 @@ public:
     virtual void findPoints(const float bboxMin[3],const float bboxMax[3],
         std::vector<ParticleIndex>& points) const=0;
 
+    //! Find the points inside a convex region, on the positive side
+    //! a*x+b*y+c*z+d>=0 of each of nPlanes planes given as abcd quadruples,
+    //! e.g. the inward facing planes of a camera frustum. Whole parts of the
+    //! KD-Tree inside the region are taken without testing their points.
+    //! NOTE: points array is not pre-cleared.
+    //! Must call sort() before using this function
+    virtual void findPointsInConvex(const float* planes,const int nPlanes,
+        std::vector<ParticleIndex>& points) const=0;
+
     //! Find the N nearest neighbors that are within maxRadius distance using STL types
     //! (measured in standard 2-norm). If less than N are found within the
     //! radius, the search radius is not increased.
@@ -150,6 +200,114 @@ public:
     virtual int findNPoints(const float center[3],int nPoints,const float maxRadius,
         ParticleIndex *points, float *pointDistancesSquared, float *finalRadius2) const=0;
 
+    //! Same as findNPoints() using POD types, but only particles filter accepts
+    //! are returned. Rejected particles never displace nearer accepted ones, so
+    //! there is no need to ask for more points and discard some.
+    //! Must call sort() before using this function
+    virtual int findNPoints(const float center[3],int nPoints,const float maxRadius,const PointFilter& filter,
+        ParticleIndex *points,float *pointDistancesSquared,float *finalRadius2) const=0;
+
+    //! Runs findNPoints for nQueries query points given as a flat xyz array,
+    //! spreading the queries over numThreads() threads.
+    //! Query q writes its points and squared distances starting at
+    //! points[q*nPoints] and pointDistancesSquared[q*nPoints], and the number
+    //! found into pointCounts[q].
+    //! Must call sort() before using this function
+    virtual void findNPointsBatch(const float* centers,const int nQueries,const int nPoints,
+        const float maxRadius,ParticleIndex* points,float* pointDistancesSquared,int* pointCounts) const=0;
+
+    //! Approximate findNPoints() using POD types. A part of the KD-Tree is only
+    //! searched if it could hold a point more than 1+epsilon times nearer than
+    //! the farthest of the nPoints found so far, so the ith point returned is at
+    //! most 1+epsilon times farther than the true ith nearest. If maxVisits>0 the
+    //! search also gives up after looking at that many particles and returns the
+    //! nearest it saw. epsilon=0 and maxVisits=0 is the exact search.
+    //! Must call sort() before using this function
+    virtual int findNPointsApproximate(const float center[3],int nPoints,const float maxRadius,
+        const float epsilon,const int maxVisits,ParticleIndex *points,float *pointDistancesSquared,
+        float *finalRadius2) const=0;
+
+    //! Runs findNPointsApproximate for nQueries query points, laid out as for
+    //! findNPointsBatch().
+    //! Must call sort() before using this function
+    virtual void findNPointsBatchApproximate(const float* centers,const int nQueries,const int nPoints,
+        const float maxRadius,const float epsilon,const int maxVisits,ParticleIndex* points,
+        float* pointDistancesSquared,int* pointCounts) const=0;
+
+    //! Calls visitor.visit() with the index and squared distance of every particle
+    //! closer than radius to center, in no particular order. Nothing is allocated
+    //! and the search stops as soon as visit() returns false.
+    //! Returns false if the search was stopped early.
+    //! Must call sort() before using this function
+    virtual bool visitPointsInRadius(const float center[3],const float radius,PointVisitor& visitor) const=0;
+
+    //! Same as findPoints() in the KD-Tree sort(attributeName) built over another
+    //! attribute, with bboxMin and bboxMax having as many components as it does.
+    //! The tree is built on first use if it wasn't. "position" searches the
+    //! index sort() built.
+    virtual void findPoints(const char* attributeName,const float* bboxMin,const float* bboxMax,
+        std::vector<ParticleIndex>& points) const=0;
+
+    //! Same as findNPoints() in the KD-Tree sort(attributeName) built over another
+    //! attribute, with center having as many components as it does.
+    //! The tree is built on first use if it wasn't. "position" searches the
+    //! index sort() built.
+    virtual int findNPoints(const char* attributeName,const float* center,int nPoints,const float maxRadius,
+        ParticleIndex *points,float *pointDistancesSquared,float *finalRadius2) const=0;
+
+    //! Find the particles whose sphere, around their position with the radius
+    //! sortSpheres() was given, contains point.
+    //! NOTE: points array is not pre-cleared.
+    //! Must call sortSpheres() before using this function
+    virtual void findSpheresContaining(const float point[3],std::vector<ParticleIndex>& points) const=0;
+
+    //! Find the particles whose sphere overlaps the bounding box specified.
+    //! NOTE: points array is not pre-cleared.
+    //! Must call sortSpheres() before using this function
+    virtual void findSpheresOverlapping(const float bboxMin[3],const float bboxMax[3],
+        std::vector<ParticleIndex>& points) const=0;
+
+    //! Find the particles closer than radius to the segment origin+t*direction,
+    //! tMin<=t<=tMax, nearest first. t[i] is where the segment passes closest to
+    //! points[i], in units of direction. Only the maxHits nearest are kept, all
+    //! of them if maxHits<=0, and the search stops once nothing nearer is left.
+    //! NOTE: points/t are cleared before use.
+    //! Must call sort() before using this function
+    virtual void findPointsAlongRay(const float origin[3],const float direction[3],const float tMin,
+        const float tMax,const float radius,const int maxHits,std::vector<ParticleIndex>& points,
+        std::vector<float>& t) const=0;
+
+    //! Runs findPointsAlongRay for nRays rays given as flat xyz arrays, spreading
+    //! them over numThreads() threads. Neighbouring rays are traced together in
+    //! small packets, so coherent rays, like a camera's in scanline order, should
+    //! be next to each other. Ray r writes its hits starting at points[r*maxHits]
+    //! and t[r*maxHits], and the number found into hitCounts[r].
+    //! Must call sort() before using this function
+    virtual void findPointsAlongRays(const float* origins,const float* directions,const int nRays,
+        const float tMin,const float tMax,const float radius,const int maxHits,
+        ParticleIndex* points,float* t,int* hitCounts) const=0;
+
+    //! Find the particles whose sphere the segment origin+t*direction,
+    //! tMin<=t<=tMax, passes through, nearest first. t[i] is where it enters
+    //! the sphere of points[i], or tMin if it starts inside. maxHits is as for
+    //! findPointsAlongRay().
+    //! NOTE: points/t are cleared before use.
+    //! Must call sortSpheres() before using this function
+    virtual void findSpheresAlongRay(const float origin[3],const float direction[3],const float tMin,
+        const float tMax,const int maxHits,std::vector<ParticleIndex>& points,std::vector<float>& t) const=0;
+
+    //! Runs findSpheresAlongRay for nRays rays, laid out as for findPointsAlongRays().
+    //! Must call sortSpheres() before using this function
+    virtual void findSpheresAlongRays(const float* origins,const float* directions,const int nRays,
+        const float tMin,const float tMax,const int maxHits,ParticleIndex* points,float* t,
+        int* hitCounts) const=0;
+
+    //! Find all the particles closer than radius to center.
+    //! NOTE: points/pointDistancesSquared are not pre-cleared, so they can be reused across queries.
+    //! Must call sort() before using this function
+    void findPointsInRadius(const float center[3],const float radius,
+        std::vector<ParticleIndex>& points,std::vector<float>& pointDistancesSquared) const;
+
     //! Produce a const iterator
     virtual const_iterator setupConstIterator() const=0;
 
@@ -165,6 +323,107 @@ private:
     virtual void* dataInternal(const ParticleAttribute& attribute,const ParticleIndex particleIndex) const=0;
     virtual void dataInternalMultiple(const ParticleAttribute& attribute,const int indexCount,
         const ParticleIndex* particleIndices,const bool sorted,char* values) const=0;
+    virtual void dataInternalRange(const ParticleAttribute& attribute,const ParticleIndex start,
+        const int64_t count,char* values) const=0;
+    virtual void* dataInternalContiguous(const ParticleAttribute& attribute) const=0;
+};
+
+//! Accepts every particle but one, usually the one a search is centered on
+class ExcludeIndexFilter:public PointFilter
+{
+public:
+    ExcludeIndexFilter(const ParticleIndex excluded)
+        :excluded(excluded)
+    {}
+
+    bool accept(const ParticleIndex particleIndex) const
+    {return particleIndex!=excluded;}
+
+    ParticleIndex excluded;
+};
+
+//! Accepts the particles whose INT or INDEXEDSTR attribute has value as its
+//! first component. The particles must outlive the filter and not be resized.
+class IntAttributeFilter:public PointFilter
+{
+public:
+    IntAttributeFilter(const ParticlesData& particles,const ParticleAttribute& attribute,const int value)
+        :particles(particles),attribute(attribute),value(value),
+        values(particles.contiguousPointer<int>(attribute))
+    {}
+
+    bool accept(const ParticleIndex particleIndex) const
+    {
+        if(values) return values[(size_t)particleIndex*attribute.count]==value;
+        return particles.data<int>(attribute,particleIndex)[0]==value;
+    }
+
+    const ParticlesData& particles;
+    ParticleAttribute attribute;
+    int value;
+private:
+    const int* values; // read directly when the attribute is packed
+};
+
+//! Accepts the particles whose INDEXEDSTR attribute is str, none if no
+//! particle has it
+class IndexedStrFilter:public IntAttributeFilter
+{
+public:
+    IndexedStrFilter(const ParticlesData& particles,const ParticleAttribute& attribute,const char* str)
+        :IntAttributeFilter(particles,attribute,particles.lookupIndexedStr(attribute,str))
+    {}
+};
+
+//! Accepts the particles both filters accept, e.g. the neighbors from the
+//! same source other than the particle itself
+class BothFilters:public PointFilter
+{
+public:
+    BothFilters(const PointFilter& first,const PointFilter& second)
+        :first(first),second(second)
+    {}
+
+    bool accept(const ParticleIndex particleIndex) const
+    {return first.accept(particleIndex) && second.accept(particleIndex);}
+
+    const PointFilter& first;
+    const PointFilter& second;
+};
+
+//! Spatial indices ParticlesDataMutable::sort() can build
+/*!
+  KDTREE suits any query. HASHGRID is a uniform grid of cells that is much
+  cheaper to build and suits sets that are always queried at about one radius.
+*/
+enum SpatialIndex {KDTREE=0,HASHGRID};
+
+//! Options controlling how ParticlesDataMutable::sort() builds its spatial index
+struct SortOptions
+{
+    //! Which spatial index to build
+    SpatialIndex index;
+
+    //! Build a low memory tree that reads positions in place through 32 bit
+    //! ids instead of keeping its own copy of them. Queries are a little
+    //! slower and positions must not be moved until the next sort.
+    bool compact;
+
+    //! Edge length of the HASHGRID cells, usually the radius the set will be queried at
+    float cellSize;
+
+    //! File the particles were read from, still in the file's order. A KDTREE
+    //! is then loaded from the index writeSortIndex() saved for the file, when
+    //! it still matches the file, instead of being built.
+    const char* sourceFile;
+
+    SortOptions(const bool compact=false)
+        :index(KDTREE),compact(compact),cellSize(0),sourceFile(0)
+    {}
+
+    SortOptions(const SpatialIndex index,const float cellSize)
+        :index(index),compact(false),cellSize(cellSize),sourceFile(0)
+    {}
 };
 
 // Particle Mutable Data Interface
@@ -191,13 +450,70 @@ public:
         return static_cast<T*>(dataInternal(attribute,particleIndex));
     }
 
+    //! Copy packed attribute values from the user supplied values array into
+    //! the count particles starting at start.
+    //! note if T is void, then type checking is disabled.
+    template<class T> inline void setRange(const ParticleAttribute& attribute,
+        const ParticleIndex start,const int64_t count,const T* values)
+    {
+        assert(typeCheck<T>(attribute.type));
+        dataWriteInternalRange(attribute,start,count,(const char*)values);
+    }
+
+    //! Writable version of contiguousPointer(), null if the attribute is
+    //! not stored contiguously
+    template<class T> inline T* contiguousPointerWrite(const ParticleAttribute& attribute)
+    {
+        assert(typeCheck<T>(attribute.type));
+        return static_cast<T*>(dataInternalContiguous(attribute));
+    }
+
     /// Returns a token for the given string. This allows efficient storage of string data
     virtual int registerIndexedStr(const ParticleAttribute& attribute,const char* str)=0;
 
     //! Preprocess the data for finding nearest neighbors by sorting into a
     //! KD-Tree. Note: all particle pointers are invalid after this call.
+    //! The tree is built with up to numThreads() threads.
+    //! Queries on a set that was never sorted build the tree on first use.
+    //! sort() may run while other threads query, they finish on the old tree,
+    //! but not from inside a PointVisitor. reorder(), updateSort() and
+    //! changes to the particles themselves must not overlap queries.
     virtual void sort()=0;
 
+    //! Same as sort() with control over which spatial index is built and how
+    virtual void sort(const SortOptions& options)=0;
+
+    //! Builds a KD-Tree over the named FLOAT or VECTOR attribute with 1 to 4
+    //! components, such as velocity, for the findPoints() and findNPoints()
+    //! taking an attribute name. A set keeps one tree per attribute next to its
+    //! position index. The tree copies the values, so sort the attribute again
+    //! after changing them. reorder() rebuilds the trees, since it changes
+    //! particle indices. "position" is the same as sort().
+    virtual void sort(const char* attributeName)=0;
+
+    //! Builds a bounding volume hierarchy over a sphere around each particle's
+    //! position, with its radius from the named FLOAT attribute, for
+    //! findSpheresContaining() and findSpheresOverlapping(). Unlike searching
+    //! the positions within the largest radius and filtering, the cost
+    //! doesn't grow with how much the radii vary. The hierarchy is kept next
+    //! to the other indices and copies the spheres, so sort them again after
+    //! moving particles or changing radii. reorder() rebuilds it.
+    virtual void sortSpheres(const char* radiusAttribute)=0;
+
+    //! Like sort(), but also permutes the particles into the KD-Tree's
+    //! spatial order, so particles near each other in space are near each
+    //! other in memory. Queries then index storage directly and attribute
+    //! reads after a query stay cache coherent. Particle indices change, and
+    //! positions must not be moved until the next sort.
+    virtual void reorder()=0;
+
+    //! Brings the spatial index up to date after positions moved a little.
+    //! The KD-Tree keeps its layout and only subtrees the motion disturbed
+    //! are sorted again. Falls back to sort() when there is no index yet,
+    //! the particle count changed or too much moved, and to reorder() for
+    //! sets laid out by reorder().
+    virtual void updateSort()=0;
+
     //! Adds an attribute to the particle with the provided name, type and count
     virtual ParticleAttribute addAttribute(const char* attribute,ParticleAttributeType type,
         const int count)=0;
@@ -207,7 +523,7 @@ public:
 
     //! Add a set of particles to the particle set. Returns the offset to the
     //! first particle
-    virtual iterator addParticles(const int count)=0;
+    virtual iterator addParticles(const int64_t count)=0;
 
     //! Produce a beginning iterator for the particles
     iterator begin()
@@ -222,6 +538,9 @@ public:
 
 private:
     virtual void* dataInternal(const ParticleAttribute& attribute,const ParticleIndex particleIndex) const=0;
+    virtual void* dataInternalContiguous(const ParticleAttribute& attribute) const=0;
+    virtual void dataWriteInternalRange(const ParticleAttribute& attribute,const ParticleIndex start,
+        const int64_t count,const char* values)=0;
 };
 
 //! Provides an empty particle instance, freed with p->release()
@@ -233,25 +552,76 @@ ParticlesDataMutable* createInterleave();
 //! freed with p->release()
 ParticlesDataMutable* read(const char* filename);
 
-//! Provides read/write access to a particle set stored in a file with only particular attribute
-////! freed with p->release()
-ParticlesDataMutable* readPart(const char* filename, char** attributes, int percentage);
+//! Provides read/write access to part of a particle set stored in a file
+/*!
+  Only the attributes named in the null terminated attributes list are
+  loaded, all of them if attributes is null. percentage (0 to 100) selects
+  that share of the particles, evenly spread over the file and the same ones
+  on every read, which makes quick previews of large files.
+  freed with p->release()
+*/
+ParticlesDataMutable* readPart(const char* filename,char** attributes,int percentage);
+
+//! Provides read only access to a particle set stored in a file
+/*!
+  Uncompressed pdb and bgeo files are memory mapped instead of being copied
+  into memory, so only the pages that are used get loaded, and they are
+  shared with every other process mapping the same file. Other files are
+  read as with read(). The file must not be modified while it is mapped.
+  If you want to do finding neighbors give true to sort.
+  freed with p->release()
+*/
+ParticlesData* readMapped(const char* filename,const bool sort=false);
+
+//! Saves the KD-Tree of particles read from filename next to the file
+/*!
+  readCached() and readMapped() asked to sort the same file, or sort() given
+  it as SortOptions::sourceFile, then load the tree instead of building it,
+  for as long as the file keeps its size and modification time. particles
+  must hold the file's positions in the file's order (not reorder()ed) and
+  are sorted first if they weren't. Returns false if the index could not be
+  written.
+*/
+bool writeSortIndex(const char* filename,const ParticlesData& particles);
 
 //! Provides read access to a particle headers (number of particles
 //! and attribute information, much cheapeer
 ParticlesInfo* readHeaders(const char* filename);
 
+//! Options controlling how write() stores a particle file
+struct WriteOptions
+{
+    //! Compress the file even if its name does not end with .gz
+    bool forceCompressed;
+    //! zlib level from 1 (fastest) to 9 (smallest), -1 for zlib's default
+    int compressionLevel;
+    //! Threads compressing blocks of the file, 0 to use numThreads()
+    int numThreads;
+
+    WriteOptions(const bool forceCompressed=false,const int compressionLevel=-1,const int numThreads=0)
+        :forceCompressed(forceCompressed),compressionLevel(compressionLevel),numThreads(numThreads)
+    {}
+};
+
 //! Provides access to a particle set stored in a file
 //! if filename ends with .gz or forceCompressed is true, the file is compressed.
 void write(const char* filename,const ParticlesData&,const bool forceCompressed=false);
 
+//! Same as above with control over compression
+/*!
+  Compressed files are split into independently deflated blocks that are
+  compressed on several threads. The result is an ordinary multi-member gzip.
+*/
+void write(const char* filename,const ParticlesData&,const WriteOptions& options);
+
 
 //! Cached (only one copy) read only way to read a particle file
 /*!
   Loads a file read-only if not already in memory, otherwise returns
   already loaded item. Pointer is owned by Partio and must be releasedwith
   p->release(); (will not be deleted if others are also holding).
-  If you want to do finding neighbors give true to sort
+  If you want to do finding neighbors give true to sort, the KD-Tree is then
+  loaded from the file's sort index if writeSortIndex() saved one.
 */
 ParticlesData* readCached(const char* filename,const bool sort);
 
@@ -260,6 +630,8 @@ ParticlesData* readCached(const char* filename,const bool sort);
   Indicates to Partio that data access from a cached particle set will
   start. The sent in particles pointer must be from a readCached()
   call, not from read() or create(). Attributes can be read before this call.
+  If the data was evicted to stay within the cache budget it is read back
+  in from the file here.
 */
 void beginCachedAccess(ParticlesData* particles);
 
@@ -272,8 +644,46 @@ void beginCachedAccess(ParticlesData* particles);
 */
 void endCachedAccess(ParticlesData* particles);
 
+//! Sets how many bytes of particle data readCached() may keep in memory
+/*!
+  With a budget, the data of cached sets that are not between
+  beginCachedAccess() and endCachedAccess() is freed in least recently used
+  order whenever the budget is exceeded, and sets that are no longer
+  referenced stay cached until they are evicted. Data of a cached set must
+  then only be touched between beginCachedAccess() and endCachedAccess().
+  A budget of 0 (the default) never evicts and frees sets when their last
+  reference is released.
+*/
+void setCacheBudget(const size_t bytes);
+
+//! Counters describing how readCached() has been doing
+struct CacheStats
+{
+    //! readCached() and beginCachedAccess() calls answered from memory
+    uint64_t hits;
+    //! Reads from disk, including re-reads of evicted data
+    uint64_t misses;
+    //! Number of times a set's data was freed to stay within the budget
+    uint64_t evictions;
+    //! Bytes of particle data currently held by the cache
+    uint64_t residentBytes;
+};
+
+//! Returns the current cache counters
+CacheStats cacheStats();
+
 //! Prints a subset of particle data in a textual form
 void print(const ParticlesData* particles);
 
+//! Sets how many threads Partio may use for parallel work such as sort()
+/*!
+  A count of 0 (the default) uses one thread per processor, 1 turns
+  threading off.
+*/
+void setNumThreads(const int numThreads);
+
+//! Number of threads Partio will use for parallel work
+int numThreads();
+
 }
 #endif
@@ -0,0 +1,97 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+
+#ifdef PARTIO_WIN32
+#    define NOMINMAX
+#endif
+
+#include <algorithm>
+#include <cassert>
+#include <float.h>
+#include <string.h>
+#include "AttributeTree.h"
+#include "KdTree.h"
+
+namespace Partio{
+
+namespace
+{
+    template<int k> class AttributeTreeOf:public AttributeTree
+    {
+        KdTree<k> tree;
+    public:
+        AttributeTreeOf(const float* values,const int64_t n,const int numThreads)
+        {
+            tree.setPoints(values,n);
+            tree.sort(numThreads);
+        }
+
+        int dimension() const
+        {return k;}
+
+        size_t memorySize() const
+        {return tree.memorySize();}
+
+        void findPoints(std::vector<ParticleIndex>& points,const float* bboxMin,const float* bboxMax) const
+        {
+            BBox<k> box(bboxMin);box.grow(bboxMax);
+            size_t start=points.size();
+            tree.findPoints(points,box);
+            for(size_t i=start;i<points.size();i++) points[i]=tree.id(points[i]);
+        }
+
+        int findNPoints(ParticleIndex* points,float* distanceSquared,float* finalRadius2,
+            const float* center,const int nPoints,const float maxRadius) const
+        {
+            int count=tree.findNPoints(points,distanceSquared,finalRadius2,center,nPoints,maxRadius);
+            for(int i=0;i<count;i++) points[i]=tree.id(points[i]);
+            return count;
+        }
+    };
+}
+
+AttributeTree* AttributeTree::
+build(const float* values,const int64_t n,const int dimension,const int numThreads)
+{
+    switch(dimension){
+        case 1: return new AttributeTreeOf<1>(values,n,numThreads);
+        case 2: return new AttributeTreeOf<2>(values,n,numThreads);
+        case 3: return new AttributeTreeOf<3>(values,n,numThreads);
+        case 4: return new AttributeTreeOf<4>(values,n,numThreads);
+    }
+    return 0;
+}
+
+}
@@ -0,0 +1,69 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+
+#ifndef _AttributeTree_h_
+#define _AttributeTree_h_
+
+#include <vector>
+#include "../Partio.h"
+
+namespace Partio{
+
+//! KD-Tree over the values of a FLOAT or VECTOR attribute with 1 to 4 components
+/*!
+  Each dimension is its own KdTree<k>, so the searches stay specialized at
+  compile time. The tree keeps a copy of the values. All results are
+  particle indices, no remapping is needed.
+*/
+class AttributeTree
+{
+public:
+    //! Builds a tree over n values of dimension floats each, or returns null
+    //! if the dimension isn't 1 to 4
+    static AttributeTree* build(const float* values,const int64_t n,const int dimension,const int numThreads);
+
+    virtual ~AttributeTree(){}
+    virtual int dimension() const=0;
+    virtual size_t memorySize() const=0;
+
+    //! Appends the points inside the box from bboxMin to bboxMax
+    virtual void findPoints(std::vector<ParticleIndex>& points,const float* bboxMin,const float* bboxMax) const=0;
+    //! Finds the nPoints nearest points within maxRadius
+    virtual int findNPoints(ParticleIndex* points,float* distanceSquared,float* finalRadius2,
+        const float* center,const int nPoints,const float maxRadius) const=0;
+};
+
+}
+#endif
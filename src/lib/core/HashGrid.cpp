@@ -0,0 +1,549 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+
+#ifdef PARTIO_WIN32
+#    define NOMINMAX
+#endif
+
+#include "HashGrid.h"
+#include "RayHits.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+
+namespace Partio{
+
+//! Builds the grid in phases. The chunks of points first split themselves
+//! into partitions by the top bits of their bucket, then every partition
+//! counting sorts its points into the buckets it owns
+struct HashGrid::BuildTask
+{
+    enum Phase {COUNT,PARTITION,SORT};
+    HashGrid& grid;
+    const float* points;
+    const int64_t n,chunkSize;
+    const int chunks,partitions,partitionShift;
+    std::vector<int64_t>& counts; // counts[chunk*partitions+partition], later that chunk's next slot
+    std::vector<int64_t>& partitionStart; // first slot of each partition, plus one past the end
+    std::vector<ParticleIndex>& order; // point indices grouped by partition
+    Phase phase;
+
+    BuildTask(HashGrid& grid,const float* points,const int64_t n,const int64_t chunkSize,const int chunks,
+        const int partitionBits,std::vector<int64_t>& counts,std::vector<int64_t>& partitionStart,
+        std::vector<ParticleIndex>& order)
+        :grid(grid),points(points),n(n),chunkSize(chunkSize),chunks(chunks),partitions(1<<partitionBits),
+        partitionShift(leadingBits(grid._bucketMask)-partitionBits),counts(counts),
+        partitionStart(partitionStart),order(order),phase(COUNT)
+    {}
+
+    static int leadingBits(uint64_t mask)
+    {
+        int bits=0;
+        for(;mask;mask>>=1) bits++;
+        return bits;
+    }
+
+    uint64_t bucketOfPoint(const int64_t i) const
+    {
+        int cell[3];
+        grid.cellOf(points+3*i,cell);
+        return grid.bucketOf(cell[0],cell[1],cell[2]);
+    }
+
+    void operator()(int task)
+    {
+        switch(phase){
+            case COUNT:{
+                int64_t* chunkCounts=&counts[task*partitions];
+                const int64_t begin=task*chunkSize,end=std::min(n,begin+chunkSize);
+                for(int64_t i=begin;i<end;i++) chunkCounts[bucketOfPoint(i)>>partitionShift]++;
+                break;}
+            case PARTITION:{
+                int64_t* chunkCounts=&counts[task*partitions];
+                const int64_t begin=task*chunkSize,end=std::min(n,begin+chunkSize);
+                for(int64_t i=begin;i<end;i++) order[chunkCounts[bucketOfPoint(i)>>partitionShift]++]=i;
+                break;}
+            case SORT:{
+                // the partition owns a contiguous run of buckets, count into their
+                // starts, turn those into slots and advance them while scattering
+                const int64_t first=partitionStart[task],last=partitionStart[task+1];
+                const uint64_t bucketBegin=(uint64_t)task<<partitionShift,bucketEnd=(uint64_t)(task+1)<<partitionShift;
+                for(uint64_t b=bucketBegin;b<bucketEnd;b++) grid._start[b]=0;
+                for(int64_t s=first;s<last;s++) grid._start[bucketOfPoint(order[s])]++;
+                int64_t next=first;
+                for(uint64_t b=bucketBegin;b<bucketEnd;b++){
+                    const int64_t count=grid._start[b];
+                    grid._start[b]=next;
+                    next+=count;
+                }
+                for(int64_t s=first;s<last;s++){
+                    const ParticleIndex i=order[s];
+                    const int64_t slot=grid._start[bucketOfPoint(i)]++;
+                    grid._ids[slot]=i;
+                    for(int k=0;k<3;k++) grid._points[3*slot+k]=points[3*i+k];
+                }
+                // each start now holds the start of the following bucket
+                for(uint64_t b=bucketEnd-1;b>bucketBegin;b--) grid._start[b]=grid._start[b-1];
+                grid._start[bucketBegin]=first;
+                break;}
+        }
+    }
+};
+
+//! k nearest search state, keeps a max heap once maxPoints are found
+struct HashGrid::NearestQuery
+{
+    const HashGrid& grid;
+    ParticleIndex* result;
+    float* distanceSquared;
+    const float* p;
+    const int maxPoints;
+    int foundPoints;
+    float maxRadiusSquared;
+    const int maxVisits; // points looked at, unlimited if 0
+    int visits;
+    const PointFilter* filter; // asked about points within the radius, if given
+
+    NearestQuery(const HashGrid& grid,ParticleIndex* result,float* distanceSquared,const float* p,
+        const int maxPoints,const float maxRadiusSquared,const int maxVisits,const PointFilter* filter)
+        :grid(grid),result(result),distanceSquared(distanceSquared),p(p),maxPoints(maxPoints),
+        foundPoints(0),maxRadiusSquared(maxRadiusSquared),maxVisits(maxVisits),visits(0),filter(filter)
+    {}
+
+    bool operator()(const int64_t slot)
+    {
+        if(maxVisits && visits++>=maxVisits) return false;
+        const float* q=&grid._points[3*slot];
+        const float dx=q[0]-p[0],dy=q[1]-p[1],dz=q[2]-p[2];
+        const float d2=dx*dx+dy*dy+dz*dz;
+        if(d2>=maxRadiusSquared) return true;
+        if(filter && !filter->accept(grid._ids[slot])) return true;
+        if(foundPoints<maxPoints){
+            result[foundPoints]=grid._ids[slot];
+            distanceSquared[foundPoints]=d2;
+            foundPoints++;
+            if(foundPoints==maxPoints) maxRadiusSquared=buildHeap(result,distanceSquared,foundPoints);
+        }else maxRadiusSquared=insertToHeap(result,distanceSquared,foundPoints,grid._ids[slot],d2);
+        return true;
+    }
+};
+
+struct HashGrid::BBoxCollector
+{
+    const HashGrid& grid;
+    const BBox<3>& bbox;
+    std::vector<ParticleIndex>& points;
+
+    BBoxCollector(const HashGrid& grid,const BBox<3>& bbox,std::vector<ParticleIndex>& points)
+        :grid(grid),bbox(bbox),points(points)
+    {}
+
+    bool operator()(const int64_t slot)
+    {
+        if(bbox.inside(&grid._points[3*slot])) points.push_back(grid._ids[slot]);
+        return true;
+    }
+};
+
+struct HashGrid::RadiusVisitor
+{
+    const HashGrid& grid;
+    const float* p;
+    const float radiusSquared;
+    PointVisitor& visitor;
+
+    RadiusVisitor(const HashGrid& grid,const float* p,const float radiusSquared,PointVisitor& visitor)
+        :grid(grid),p(p),radiusSquared(radiusSquared),visitor(visitor)
+    {}
+
+    bool operator()(const int64_t slot)
+    {
+        const float* q=&grid._points[3*slot];
+        const float dx=q[0]-p[0],dy=q[1]-p[1],dz=q[2]-p[2];
+        const float d2=dx*dx+dy*dy+dz*dz;
+        return d2>=radiusSquared || visitor.visit(grid._ids[slot],d2);
+    }
+};
+
+//! Takes the points of one step along a ray, those whose nearest point on it is in [t0,t1)
+struct HashGrid::RayCollector
+{
+    const HashGrid& grid;
+    RayHits& hits;
+    const float radiusSquared;
+    float t0,t1;
+    bool last; // the final step keeps t1 itself too
+
+    RayCollector(const HashGrid& grid,RayHits& hits,const float radiusSquared)
+        :grid(grid),hits(hits),radiusSquared(radiusSquared),t0(0),t1(0),last(false)
+    {}
+
+    bool operator()(const int64_t slot)
+    {
+        float t;
+        if(hits.pointHit(&grid._points[3*slot],radiusSquared,t) && t>=t0 && (t<t1 || last))
+            hits.add(grid._ids[slot],t);
+        return true;
+    }
+};
+
+struct HashGrid::BatchTask
+{
+    const HashGrid& grid;
+    ParticleIndex* points;
+    float* distanceSquared;
+    int* counts;
+    const float* p;
+    const int nQueries,nPoints,blockSize;
+    const float maxRadius,epsilon;
+    const int maxVisits;
+
+    BatchTask(const HashGrid& grid,ParticleIndex* points,float* distanceSquared,int* counts,const float* p,
+        const int nQueries,const int nPoints,const int blockSize,const float maxRadius,const float epsilon,
+        const int maxVisits)
+        :grid(grid),points(points),distanceSquared(distanceSquared),counts(counts),p(p),
+        nQueries(nQueries),nPoints(nPoints),blockSize(blockSize),maxRadius(maxRadius),epsilon(epsilon),
+        maxVisits(maxVisits)
+    {}
+
+    void operator()(int block)
+    {
+        const int end=std::min(nQueries,(block+1)*blockSize);
+        for(int q=block*blockSize;q<end;q++){
+            float finalRadius2;
+            counts[q]=grid.findNPoints(points+(size_t)q*nPoints,distanceSquared+(size_t)q*nPoints,
+                &finalRadius2,p+(size_t)q*3,nPoints,maxRadius,epsilon,maxVisits);
+        }
+    }
+};
+
+HashGrid::
+HashGrid()
+    :_cellSize(0),_invCellSize(0),_bucketMask(0)
+{
+    for(int k=0;k<3;k++){_origin[k]=0;_dims[k]=1;}
+}
+
+void HashGrid::
+build(const float* points,const int64_t n,const float cellSize,const int numThreads)
+{
+    std::vector<ParticleIndex>().swap(_ids);
+    std::vector<float>().swap(_points);
+    _start.assign(2,0);
+    _bucketMask=0;
+    for(int k=0;k<3;k++){_origin[k]=0;_dims[k]=1;}
+    _cellSize=cellSize;_invCellSize=1/cellSize;
+    if(n<=0) return;
+
+    BBox<3> box(points);
+    for(int64_t i=1;i<n;i++) box.grow(points+3*i);
+    // keep cell coordinates well inside int range
+    float extent=0;
+    for(int k=0;k<3;k++) extent=std::max(extent,box.max[k]-box.min[k]);
+    _cellSize=std::max(cellSize,extent/(float)(1<<30));
+    _invCellSize=1/_cellSize;
+    for(int k=0;k<3;k++){
+        _origin[k]=box.min[k];
+        _dims[k]=(int)std::min((box.max[k]-box.min[k])*_invCellSize,(float)(1<<30))+1;
+    }
+
+    // about two points per bucket
+    uint64_t buckets=1;
+    while(buckets<(uint64_t)(n/2)) buckets<<=1;
+    _bucketMask=buckets-1;
+
+    // counting sort by bucket in two passes, so the working set stays O(n+buckets).
+    // the chunks partition their points by the top bits of the bucket with small
+    // histograms of their own, then each partition sorts into its own buckets
+    const int64_t minChunkSize=1<<16;
+    const int chunks=(int)std::max((int64_t)1,std::min((int64_t)numThreads,(n+minChunkSize-1)/minChunkSize));
+    const int64_t chunkSize=(n+chunks-1)/chunks;
+    const int partitionBits=std::min(BuildTask::leadingBits(_bucketMask),10);
+    const int partitions=1<<partitionBits;
+    std::vector<int64_t> counts((size_t)chunks*partitions,0);
+    std::vector<int64_t> partitionStart(partitions+1);
+    std::vector<ParticleIndex> order(n);
+    _start.resize(buckets+1);
+    _ids.resize(n);
+    _points.resize(3*n);
+
+    BuildTask task(*this,points,n,chunkSize,chunks,partitionBits,counts,partitionStart,order);
+    parallelFor(chunks,task,numThreads);
+    // partitions in order, and within one the chunks in order, keeps each bucket in index order
+    int64_t next=0;
+    for(int p=0;p<partitions;p++){
+        partitionStart[p]=next;
+        for(int c=0;c<chunks;c++){
+            const int64_t count=counts[c*partitions+p];
+            counts[c*partitions+p]=next;
+            next+=count;
+        }
+    }
+    partitionStart[partitions]=n;
+    task.phase=BuildTask::PARTITION;
+    parallelFor(chunks,task,numThreads);
+    task.phase=BuildTask::SORT;
+    parallelFor(partitions,task,numThreads);
+    _start[buckets]=n;
+}
+
+size_t HashGrid::
+memorySize() const
+{
+    return _start.capacity()*sizeof(int64_t)+_ids.capacity()*sizeof(ParticleIndex)+_points.capacity()*sizeof(float);
+}
+
+void HashGrid::
+cellOf(const float p[3],int cell[3]) const
+{
+    for(int k=0;k<3;k++){
+        const float c=(p[k]-_origin[k])*_invCellSize;
+        cell[k]=c<=0 ? 0 : c>=_dims[k]-1 ? _dims[k]-1 : (int)c;
+    }
+}
+
+uint64_t HashGrid::
+bucketOf(const int x,const int y,const int z) const
+{
+    return ((uint64_t)x*73856093u^(uint64_t)y*19349663u^(uint64_t)z*83492791u)&_bucketMask;
+}
+
+template<class F> bool HashGrid::
+visitCells(const int lo[3],const int hi[3],F& f) const
+{
+    int a[3],b[3];
+    uint64_t cells=1;
+    for(int k=0;k<3;k++){
+        a[k]=std::max(lo[k],0);b[k]=std::min(hi[k],_dims[k]-1);
+        if(a[k]>b[k]) return true;
+        cells*=b[k]-a[k]+1;
+    }
+
+    int cell[3];
+    if(cells>_bucketMask){
+        // about as many cells as buckets, cheaper to look at every point once
+        for(int64_t slot=0;slot<size();slot++){
+            cellOf(&_points[3*slot],cell);
+            if(cell[0]>=a[0] && cell[0]<=b[0] && cell[1]>=a[1] && cell[1]<=b[1]
+                && cell[2]>=a[2] && cell[2]<=b[2] && !f(slot)) return false;
+        }
+        return true;
+    }
+
+    for(int x=a[0];x<=b[0];x++)
+        for(int y=a[1];y<=b[1];y++)
+            for(int z=a[2];z<=b[2];z++){
+                const uint64_t bucket=bucketOf(x,y,z);
+                for(int64_t slot=_start[bucket];slot<_start[bucket+1];slot++){
+                    cellOf(&_points[3*slot],cell);
+                    if(cell[0]==x && cell[1]==y && cell[2]==z && !f(slot)) return false;
+                }
+            }
+    return true;
+}
+
+void HashGrid::
+findPoints(std::vector<ParticleIndex>& points,const BBox<3>& bbox) const
+{
+    if(!size()) return;
+    int lo[3],hi[3];
+    cellOf(bbox.min,lo);cellOf(bbox.max,hi);
+    BBoxCollector collect(*this,bbox,points);
+    visitCells(lo,hi,collect);
+}
+
+bool HashGrid::
+visitPointsInRadius(const float p[3],const float radius,PointVisitor& visitor) const
+{
+    if(!size()) return true;
+    int lo[3],hi[3];
+    const float pmin[3]={p[0]-radius,p[1]-radius,p[2]-radius},pmax[3]={p[0]+radius,p[1]+radius,p[2]+radius};
+    cellOf(pmin,lo);cellOf(pmax,hi);
+    RadiusVisitor visit(*this,p,radius*radius,visitor);
+    return visitCells(lo,hi,visit);
+}
+
+void HashGrid::
+findPointsInConvex(std::vector<ParticleIndex>& points,const float* planes,const int nPlanes) const
+{
+    for(int64_t slot=0;slot<size();slot++){
+        const float* p=&_points[3*slot];
+        int i=0;
+        for(;i<nPlanes;i++){
+            const float* plane=planes+4*i;
+            if(plane[0]*p[0]+plane[1]*p[1]+plane[2]*p[2]+plane[3]<0) break;
+        }
+        if(i==nPlanes) points.push_back(_ids[slot]);
+    }
+}
+
+void HashGrid::
+findPointsAlongRay(RayHits& hits,const float radius) const
+{
+    if(!size()) return;
+    float boxMin[3],boxMax[3],length2=0;
+    for(int k=0;k<3;k++){
+        boxMin[k]=_origin[k]-radius;
+        boxMax[k]=_origin[k]+_dims[k]*_cellSize+radius;
+        length2+=hits.direction[k]*hits.direction[k];
+    }
+    // the grid spans the bounds of the points, nothing outside them to step through
+    float t0=hits.tMin,t1=hits.tMax;
+    if(!hits.clip(boxMin,boxMax,t0,t1)) return;
+
+    // steps of at least a cell, each visiting the cells around its piece of the ray
+    const float step=length2>0 ? std::max(_cellSize,radius)/sqrtf(length2) : FLT_MAX;
+    double cells=step==FLT_MAX ? 1 : floor((t1-t0)/step)+1;
+    for(int k=0;k<3;k++){
+        const float reach=step==FLT_MAX ? 2*radius : fabsf(hits.direction[k])*step+2*radius;
+        cells*=std::min((double)_dims[k],floor((double)reach*_invCellSize)+2);
+    }
+    if(cells>(double)_bucketMask){
+        // a long ray through a sparse grid, e.g. one stretched by an outlier, would
+        // touch about every bucket. cheaper to look at every point once
+        for(int64_t slot=0;slot<size();slot++) hits.addPoint(_ids[slot],&_points[3*slot],radius*radius);
+        return;
+    }
+    RayCollector collect(*this,hits,radius*radius);
+    for(int64_t s=0;;s++){
+        collect.t0=t0+s*step;
+        if(collect.t0>hits.limit()) return;
+        collect.last=!(collect.t0+step<t1);
+        collect.t1=collect.last ? t1 : collect.t0+step;
+        float pmin[3],pmax[3];
+        for(int k=0;k<3;k++){
+            const float a=hits.origin[k]+collect.t0*hits.direction[k],b=hits.origin[k]+collect.t1*hits.direction[k];
+            pmin[k]=std::min(a,b)-radius;pmax[k]=std::max(a,b)+radius;
+        }
+        int lo[3],hi[3];
+        cellOf(pmin,lo);cellOf(pmax,hi);
+        visitCells(lo,hi,collect);
+        if(collect.last) return;
+    }
+}
+
+int HashGrid::
+findNPoints(ParticleIndex* points,float* distanceSquared,float* finalRadius2,
+    const float p[3],const int nPoints,const float maxRadius,const float epsilon,const int maxVisits,
+    const PointFilter* filter) const
+{
+    *finalRadius2=maxRadius*maxRadius;
+    if(!size() || nPoints<1) return 0;
+
+    NearestQuery query(*this,points,distanceSquared,p,nPoints,maxRadius*maxRadius,maxVisits,filter);
+    const float pruneScale=1/((1+epsilon)*(1+epsilon));
+    // the query's own cell, which may be outside the grid. rings before the
+    // first one reaching the grid would be empty
+    int64_t c[3],firstRing=0;
+    for(int k=0;k<3;k++){
+        const float x=floorf((p[k]-_origin[k])*_invCellSize);
+        c[k]=x<=-(float)(1<<30) ? -(1<<30) : x>=(float)(1<<30) ? (1<<30) : (int64_t)x;
+        firstRing=std::max(firstRing,std::max(-c[k],c[k]-(_dims[k]-1)));
+    }
+    double cellsVisited=0;
+    for(int64_t ring=firstRing;;ring++){
+        // the shell of cells at this ring. sides beyond the grid are clamped one cell
+        // outside it, where visitCells finds nothing
+        int lo[3],hi[3];
+        for(int k=0;k<3;k++){
+            lo[k]=(int)std::max(c[k]-ring,(int64_t)-1);
+            hi[k]=(int)std::min(c[k]+ring,(int64_t)_dims[k]);
+        }
+        double outer=1,inner=1;
+        for(int k=0;k<3;k++){
+            outer*=std::max(0,std::min(hi[k],_dims[k]-1)-std::max(lo[k],0)+1);
+            inner*=std::max(0,std::min(hi[k]-1,_dims[k]-1)-std::max(lo[k]+1,0)+1);
+        }
+        cellsVisited+=outer-inner;
+        if(cellsVisited>(double)_bucketMask){
+            // far from any point, e.g. in the empty space around an outlier. the rest of the
+            // rings would touch about every bucket, so look at each point not seen yet once
+            int cell[3];
+            for(int64_t slot=0;slot<size();slot++){
+                cellOf(&_points[3*slot],cell);
+                // strictly inside this ring is inside the rings already visited
+                bool seen=ring>firstRing;
+                for(int k=0;k<3 && seen;k++) seen=cell[k]>lo[k] && cell[k]<hi[k];
+                if(!seen && !query(slot)) break;
+            }
+            break;
+        }
+
+        // two x faces, two y faces and two z faces
+        for(int k=0;k<3;k++){
+            int faceLo[3],faceHi[3];
+            for(int j=0;j<3;j++){
+                // axes before k already had their faces visited
+                faceLo[j]=j<k ? lo[j]+1 : lo[j];
+                faceHi[j]=j<k ? hi[j]-1 : hi[j];
+            }
+            faceHi[k]=lo[k];
+            bool more=visitCells(faceLo,faceHi,query);
+            if(more && ring){
+                faceLo[k]=faceHi[k]=hi[k];
+                more=visitCells(faceLo,faceHi,query);
+            }
+            if(!more){ // out of visits
+                *finalRadius2=query.maxRadiusSquared;
+                return query.foundPoints;
+            }
+        }
+
+        // points not visited yet are beyond one of the faces that is still inside the grid
+        float gap=FLT_MAX;
+        for(int k=0;k<3;k++){
+            if(lo[k]>0) gap=std::min(gap,p[k]-(_origin[k]+lo[k]*_cellSize));
+            if(hi[k]<_dims[k]-1) gap=std::min(gap,_origin[k]+(hi[k]+1)*_cellSize-p[k]);
+        }
+        const float pruneRadiusSquared=query.foundPoints==nPoints ?
+            query.maxRadiusSquared*pruneScale : query.maxRadiusSquared;
+        if(gap==FLT_MAX || (gap>0 && gap*gap>=pruneRadiusSquared)) break;
+    }
+    *finalRadius2=query.maxRadiusSquared;
+    return query.foundPoints;
+}
+
+void HashGrid::
+findNPointsBatch(ParticleIndex* points,float* distanceSquared,int* counts,
+    const float* p,const int nQueries,const int nPoints,const float maxRadius,const int numThreads,
+    const float epsilon,const int maxVisits) const
+{
+    const int blockSize=256;
+    BatchTask task(*this,points,distanceSquared,counts,p,nQueries,nPoints,blockSize,maxRadius,epsilon,maxVisits);
+    parallelFor((nQueries+blockSize-1)/blockSize,task,numThreads);
+}
+
+}
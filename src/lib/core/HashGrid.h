@@ -0,0 +1,114 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+
+#ifndef _HashGrid_h_
+#define _HashGrid_h_
+
+#include <vector>
+#include <algorithm>
+#include <cassert>
+#include <float.h>
+#include <string.h>
+#include "../Partio.h"
+#include "KdTree.h"
+
+namespace Partio{
+
+class RayHits;
+
+//! Uniform grid of cells, hashed into a table of buckets
+/*!
+  Meant for queries at about one fixed radius, where it is much cheaper to
+  build than a KdTree. Points are counting sorted by bucket so each bucket's
+  points are contiguous in memory, next to a copy of their positions. Cells
+  that collide in the table share a bucket, so queries check each point's
+  own cell. All results are particle indices, no remapping is needed.
+*/
+class HashGrid
+{
+public:
+    HashGrid();
+
+    //! Builds the grid over n xyz points with the given cell edge length
+    void build(const float* points,const int64_t n,const float cellSize,const int numThreads);
+
+    int64_t size() const {return (int64_t)_ids.size();}
+    float cellSize() const {return _cellSize;}
+    size_t memorySize() const;
+
+    //! Appends the points inside bbox
+    void findPoints(std::vector<ParticleIndex>& points,const BBox<3>& bbox) const;
+    //! Appends the points on the positive side of every abcd plane. The grid has no
+    //! bounds coarser than its cells, so this scans every point
+    void findPointsInConvex(std::vector<ParticleIndex>& points,const float* planes,const int nPlanes) const;
+    //! Finds the nPoints nearest points within maxRadius, searching outwards one ring of cells at a time.
+    //! With epsilon>0 rings stop once they are 1+epsilon times beyond the farthest point found,
+    //! and with maxVisits>0 once that many points were looked at. Points filter rejects are skipped
+    int findNPoints(ParticleIndex* points,float* distanceSquared,float* finalRadius2,
+        const float p[3],const int nPoints,const float maxRadius,const float epsilon=0,const int maxVisits=0,
+        const PointFilter* filter=0) const;
+    //! Runs nQueries findNPoints on numThreads threads
+    void findNPointsBatch(ParticleIndex* points,float* distanceSquared,int* counts,
+        const float* p,const int nQueries,const int nPoints,const float maxRadius,const int numThreads,
+        const float epsilon=0,const int maxVisits=0) const;
+    //! Calls visitor.visit() for every point closer than radius until it returns false
+    bool visitPointsInRadius(const float p[3],const float radius,PointVisitor& visitor) const;
+    //! Adds the points closer than radius to the ray to its hits, stepping along it
+    //! near to far until the hits are full
+    void findPointsAlongRay(RayHits& hits,const float radius) const;
+
+private:
+    struct NearestQuery;
+    struct BBoxCollector;
+    struct RadiusVisitor;
+    struct RayCollector;
+    struct BatchTask;
+    struct BuildTask;
+
+    void cellOf(const float p[3],int cell[3]) const;
+    uint64_t bucketOf(const int x,const int y,const int z) const;
+    template<class F> bool visitCells(const int lo[3],const int hi[3],F& f) const;
+
+    float _origin[3];
+    float _cellSize,_invCellSize;
+    int _dims[3]; // cells along each axis
+    uint64_t _bucketMask;
+    std::vector<int64_t> _start; // first slot of each bucket, plus one past the end
+    std::vector<ParticleIndex> _ids; // particle index of each slot
+    std::vector<float> _points; // xyz of each slot
+};
+
+}
+#endif
@@ -35,6 +35,12 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
 #ifndef KdTree_h
 #define KdTree_h
 #include <ext/numeric>
+#include <limits>
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP>=1)
+#    define PARTIO_KDTREE_SSE
+#    include <xmmintrin.h>
+#endif
+#include "Parallel.h"
 
 namespace Partio
 {
@@ -159,7 +165,7 @@ inline float buildHeap(uint64_t *result, float *distance_squared,int heap_size)
 }
 
 // Inserts smaller element into heap (does not check so caller must)
-inline float insertToHeap(uint64_t *result,float*distance_squared,int heap_size,int new_id,float new_distance_squared)
+inline float insertToHeap(uint64_t *result,float*distance_squared,int heap_size,uint64_t new_id,float new_distance_squared)
 {
     assert(new_distance_squared<distance_squared[0]);
     int current_parent=0;
@@ -186,13 +192,15 @@ inline float insertToHeap(uint64_t *result,float*distance_squared,int heap_size,
 
 template <int k> class KdTree
 {
+    struct Point { float p[k]; };
 
     struct NearestQuery
     {
         NearestQuery(uint64_t *result,float *distanceSquared,const float pquery_in[k],
-                      int maxPoints,float maxRadiusSquared)
+                      int maxPoints,float maxRadiusSquared,float epsilon=0,int maxVisits=0)
             :result(result),distanceSquared(distanceSquared),maxPoints(maxPoints),
-             foundPoints(0),maxRadiusSquared(maxRadiusSquared)
+             foundPoints(0),maxRadiusSquared(maxRadiusSquared),
+             pruneScale(1/((1+epsilon)*(1+epsilon))),maxVisits(maxVisits),visits(0)
 
         {for(int i=0;i<k;i++) pquery[i]=pquery_in[i];}
 
@@ -202,36 +210,230 @@ template <int k> class KdTree
         int maxPoints;
         int foundPoints;
         float maxRadiusSquared;
+        float pruneScale; // subtrees must be this much nearer than the farthest found once full
+        int maxVisits,visits; // points looked at, unlimited if maxVisits is 0
     };
 
  public:
     KdTree();
     ~KdTree();
-    int size() const { return _points.size(); }
+    int64_t size() const { return _size; }
     const BBox<k>& bbox() const { return _bbox; }
-    const float* point(int i) const { return _points[i].p; }
-    uint64_t id(int i) const { return _ids[i]; }
-    void setPoints(const float* p, int n);
-    void sort();
+    // subtrees with at most this many points are searched as one bucket
+    static const int leafSize = 16;
+    float coord(int64_t i, int axis) const
+    {
+	if (!_lanes.empty()) return _lanes[axis*_size+i];
+	return _pointData ? _pointData[i].p[axis] : _idPoints[id(i)].p[axis];
+    }
+    uint64_t id(int64_t i) const
+    { return !_ids32.empty() ? _ids32[i] : !_ids.empty() ? _ids[i] : (uint64_t)i; }
+    size_t memorySize() const
+    { return _points.capacity()*sizeof(Point) + (_lanes.capacity()+_planes.capacity())*sizeof(float)
+	+ _ids.capacity()*sizeof(uint64_t) + _ids32.capacity()*sizeof(uint32_t); }
+    // compact trees don't copy p but read it through the id table, so it must stay put
+    // for the life of the tree
+    void setPoints(const float* p, int64_t n, bool compact=false);
+    void sort(int numThreads=1);
+    // call after the caller has permuted its data into tree order (caller index i is
+    // node i). drops the id table, and the point copy if the reordered points are given,
+    // in which case they must stay put for the life of the tree. compact trees need them.
+    void adoptOrder(const float* points=0);
+    // makes a sorted tree of p without sorting, from the node order of an earlier sort of
+    // the same points (ids[i] was that tree's id(i)) and their bbox. returns false and
+    // leaves the tree empty if ids is not a permutation of 0..n-1
+    template<class ID> bool setOrder(const float* p, int64_t n, const ID* ids, const BBox<k>& bbox,
+	bool compact=false, int numThreads=1);
+    // false once adoptOrder() made ids the identity
+    bool hasIds() const { return !_size || !_ids.empty() || !_ids32.empty(); }
+    bool ownsPoints() const { return !_size || !_points.empty() || !_lanes.empty(); }
+    bool compact() const { return _size && _points.empty() && _lanes.empty() && !_pointData; }
+    // refits a sorted tree to moved points (same count, id order) keeping its layout. each
+    // node's split becomes a pair of planes bounding its children, and only subtrees whose
+    // children came to overlap too much are re-sorted, everything if more than a quarter of
+    // the points are in them. returns false if the tree can't be updated (different count,
+    // or adoptOrder() dropped the ids) and must be rebuilt
+    bool update(const float* p, int64_t n, int numThreads=1);
     void findPoints(std::vector<uint64_t>& points, const BBox<k>& bbox) const;
+    // appends the nodes on the positive side a.p+d>=0 of every plane, given as k+1 floats
+    // each. subtrees whose bounds are inside all the planes are appended whole
+    void findPointsInConvex(std::vector<uint64_t>& points, const float* planes, int nPlanes) const;
     float findNPoints(std::vector<uint64_t>& result,std::vector<float>& distanceSquared,
         const float p[k],int nPoints,float maxRadius) const;
+    // with epsilon > 0 the ith point found is at most 1+epsilon times farther than the true
+    // ith nearest, and with maxVisits > 0 the search gives up once it looked at that many points
     int findNPoints(uint64_t *result,float *distanceSquared, float *finalSearchRadius2,
-                    const float p[k], int nPoints, float maxRadius) const;
+                    const float p[k], int nPoints, float maxRadius, float epsilon=0, int maxVisits=0) const;
+    // findNPoints of only the nodes n for which filter(id(n)) is true. filter is asked once a
+    // point is within the current radius, so rejected points never enter the heap
+    template<class Filter> int findNPointsFiltered(uint64_t *result, float *distanceSquared,
+	float *finalSearchRadius2, const float p[k], int nPoints, float maxRadius, const Filter& filter) const;
+    // runs nQueries findNPoints on numThreads threads, results are already mapped through id()
+    void findNPointsBatch(uint64_t *result, float *distanceSquared, int *counts,
+                          const float *p, int nQueries, int nPoints, float maxRadius, int numThreads,
+                          float epsilon=0, int maxVisits=0) const;
+    // calls visitor.visit(id(n), distanceSquared) for every point closer than radius, in no
+    // particular order, until visit returns false. returns false if the search was cut short
+    template<class Visitor> bool visitPointsInRadius(const float p[k], float radius, Visitor& visitor) const;
+    // most rays findPointsAlongRays() takes at once
+    static const int rayPacketSize = 8;
+    // calls hits[r].addPoint(id(n), point, radius*radius) for the points near each ray r of
+    // the packet, nearer subtrees first, skipping subtrees the ray reaches beyond
+    // hits[r].limit(). the rays descend together, so they should be coherent, e.g.
+    // neighbouring camera rays. Hits is a RayHits
+    template<class Hits> void findPointsAlongRays(Hits* hits, int nRays, float radius) const;
 
 
  private:
-    void sortSubtree(int n, int count, int j);
+    void sortSubtree(int64_t n, int64_t count, int j);
+    void partitionSubtree(int64_t n, int64_t size, int j, int64_t& left, int64_t& right);
+    void sortParallel(int numThreads);
+    struct Subtree;
+    void refitSubtree(int64_t n, int64_t size, int j, BBox<k>& box, std::vector<Subtree>& broken);
+    void resetPlanes(int64_t n, int64_t size, int j);
+    void fillLanes(int numThreads);
+
+    struct Subtree {
+	int64_t n, size; int j;
+	Subtree(int64_t n, int64_t size, int j) : n(n), size(size), j(j) {}
+    };
+    struct PartitionTask {
+	KdTree& tree;
+	const std::vector<Subtree>& level;
+	std::vector<Subtree>& children;
+	PartitionTask(KdTree& tree, const std::vector<Subtree>& level, std::vector<Subtree>& children)
+	    : tree(tree), level(level), children(children) {}
+	void operator() (int i);
+    };
+    struct SortSubtreeTask {
+	KdTree& tree;
+	const std::vector<Subtree>& level;
+	SortSubtreeTask(KdTree& tree, const std::vector<Subtree>& level) : tree(tree), level(level) {}
+	void operator() (int i) { tree.sortSubtree(level[i].n, level[i].size, level[i].j); }
+    };
+    struct RebuildSubtreeTask {
+	KdTree& tree;
+	const std::vector<Subtree>& subtrees;
+	RebuildSubtreeTask(KdTree& tree, const std::vector<Subtree>& subtrees) : tree(tree), subtrees(subtrees) {}
+	void operator() (int i)
+	{
+	    const Subtree& s = subtrees[i];
+	    tree.sortSubtree(s.n, s.size, s.j);
+	    tree.resetPlanes(s.n, s.size, s.j);
+	}
+    };
+    struct FindNPointsBatchTask {
+	const KdTree& tree;
+	uint64_t *result; float *distanceSquared; int *counts;
+	const float *p; int nQueries, nPoints; float maxRadius; int blockSize;
+	float epsilon; int maxVisits;
+	FindNPointsBatchTask(const KdTree& tree, uint64_t *result, float *distanceSquared, int *counts,
+			     const float *p, int nQueries, int nPoints, float maxRadius, int blockSize,
+			     float epsilon, int maxVisits)
+	    : tree(tree), result(result), distanceSquared(distanceSquared), counts(counts),
+	      p(p), nQueries(nQueries), nPoints(nPoints), maxRadius(maxRadius), blockSize(blockSize),
+	      epsilon(epsilon), maxVisits(maxVisits) {}
+	void operator() (int block)
+	{
+	    int end = std::min(nQueries, (block+1)*blockSize);
+	    for (int q = block*blockSize; q < end; q++) {
+		uint64_t *queryResult = result + (size_t)q*nPoints;
+		float finalSearchRadius2;
+		int count = tree.findNPoints(queryResult, distanceSquared + (size_t)q*nPoints,
+					     &finalSearchRadius2, p + (size_t)q*k, nPoints, maxRadius,
+					     epsilon, maxVisits);
+		for (int i = 0; i < count; i++) queryResult[i] = tree.id(queryResult[i]);
+		counts[q] = count;
+	    }
+	}
+    };
+    struct FillLanesTask {
+	KdTree& tree;
+	int chunkSize;
+	FillLanesTask(KdTree& tree, int chunkSize)
+	    : tree(tree), chunkSize(chunkSize) {}
+	void operator() (int chunk)
+	{
+	    int64_t end = std::min(tree._size, (int64_t)(chunk+1)*chunkSize);
+	    for (int64_t i = (int64_t)chunk*chunkSize; i < end; i++) {
+		const float* p = tree._idPoints[tree.id(i)].p;
+		for (int axis = 0; axis < k; axis++) tree._lanes[axis*tree._size+i] = p[axis];
+	    }
+	}
+    };
     struct ComparePointsById {
-	float* points;
-	ComparePointsById(float* p) : points(p) {}
-	bool operator() (int a, int b) { return points[a*k] < points[b*k]; }
+	const float* points;
+	ComparePointsById(const float* p) : points(p) {}
+	bool operator() (uint64_t a, uint64_t b) { return points[a*k] < points[b*k]; }
     };
     void findPoints(std::vector<uint64_t>& result, const BBox<k>& bbox,
-		    int n, int size, int j) const;
-    void findNPoints(NearestQuery& query,int n,int size,int j) const;
+		    int64_t n, int64_t size, int j) const;
+    struct AcceptAll { bool operator() (uint64_t) const { return true; } };
+    template<class Filter> void findNPoints(NearestQuery& query, const Filter& filter) const;
+    // planes already known to hold the whole subtree are cleared from active, the first
+    // 64 can be. box bounds the subtree
+    void findPointsInConvex(std::vector<uint64_t>& result, const float* planes, int nPlanes,
+			    uint64_t active, const BBox<k>& box, int64_t n, int64_t size, int j) const;
+    static inline bool insidePlanes(const float* planes, int nPlanes, uint64_t active, const float p[k])
+    {
+	for (int i = 0; i < nPlanes; i++) {
+	    if (i < 64 && !(active>>i & 1)) continue;
+	    const float* plane = planes+i*(k+1);
+	    float side = plane[k];
+	    for (int axis = 0; axis < k; axis++) side += plane[axis]*p[axis];
+	    if (side < 0) return false;
+	}
+	return true;
+    }
+    // the left child's largest and the right child's smallest coordinate along the split
+    // axis. both are the node's own coordinate until update() refits them
+    void splitPlanes(int64_t n, int j, float& leftMax, float& rightMin) const
+    {
+	if (_planes.empty()) leftMax = rightMin = coord(n, j);
+	else { leftMax = _planes[2*n]; rightMin = _planes[2*n+1]; }
+    }
+    // orders the children of subtree n by their distance from coordinate q along axis j
+    void nearFar(int64_t n, int64_t size, int j, float q, int64_t& nearN, int64_t& nearSize, float& nearDistance,
+		 int64_t& farN, int64_t& farSize, float& farDistance) const
+    {
+	int64_t left, right; ComputeSubtreeSizes(size, left, right);
+	float leftMax, rightMin; splitPlanes(n, j, leftMax, rightMin);
+	nearN = n+1; nearSize = left; nearDistance = std::max(0.f, q-leftMax);
+	farN = n+left+1; farSize = right; farDistance = std::max(0.f, rightMin-q);
+	if (farDistance < nearDistance) { // right is nearer
+	    std::swap(nearN, farN);
+	    std::swap(nearSize, farSize);
+	    std::swap(nearDistance, farDistance);
+	}
+    }
+    // narrow [t0,t1] to where o+t*d is at most (clipAbove: at least) bound along one axis
+    static inline void clipBelow(float o, float d, float bound, float& t0, float& t1)
+    {
+	if (d > 0) t1 = std::min(t1, (bound-o)/d);
+	else if (d < 0) t0 = std::max(t0, (bound-o)/d);
+	else if (o > bound) t1 = -FLT_MAX;
+    }
+    static inline void clipAbove(float o, float d, float bound, float& t0, float& t1)
+    {
+	if (d > 0) t0 = std::max(t0, (bound-o)/d);
+	else if (d < 0) t1 = std::min(t1, (bound-o)/d);
+	else if (o < bound) t1 = -FLT_MAX;
+    }
+    template<class Filter> void findNPointsLeaf(NearestQuery& query, int64_t n, int count, const Filter& filter) const;
+    void leafDistances(const float q[k], int64_t n, int count, float* distanceSquared) const;
+    static inline void admit(NearestQuery& query, uint64_t n, float distanceSquared);
+    static inline void distances(const float q[k], const float* base, int64_t axisStride, int stride,
+				 int count, float* distanceSquared);
+    template<class ID> void partitionIds(ID* ids, int64_t n, int64_t size, int64_t left, int j)
+    {
+	// partition range [n, n+size) along axis j into two subranges:
+	//   [n, n+leftSize+1) and [n+leftSize+1, n+size)
+	std::nth_element(ids+n, ids+n+left, ids+n+size, ComparePointsById(&_idPoints[0].p[j]));
+	// move median value (nth element) to front as root node of subtree
+	std::swap(ids[n], ids[n+left]);
+    }
 
-    static inline void ComputeSubtreeSizes(int size, int& left, int& right)
+    static inline void ComputeSubtreeSizes(int64_t size, int64_t& left, int64_t& right)
     {
 	// if (size+1) is a power of two, then subtree is balanced
 	bool balanced = ((size+1) & size) == 0;
@@ -247,22 +449,27 @@ template <int k> class KdTree
 	else {
 	    // left subtree size = (smallest power of 2 > half size)-1
 	    int i = 0;
-	    for (int c = size; c != 1; c >>= 1) i++;
-	    left = (1<<i)-1;
+	    for (int64_t c = size; c != 1; c >>= 1) i++;
+	    left = ((int64_t)1<<i)-1;
 	    right = size - left - 1;
 	}
     }
 
     BBox<k> _bbox;
-    struct Point { float p[k]; };
+    int64_t _size;
+    std::vector<float> _lanes; // points in node order, one array per axis, when the tree owns them
+    std::vector<float> _planes; // splitPlanes() of each node, kept once update() has refit them
+    const Point* _pointData; // points in node order, the caller's after adoptOrder()
+    const Point* _idPoints; // points in id order, the copy while building or the caller's when compact
     std::vector<Point> _points;
-    std::vector<uint64_t> _ids;
+    std::vector<uint64_t> _ids; // ids are 32 bit when they fit, both are empty once
+    std::vector<uint32_t> _ids32; // adoptOrder() makes ids the identity
     bool _sorted;
 };
 
 template <int k>
 KdTree<k>::KdTree()
-    : _sorted(0)
+    : _size(0), _pointData(0), _idPoints(0), _sorted(0)
 {}
 
 template <int k>
@@ -271,56 +478,202 @@ KdTree<k>::~KdTree()
 
 // TODO: this should take an array of ids in
 template <int k>
-void KdTree<k>::setPoints(const float* p, int n)
+void KdTree<k>::setPoints(const float* p, int64_t n, bool compact)
 {
-    // copy points
-    _points.resize(n);
-    memcpy(&_points[0], p, sizeof(Point)*n);
+    // copy points unless compact
+    _size = n;
+    _pointData = 0;
+    std::vector<float>().swap(_lanes);
+    std::vector<float>().swap(_planes);
+    if (compact) {
+	std::vector<Point>().swap(_points);
+	_idPoints = reinterpret_cast<const Point*>(p);
+    } else {
+	_points.resize(n);
+	if (n) memcpy(&_points[0], p, sizeof(Point)*n);
+	_idPoints = n ? &_points[0] : 0;
+    }
 
     // compute bbox
     if (n) {
 	_bbox.set(p);
-	for (int i = 1; i < n; i++)
-	    _bbox.grow(_points[i].p);
+	for (int64_t i = 1; i < n; i++)
+	    _bbox.grow(_idPoints[i].p);
     } else _bbox.clear();
 
     // assign sequential ids
-    _ids.resize(n);
-    __gnu_cxx::iota(_ids.begin(), _ids.end(), 0);
+    if (n <= (int64_t)std::numeric_limits<uint32_t>::max()) {
+	std::vector<uint64_t>().swap(_ids);
+	_ids32.resize(n);
+	__gnu_cxx::iota(_ids32.begin(), _ids32.end(), 0);
+    } else {
+	std::vector<uint32_t>().swap(_ids32);
+	_ids.resize(n);
+	__gnu_cxx::iota(_ids.begin(), _ids.end(), 0);
+    }
 //    _ids.reserve(n);
 //    while ((int)_ids.size() < n) _ids.push_back(_ids.size());
     _sorted = 0;
 }
 
 template <int k>
-void KdTree<k>::sort()
+void KdTree<k>::sort(int numThreads)
 {
     if (_sorted) return;
     _sorted = 1;
 
     // reorder ids to sort points
-    int np = _points.size();
+    int64_t np = _size;
     if (!np) return;
-    if (np > 1) sortSubtree(0, np, 0);
+    if (np > 1) {
+	if (numThreads > 1) sortParallel(numThreads);
+	else sortSubtree(0, np, 0);
+    }
 
-    // reorder points to match id order
-    std::vector<Point> newpoints(np);
-    for (int i = 0; i < np; i++)
-	newpoints[i] = _points[_ids[i]];
-    std::swap(_points, newpoints);
+    // compact trees keep reading points through the ids
+    if (_points.empty()) return;
+
+    fillLanes(numThreads);
+    std::vector<Point>().swap(_points);
 }
 
 template <int k>
-void KdTree<k>::sortSubtree(int n, int size, int j)
+void KdTree<k>::fillLanes(int numThreads)
 {
-    int left, right; ComputeSubtreeSizes(size, left, right);
+    // move the points into per axis lanes in node order, so leaf buckets load
+    // consecutive coordinates straight into SIMD registers
+    _lanes.resize((size_t)k*_size);
+    const int chunkSize = 1<<16;
+    FillLanesTask fill(*this, chunkSize);
+    parallelFor((_size+chunkSize-1)/chunkSize, fill, numThreads);
+    _idPoints = 0;
+}
+
+template <int k> template<class ID>
+bool KdTree<k>::setOrder(const float* p, int64_t n, const ID* ids, const BBox<k>& bbox,
+    bool compact, int numThreads)
+{
+    setPoints(0, 0);
+    std::vector<bool> seen(n);
+    for (int64_t i = 0; i < n; i++) {
+	if ((uint64_t)ids[i] >= (uint64_t)n || seen[ids[i]]) return false;
+	seen[ids[i]] = true;
+    }
 
-    // partition range [n, n+size) along axis j into two subranges:
-    //   [n, n+leftSize+1) and [n+leftSize+1, n+size)
-    std::nth_element(&_ids[n], &_ids[n+left], &_ids[n+size],
-		     ComparePointsById(&_points[0].p[j]));
-    // move median value (nth element) to front as root node of subtree
-    std::swap(_ids[n], _ids[n+left]);
+    _size = n;
+    _bbox = bbox;
+    if (n <= (int64_t)std::numeric_limits<uint32_t>::max()) _ids32.assign(ids, ids+n);
+    else {
+	std::vector<uint32_t>().swap(_ids32);
+	_ids.assign(ids, ids+n);
+    }
+    _idPoints = reinterpret_cast<const Point*>(p);
+    _sorted = 1;
+    if (!compact && n) fillLanes(numThreads);
+    return true;
+}
+
+template <int k>
+bool KdTree<k>::update(const float* p, int64_t n, int numThreads)
+{
+    if (!_sorted || n != _size || (_ids.empty() && _ids32.empty() && n)) return false;
+    if (!n) return true;
+    const bool copy = !compact();
+    _idPoints = reinterpret_cast<const Point*>(p);
+
+    // refit every node's planes, collecting the subtrees that need sorting again
+    _planes.resize(2*n);
+    std::vector<Subtree> broken;
+    refitSubtree(0, n, 0, _bbox, broken);
+    int64_t brokenSize = 0;
+    for (size_t i = 0; i < broken.size(); i++) brokenSize += broken[i].size;
+    if (brokenSize > n/4) {
+	// too much moved, a full sort costs about the same
+	if (numThreads > 1) sortParallel(numThreads);
+	else sortSubtree(0, n, 0);
+	std::vector<float>().swap(_planes);
+    } else {
+	RebuildSubtreeTask rebuild(*this, broken);
+	parallelFor((int)broken.size(), rebuild, numThreads);
+    }
+
+    if (copy) {
+	const int chunkSize = 1<<16;
+	FillLanesTask fill(*this, chunkSize);
+	parallelFor((n+chunkSize-1)/chunkSize, fill, numThreads);
+	_idPoints = 0;
+    }
+    return true;
+}
+
+template <int k>
+void KdTree<k>::refitSubtree(int64_t n, int64_t size, int j, BBox<k>& box, std::vector<Subtree>& broken)
+{
+    // buckets are scanned whole, so points can move freely inside them
+    if (size <= leafSize) {
+	box.set(_idPoints[id(n)].p);
+	for (int64_t i = n+1; i < n+size; i++) box.grow(_idPoints[id(i)].p);
+	return;
+    }
+
+    int64_t left, right; ComputeSubtreeSizes(size, left, right);
+    int nextj = (j+1)%k;
+    BBox<k> rightBox;
+    refitSubtree(n+1, left, nextj, box, broken);
+    if (right) refitSubtree(n+left+1, right, nextj, rightBox, broken);
+    _planes[2*n] = box.max[j];
+    _planes[2*n+1] = right ? rightBox.min[j] : FLT_MAX;
+    const float overlap = _planes[2*n] - _planes[2*n+1];
+    box.grow(_idPoints[id(n)].p);
+    if (right) box.grow(rightBox);
+
+    // queries between overlapping children have to search both, so past an eighth of
+    // the subtree's extent it is worth sorting again
+    if (overlap > (box.max[j]-box.min[j])/8) {
+	// its broken descendants get sorted along with it
+	while (!broken.empty() && broken.back().n > n) broken.pop_back();
+	broken.push_back(Subtree(n, size, j));
+    }
+}
+
+template <int k>
+void KdTree<k>::resetPlanes(int64_t n, int64_t size, int j)
+{
+    // a freshly sorted subtree splits at its nodes' own coordinates
+    if (size <= leafSize) return;
+    _planes[2*n] = _planes[2*n+1] = _idPoints[id(n)].p[j];
+    int64_t left, right; ComputeSubtreeSizes(size, left, right);
+    int nextj = (j+1)%k;
+    resetPlanes(n+1, left, nextj);
+    if (right) resetPlanes(n+left+1, right, nextj);
+}
+
+template <int k>
+void KdTree<k>::adoptOrder(const float* points)
+{
+    assert(_sorted && (points || !_lanes.empty() || !_size));
+    std::vector<uint64_t>().swap(_ids);
+    std::vector<uint32_t>().swap(_ids32);
+    if (points && _size) {
+	std::vector<Point>().swap(_points);
+	std::vector<float>().swap(_lanes);
+	_pointData = reinterpret_cast<const Point*>(points);
+    }
+    _idPoints = 0;
+}
+
+template <int k>
+void KdTree<k>::partitionSubtree(int64_t n, int64_t size, int j, int64_t& left, int64_t& right)
+{
+    ComputeSubtreeSizes(size, left, right);
+    if (!_ids32.empty()) partitionIds(&_ids32[0], n, size, left, j);
+    else partitionIds(&_ids[0], n, size, left, j);
+}
+
+template <int k>
+void KdTree<k>::sortSubtree(int64_t n, int64_t size, int j)
+{
+    int64_t left, right; partitionSubtree(n, size, j, left, right);
 
     // sort left and right subtrees using next discriminant
     if (left <= 1) return;
@@ -330,6 +683,42 @@ void KdTree<k>::sortSubtree(int n, int size, int j)
     sortSubtree(n+left+1, right, j);
 }
 
+template <int k>
+void KdTree<k>::PartitionTask::operator() (int i)
+{
+    const Subtree& s = level[i];
+    int64_t left, right; tree.partitionSubtree(s.n, s.size, s.j, left, right);
+
+    // same recursion rules as sortSubtree, children go in slots 2i and 2i+1
+    int nextj = (k > 1)? (s.j+1)%k : s.j;
+    if (left > 1) children[2*i] = Subtree(s.n+1, left, nextj);
+    if (left > 1 && right > 1) children[2*i+1] = Subtree(s.n+left+1, right, nextj);
+}
+
+/* Parallel build
+   Subtrees cover disjoint id ranges once their parent is partitioned, so
+   they can be sorted independently.  The top levels are partitioned one
+   level at a time (each level's subtrees in parallel) until there are
+   enough subtrees to keep every thread busy, and the remaining subtrees
+   are then sorted whole by the pool.  Every range sees the same
+   nth_element calls as in the serial build, so the layout is identical.
+*/
+template <int k>
+void KdTree<k>::sortParallel(int numThreads)
+{
+    std::vector<Subtree> level(1, Subtree(0, size(), 0));
+    while (!level.empty() && (int)level.size() < 4*numThreads) {
+	std::vector<Subtree> children(2*level.size(), Subtree(0, 0, 0));
+	PartitionTask partition(*this, level, children);
+	parallelFor(level.size(), partition, numThreads);
+
+	level.clear();
+	for (size_t i = 0; i < children.size(); i++)
+	    if (children[i].size) level.push_back(children[i]);
+    }
+    SortSubtreeTask sortTask(*this, level);
+    parallelFor(level.size(), sortTask, numThreads);
+}
 
 
 template <int k>
@@ -347,57 +736,331 @@ float KdTree<k>::findNPoints(std::vector<uint64_t>& result,
 
 template <int k>
 int KdTree<k>::findNPoints(uint64_t *result, float *distanceSquared, float *finalSearchRadius2,
-                           const float p[k],int nPoints,float maxRadius) const
+                           const float p[k],int nPoints,float maxRadius,float epsilon,int maxVisits) const
 {
     float radius_squared=maxRadius*maxRadius;
 
     if (!size() || !_sorted || nPoints<1) return 0;
 
+    NearestQuery query(result,distanceSquared,p,nPoints,radius_squared,epsilon,maxVisits);
+    findNPoints(query,AcceptAll());
+    *finalSearchRadius2=query.maxRadiusSquared;
+    return query.foundPoints;
+}
+
+template <int k> template<class Filter>
+int KdTree<k>::findNPointsFiltered(uint64_t *result, float *distanceSquared, float *finalSearchRadius2,
+                                   const float p[k],int nPoints,float maxRadius,const Filter& filter) const
+{
+    float radius_squared=maxRadius*maxRadius;
+    *finalSearchRadius2=radius_squared;
+
+    if (!size() || !_sorted || nPoints<1) return 0;
+
     NearestQuery query(result,distanceSquared,p,nPoints,radius_squared);
-    findNPoints(query,0,size(),0);
+    findNPoints(query,filter);
     *finalSearchRadius2=query.maxRadiusSquared;
     return query.foundPoints;
 }
 
+template <int k>
+void KdTree<k>::findNPointsBatch(uint64_t *result, float *distanceSquared, int *counts,
+				 const float *p, int nQueries, int nPoints, float maxRadius, int numThreads,
+				 float epsilon, int maxVisits) const
+{
+    const int blockSize = 256;
+    FindNPointsBatchTask task(*this, result, distanceSquared, counts, p, nQueries, nPoints, maxRadius, blockSize,
+			      epsilon, maxVisits);
+    parallelFor((nQueries+blockSize-1)/blockSize, task, numThreads);
+}
+
+template<int k>
+void KdTree<k>::admit(typename KdTree<k>::NearestQuery& query,uint64_t n,float pDistanceSquared)
+{
+    if(query.foundPoints<query.maxPoints){
+        // TODO: we could do the remapping here, but we do it at the end before returning teh result
+        query.result[query.foundPoints]=n;
+        query.distanceSquared[query.foundPoints] = pDistanceSquared;
+        query.foundPoints++;
+        if(query.foundPoints==query.maxPoints)
+            query.maxRadiusSquared=buildHeap(query.result,query.distanceSquared,query.foundPoints);
+    }else // already have heap, find somebody to throw out
+        query.maxRadiusSquared=insertToHeap(query.result,query.distanceSquared,query.foundPoints,n,pDistanceSquared);
+}
+
+// Squared distances from q to count points, where coordinate axis of point i
+// is base[axis*axisStride+i*stride]. Four points at a time with SSE.
 template<int k>
-void KdTree<k>::findNPoints(typename KdTree<k>::NearestQuery& query,int n,int size,int j) const
-{
-    const float* p=&_points[n].p[0];
-
-    if(size>1){
-        float axis_distance=query.pquery[j]-p[j];
-        int left,right;ComputeSubtreeSizes(size,left,right);
-        int nextj=(j+1)%k;
-
-        if(axis_distance>0){ // visit right definitely, and left if within distance
-            if(right) findNPoints(query,n+left+1,right,nextj);
-            if(axis_distance*axis_distance<query.maxRadiusSquared)
-                findNPoints(query,n+1,left,nextj);
-        }else{ // visit left definitely, and right if within distance
-            findNPoints(query,n+1,left,nextj);
-            if(right && axis_distance*axis_distance<query.maxRadiusSquared)
-                findNPoints(query,n+left+1,right,nextj);
+void KdTree<k>::distances(const float q[k],const float* base,int64_t axisStride,int stride,
+    int count,float* distanceSquared)
+{
+    int i=0;
+#ifdef PARTIO_KDTREE_SSE
+    for(;i+4<=count;i+=4){
+        __m128 sum=_mm_setzero_ps();
+        for(int axis=0;axis<k;axis++){
+            const float* p=base+axis*axisStride+(int64_t)i*stride;
+            __m128 v=stride==1 ? _mm_loadu_ps(p) : _mm_set_ps(p[3*stride],p[2*stride],p[stride],p[0]);
+            __m128 d=_mm_sub_ps(v,_mm_set1_ps(q[axis]));
+            sum=_mm_add_ps(sum,_mm_mul_ps(d,d));
+        }
+        _mm_storeu_ps(distanceSquared+i,sum);
+    }
+#endif
+    for(;i<count;i++){
+        float sum=0;
+        for(int axis=0;axis<k;axis++){
+            float d=base[axis*axisStride+(int64_t)i*stride]-q[axis];
+            sum+=d*d;
+        }
+        distanceSquared[i]=sum;
+    }
+}
+
+template<int k>
+void KdTree<k>::leafDistances(const float q[k],int64_t n,int count,float* d2) const
+{
+    // a subtree is a contiguous run of nodes, so the bucket is just the range [n,n+count)
+    if(!_lanes.empty()) distances(q,&_lanes[n],_size,1,count,d2);
+    else if(_pointData) distances(q,_pointData[n].p,1,k,count,d2);
+    else{
+        for(int i=0;i<count;i++) distances(q,_idPoints[id(n+i)].p,1,k,1,d2+i);
+    }
+}
+
+template<int k> template<class Filter>
+void KdTree<k>::findNPointsLeaf(typename KdTree<k>::NearestQuery& query,int64_t n,int count,const Filter& filter) const
+{
+    float d2[leafSize];
+    leafDistances(query.pquery,n,count,d2);
+
+    int i=0;
+#ifdef PARTIO_KDTREE_SSE
+    // admission test four at a time, most points in a bucket are outside the radius
+    for(;i+4<=count;i+=4){
+        int mask=_mm_movemask_ps(_mm_cmplt_ps(_mm_loadu_ps(d2+i),_mm_set1_ps(query.maxRadiusSquared)));
+        for(int lane=0;mask;lane++,mask>>=1)
+            if((mask&1) && d2[i+lane]<query.maxRadiusSquared && filter(id(n+i+lane)))
+                admit(query,n+i+lane,d2[i+lane]);
+    }
+#endif
+    for(;i<count;i++)
+        if(d2[i]<query.maxRadiusSquared && filter(id(n+i))) admit(query,n+i,d2[i]);
+}
+
+template<int k> template<class Filter>
+void KdTree<k>::findNPoints(typename KdTree<k>::NearestQuery& query,const Filter& filter) const
+{
+    // depth first with an explicit stack, nearer child first. Entries carry a lower
+    // bound on their distance so subtrees are dropped if the radius shrank meanwhile
+    struct Entry { int64_t n, size; int j; float minDistanceSquared; };
+    Entry stack[128];
+    int top=0;
+    stack[0].n=0;stack[0].size=size();stack[0].j=0;stack[0].minDistanceSquared=0;
+    top++;
+
+    while(top){
+        const Entry e=stack[--top];
+        // until the heap is full any subtree within the radius may hold a neighbor
+        const float pruneRadiusSquared=query.foundPoints==query.maxPoints ?
+            query.maxRadiusSquared*query.pruneScale : query.maxRadiusSquared;
+        if(e.minDistanceSquared>=pruneRadiusSquared) continue;
+        if(query.maxVisits){
+            if(query.visits>=query.maxVisits) break;
+            query.visits+=e.size<=leafSize ? (int)e.size : 1;
+        }
+        if(e.size<=leafSize){
+            findNPointsLeaf(query,e.n,(int)e.size,filter);
+            continue;
+        }
+
+        // the split point itself
+        float p[k];
+        for(int axis=0;axis<k;axis++) p[axis]=coord(e.n,axis);
+        float pDistanceSquared;
+        distances(query.pquery,p,1,k,1,&pDistanceSquared);
+        if(pDistanceSquared<query.maxRadiusSquared && filter(id(e.n))) admit(query,e.n,pDistanceSquared);
+
+        int64_t nearN,nearSize,farN,farSize;float nearDistance,farDistance;
+        nearFar(e.n,e.size,e.j,query.pquery[e.j],nearN,nearSize,nearDistance,farN,farSize,farDistance);
+        int nextj=(e.j+1)%k;
+        if(farSize){
+            Entry& farther=stack[top++];
+            farther.n=farN;farther.size=farSize;farther.j=nextj;
+            farther.minDistanceSquared=std::max(e.minDistanceSquared,farDistance*farDistance);
         }
+        Entry& nearer=stack[top++];
+        nearer.n=nearN;nearer.size=nearSize;nearer.j=nextj;
+        nearer.minDistanceSquared=std::max(e.minDistanceSquared,nearDistance*nearDistance);
     }
+}
+
+template<int k> template<class Visitor>
+bool KdTree<k>::visitPointsInRadius(const float p[k],float radius,Visitor& visitor) const
+{
+    if(!_size) return true;
+    const float radiusSquared=radius*radius;
 
-    // Compute squared distance for this entry
-    float pDistanceSquared=0;
+    // same walk as findNPoints, but the radius never shrinks so far children are
+    // culled when pushed. nothing here allocates
+    struct Entry { int64_t n, size; int j; };
+    Entry stack[128];
+    int top=0;
+    stack[0].n=0;stack[0].size=size();stack[0].j=0;
+    top++;
 
-    for(int axis=0;axis<k;axis++){
-        float tmp=p[axis]-query.pquery[axis];
-        pDistanceSquared+=tmp*tmp;
+    float d2[leafSize];
+    while(top){
+        const Entry e=stack[--top];
+        if(e.size<=leafSize){
+            const int count=(int)e.size;
+            leafDistances(p,e.n,count,d2);
+            int i=0;
+#ifdef PARTIO_KDTREE_SSE
+            for(;i+4<=count;i+=4){
+                int mask=_mm_movemask_ps(_mm_cmplt_ps(_mm_loadu_ps(d2+i),_mm_set1_ps(radiusSquared)));
+                for(int lane=0;mask;lane++,mask>>=1)
+                    if((mask&1) && !visitor.visit(id(e.n+i+lane),d2[i+lane])) return false;
+            }
+#endif
+            for(;i<count;i++)
+                if(d2[i]<radiusSquared && !visitor.visit(id(e.n+i),d2[i])) return false;
+            continue;
+        }
+
+        leafDistances(p,e.n,1,d2);
+        if(d2[0]<radiusSquared && !visitor.visit(id(e.n),d2[0])) return false;
+
+        int64_t nearN,nearSize,farN,farSize;float nearDistance,farDistance;
+        nearFar(e.n,e.size,e.j,p[e.j],nearN,nearSize,nearDistance,farN,farSize,farDistance);
+        int nextj=(e.j+1)%k;
+        if(farSize && farDistance*farDistance<radiusSquared){
+            Entry& farther=stack[top++];
+            farther.n=farN;farther.size=farSize;farther.j=nextj;
+        }
+        if(nearSize && nearDistance*nearDistance<radiusSquared){
+            Entry& nearer=stack[top++];
+            nearer.n=nearN;nearer.size=nearSize;nearer.j=nextj;
+        }
     }
+    return true;
+}
 
-    if(pDistanceSquared<query.maxRadiusSquared){
-        if(query.foundPoints<query.maxPoints){
-            // TODO: we could do the remapping here, but we do it at the end before returning teh result
-            query.result[query.foundPoints]=n;
-            query.distanceSquared[query.foundPoints] = pDistanceSquared;
-            query.foundPoints++;
-            if(query.foundPoints==query.maxPoints)
-                query.maxRadiusSquared=buildHeap(query.result,query.distanceSquared,query.foundPoints);
-        }else // already have heap, find somebody to throw out
-            query.maxRadiusSquared=insertToHeap(query.result,query.distanceSquared,query.foundPoints,n,pDistanceSquared);
+template<int k> template<class Hits>
+void KdTree<k>::findPointsAlongRays(Hits* hits, int nRays, float radius) const
+{
+    assert(nRays <= rayPacketSize);
+    if (!_size || nRays <= 0) return;
+    const float radiusSquared = radius*radius;
+
+    // a point within radius of ray r at t is within radius of it along every axis, so each
+    // child keeps the part of [t0,t1] where the ray is within radius of its side of the
+    // split. rays whose part is empty, or starts beyond their limit, drop out
+    struct Entry { int64_t n, size; int j; unsigned active; float t0[rayPacketSize], t1[rayPacketSize]; };
+    Entry stack[128];
+    int top = 0;
+    Entry& root = stack[top++];
+    root.n = 0; root.size = _size; root.j = 0; root.active = 0;
+    BBox<k> box = _bbox; box.grow(radius);
+    for (int r = 0; r < nRays; r++) {
+	root.t0[r] = hits[r].tMin; root.t1[r] = hits[r].tMax;
+	if (hits[r].clip(box.min, box.max, root.t0[r], root.t1[r])) root.active |= 1u<<r;
+    }
+
+    float p[k];
+    while (top) {
+	const Entry e = stack[--top];
+	unsigned active = 0;
+	for (int r = 0; r < nRays; r++)
+	    if ((e.active>>r & 1) && e.t0[r] <= hits[r].limit()) active |= 1u<<r;
+	if (!active) continue;
+
+	const int64_t end = e.size <= leafSize ? e.n+e.size : e.n+1;
+	for (int64_t i = e.n; i < end; i++) {
+	    for (int axis = 0; axis < k; axis++) p[axis] = coord(i, axis);
+	    for (int r = 0; r < nRays; r++)
+		if (active>>r & 1) hits[r].addPoint(id(i), p, radiusSquared);
+	}
+	if (e.size <= leafSize) continue;
+
+	int64_t left, right; ComputeSubtreeSizes(e.size, left, right);
+	float leftMax, rightMin; splitPlanes(e.n, e.j, leftMax, rightMin);
+	Entry children[2];
+	children[0].n = e.n+1; children[0].size = left;
+	children[1].n = e.n+left+1; children[1].size = right;
+	children[0].active = children[1].active = 0;
+	int first = -1;
+	for (int r = 0; r < nRays; r++) {
+	    if (!(active>>r & 1)) continue;
+	    const float o = hits[r].origin[e.j], d = hits[r].direction[e.j];
+	    if (first < 0) first = d < 0; // the first ray's direction decides which side is near
+	    children[0].t0[r] = children[1].t0[r] = e.t0[r];
+	    children[0].t1[r] = children[1].t1[r] = e.t1[r];
+	    clipBelow(o, d, leftMax+radius, children[0].t0[r], children[0].t1[r]);
+	    clipAbove(o, d, rightMin-radius, children[1].t0[r], children[1].t1[r]);
+	    for (int side = 0; side < 2; side++)
+		if (children[side].t0[r] <= children[side].t1[r]) children[side].active |= 1u<<r;
+	}
+	const int nextj = (e.j+1)%k;
+	for (int side = 1; side >= 0; side--) { // far child first, so near is popped next
+	    Entry& child = children[side == 1 ? 1-first : first];
+	    if (!child.size || !child.active) continue;
+	    child.j = nextj;
+	    stack[top++] = child;
+	}
+    }
+}
+
+template <int k>
+void KdTree<k>::findPointsInConvex(std::vector<uint64_t>& result, const float* planes, int nPlanes) const
+{
+    if (!size() || !_sorted) return;
+    findPointsInConvex(result, planes, nPlanes, ~(uint64_t)0, _bbox, 0, size(), 0);
+}
+
+template <int k>
+void KdTree<k>::findPointsInConvex(std::vector<uint64_t>& result, const float* planes, int nPlanes,
+				   uint64_t active, const BBox<k>& box, int64_t n, int64_t size, int j) const
+{
+    // the corners of the box nearest and farthest along each plane's normal
+    bool inside = true;
+    for (int i = 0; i < nPlanes; i++) {
+	if (i < 64 && !(active>>i & 1)) continue;
+	const float* plane = planes+i*(k+1);
+	float low = plane[k], high = plane[k];
+	for (int axis = 0; axis < k; axis++) {
+	    const float a = plane[axis];
+	    low += a*(a >= 0 ? box.min[axis] : box.max[axis]);
+	    high += a*(a >= 0 ? box.max[axis] : box.min[axis]);
+	}
+	if (high < 0) return;
+	if (low < 0) inside = false;
+	else if (i < 64) active &= ~((uint64_t)1<<i);
+    }
+    if (inside) {
+	// a subtree is a contiguous run of nodes
+	for (int64_t i = n; i < n+size; i++) result.push_back(i);
+	return;
+    }
+
+    float p[k];
+    const int64_t end = size <= leafSize ? n+size : n+1;
+    for (int64_t i = n; i < end; i++) {
+	for (int axis = 0; axis < k; axis++) p[axis] = coord(i, axis);
+	if (insidePlanes(planes, nPlanes, active, p)) result.push_back(i);
+    }
+    if (size <= leafSize) return;
+
+    int64_t left, right; ComputeSubtreeSizes(size, left, right);
+    int nextj = (k > 1)? (j+1)%k : j;
+    float leftMax, rightMin; splitPlanes(n, j, leftMax, rightMin);
+    BBox<k> child = box;
+    child.max[j] = std::min(box.max[j], leftMax);
+    findPointsInConvex(result, planes, nPlanes, active, child, n+1, left, nextj);
+    if (right) {
+	child = box;
+	child.min[j] = std::max(box.min[j], rightMin);
+	findPointsInConvex(result, planes, nPlanes, active, child, n+left+1, right, nextj);
     }
 }
 
@@ -411,23 +1074,32 @@ void KdTree<k>::findPoints(std::vector<uint64_t>& result, const BBox<k>& bbox) c
 
 template <int k>
 void KdTree<k>::findPoints(std::vector<uint64_t>& result, const BBox<k>& bbox,
-			   int n, int size, int j) const
+			   int64_t n, int64_t size, int j) const
 {
+    // small subtrees are one contiguous bucket
+    float p[k];
+    if (size <= leafSize) {
+	for (int64_t i = n; i < n+size; i++) {
+	    for (int axis = 0; axis < k; axis++) p[axis] = coord(i, axis);
+	    if (bbox.inside(p)) result.push_back(i);
+	}
+	return;
+    }
+
     // check point at n for inclusion
-    const float* p = &_points[n].p[0];
+    for (int axis = 0; axis < k; axis++) p[axis] = coord(n, axis);
     if (bbox.inside(p))
 	result.push_back(n);
 
-    if (size == 1) return;
-
     // visit left subtree
-    int left, right; ComputeSubtreeSizes(size, left, right);
+    int64_t left, right; ComputeSubtreeSizes(size, left, right);
     int nextj = (k > 1)? (j+1)%k : j;
-    if (p[j] >= bbox.min[j])
+    float leftMax, rightMin; splitPlanes(n, j, leftMax, rightMin);
+    if (leftMax >= bbox.min[j])
 	findPoints(result, bbox, n+1, left, nextj);
 
     // visit right subtree
-    if (right && p[j] <= bbox.max[j])
+    if (right && rightMin <= bbox.max[j])
 	findPoints(result, bbox, n+left+1, right, nextj);
 }
 
@@ -39,6 +39,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
 #ifndef PARTIO_WIN32
 
 #include <pthread.h>
+#include <sched.h>
 
 namespace Partio
 {
@@ -100,6 +101,39 @@ namespace Partio
     };
     
 #endif // USE_PTHREAD_SPINLOCK
+
+    // Atomic counters for lock free readers, each one is a full memory barrier
+    inline int atomicIncrement(volatile int* value)
+    {
+        return __sync_add_and_fetch(value,1);
+    }
+
+    inline int atomicDecrement(volatile int* value)
+    {
+        return __sync_sub_and_fetch(value,1);
+    }
+
+    inline void memoryBarrier()
+    {
+        __sync_synchronize();
+    }
+
+    //! Reads a pointer another thread publishes, seeing everything written before it was stored
+    template<class T> inline T* loadAcquire(T* volatile const* slot)
+    {
+#ifdef __ATOMIC_ACQUIRE
+        return __atomic_load_n(slot,__ATOMIC_ACQUIRE);
+#else
+        T* value=*slot;
+        __sync_synchronize();
+        return value;
+#endif
+    }
+
+    inline void yieldThread()
+    {
+        sched_yield();
+    }
 }
 
 #else
@@ -113,7 +147,7 @@ namespace Partio
     public:
         inline PartioMutex()
         {
-            CacheLock=CreateMutex(0,FALSE,"partiocache");
+            CacheLock=CreateMutex(0,FALSE,0);
         }
     
         inline ~PartioMutex()
@@ -131,6 +165,94 @@ namespace Partio
             ReleaseMutex(CacheLock);
         }
     };
+
+    // Atomic counters for lock free readers, each one is a full memory barrier
+    inline int atomicIncrement(volatile int* value)
+    {
+        return InterlockedIncrement((volatile LONG*)value);
+    }
+
+    inline int atomicDecrement(volatile int* value)
+    {
+        return InterlockedDecrement((volatile LONG*)value);
+    }
+
+    inline void memoryBarrier()
+    {
+        MemoryBarrier();
+    }
+
+    //! Reads a pointer another thread publishes, seeing everything written before it was stored
+    template<class T> inline T* loadAcquire(T* volatile const* slot)
+    {
+        T* value=*slot;
+#if defined(_M_IX86) || defined(_M_X64)
+        _ReadWriteBarrier(); // loads are not reordered with later loads on x86
+#else
+        MemoryBarrier();
+#endif
+        return value;
+    }
+
+    inline void yieldThread()
+    {
+        SwitchToThread();
+    }
     }
 #endif // USE_PTHREADS
+
+namespace Partio
+{
+    //! Lets queries read a pointer that a writer may replace, without locking
+    /*!
+      Readers count themselves under the parity of the epoch. A writer publishes
+      the new pointer, then drain() flips the epoch and waits for the old parity's
+      readers to leave, twice. After that no reader can still hold the old pointer.
+    */
+    class ReaderEpoch
+    {
+        volatile int epoch;
+        mutable volatile int readers[2];
+
+    public:
+        inline ReaderEpoch()
+            :epoch(0)
+        {
+            readers[0]=readers[1]=0;
+        }
+
+        //! Counts a reader in under the current epoch, retrying if a writer flips
+        //! it meanwhile. Returns the slot to give leave()
+        inline int enter() const
+        {
+            for(;;){
+                const int slot=epoch&1;
+                atomicIncrement(&readers[slot]);
+                if((epoch&1)==slot) return slot;
+                atomicDecrement(&readers[slot]);
+            }
+        }
+
+        inline void leave(const int slot) const
+        {
+            atomicDecrement(&readers[slot]);
+        }
+
+        //! Waits out every reader that may have seen the pointer before it was
+        //! replaced. Writers must not call this concurrently
+        inline void drain()
+        {
+            // a reader that saw the old pointer registered before one of the two
+            // flips, so draining the old parity after each flip waits out all of them
+            for(int flip=0;flip<2;flip++){
+                memoryBarrier();
+                const int parity=epoch&1;
+                epoch=epoch+1;
+                memoryBarrier();
+                while(readers[parity]) yieldThread();
+            }
+        }
+    };
+}
+
 #endif // Header guard
@@ -0,0 +1,128 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+
+#ifndef _Parallel_h_
+#define _Parallel_h_
+
+#include <vector>
+#include "Mutex.h"
+
+namespace Partio
+{
+
+//! Work shared by the threads of one parallelFor() call
+/*!
+  Workers pull task indices from a shared counter, so uneven tasks balance
+  out across the pool instead of being statically split up front.
+*/
+template<class TASK> class ParallelForJob
+{
+    TASK& task;
+    const int count;
+    int next;
+    PartioMutex mutex;
+
+public:
+    ParallelForJob(TASK& task,const int count)
+        :task(task),count(count),next(0)
+    {}
+
+    bool fetch(int& index)
+    {
+        mutex.lock();
+        index=next<count ? next++ : -1;
+        mutex.unlock();
+        return index>=0;
+    }
+
+    void run()
+    {
+        int index;
+        while(fetch(index)) task(index);
+    }
+
+#ifndef PARTIO_WIN32
+    static void* entry(void* job)
+    {
+        static_cast<ParallelForJob*>(job)->run();
+        return 0;
+    }
+#else
+    static DWORD WINAPI entry(LPVOID job)
+    {
+        static_cast<ParallelForJob*>(job)->run();
+        return 0;
+    }
+#endif
+};
+
+//! Calls task(i) for every i in [0,count) using up to numThreads threads
+/*!
+  The calling thread works alongside the spawned ones and returns once every
+  task is done. With one thread or one task everything runs inline.
+*/
+template<class TASK> void parallelFor(const int count,TASK& task,int numThreads)
+{
+    if(numThreads>count) numThreads=count;
+    if(numThreads<=1){
+        for(int i=0;i<count;i++) task(i);
+        return;
+    }
+
+    ParallelForJob<TASK> job(task,count);
+#ifndef PARTIO_WIN32
+    std::vector<pthread_t> threads;
+    for(int t=1;t<numThreads;t++){
+        pthread_t thread;
+        if(pthread_create(&thread,0,ParallelForJob<TASK>::entry,&job)==0) threads.push_back(thread);
+    }
+    job.run();
+    for(size_t t=0;t<threads.size();t++) pthread_join(threads[t],0);
+#else
+    std::vector<HANDLE> threads;
+    for(int t=1;t<numThreads;t++){
+        HANDLE thread=CreateThread(0,0,ParallelForJob<TASK>::entry,&job,0,0);
+        if(thread) threads.push_back(thread);
+    }
+    job.run();
+    for(size_t t=0;t<threads.size();t++){
+        WaitForSingleObject(threads[t],INFINITE);
+        CloseHandle(threads[t]);
+    }
+#endif
+}
+
+}
+#endif
@@ -70,6 +70,31 @@ createInterleave()
     return new ParticlesSimpleInterleave;
 }
 
+namespace{
+struct AppendPoints:public PointVisitor
+{
+    std::vector<ParticleIndex>& points;
+    std::vector<float>& pointDistancesSquared;
+    AppendPoints(std::vector<ParticleIndex>& points,std::vector<float>& pointDistancesSquared)
+        :points(points),pointDistancesSquared(pointDistancesSquared)
+    {}
+    bool visit(const ParticleIndex particleIndex,const float distanceSquared)
+    {
+        points.push_back(particleIndex);
+        pointDistancesSquared.push_back(distanceSquared);
+        return true;
+    }
+};
+}
+
+void ParticlesData::
+findPointsInRadius(const float center[3],const float radius,
+    std::vector<ParticleIndex>& points,std::vector<float>& pointDistancesSquared) const
+{
+    AppendPoints append(points,pointDistancesSquared);
+    visitPointsInRadius(center,radius,append);
+}
+
 
 
 
@@ -95,7 +120,7 @@ print(const ParticlesData* particles)
         std::cout<<"attribute "<<attr.name<<" "<<int(attr.type)<<" "<<attr.count<<std::endl;
     }
 
-    int numToPrint=std::min(10,particles->numParticles());
+    int numToPrint=(int)std::min((int64_t)10,particles->numParticles());
     std::cout<<"num to print "<<numToPrint<<std::endl;
 
     ParticlesData::const_iterator it=particles->begin(),end=particles->end();
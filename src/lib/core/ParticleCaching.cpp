@@ -34,7 +34,10 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
 */
 #include <iostream>
 #include <cassert>
+#include <list>
+#include <vector>
 #include "Mutex.h"
+#include "ParticleSimple.h"
 #include "../Partio.h"
 
 //#####################################################################
@@ -43,31 +46,152 @@ namespace Partio{
 namespace
 {
     static PartioMutex mutex;
+
+    struct CacheEntry
+    {
+        std::string filename;
+        ParticlesData* particles;
+        bool sort;
+        int refCount; // outstanding readCached() references
+        int accessCount; // open beginCachedAccess() calls
+        bool resident; // false once the data has been evicted
+        bool loading; // a thread is reading the file, wait on loaded for it
+        PartioMutex loaded; // held by the loading thread until the data is in place
+        size_t bytes;
+        std::list<CacheEntry*>::iterator lruPosition;
+    };
+
+    // cached read write
+    std::map<std::string,CacheEntry*> cachedParticles;
+    std::map<const ParticlesData*,CacheEntry*> cachedEntries;
+    std::list<CacheEntry*> lru; // most recently used first
+    size_t budget=0;
+    CacheStats stats={0,0,0,0};
+
+    size_t dataSize(const ParticlesData* particles)
+    {
+        const ParticlesSimple* simple=dynamic_cast<const ParticlesSimple*>(particles);
+        return simple ? simple->memorySize() : 0;
+    }
+
+    void touch(CacheEntry* entry)
+    {
+        lru.splice(lru.begin(),lru,entry->lruPosition);
+    }
+
+    void forget(CacheEntry* entry)
+    {
+        if(entry->resident) stats.residentBytes-=entry->bytes;
+        cachedParticles.erase(entry->filename);
+        cachedEntries.erase(entry->particles);
+        lru.erase(entry->lruPosition);
+        delete entry;
+    }
+
+    //! Frees data from the least recently used end until the budget is met.
+    //! Unreferenced sets are dropped entirely and returned so the caller can
+    //! free them once the lock is released.
+    void evict(std::vector<ParticlesData*>& toFree)
+    {
+        if(!budget) return;
+        std::list<CacheEntry*>::iterator it=lru.end();
+        while(stats.residentBytes>budget && it!=lru.begin()){
+            CacheEntry* entry=*--it;
+            if(entry->refCount==0){
+                toFree.push_back(entry->particles);
+                std::list<CacheEntry*>::iterator next=it;
+                ++next; // forget() erases it, continue from the following node
+                forget(entry);
+                it=next;
+                stats.evictions++;
+            }else if(entry->resident && entry->accessCount==0){
+                ParticlesSimple* simple=dynamic_cast<ParticlesSimple*>(entry->particles);
+                if(!simple) continue;
+                simple->freeData();
+                entry->resident=false;
+                stats.residentBytes-=entry->bytes;
+                stats.evictions++;
+            }
+        }
+    }
+
+    //! Sorts particles read from filename, loading the file's sort index if it has one
+    void sortRead(ParticlesDataMutable* particles,const char* filename)
+    {
+        SortOptions options;
+        options.sourceFile=filename;
+        particles->sort(options);
+    }
+
+    void freeAll(const std::vector<ParticlesData*>& toFree)
+    {
+        for(size_t i=0;i<toFree.size();i++) toFree[i]->release(); // no longer cached, so this deletes
+    }
 }
-    
-// cached read write
-std::map<ParticlesData*,int> cachedParticlesCount;
-std::map<std::string,ParticlesData*> cachedParticles;
 
 ParticlesData* readCached(const char* filename,const bool sort)
 {
+    std::vector<ParticlesData*> toFree;
     mutex.lock();
-    std::map<std::string,ParticlesData*>::iterator i=cachedParticles.find(filename);
+    std::map<std::string,CacheEntry*>::iterator i=cachedParticles.find(filename);
 
-    ParticlesData* p=0;
     if(i!=cachedParticles.end()){
-        p=i->second;
-        cachedParticlesCount[p]++;
-    }else{
-        ParticlesDataMutable* p_rw=read(filename);
-        if(p_rw){
-            if(sort) p_rw->sort();
-            p=p_rw;
-            cachedParticles[filename]=p;
-            cachedParticlesCount[p]=1;
+        CacheEntry* entry=i->second;
+        entry->refCount++;
+        touch(entry);
+        stats.hits++;
+        if(entry->loading){
+            // another thread is reading this file, wait for it instead of reading it again
+            mutex.unlock();
+            entry->loaded.lock();
+            entry->loaded.unlock();
+            mutex.lock();
         }
+        ParticlesData* p=entry->particles;
+        if(!p && --entry->refCount==0) delete entry; // the read failed and was already reported
+        mutex.unlock();
+        return p;
+    }
+
+    // publish an entry that is still loading so readers of the same file wait on it
+    CacheEntry* entry=new CacheEntry;
+    entry->filename=filename;
+    entry->particles=0;
+    entry->sort=sort;
+    entry->refCount=1;
+    entry->accessCount=0;
+    entry->resident=false;
+    entry->loading=true;
+    entry->bytes=0;
+    entry->loaded.lock();
+    entry->lruPosition=lru.insert(lru.begin(),entry);
+    cachedParticles[filename]=entry;
+    stats.misses++;
+    mutex.unlock();
+
+    // the read and sort run unlocked so different files load concurrently
+    ParticlesDataMutable* p_rw=read(filename);
+    if(p_rw && sort) sortRead(p_rw,filename);
+
+    mutex.lock();
+    entry->loading=false;
+    ParticlesData* p=p_rw;
+    if(p){
+        entry->particles=p;
+        entry->resident=true;
+        entry->bytes=dataSize(p);
+        cachedEntries[p]=entry;
+        stats.residentBytes+=entry->bytes;
+        evict(toFree);
+        entry->loaded.unlock();
+    }else{
+        cachedParticles.erase(entry->filename);
+        lru.erase(entry->lruPosition);
+        entry->loaded.unlock();
+        if(--entry->refCount==0) delete entry; // otherwise the last waiter deletes it
     }
     mutex.unlock();
+    freeAll(toFree);
     return p;
 }
 
@@ -77,36 +201,111 @@ void freeCached(ParticlesData* particles)
 
     mutex.lock();
 
-    std::map<ParticlesData*,int>::iterator i=cachedParticlesCount.find(particles);
-    if(i==cachedParticlesCount.end()){ // Not found in cache, just free
+    std::map<const ParticlesData*,CacheEntry*>::iterator i=cachedEntries.find(particles);
+    if(i==cachedEntries.end()){ // Not found in cache, just free
         delete (ParticlesInfo*)particles;
     }else{ // found in cache
-        i->second--; // decrement ref count
-        if(i->second==0){ // ref count is now zero, remove from structure
+        CacheEntry* entry=i->second;
+        entry->refCount--; // decrement ref count
+        // ref count is now zero, remove from structure unless a budget keeps it around
+        if(entry->refCount==0 && !budget){
+            forget(entry);
             delete (ParticlesInfo*)particles;
-            cachedParticlesCount.erase(i);
-            for(std::map<std::string,ParticlesData*>::iterator i2=cachedParticles.begin();
-                i2!=cachedParticles.end();++i2){
-                if(i2->second==particles){
-                    cachedParticles.erase(i2);
-                    goto exit_and_release;
-                }
-            }        
-            assert(false);
         }
     }
-  exit_and_release:
     mutex.unlock();
 }
 
 void beginCachedAccess(ParticlesData* particles)
 {
-    // TODO: for future use
+    std::vector<ParticlesData*> toFree;
+    mutex.lock();
+    std::map<const ParticlesData*,CacheEntry*>::iterator i=cachedEntries.find(particles);
+    if(i!=cachedEntries.end()){
+        CacheEntry* entry=i->second;
+        entry->accessCount++;
+        touch(entry);
+        if(entry->resident){
+            stats.hits++;
+        }else if(entry->loading){
+            // another thread is already reading the evicted data back in
+            stats.hits++;
+            mutex.unlock();
+            entry->loaded.lock();
+            entry->loaded.unlock();
+            return;
+        }else{
+            entry->loading=true;
+            entry->loaded.lock();
+            stats.misses++;
+            mutex.unlock();
+
+            // read the file again and move its data into the set callers already hold
+            ParticlesDataMutable* fresh=read(entry->filename.c_str());
+            if(fresh && entry->sort) sortRead(fresh,entry->filename.c_str());
+
+            mutex.lock();
+            ParticlesSimple* simple=dynamic_cast<ParticlesSimple*>(particles);
+            ParticlesSimple* freshSimple=dynamic_cast<ParticlesSimple*>(fresh);
+            if(simple && freshSimple && simple->takeData(*freshSimple)){
+                entry->resident=true;
+                entry->bytes=dataSize(particles);
+                stats.residentBytes+=entry->bytes;
+            }else{
+                std::cerr<<"Partio: failed to reload evicted cache data from "<<entry->filename<<std::endl;
+            }
+            entry->loading=false;
+            entry->loaded.unlock();
+            if(fresh) toFree.push_back(fresh);
+            evict(toFree);
+        }
+    }
+    mutex.unlock();
+    freeAll(toFree);
 }
 
 void endCachedAccess(ParticlesData* particles)
 {
-    // TODO: for future use
+    std::vector<ParticlesData*> toFree;
+    mutex.lock();
+    std::map<const ParticlesData*,CacheEntry*>::iterator i=cachedEntries.find(particles);
+    if(i!=cachedEntries.end()){
+        CacheEntry* entry=i->second;
+        if(entry->accessCount>0) entry->accessCount--;
+        touch(entry);
+        evict(toFree);
+    }
+    mutex.unlock();
+    freeAll(toFree);
+}
+
+void setCacheBudget(const size_t bytes)
+{
+    std::vector<ParticlesData*> toFree;
+    mutex.lock();
+    budget=bytes;
+    if(budget){
+        evict(toFree);
+    }else{
+        // without a budget unreferenced sets are not kept
+        for(std::list<CacheEntry*>::iterator it=lru.begin();it!=lru.end();){
+            CacheEntry* entry=*it++;
+            if(entry->refCount==0){
+                toFree.push_back(entry->particles);
+                forget(entry);
+            }
+        }
+    }
+    mutex.unlock();
+    freeAll(toFree);
+}
+
+CacheStats cacheStats()
+{
+    mutex.lock();
+    CacheStats current=stats;
+    mutex.unlock();
+    return current;
 }
 
 } // namespace Partio
@@ -56,7 +56,7 @@ release() const
     delete this;
 }
 
-int ParticleHeaders::
+int64_t ParticleHeaders::
 numParticles() const
 {
     return particleCount;
@@ -93,6 +93,36 @@ sort()
     assert(false);
 }
 
+void ParticleHeaders::
+sort(const SortOptions& options)
+{
+    assert(false);
+}
+
+void ParticleHeaders::
+sort(const char* attributeName)
+{
+    assert(false);
+}
+
+void ParticleHeaders::
+sortSpheres(const char* radiusAttribute)
+{
+    assert(false);
+}
+
+void ParticleHeaders::
+reorder()
+{
+    assert(false);
+}
+
+void ParticleHeaders::
+updateSort()
+{
+    assert(false);
+}
+
 
 int ParticleHeaders::
 registerIndexedStr(const ParticleAttribute& attribute,const char* str)
@@ -122,6 +152,12 @@ findPoints(const float bboxMin[3],const float bboxMax[3],std::vector<ParticleInd
     assert(false);
 }
 
+void ParticleHeaders::
+findPointsInConvex(const float* planes,const int nPlanes,std::vector<ParticleIndex>& points) const
+{
+    assert(false);
+}
+
 float ParticleHeaders::
 findNPoints(const float center[3],const int nPoints,const float maxRadius,std::vector<ParticleIndex>& points,
     std::vector<float>& pointDistancesSquared) const
@@ -138,6 +174,97 @@ findNPoints(const float center[3],int nPoints,const float maxRadius, ParticleInd
     return 0;
 }
 
+int ParticleHeaders::
+findNPoints(const float center[3],int nPoints,const float maxRadius,const PointFilter& filter,
+    ParticleIndex *points,float *pointDistancesSquared,float *finalRadius2) const
+{
+    assert(false);
+    return 0;
+}
+
+void ParticleHeaders::
+findNPointsBatch(const float* centers,const int nQueries,const int nPoints,const float maxRadius,
+    ParticleIndex* points,float* pointDistancesSquared,int* pointCounts) const
+{
+    assert(false);
+}
+
+int ParticleHeaders::
+findNPointsApproximate(const float center[3],int nPoints,const float maxRadius,const float epsilon,
+    const int maxVisits,ParticleIndex *points,float *pointDistancesSquared,float *finalRadius2) const
+{
+    assert(false);
+    return 0;
+}
+
+void ParticleHeaders::
+findNPointsBatchApproximate(const float* centers,const int nQueries,const int nPoints,const float maxRadius,
+    const float epsilon,const int maxVisits,ParticleIndex* points,float* pointDistancesSquared,int* pointCounts) const
+{
+    assert(false);
+}
+
+bool ParticleHeaders::
+visitPointsInRadius(const float center[3],const float radius,PointVisitor& visitor) const
+{
+    assert(false);
+    return true;
+}
+
+void ParticleHeaders::
+findPoints(const char* attributeName,const float* bboxMin,const float* bboxMax,std::vector<ParticleIndex>& points) const
+{
+    assert(false);
+}
+
+int ParticleHeaders::
+findNPoints(const char* attributeName,const float* center,int nPoints,const float maxRadius,
+    ParticleIndex *points,float *pointDistancesSquared,float *finalRadius2) const
+{
+    assert(false);
+    return 0;
+}
+
+void ParticleHeaders::
+findSpheresContaining(const float point[3],std::vector<ParticleIndex>& points) const
+{
+    assert(false);
+}
+
+void ParticleHeaders::
+findSpheresOverlapping(const float bboxMin[3],const float bboxMax[3],std::vector<ParticleIndex>& points) const
+{
+    assert(false);
+}
+
+void ParticleHeaders::
+findPointsAlongRay(const float origin[3],const float direction[3],const float tMin,const float tMax,
+    const float radius,const int maxHits,std::vector<ParticleIndex>& points,std::vector<float>& t) const
+{
+    assert(false);
+}
+
+void ParticleHeaders::
+findPointsAlongRays(const float* origins,const float* directions,const int nRays,const float tMin,
+    const float tMax,const float radius,const int maxHits,ParticleIndex* points,float* t,int* hitCounts) const
+{
+    assert(false);
+}
+
+void ParticleHeaders::
+findSpheresAlongRay(const float origin[3],const float direction[3],const float tMin,const float tMax,
+    const int maxHits,std::vector<ParticleIndex>& points,std::vector<float>& t) const
+{
+    assert(false);
+}
+
+void ParticleHeaders::
+findSpheresAlongRays(const float* origins,const float* directions,const int nRays,const float tMin,
+    const float tMax,const int maxHits,ParticleIndex* points,float* t,int* hitCounts) const
+{
+    assert(false);
+}
+
 ParticleAttribute ParticleHeaders::
 addAttribute(const char* attribute,ParticleAttributeType type,const int count)
 {
@@ -161,7 +288,7 @@ addParticle()
 }
 
 ParticlesDataMutable::iterator ParticleHeaders::
-addParticles(const int countToAdd)
+addParticles(const int64_t countToAdd)
 {
     particleCount+=countToAdd;
     return iterator();
@@ -181,6 +308,26 @@ dataInternalMultiple(const ParticleAttribute& attribute,const int indexCount,
     assert(false);
 }
 
+void ParticleHeaders::
+dataInternalRange(const ParticleAttribute& attribute,const ParticleIndex start,
+    const int64_t count,char* values) const
+{
+    assert(false);
+}
+
+void ParticleHeaders::
+dataWriteInternalRange(const ParticleAttribute& attribute,const ParticleIndex start,
+    const int64_t count,const char* values)
+{
+    assert(false);
+}
+
+void* ParticleHeaders::
+dataInternalContiguous(const ParticleAttribute& attribute) const
+{
+    return 0;
+}
+
 void ParticleHeaders::
 dataAsFloat(const ParticleAttribute& attribute,const int indexCount,
     const ParticleIndex* particleIndices,const bool sorted,float* values) const
@@ -0,0 +1,686 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+
+#ifdef PARTIO_WIN32
+#    define NOMINMAX
+#endif
+
+#include "ParticleMapped.h"
+#include "ParticleCaching.h"
+#include "../io/PartioEndian.h"
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef PARTIO_WIN32
+#    include <fcntl.h>
+#    include <unistd.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#endif
+
+#include "KdTree.h"
+#include "SortIndex.h"
+#include "RayHits.h"
+
+using namespace Partio;
+
+namespace{
+    //! Traces a packet of rays through the KD-Tree
+    struct TracePoints
+    {
+        const KdTree<3>& kdtree;
+        const float radius;
+        TracePoints(const KdTree<3>& kdtree,const float radius):kdtree(kdtree),radius(radius){}
+
+        void operator()(RayHits* hits,const int count) const
+        {kdtree.findPointsAlongRays(hits,count,radius);}
+    };
+
+    //! Asks a PointFilter about the ids the KD-Tree finds
+    struct AcceptFiltered
+    {
+        const PointFilter& filter;
+        AcceptFiltered(const PointFilter& filter):filter(filter){}
+
+        bool operator()(const uint64_t id) const
+        {return filter.accept((ParticleIndex)id);}
+    };
+}
+
+namespace
+{
+    // Makes sure everything written before is visible to threads that see
+    // the pointer published after it
+    inline void publishBarrier()
+    {
+#ifndef PARTIO_WIN32
+        __sync_synchronize();
+#else
+        MemoryBarrier();
+#endif
+    }
+}
+
+ParticlesMapped::
+ParticlesMapped()
+    :particleCount(0),mapping(0),mappingSize(0),
+#ifdef PARTIO_WIN32
+    file(INVALID_HANDLE_VALUE),fileMapping(0),
+#endif
+    kdtree(0)
+{
+}
+
+ParticlesMapped::
+~ParticlesMapped()
+{
+    for(unsigned int i=0;i<attributeData.size();i++) if(attributeOwned[i]) free(attributeData[i]);
+    delete kdtree;
+#ifndef PARTIO_WIN32
+    if(mapping) munmap(mapping,mappingSize);
+#else
+    if(mapping) UnmapViewOfFile(mapping);
+    if(fileMapping) CloseHandle(fileMapping);
+    if(file!=INVALID_HANDLE_VALUE) CloseHandle(file);
+#endif
+}
+
+void ParticlesMapped::
+release() const
+{
+    freeCached(const_cast<ParticlesMapped*>(this));
+}
+
+bool ParticlesMapped::
+open(const char* filename)
+{
+#ifndef PARTIO_WIN32
+    int fd=::open(filename,O_RDONLY);
+    if(fd<0) return false;
+    struct stat info;
+    if(fstat(fd,&info)!=0 || info.st_size==0){
+        close(fd);
+        return false;
+    }
+    void* data=mmap(0,info.st_size,PROT_READ,MAP_SHARED,fd,0);
+    close(fd); // the mapping keeps its own reference to the file
+    if(data==MAP_FAILED) return false;
+    mapping=(char*)data;
+    mappingSize=info.st_size;
+#else
+    file=CreateFileA(filename,GENERIC_READ,FILE_SHARE_READ,0,OPEN_EXISTING,FILE_ATTRIBUTE_NORMAL,0);
+    if(file==INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER size;
+    if(!GetFileSizeEx(file,&size) || size.QuadPart==0) return false;
+    fileMapping=CreateFileMapping(file,0,PAGE_READONLY,0,0,0);
+    if(!fileMapping) return false;
+    mapping=(char*)MapViewOfFile(fileMapping,FILE_MAP_READ,0,0,0);
+    if(!mapping) return false;
+    mappingSize=(size_t)size.QuadPart;
+#endif
+    return true;
+}
+
+void ParticlesMapped::
+setNumParticles(const int64_t count)
+{
+    assert(attributes.empty());
+    particleCount=count;
+}
+
+ParticleAttribute ParticlesMapped::
+addAttribute(const char* attribute,ParticleAttributeType type,const int count,
+    const size_t offset,const int stride,const bool swapEndian)
+{
+    if(nameToAttribute.find(attribute) != nameToAttribute.end()){
+        std::cerr<<"Partio: addAttribute failed because attr '"<<attribute<<"'"<<" already exists"<<std::endl;
+        return ParticleAttribute();
+    }
+    ParticleAttribute attr;
+    attr.name=attribute;
+    attr.type=type;
+    attr.attributeIndex=attributes.size();
+    attr.count=count;
+    attributes.push_back(attr);
+    nameToAttribute[attribute]=attributes.size()-1;
+
+    AttributeLayout layout;
+    layout.offset=offset;
+    layout.stride=stride;
+    layout.swapEndian=swapEndian;
+    attributeLayouts.push_back(layout);
+
+    // contiguous, aligned and native values can be used in place
+    int valueStride=TypeSize(type)*count;
+    bool inPlace=!swapEndian && stride==valueStride && offset%TypeSize(type)==0;
+    attributeStrides.push_back(valueStride);
+    attributeData.push_back(inPlace ? mapping+offset : 0);
+    attributeOwned.push_back(!inPlace);
+    attributeIndexedStrs.push_back(IndexedStrTable());
+
+    return attr;
+}
+
+char* ParticlesMapped::
+attributeBase(const int attributeIndex) const
+{
+    // the slot is filled in once, readers that see it also see the gathered values
+    char* volatile* slot=(char* volatile*)&attributeData[attributeIndex];
+    char* base=loadAcquire(slot);
+    if(base) return base;
+
+    attribute_mutex.lock();
+    if(!*slot){
+        const AttributeLayout& layout=attributeLayouts[attributeIndex];
+        int valueStride=attributeStrides[attributeIndex];
+        int valueSize=TypeSize(attributes[attributeIndex].type);
+        char* values=(char*)malloc(std::max((size_t)1,(size_t)particleCount*valueStride));
+        const char* src=mapping+layout.offset;
+        char* dest=values;
+        for(int64_t i=0;i<particleCount;i++){
+            memcpy(dest,src,valueStride);
+            if(layout.swapEndian){
+                // every supported type is 32 bits wide
+                assert(valueSize==sizeof(int));
+                for(int k=0;k<valueStride;k+=valueSize) endianSwap(*(int*)(dest+k));
+            }
+            src+=layout.stride;
+            dest+=valueStride;
+        }
+        publishBarrier();
+        *slot=values;
+    }
+    base=*slot;
+    attribute_mutex.unlock();
+    return base;
+}
+
+int64_t ParticlesMapped::
+numParticles() const
+{
+    return particleCount;
+}
+
+int ParticlesMapped::
+numAttributes() const
+{
+    return attributes.size();
+}
+
+bool ParticlesMapped::
+attributeInfo(const int attributeIndex,ParticleAttribute& attribute) const
+{
+    if(attributeIndex<0 || attributeIndex>=(int)attributes.size()) return false;
+    attribute=attributes[attributeIndex];
+    return true;
+}
+
+bool ParticlesMapped::
+attributeInfo(const char* attributeName,ParticleAttribute& attribute) const
+{
+    std::map<std::string,int>::const_iterator it=nameToAttribute.find(attributeName);
+    if(it!=nameToAttribute.end()){
+        attribute=attributes[it->second];
+        return true;
+    }
+    return false;
+}
+
+void ParticlesMapped::
+sort(const char* sourceFile)
+{
+    KdTree<3>* built=buildIndex(sourceFile);
+    if(!built) return;
+    kdtree_mutex.lock();
+    publishIndex(built);
+    kdtree_mutex.unlock();
+}
+
+class ParticlesMapped::IndexReader
+{
+    const ParticlesMapped& particles;
+    int slot;
+
+public:
+    const KdTree<3>* kdtree;
+
+    IndexReader(const ParticlesMapped& particles)
+        :particles(particles)
+    {
+        slot=particles.indexReaders.enter();
+        kdtree=particles.kdtree;
+        // the first query builds the tree if sort() was never called
+        if(!kdtree){
+            particles.indexReaders.leave(slot);
+            const_cast<ParticlesMapped&>(particles).ensureIndex();
+            slot=particles.indexReaders.enter();
+            kdtree=particles.kdtree;
+        }
+    }
+
+    ~IndexReader()
+    {
+        particles.indexReaders.leave(slot);
+    }
+};
+
+KdTree<3>* ParticlesMapped::
+buildIndex(const char* sourceFile)
+{
+    ParticleAttribute attr;
+    bool foundPosition=attributeInfo("position",attr);
+    if(!foundPosition){
+        std::cerr<<"Partio: sort, Failed to find position in particle"<<std::endl;
+        return 0;
+    }else if(attr.type!=VECTOR || attr.count!=3){
+        std::cerr<<"Partio: sort, position attribute is not a vector of size 3"<<std::endl;
+        return 0;
+    }
+
+    const float* data=(const float*)attributeBase(attr.attributeIndex);
+    KdTree<3>* built=new KdTree<3>();
+    if(!sourceFile || !loadSortIndex(sourceFile,*built,data,numParticles(),false,Partio::numThreads())){
+        built->setPoints(data,numParticles());
+        built->sort(Partio::numThreads());
+    }
+    return built;
+}
+
+void ParticlesMapped::
+ensureIndex()
+{
+    kdtree_mutex.lock();
+    if(!kdtree){
+        KdTree<3>* built=buildIndex(0);
+        if(built) publishIndex(built);
+    }
+    kdtree_mutex.unlock();
+}
+
+void ParticlesMapped::
+publishIndex(KdTree<3>* newTree)
+{
+    KdTree<3>* old=kdtree;
+    memoryBarrier();
+    kdtree=newTree;
+    if(!old) return;
+    indexReaders.drain();
+    delete old;
+}
+
+bool ParticlesMapped::
+writeSortIndex(const char* filename) const
+{
+    IndexReader reader(*this);
+    const KdTree<3>* kdtree=reader.kdtree;
+    if(!kdtree){ // no usable positions, buildIndex() said why
+        return false;
+    }
+    return saveSortIndex(filename,*kdtree);
+}
+
+void ParticlesMapped::
+findPoints(const float bboxMin[3],const float bboxMax[3],std::vector<ParticleIndex>& points) const
+{
+    IndexReader reader(*this);
+    const KdTree<3>* kdtree=reader.kdtree;
+    if(!kdtree){ // no usable positions, buildIndex() said why
+        return;
+    }
+
+    BBox<3> box(bboxMin);box.grow(bboxMax);
+
+    int startIndex=points.size();
+    kdtree->findPoints(points,box);
+    // remap points found in findPoints to original index space
+    for(unsigned int i=startIndex;i<points.size();i++){
+        points[i]=kdtree->id(points[i]);
+    }
+}
+
+void ParticlesMapped::
+findPointsInConvex(const float* planes,const int nPlanes,std::vector<ParticleIndex>& points) const
+{
+    IndexReader reader(*this);
+    const KdTree<3>* kdtree=reader.kdtree;
+    if(!kdtree){ // no usable positions, buildIndex() said why
+        return;
+    }
+
+    size_t startIndex=points.size();
+    kdtree->findPointsInConvex(points,planes,nPlanes);
+    for(size_t i=startIndex;i<points.size();i++) points[i]=kdtree->id(points[i]);
+}
+
+float ParticlesMapped::
+findNPoints(const float center[3],const int nPoints,const float maxRadius,std::vector<ParticleIndex>& points,
+    std::vector<float>& pointDistancesSquared) const
+{
+    IndexReader reader(*this);
+    const KdTree<3>* kdtree=reader.kdtree;
+    if(!kdtree){ // no usable positions, buildIndex() said why
+        return 0;
+    }
+
+    float maxDistance=kdtree->findNPoints(points,pointDistancesSquared,center,nPoints,maxRadius);
+    // remap all points since findNPoints clears array
+    for(unsigned int i=0;i<points.size();i++) points[i]=kdtree->id(points[i]);
+    return maxDistance;
+}
+
+int ParticlesMapped::
+findNPoints(const float center[3],int nPoints,const float maxRadius, ParticleIndex *points,
+    float *pointDistancesSquared, float *finalRadius2) const
+{
+    IndexReader reader(*this);
+    const KdTree<3>* kdtree=reader.kdtree;
+    if(!kdtree){ // no usable positions, buildIndex() said why
+        return 0;
+    }
+
+    int count=kdtree->findNPoints(points,pointDistancesSquared,finalRadius2,center,nPoints,maxRadius);
+    // remap all points since findNPoints clears array
+    for(int i=0;i<count;i++) points[i]=kdtree->id(points[i]);
+    return count;
+}
+
+int ParticlesMapped::
+findNPoints(const float center[3],int nPoints,const float maxRadius,const PointFilter& filter,
+    ParticleIndex *points,float *pointDistancesSquared,float *finalRadius2) const
+{
+    IndexReader reader(*this);
+    const KdTree<3>* kdtree=reader.kdtree;
+    if(!kdtree){ // no usable positions, buildIndex() said why
+        return 0;
+    }
+
+    int count=kdtree->findNPointsFiltered(points,pointDistancesSquared,finalRadius2,center,nPoints,maxRadius,
+        AcceptFiltered(filter));
+    for(int i=0;i<count;i++) points[i]=kdtree->id(points[i]);
+    return count;
+}
+
+void ParticlesMapped::
+findNPointsBatch(const float* centers,const int nQueries,const int nPoints,const float maxRadius,
+    ParticleIndex* points,float* pointDistancesSquared,int* pointCounts) const
+{
+    IndexReader reader(*this);
+    const KdTree<3>* kdtree=reader.kdtree;
+    if(!kdtree){ // no usable positions, buildIndex() said why
+        for(int q=0;q<nQueries;q++) pointCounts[q]=0;
+        return;
+    }
+
+    kdtree->findNPointsBatch(points,pointDistancesSquared,pointCounts,centers,nQueries,nPoints,
+        maxRadius,Partio::numThreads());
+}
+
+int ParticlesMapped::
+findNPointsApproximate(const float center[3],int nPoints,const float maxRadius,const float epsilon,
+    const int maxVisits,ParticleIndex *points,float *pointDistancesSquared,float *finalRadius2) const
+{
+    IndexReader reader(*this);
+    const KdTree<3>* kdtree=reader.kdtree;
+    if(!kdtree){ // no usable positions, buildIndex() said why
+        return 0;
+    }
+
+    int count=kdtree->findNPoints(points,pointDistancesSquared,finalRadius2,center,nPoints,maxRadius,
+        epsilon,maxVisits);
+    for(int i=0;i<count;i++) points[i]=kdtree->id(points[i]);
+    return count;
+}
+
+void ParticlesMapped::
+findNPointsBatchApproximate(const float* centers,const int nQueries,const int nPoints,const float maxRadius,
+    const float epsilon,const int maxVisits,ParticleIndex* points,float* pointDistancesSquared,int* pointCounts) const
+{
+    IndexReader reader(*this);
+    const KdTree<3>* kdtree=reader.kdtree;
+    if(!kdtree){ // no usable positions, buildIndex() said why
+        for(int q=0;q<nQueries;q++) pointCounts[q]=0;
+        return;
+    }
+
+    kdtree->findNPointsBatch(points,pointDistancesSquared,pointCounts,centers,nQueries,nPoints,
+        maxRadius,Partio::numThreads(),epsilon,maxVisits);
+}
+
+bool ParticlesMapped::
+visitPointsInRadius(const float center[3],const float radius,PointVisitor& visitor) const
+{
+    IndexReader reader(*this);
+    const KdTree<3>* kdtree=reader.kdtree;
+    if(!kdtree){ // no usable positions, buildIndex() said why
+        return true;
+    }
+
+    return kdtree->visitPointsInRadius(center,radius,visitor);
+}
+
+void ParticlesMapped::
+findPoints(const char* attributeName,const float* bboxMin,const float* bboxMax,std::vector<ParticleIndex>& points) const
+{
+    if(strcmp(attributeName,"position")){
+        std::cerr<<"Partio: mapped particles can only be searched by position, read() them to search by "<<attributeName<<std::endl;
+        return;
+    }
+    findPoints(bboxMin,bboxMax,points);
+}
+
+int ParticlesMapped::
+findNPoints(const char* attributeName,const float* center,int nPoints,const float maxRadius,
+    ParticleIndex *points,float *pointDistancesSquared,float *finalRadius2) const
+{
+    if(strcmp(attributeName,"position")){
+        std::cerr<<"Partio: mapped particles can only be searched by position, read() them to search by "<<attributeName<<std::endl;
+        return 0;
+    }
+    return findNPoints(center,nPoints,maxRadius,points,pointDistancesSquared,finalRadius2);
+}
+
+void ParticlesMapped::
+findSpheresContaining(const float point[3],std::vector<ParticleIndex>& points) const
+{
+    std::cerr<<"Partio: mapped particles can't be searched by sphere, read() them to call sortSpheres()"<<std::endl;
+}
+
+void ParticlesMapped::
+findSpheresOverlapping(const float bboxMin[3],const float bboxMax[3],std::vector<ParticleIndex>& points) const
+{
+    std::cerr<<"Partio: mapped particles can't be searched by sphere, read() them to call sortSpheres()"<<std::endl;
+}
+
+void ParticlesMapped::
+findPointsAlongRay(const float origin[3],const float direction[3],const float tMin,const float tMax,
+    const float radius,const int maxHits,std::vector<ParticleIndex>& points,std::vector<float>& t) const
+{
+    points.clear();t.clear();
+    IndexReader reader(*this);
+    const KdTree<3>* kdtree=reader.kdtree;
+    if(!kdtree){ // no usable positions, buildIndex() said why
+        return;
+    }
+
+    RayHits hits(origin,direction,tMin,tMax,maxHits);
+    kdtree->findPointsAlongRays(&hits,1,radius);
+    hits.finish(points,t);
+}
+
+void ParticlesMapped::
+findPointsAlongRays(const float* origins,const float* directions,const int nRays,const float tMin,
+    const float tMax,const float radius,const int maxHits,ParticleIndex* points,float* t,int* hitCounts) const
+{
+    IndexReader reader(*this);
+    const KdTree<3>* kdtree=reader.kdtree;
+    if(!kdtree){ // no usable positions, buildIndex() said why
+        for(int r=0;r<nRays;r++) hitCounts[r]=0;
+        return;
+    }
+
+    traceRays(TracePoints(*kdtree,radius),origins,directions,nRays,KdTree<3>::rayPacketSize,
+        tMin,tMax,maxHits,points,t,hitCounts,Partio::numThreads());
+}
+
+void ParticlesMapped::
+findSpheresAlongRay(const float origin[3],const float direction[3],const float tMin,const float tMax,
+    const int maxHits,std::vector<ParticleIndex>& points,std::vector<float>& t) const
+{
+    points.clear();t.clear();
+    std::cerr<<"Partio: mapped particles can't be searched by sphere, read() them to call sortSpheres()"<<std::endl;
+}
+
+void ParticlesMapped::
+findSpheresAlongRays(const float* origins,const float* directions,const int nRays,const float tMin,
+    const float tMax,const int maxHits,ParticleIndex* points,float* t,int* hitCounts) const
+{
+    std::cerr<<"Partio: mapped particles can't be searched by sphere, read() them to call sortSpheres()"<<std::endl;
+    for(int r=0;r<nRays;r++) hitCounts[r]=0;
+}
+
+ParticlesData::const_iterator ParticlesMapped::
+setupConstIterator() const
+{
+    if(numParticles()==0) return ParticlesData::const_iterator();
+    return ParticlesData::const_iterator(this,0,numParticles()-1);
+}
+
+void ParticlesMapped::
+setupIteratorNextBlock(Partio::ParticleIterator<false>& iterator)
+{
+    iterator=ParticleIterator<false>();
+}
+
+void ParticlesMapped::
+setupIteratorNextBlock(Partio::ParticleIterator<true>& iterator) const
+{
+    iterator=ParticlesData::end();
+}
+
+void ParticlesMapped::
+setupAccessor(Partio::ParticleIterator<false>& iterator,ParticleAccessor& accessor)
+{
+    assert(false); // read only
+}
+
+void ParticlesMapped::
+setupAccessor(Partio::ParticleIterator<true>& iterator,ParticleAccessor& accessor) const
+{
+    accessor.stride=attributeStrides[accessor.attributeIndex];
+    accessor.basePointer=attributeBase(accessor.attributeIndex);
+}
+
+void* ParticlesMapped::
+dataInternal(const ParticleAttribute& attribute,const ParticleIndex particleIndex) const
+{
+    assert(attribute.attributeIndex>=0 && attribute.attributeIndex<(int)attributes.size());
+    return attributeBase(attribute.attributeIndex)+attributeStrides[attribute.attributeIndex]*particleIndex;
+}
+
+void ParticlesMapped::
+dataInternalMultiple(const ParticleAttribute& attribute,const int indexCount,
+    const ParticleIndex* particleIndices,const bool sorted,char* values) const
+{
+    assert(attribute.attributeIndex>=0 && attribute.attributeIndex<(int)attributes.size());
+
+    char* base=attributeBase(attribute.attributeIndex);
+    int bytes=attributeStrides[attribute.attributeIndex];
+    for(int i=0;i<indexCount;i++)
+        memcpy(values+bytes*i,base+particleIndices[i]*bytes,bytes);
+}
+
+void ParticlesMapped::
+dataInternalRange(const ParticleAttribute& attribute,const ParticleIndex start,
+    const int64_t count,char* values) const
+{
+    assert(attribute.attributeIndex>=0 && attribute.attributeIndex<(int)attributes.size());
+    assert(start+count<=(ParticleIndex)particleCount);
+
+    int bytes=attributeStrides[attribute.attributeIndex];
+    memcpy(values,attributeBase(attribute.attributeIndex)+start*bytes,(size_t)count*bytes);
+}
+
+void* ParticlesMapped::
+dataInternalContiguous(const ParticleAttribute& attribute) const
+{
+    assert(attribute.attributeIndex>=0 && attribute.attributeIndex<(int)attributes.size());
+    // values are always packed, either in place in the mapping or gathered
+    return attributeBase(attribute.attributeIndex);
+}
+
+void ParticlesMapped::
+dataAsFloat(const ParticleAttribute& attribute,const int indexCount,
+    const ParticleIndex* particleIndices,const bool sorted,float* values) const
+{
+    assert(attribute.attributeIndex>=0 && attribute.attributeIndex<(int)attributes.size());
+
+    if(attribute.type==FLOAT || attribute.type==VECTOR) dataInternalMultiple(attribute,indexCount,particleIndices,sorted,(char*)values);
+    else if(attribute.type==INT || attribute.type==INDEXEDSTR){
+        const int* attrbase=(const int*)attributeBase(attribute.attributeIndex);
+        int count=attribute.count;
+        for(int i=0;i<indexCount;i++) for(int k=0;k<count;k++) values[i*count+k]=(int)attrbase[particleIndices[i]*count+k];
+    }
+}
+
+int ParticlesMapped::
+registerIndexedStr(const ParticleAttribute& attribute,const char* str)
+{
+    IndexedStrTable& table=attributeIndexedStrs[attribute.attributeIndex];
+    std::map<std::string,int>::const_iterator it=table.stringToIndex.find(str);
+    if(it!=table.stringToIndex.end()) return it->second;
+    int newIndex=table.strings.size();
+    table.strings.push_back(str);
+    table.stringToIndex[str]=newIndex;
+    return newIndex;
+}
+
+int ParticlesMapped::
+lookupIndexedStr(const ParticleAttribute& attribute,const char* str) const
+{
+    const IndexedStrTable& table=attributeIndexedStrs[attribute.attributeIndex];
+    std::map<std::string,int>::const_iterator it=table.stringToIndex.find(str);
+    if(it!=table.stringToIndex.end()) return it->second;
+    return -1;
+}
+
+const std::vector<std::string>& ParticlesMapped::
+indexedStrs(const ParticleAttribute& attr) const
+{
+    const IndexedStrTable& table=attributeIndexedStrs[attr.attributeIndex];
+    return table.strings;
+}
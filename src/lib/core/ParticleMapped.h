@@ -0,0 +1,190 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+
+#ifndef _ParticleMapped_h_
+#define _ParticleMapped_h_
+
+#include <string>
+#include <vector>
+#include <map>
+#include "Mutex.h"
+#include "../Partio.h"
+
+namespace Partio{
+
+template<int d> class KdTree;
+
+//! Read only particle set whose attributes live in a memory mapped file
+/*!
+  Readers describe where each attribute's values sit in the file. Attributes
+  stored contiguously, aligned and in native byte order are handed out
+  straight from the mapping. Anything else (interleaved records, foreign
+  endianness) is gathered into a private array the first time it is touched.
+*/
+class ParticlesMapped:public ParticlesData,
+                      public Provider
+{
+protected:
+    virtual ~ParticlesMapped();
+public:
+    using ParticlesData::const_iterator;
+
+    void release() const;
+
+    ParticlesMapped();
+
+    //! Maps the file into memory. Returns false if the file can't be mapped.
+    bool open(const char* filename);
+    //! Start of the mapped file
+    const char* mappedData() const {return mapping;}
+    //! Size of the mapped file in bytes
+    size_t mappedSize() const {return mappingSize;}
+
+    //! Sets the number of particles, call before adding attributes
+    void setNumParticles(const int64_t count);
+    //! Adds an attribute whose values for particle i start at byte
+    //! offset+i*stride of the file. swapEndian says the values are stored
+    //! in the other byte order from this machine's.
+    ParticleAttribute addAttribute(const char* attribute,ParticleAttributeType type,const int count,
+        const size_t offset,const int stride,const bool swapEndian);
+    int registerIndexedStr(const ParticleAttribute& attribute,const char* str);
+    //! Builds the KD-Tree used by findPoints()/findNPoints(), loading it from
+    //! the sort index of sourceFile instead if one matches it. Queries build it
+    //! on first use if sort() wasn't called
+    void sort(const char* sourceFile=0);
+    //! Saves the KD-Tree as the sort index of filename, see Partio::writeSortIndex()
+    bool writeSortIndex(const char* filename) const;
+
+    int numAttributes() const;
+    int64_t numParticles() const;
+    bool attributeInfo(const char* attributeName,ParticleAttribute& attribute) const;
+    bool attributeInfo(const int attributeInfo,ParticleAttribute& attribute) const;
+    void dataAsFloat(const ParticleAttribute& attribute,const int indexCount,
+        const ParticleIndex* particleIndices,const bool sorted,float* values) const;
+    int lookupIndexedStr(const ParticleAttribute& attribute,const char* str) const;
+    const std::vector<std::string>& indexedStrs(const ParticleAttribute& attr) const;
+    void findPoints(const float bboxMin[3],const float bboxMax[3],std::vector<ParticleIndex>& points) const;
+    void findPointsInConvex(const float* planes,const int nPlanes,std::vector<ParticleIndex>& points) const;
+    float findNPoints(const float center[3],int nPoints,const float maxRadius,
+        std::vector<ParticleIndex>& points,std::vector<float>& pointDistancesSquared) const;
+    int findNPoints(const float center[3],int nPoints,const float maxRadius,
+        ParticleIndex *points, float *pointDistancesSquared, float *finalRadius2) const;
+    int findNPoints(const float center[3],int nPoints,const float maxRadius,const PointFilter& filter,
+        ParticleIndex *points,float *pointDistancesSquared,float *finalRadius2) const;
+    void findNPointsBatch(const float* centers,const int nQueries,const int nPoints,
+        const float maxRadius,ParticleIndex* points,float* pointDistancesSquared,int* pointCounts) const;
+    int findNPointsApproximate(const float center[3],int nPoints,const float maxRadius,
+        const float epsilon,const int maxVisits,ParticleIndex *points,float *pointDistancesSquared,
+        float *finalRadius2) const;
+    void findNPointsBatchApproximate(const float* centers,const int nQueries,const int nPoints,
+        const float maxRadius,const float epsilon,const int maxVisits,ParticleIndex* points,
+        float* pointDistancesSquared,int* pointCounts) const;
+    bool visitPointsInRadius(const float center[3],const float radius,PointVisitor& visitor) const;
+    void findPoints(const char* attributeName,const float* bboxMin,const float* bboxMax,
+        std::vector<ParticleIndex>& points) const;
+    int findNPoints(const char* attributeName,const float* center,int nPoints,const float maxRadius,
+        ParticleIndex *points,float *pointDistancesSquared,float *finalRadius2) const;
+    void findSpheresContaining(const float point[3],std::vector<ParticleIndex>& points) const;
+    void findSpheresOverlapping(const float bboxMin[3],const float bboxMax[3],std::vector<ParticleIndex>& points) const;
+    void findPointsAlongRay(const float origin[3],const float direction[3],const float tMin,
+        const float tMax,const float radius,const int maxHits,std::vector<ParticleIndex>& points,
+        std::vector<float>& t) const;
+    void findPointsAlongRays(const float* origins,const float* directions,const int nRays,
+        const float tMin,const float tMax,const float radius,const int maxHits,
+        ParticleIndex* points,float* t,int* hitCounts) const;
+    void findSpheresAlongRay(const float origin[3],const float direction[3],const float tMin,
+        const float tMax,const int maxHits,std::vector<ParticleIndex>& points,std::vector<float>& t) const;
+    void findSpheresAlongRays(const float* origins,const float* directions,const int nRays,
+        const float tMin,const float tMax,const int maxHits,ParticleIndex* points,float* t,
+        int* hitCounts) const;
+
+    const_iterator setupConstIterator() const;
+    void setupIteratorNextBlock(Partio::ParticleIterator<false>& iterator);
+    void setupIteratorNextBlock(Partio::ParticleIterator<true>& iterator) const;
+    void setupAccessor(Partio::ParticleIterator<false>& iterator,ParticleAccessor& accessor);
+    void setupAccessor(Partio::ParticleIterator<true>& iterator,ParticleAccessor& accessor) const;
+private:
+    void* dataInternal(const ParticleAttribute& attribute,const ParticleIndex particleIndex) const;
+    void dataInternalMultiple(const ParticleAttribute& attribute,const int indexCount,
+        const ParticleIndex* particleIndices,const bool sorted,char* values) const;
+    void dataInternalRange(const ParticleAttribute& attribute,const ParticleIndex start,
+        const int64_t count,char* values) const;
+    void* dataInternalContiguous(const ParticleAttribute& attribute) const;
+    char* attributeBase(const int attributeIndex) const;
+    //! Registers a query as reading the current KD-Tree for its lifetime
+    class IndexReader;
+    //! Builds the KD-Tree over the positions, or reports why not and returns null
+    KdTree<3>* buildIndex(const char* sourceFile);
+    //! Builds the KD-Tree unless there already is one
+    void ensureIndex();
+    //! Publishes newTree and frees the old one once no query can still be reading it.
+    //! Callers hold kdtree_mutex
+    void publishIndex(KdTree<3>* newTree);
+
+private:
+    int64_t particleCount;
+    char* mapping;
+    size_t mappingSize;
+#ifdef PARTIO_WIN32
+    HANDLE file;
+    HANDLE fileMapping;
+#endif
+    struct AttributeLayout{
+        size_t offset;
+        int stride;
+        bool swapEndian;
+    };
+    std::vector<AttributeLayout> attributeLayouts;
+    mutable std::vector<char*> attributeData; // null until the attribute is first touched, see attributeBase()
+    std::vector<bool> attributeOwned; // whether attributeData was allocated here
+    std::vector<int> attributeStrides;
+    struct IndexedStrTable{
+        std::map<std::string,int> stringToIndex;
+        std::vector<std::string> strings;
+    };
+    std::vector<IndexedStrTable> attributeIndexedStrs;
+    std::vector<ParticleAttribute> attributes;
+    std::map<std::string,int> nameToAttribute;
+
+    mutable PartioMutex attribute_mutex;
+    // Queries never lock, they count themselves in indexReaders and sort() waits for
+    // them to drain before freeing the tree it replaces
+    PartioMutex kdtree_mutex; // serializes writers of kdtree
+    KdTree<3>* volatile kdtree;
+    ReaderEpoch indexReaders;
+};
+
+}
+#endif
@@ -43,15 +43,58 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
 #include <algorithm>
 #include <cassert>
 #include <iostream>
+#include <string.h>
 
 #include "KdTree.h"
+#include "HashGrid.h"
+#include "SortIndex.h"
+#include "AttributeTree.h"
+#include "SphereBVH.h"
+#include "RayHits.h"
 
 
 using namespace Partio;
 
+namespace{
+    //! Traces a packet of rays through whichever position index a query is reading
+    struct TracePoints
+    {
+        const KdTree<3>* kdtree;
+        const HashGrid* grid;
+        const float radius;
+        TracePoints(const KdTree<3>* kdtree,const HashGrid* grid,const float radius)
+            :kdtree(kdtree),grid(grid),radius(radius){}
+
+        void operator()(RayHits* hits,const int count) const
+        {
+            if(grid) for(int r=0;r<count;r++) grid->findPointsAlongRay(hits[r],radius);
+            else kdtree->findPointsAlongRays(hits,count,radius);
+        }
+    };
+
+    struct TraceSpheres
+    {
+        const SphereBVH* spheres;
+        TraceSpheres(const SphereBVH* spheres):spheres(spheres){}
+
+        void operator()(RayHits* hits,const int count) const
+        {spheres->findSpheresAlongRays(hits,count);}
+    };
+
+    //! Asks a PointFilter about the ids the KD-Tree finds
+    struct AcceptFiltered
+    {
+        const PointFilter& filter;
+        AcceptFiltered(const PointFilter& filter):filter(filter){}
+
+        bool operator()(const uint64_t id) const
+        {return filter.accept((ParticleIndex)id);}
+    };
+}
+
 ParticlesSimple::
 ParticlesSimple()
-    :particleCount(0),allocatedCount(0),kdtree(0)
+    :particleCount(0),allocatedCount(0),index(0)
 {
 }
 
@@ -59,7 +102,7 @@ ParticlesSimple::
 ~ParticlesSimple()
 {
     for(unsigned int i=0;i<attributeData.size();i++) free(attributeData[i]);
-    delete kdtree;
+    delete index;
 }
 
 void ParticlesSimple::
@@ -68,7 +111,7 @@ release() const
     freeCached(const_cast<ParticlesSimple*>(this));
 }
 
-int ParticlesSimple::
+int64_t ParticlesSimple::
 numParticles() const
 {
     return particleCount;
@@ -102,39 +145,381 @@ attributeInfo(const char* attributeName,ParticleAttribute& attribute) const
 
 void ParticlesSimple::
 sort()
+{
+    sort(SortOptions());
+}
+
+void ParticlesSimple::
+sort(const SortOptions& options)
+{
+    Index* built=buildIndex(options);
+    if(!built) return;
+    kdtree_mutex.lock();
+    built->shareAttributeIndices(index);
+    publishIndex(built);
+    kdtree_mutex.unlock();
+}
+
+void ParticlesSimple::
+sort(const char* attributeName)
+{
+    if(!attributeName || !strcmp(attributeName,"position")){
+        sort();
+        return;
+    }
+    AttributeTree* tree=buildAttributeTree(attributeName);
+    if(!tree) return;
+    kdtree_mutex.lock();
+    publishAttributeTree(attributeName,tree);
+    kdtree_mutex.unlock();
+}
+
+void ParticlesSimple::
+sortSpheres(const char* radiusAttribute)
+{
+    ParticleAttribute positionAttr,radiusAttr;
+    if(!attributeInfo("position",positionAttr) || positionAttr.type!=VECTOR || positionAttr.count!=3){
+        std::cerr<<"Partio: sortSpheres, position attribute is missing or not a vector of size 3"<<std::endl;
+        return;
+    }else if(!attributeInfo(radiusAttribute,radiusAttr) || radiusAttr.type!=FLOAT || radiusAttr.count!=1){
+        std::cerr<<"Partio: sortSpheres, radius attribute "<<radiusAttribute<<" is missing or not a single float"<<std::endl;
+        return;
+    }
+
+    SphereBVH* spheres=new SphereBVH();
+    spheres->build(data<float>(positionAttr,0),data<float>(radiusAttr,0),numParticles(),Partio::numThreads());
+    kdtree_mutex.lock();
+    Index* updated=index ? new Index(index->kdtree,index->grid) : new Index(0,0);
+    updated->shareAttributeIndices(index);
+    updated->spheres=spheres;
+    updated->sphereRadius=radiusAttribute;
+    publishIndex(updated);
+    kdtree_mutex.unlock();
+}
+
+ParticlesSimple::Index::
+Index(KdTree<3>* kdtree,HashGrid* grid)
+    :kdtree(kdtree),grid(grid),spheres(0)
+{}
+
+ParticlesSimple::Index::
+~Index()
+{
+    delete kdtree;
+    delete grid;
+    for(std::map<std::string,AttributeTree*>::iterator i=trees.begin();i!=trees.end();++i) delete i->second;
+    delete spheres;
+}
+
+void ParticlesSimple::Index::
+shareAttributeIndices(const Index* other)
+{
+    if(!other) return;
+    trees=other->trees;
+    spheres=other->spheres;
+    sphereRadius=other->sphereRadius;
+}
+
+class ParticlesSimple::IndexReader
+{
+    const ParticlesSimple& particles;
+    int slot;
+    const Index* current;
+
+    void enter()
+    {
+        slot=particles.indexReaders.enter();
+        current=particles.index;
+        kdtree=current ? current->kdtree : 0;
+        grid=current ? current->grid : 0;
+        spheres=current ? current->spheres : 0;
+    }
+
+    void leave()
+    {
+        particles.indexReaders.leave(slot);
+    }
+
+    const AttributeTree* findTree(const char* attributeName) const
+    {
+        if(!current) return 0;
+        std::map<std::string,AttributeTree*>::const_iterator i=current->trees.find(attributeName);
+        return i!=current->trees.end() ? i->second : 0;
+    }
+
+public:
+    const KdTree<3>* kdtree;
+    const HashGrid* grid;
+    const AttributeTree* tree;
+    const SphereBVH* spheres;
+
+    //! Every attribute tree of the index being read, null without an index
+    const std::map<std::string,AttributeTree*>* trees() const
+    {return current ? &current->trees : 0;}
+
+    IndexReader(const ParticlesSimple& particles,const bool build=true)
+        :particles(particles),tree(0)
+    {
+        enter();
+        // the first query builds the index if sort() was never called
+        if(build && !kdtree && !grid){
+            leave();
+            const_cast<ParticlesSimple&>(particles).ensureIndex();
+            enter();
+        }
+    }
+
+    //! Reads the tree over attributeName, built first if sort(attributeName) wasn't called
+    IndexReader(const ParticlesSimple& particles,const char* attributeName)
+        :particles(particles),tree(0)
+    {
+        enter();
+        tree=findTree(attributeName);
+        if(!tree){
+            leave();
+            const_cast<ParticlesSimple&>(particles).ensureAttributeTree(attributeName);
+            enter();
+            tree=findTree(attributeName);
+        }
+    }
+
+    ~IndexReader()
+    {
+        leave();
+    }
+};
+
+ParticlesSimple::Index* ParticlesSimple::
+buildIndex(const SortOptions& options)
 {
     ParticleAttribute attr;
     bool foundPosition=attributeInfo("position",attr);
     if(!foundPosition){
         std::cerr<<"Partio: sort, Failed to find position in particle"<<std::endl;
-        return;
+        return 0;
     }else if(attr.type!=VECTOR || attr.count!=3){
         std::cerr<<"Partio: sort, position attribute is not a vector of size 3"<<std::endl;
-        return;
+        return 0;
     }
 
     const ParticleIndex baseParticleIndex=0;
     const float* data=this->data<float>(attr,baseParticleIndex); // contiguous assumption used here
-    KdTree<3>* kdtree_temp=new KdTree<3>();
-    kdtree_temp->setPoints(data,numParticles());
-    kdtree_temp->sort();
+    if(options.index==HASHGRID){
+        if(!(options.cellSize>0)){
+            std::cerr<<"Partio: sort, hash grid needs a positive cellSize"<<std::endl;
+            return 0;
+        }
+        HashGrid* grid=new HashGrid();
+        grid->build(data,numParticles(),options.cellSize,Partio::numThreads());
+        return new Index(0,grid);
+    }
 
+    KdTree<3>* kdtree=new KdTree<3>();
+    if(!options.sourceFile
+        || !loadSortIndex(options.sourceFile,*kdtree,data,numParticles(),options.compact,Partio::numThreads())){
+        kdtree->setPoints(data,numParticles(),options.compact);
+        kdtree->sort(Partio::numThreads());
+    }
+    return new Index(kdtree,0);
+}
+
+void ParticlesSimple::
+ensureIndex()
+{
+    kdtree_mutex.lock();
+    if(!index || (!index->kdtree && !index->grid)){
+        Index* built=buildIndex(SortOptions());
+        if(built){
+            built->shareAttributeIndices(index);
+            publishIndex(built);
+        }
+    }
+    kdtree_mutex.unlock();
+}
+
+AttributeTree* ParticlesSimple::
+buildAttributeTree(const char* attributeName)
+{
+    ParticleAttribute attr;
+    if(!attributeInfo(attributeName,attr)){
+        std::cerr<<"Partio: sort, Failed to find attribute "<<attributeName<<" in particle"<<std::endl;
+        return 0;
+    }else if((attr.type!=VECTOR && attr.type!=FLOAT) || attr.count<1 || attr.count>4){
+        std::cerr<<"Partio: sort, attribute "<<attributeName<<" is not a float or vector of 1 to 4 components"<<std::endl;
+        return 0;
+    }
+    const float* data=this->data<float>(attr,0); // contiguous assumption used here
+    return AttributeTree::build(data,numParticles(),attr.count,Partio::numThreads());
+}
+
+void ParticlesSimple::
+ensureAttributeTree(const char* attributeName)
+{
+    kdtree_mutex.lock();
+    if(!index || index->trees.find(attributeName)==index->trees.end()){
+        AttributeTree* tree=buildAttributeTree(attributeName);
+        if(tree){
+            publishAttributeTree(attributeName,tree);
+        }
+    }
+    kdtree_mutex.unlock();
+}
+
+ParticlesSimple::Index* ParticlesSimple::
+exchangeIndex(Index* newIndex)
+{
+    Index* old=index;
+    memoryBarrier();
+    index=newIndex;
+    if(!old) return 0;
+    indexReaders.drain();
+    return old;
+}
+
+void ParticlesSimple::
+publishIndex(Index* updated)
+{
+    Index* old=exchangeIndex(updated);
+    if(!old) return;
+    // hand what updated shares over to it before freeing the rest
+    if(updated){
+        if(old->kdtree==updated->kdtree) old->kdtree=0;
+        if(old->grid==updated->grid) old->grid=0;
+        if(old->spheres==updated->spheres) old->spheres=0;
+        for(std::map<std::string,AttributeTree*>::iterator i=updated->trees.begin();i!=updated->trees.end();++i){
+            std::map<std::string,AttributeTree*>::iterator shared=old->trees.find(i->first);
+            if(shared!=old->trees.end() && shared->second==i->second) old->trees.erase(shared);
+        }
+    }
+    delete old;
+}
+
+void ParticlesSimple::
+publishAttributeTree(const char* attributeName,AttributeTree* tree)
+{
+    Index* updated=index ? new Index(index->kdtree,index->grid) : new Index(0,0);
+    updated->shareAttributeIndices(index);
+    updated->trees[attributeName]=tree;
+    publishIndex(updated);
+}
+
+namespace
+{
+//! Gathers every attribute into KD-Tree order, one chunk of one attribute per task
+struct ReorderAttributeTask
+{
+    const KdTree<3>& tree;
+    const std::vector<char*>& from;
+    std::vector<char*>& to;
+    const std::vector<int>& strides;
+    const int64_t numParticles,chunkSize;
+    const int chunksPerAttribute;
+
+    ReorderAttributeTask(const KdTree<3>& tree,const std::vector<char*>& from,std::vector<char*>& to,
+        const std::vector<int>& strides,const int64_t numParticles,const int64_t chunkSize,const int chunksPerAttribute)
+        :tree(tree),from(from),to(to),strides(strides),numParticles(numParticles),
+        chunkSize(chunkSize),chunksPerAttribute(chunksPerAttribute)
+    {}
+
+    void operator()(int task)
+    {
+        const int attr=task/chunksPerAttribute;
+        const int64_t begin=(task%chunksPerAttribute)*chunkSize;
+        const int64_t end=std::min(numParticles,begin+chunkSize);
+        const int stride=strides[attr];
+        const char* src=from[attr];
+        char* dest=to[attr]+begin*stride;
+        for(int64_t i=begin;i<end;i++,dest+=stride) memcpy(dest,src+tree.id(i)*stride,stride);
+    }
+};
+}
+
+void ParticlesSimple::
+reorder()
+{
+    // the points are permuted below anyway, so the tree doesn't need its own copy
+    sort(SortOptions(true));
+    ParticleAttribute positionAttr;
+    if(!index || !index->kdtree || !attributeInfo("position",positionAttr)) return; // sort() reported why
+    KdTree<3>* kdtree=index->kdtree;
+
+    const int64_t chunkSize=1<<16;
+    const int chunks=(int)((particleCount+chunkSize-1)/chunkSize);
+    std::vector<char*> reordered(attributes.size());
+    for(unsigned int i=0;i<attributes.size();i++)
+        reordered[i]=(char*)malloc((size_t)attributeStrides[i]*(size_t)allocatedCount);
+    ReorderAttributeTask task(*kdtree,attributeData,reordered,attributeStrides,particleCount,chunkSize,chunks);
+    parallelFor(chunks*(int)attributes.size(),task,Partio::numThreads());
+
+    for(unsigned int i=0;i<attributes.size();i++){
+        free(attributeData[i]);
+        attributeData[i]=reordered[i];
+        attributeOffsets[i]=attributeData[i]-(char*)0;
+    }
+    // storage is now in tree order, so the tree can drop its ids and point copy
+    kdtree->adoptOrder((const float*)attributeData[positionAttr.attributeIndex]);
+
+    // attribute trees still hold the old indices
+    std::vector<std::string> treeNames;
+    for(std::map<std::string,AttributeTree*>::iterator i=index->trees.begin();i!=index->trees.end();++i)
+        treeNames.push_back(i->first);
+    for(size_t i=0;i<treeNames.size();i++) sort(treeNames[i].c_str());
+    if(index->spheres){
+        const std::string radius=index->sphereRadius;
+        sortSpheres(radius.c_str());
+    }
+}
+
+void ParticlesSimple::
+updateSort()
+{
+    if(index && index->grid){
+        // grids are cheap to build, there is nothing to keep
+        sort(SortOptions(HASHGRID,index->grid->cellSize()));
+        return;
+    }
+    ParticleAttribute attr;
+    KdTree<3>* kdtree=index ? index->kdtree : 0;
+    if(!kdtree || !attributeInfo("position",attr) || attr.type!=VECTOR || attr.count!=3){
+        sort(); // reports what is missing
+        return;
+    }
+
+    const float* data=this->data<float>(attr,0);
+    if(kdtree->update(data,numParticles(),Partio::numThreads())) return;
+    // storage is in tree order unless the count changed
+    if(kdtree->size()==numParticles()) reorder();
+    else sort(SortOptions(kdtree->compact()));
+}
+
+void ParticlesSimple::
+releaseInPlaceTree()
+{
     kdtree_mutex.lock();
-    // TODO: this is not threadsafe!
-    if(kdtree) delete kdtree;
-    kdtree=kdtree_temp;
+    if(index && index->kdtree && !index->kdtree->ownsPoints()){
+        // attribute trees and spheres keep their own copies, so they stay
+        Index* updated=new Index(0,0);
+        updated->shareAttributeIndices(index);
+        publishIndex(updated);
+    }
     kdtree_mutex.unlock();
 }
 
 void ParticlesSimple::
 findPoints(const float bboxMin[3],const float bboxMax[3],std::vector<ParticleIndex>& points) const
 {
-    if(!kdtree){
-        std::cerr<<"Partio: findPoints without first calling sort()"<<std::endl;
+    IndexReader reader(*this);
+    const KdTree<3>* kdtree=reader.kdtree;
+    const HashGrid* grid=reader.grid;
+    if(!kdtree && !grid){ // no usable positions, buildIndex() said why
         return;
     }
 
     BBox<3> box(bboxMin);box.grow(bboxMax);
+    if(grid){
+        grid->findPoints(points,box);
+        return;
+    }
 
     int startIndex=points.size();
     kdtree->findPoints(points,box);
@@ -144,15 +529,44 @@ findPoints(const float bboxMin[3],const float bboxMax[3],std::vector<ParticleInd
     }
 }
 
+void ParticlesSimple::
+findPointsInConvex(const float* planes,const int nPlanes,std::vector<ParticleIndex>& points) const
+{
+    IndexReader reader(*this);
+    if(!reader.kdtree && !reader.grid){ // no usable positions, buildIndex() said why
+        return;
+    }
+
+    if(reader.grid){
+        reader.grid->findPointsInConvex(points,planes,nPlanes);
+        return;
+    }
+    size_t startIndex=points.size();
+    reader.kdtree->findPointsInConvex(points,planes,nPlanes);
+    for(size_t i=startIndex;i<points.size();i++) points[i]=reader.kdtree->id(points[i]);
+}
+
 float ParticlesSimple::
 findNPoints(const float center[3],const int nPoints,const float maxRadius,std::vector<ParticleIndex>& points,
     std::vector<float>& pointDistancesSquared) const
 {
-    if(!kdtree){
-        std::cerr<<"Partio: findNPoints without first calling sort()"<<std::endl;
+    IndexReader reader(*this);
+    const KdTree<3>* kdtree=reader.kdtree;
+    const HashGrid* grid=reader.grid;
+    if(!kdtree && !grid){ // no usable positions, buildIndex() said why
         return 0;
     }
 
+    if(grid){
+        points.resize(std::max(nPoints,0));
+        pointDistancesSquared.resize(std::max(nPoints,0));
+        float finalRadius2;
+        int count=nPoints>0 ? grid->findNPoints(&points[0],&pointDistancesSquared[0],&finalRadius2,center,nPoints,maxRadius) : 0;
+        points.resize(count);
+        pointDistancesSquared.resize(count);
+        return maxRadius;
+    }
+
     //assert(sizeof(ParticleIndex)==sizeof(uint64_t));
     //std::vector<uint64_t>& rawPoints=points;
     float maxDistance=kdtree->findNPoints(points,pointDistancesSquared,center,nPoints,maxRadius);
@@ -168,11 +582,15 @@ int ParticlesSimple::
 findNPoints(const float center[3],int nPoints,const float maxRadius, ParticleIndex *points,
     float *pointDistancesSquared, float *finalRadius2) const
 {
-    if(!kdtree){
-        std::cerr<<"Partio: findNPoints without first calling sort()"<<std::endl;
+    IndexReader reader(*this);
+    const KdTree<3>* kdtree=reader.kdtree;
+    const HashGrid* grid=reader.grid;
+    if(!kdtree && !grid){ // no usable positions, buildIndex() said why
         return 0;
     }
 
+    if(grid) return grid->findNPoints(points,pointDistancesSquared,finalRadius2,center,nPoints,maxRadius);
+
     int count = kdtree->findNPoints (points, pointDistancesSquared, finalRadius2, center, nPoints, maxRadius);
     // remap all points since findNPoints clears array
     for(int i=0; i < count; i++){
@@ -182,6 +600,194 @@ findNPoints(const float center[3],int nPoints,const float maxRadius, ParticleInd
     return count;
 }
 
+int ParticlesSimple::
+findNPoints(const float center[3],int nPoints,const float maxRadius,const PointFilter& filter,
+    ParticleIndex *points,float *pointDistancesSquared,float *finalRadius2) const
+{
+    IndexReader reader(*this);
+    if(!reader.kdtree && !reader.grid){ // no usable positions, buildIndex() said why
+        return 0;
+    }
+
+    if(reader.grid) return reader.grid->findNPoints(points,pointDistancesSquared,finalRadius2,center,
+        nPoints,maxRadius,0,0,&filter);
+    int count=reader.kdtree->findNPointsFiltered(points,pointDistancesSquared,finalRadius2,center,
+        nPoints,maxRadius,AcceptFiltered(filter));
+    for(int i=0;i<count;i++) points[i]=reader.kdtree->id(points[i]);
+    return count;
+}
+
+void ParticlesSimple::
+findNPointsBatch(const float* centers,const int nQueries,const int nPoints,const float maxRadius,
+    ParticleIndex* points,float* pointDistancesSquared,int* pointCounts) const
+{
+    IndexReader reader(*this);
+    const KdTree<3>* kdtree=reader.kdtree;
+    const HashGrid* grid=reader.grid;
+    if(!kdtree && !grid){ // no usable positions, buildIndex() said why
+        for(int q=0;q<nQueries;q++) pointCounts[q]=0;
+        return;
+    }
+
+    if(grid) grid->findNPointsBatch(points,pointDistancesSquared,pointCounts,centers,nQueries,nPoints,
+        maxRadius,Partio::numThreads());
+    else kdtree->findNPointsBatch(points,pointDistancesSquared,pointCounts,centers,nQueries,nPoints,
+        maxRadius,Partio::numThreads());
+}
+
+int ParticlesSimple::
+findNPointsApproximate(const float center[3],int nPoints,const float maxRadius,const float epsilon,
+    const int maxVisits,ParticleIndex *points,float *pointDistancesSquared,float *finalRadius2) const
+{
+    IndexReader reader(*this);
+    if(!reader.kdtree && !reader.grid){ // no usable positions, buildIndex() said why
+        return 0;
+    }
+
+    if(reader.grid) return reader.grid->findNPoints(points,pointDistancesSquared,finalRadius2,center,
+        nPoints,maxRadius,epsilon,maxVisits);
+    int count=reader.kdtree->findNPoints(points,pointDistancesSquared,finalRadius2,center,nPoints,
+        maxRadius,epsilon,maxVisits);
+    for(int i=0;i<count;i++) points[i]=reader.kdtree->id(points[i]);
+    return count;
+}
+
+void ParticlesSimple::
+findNPointsBatchApproximate(const float* centers,const int nQueries,const int nPoints,const float maxRadius,
+    const float epsilon,const int maxVisits,ParticleIndex* points,float* pointDistancesSquared,int* pointCounts) const
+{
+    IndexReader reader(*this);
+    if(!reader.kdtree && !reader.grid){ // no usable positions, buildIndex() said why
+        for(int q=0;q<nQueries;q++) pointCounts[q]=0;
+        return;
+    }
+
+    if(reader.grid) reader.grid->findNPointsBatch(points,pointDistancesSquared,pointCounts,centers,nQueries,
+        nPoints,maxRadius,Partio::numThreads(),epsilon,maxVisits);
+    else reader.kdtree->findNPointsBatch(points,pointDistancesSquared,pointCounts,centers,nQueries,
+        nPoints,maxRadius,Partio::numThreads(),epsilon,maxVisits);
+}
+
+bool ParticlesSimple::
+visitPointsInRadius(const float center[3],const float radius,PointVisitor& visitor) const
+{
+    IndexReader reader(*this);
+    const KdTree<3>* kdtree=reader.kdtree;
+    const HashGrid* grid=reader.grid;
+    if(!kdtree && !grid){ // no usable positions, buildIndex() said why
+        return true;
+    }
+
+    if(grid) return grid->visitPointsInRadius(center,radius,visitor);
+    return kdtree->visitPointsInRadius(center,radius,visitor);
+}
+
+void ParticlesSimple::
+findPoints(const char* attributeName,const float* bboxMin,const float* bboxMax,std::vector<ParticleIndex>& points) const
+{
+    if(!strcmp(attributeName,"position")){
+        findPoints(bboxMin,bboxMax,points);
+        return;
+    }
+    IndexReader reader(*this,attributeName);
+    if(!reader.tree) return; // buildAttributeTree() said why
+    reader.tree->findPoints(points,bboxMin,bboxMax);
+}
+
+int ParticlesSimple::
+findNPoints(const char* attributeName,const float* center,int nPoints,const float maxRadius,
+    ParticleIndex *points,float *pointDistancesSquared,float *finalRadius2) const
+{
+    if(!strcmp(attributeName,"position"))
+        return findNPoints(center,nPoints,maxRadius,points,pointDistancesSquared,finalRadius2);
+    IndexReader reader(*this,attributeName);
+    if(!reader.tree) return 0; // buildAttributeTree() said why
+    return reader.tree->findNPoints(points,pointDistancesSquared,finalRadius2,center,nPoints,maxRadius);
+}
+
+void ParticlesSimple::
+findSpheresContaining(const float point[3],std::vector<ParticleIndex>& points) const
+{
+    IndexReader reader(*this,false);
+    if(!reader.spheres){
+        std::cerr<<"Partio: findSpheresContaining without first calling sortSpheres()"<<std::endl;
+        return;
+    }
+    reader.spheres->findSpheresContaining(points,point);
+}
+
+void ParticlesSimple::
+findSpheresOverlapping(const float bboxMin[3],const float bboxMax[3],std::vector<ParticleIndex>& points) const
+{
+    IndexReader reader(*this,false);
+    if(!reader.spheres){
+        std::cerr<<"Partio: findSpheresOverlapping without first calling sortSpheres()"<<std::endl;
+        return;
+    }
+    BBox<3> box(bboxMin);box.grow(bboxMax);
+    reader.spheres->findSpheresOverlapping(points,box);
+}
+
+void ParticlesSimple::
+findPointsAlongRay(const float origin[3],const float direction[3],const float tMin,const float tMax,
+    const float radius,const int maxHits,std::vector<ParticleIndex>& points,std::vector<float>& t) const
+{
+    points.clear();t.clear();
+    IndexReader reader(*this);
+    if(!reader.kdtree && !reader.grid){ // no usable positions, buildIndex() said why
+        return;
+    }
+
+    RayHits hits(origin,direction,tMin,tMax,maxHits);
+    TracePoints(reader.kdtree,reader.grid,radius)(&hits,1);
+    hits.finish(points,t);
+}
+
+void ParticlesSimple::
+findPointsAlongRays(const float* origins,const float* directions,const int nRays,const float tMin,
+    const float tMax,const float radius,const int maxHits,ParticleIndex* points,float* t,int* hitCounts) const
+{
+    IndexReader reader(*this);
+    if(!reader.kdtree && !reader.grid){ // no usable positions, buildIndex() said why
+        for(int r=0;r<nRays;r++) hitCounts[r]=0;
+        return;
+    }
+
+    traceRays(TracePoints(reader.kdtree,reader.grid,radius),origins,directions,nRays,
+        KdTree<3>::rayPacketSize,tMin,tMax,maxHits,points,t,hitCounts,Partio::numThreads());
+}
+
+void ParticlesSimple::
+findSpheresAlongRay(const float origin[3],const float direction[3],const float tMin,const float tMax,
+    const int maxHits,std::vector<ParticleIndex>& points,std::vector<float>& t) const
+{
+    points.clear();t.clear();
+    IndexReader reader(*this,false);
+    if(!reader.spheres){
+        std::cerr<<"Partio: findSpheresAlongRay without first calling sortSpheres()"<<std::endl;
+        return;
+    }
+
+    RayHits hits(origin,direction,tMin,tMax,maxHits);
+    reader.spheres->findSpheresAlongRays(&hits,1);
+    hits.finish(points,t);
+}
+
+void ParticlesSimple::
+findSpheresAlongRays(const float* origins,const float* directions,const int nRays,const float tMin,
+    const float tMax,const int maxHits,ParticleIndex* points,float* t,int* hitCounts) const
+{
+    IndexReader reader(*this,false);
+    if(!reader.spheres){
+        std::cerr<<"Partio: findSpheresAlongRays without first calling sortSpheres()"<<std::endl;
+        for(int r=0;r<nRays;r++) hitCounts[r]=0;
+        return;
+    }
+
+    traceRays(TraceSpheres(reader.spheres),origins,directions,nRays,SphereBVH::rayPacketSize,
+        tMin,tMax,maxHits,points,t,hitCounts,Partio::numThreads());
+}
+
 ParticleAttribute ParticlesSimple::
 addAttribute(const char* attribute,ParticleAttributeType type,const int count)
 {
@@ -200,7 +806,7 @@ addAttribute(const char* attribute,ParticleAttributeType type,const int count)
 
     int stride=TypeSize(type)*count;
     attributeStrides.push_back(stride);
-    char* dataPointer=(char*)malloc(allocatedCount*stride);
+    char* dataPointer=(char*)malloc((size_t)allocatedCount*stride);
     attributeData.push_back(dataPointer);
     attributeOffsets.push_back(dataPointer-(char*)0);
     attributeIndexedStrs.push_back(IndexedStrTable());
@@ -212,7 +818,8 @@ ParticleIndex ParticlesSimple::
 addParticle()
 {
     if(allocatedCount==particleCount){
-        allocatedCount=std::max(10,std::max(allocatedCount*3/2,particleCount));
+        allocatedCount=std::max((int64_t)10,std::max(allocatedCount*3/2,particleCount));
+        releaseInPlaceTree();
         for(unsigned int i=0;i<attributes.size();i++)
             attributeData[i]=(char*)realloc(attributeData[i],(size_t)attributeStrides[i]*(size_t)allocatedCount);
     }
@@ -222,11 +829,12 @@ addParticle()
 }
 
 ParticlesDataMutable::iterator ParticlesSimple::
-addParticles(const int countToAdd)
+addParticles(const int64_t countToAdd)
 {
     if(particleCount+countToAdd>allocatedCount){
         // TODO: this should follow 2/3 rule
         allocatedCount=allocatedCount+countToAdd;
+        releaseInPlaceTree();
         for(unsigned int i=0;i<attributes.size();i++){
             attributeData[i]=(char*)realloc(attributeData[i],(size_t)attributeStrides[i]*(size_t)allocatedCount);
             attributeOffsets[i]=attributeData[i]-(char*)0;
@@ -280,6 +888,69 @@ setupAccessor(Partio::ParticleIterator<true>& iterator,ParticleAccessor& accesso
     accessor.basePointer=attributeData[accessor.attributeIndex];
 }
 
+size_t ParticlesSimple::
+memorySize() const
+{
+    size_t bytes=0;
+    for(unsigned int i=0;i<attributes.size();i++)
+        if(attributeData[i]) bytes+=(size_t)attributeStrides[i]*(size_t)allocatedCount;
+    IndexReader reader(*this,false);
+    if(reader.kdtree) bytes+=reader.kdtree->memorySize();
+    if(reader.grid) bytes+=reader.grid->memorySize();
+    if(reader.spheres) bytes+=reader.spheres->memorySize();
+    if(const std::map<std::string,AttributeTree*>* trees=reader.trees())
+        for(std::map<std::string,AttributeTree*>::const_iterator i=trees->begin();i!=trees->end();++i)
+            bytes+=i->second->memorySize();
+    return bytes;
+}
+
+void ParticlesSimple::
+freeData()
+{
+    // retire the index first, queries still running may read positions through it
+    kdtree_mutex.lock();
+    publishIndex(0);
+    kdtree_mutex.unlock();
+    for(unsigned int i=0;i<attributeData.size();i++){
+        free(attributeData[i]);
+        attributeData[i]=0;
+        attributeOffsets[i]=0;
+    }
+    allocatedCount=0;
+}
+
+bool ParticlesSimple::
+takeData(ParticlesSimple& other)
+{
+    if(other.particleCount!=particleCount || other.attributes.size()!=attributes.size()) return false;
+    for(unsigned int i=0;i<attributes.size();i++){
+        const ParticleAttribute& a=attributes[i],&b=other.attributes[i];
+        if(a.name!=b.name || a.type!=b.type || a.count!=b.count) return false;
+    }
+    std::swap(allocatedCount,other.allocatedCount);
+    attributeData.swap(other.attributeData);
+    attributeOffsets.swap(other.attributeOffsets);
+    kdtree_mutex.lock();
+    other.kdtree_mutex.lock();
+    Index* theirs=other.exchangeIndex(0);
+    other.exchangeIndex(exchangeIndex(theirs));
+    other.kdtree_mutex.unlock();
+    kdtree_mutex.unlock();
+    return true;
+}
+
+bool ParticlesSimple::
+writeSortIndex(const char* filename) const
+{
+    IndexReader reader(*this);
+    if(!reader.kdtree || !reader.kdtree->hasIds()){
+        if(reader.grid || reader.kdtree)
+            std::cerr<<"Partio: writeSortIndex needs a KD-Tree of the particles in file order, sort() them again"<<std::endl;
+        return false;
+    }
+    return saveSortIndex(filename,*reader.kdtree);
+}
+
 void* ParticlesSimple::
 dataInternal(const ParticleAttribute& attribute,const ParticleIndex particleIndex) const
 {
@@ -299,6 +970,35 @@ dataInternalMultiple(const ParticleAttribute& attribute,const int indexCount,
         memcpy(values+bytes*i,base+particleIndices[i]*bytes,bytes);
 }
 
+void ParticlesSimple::
+dataInternalRange(const ParticleAttribute& attribute,const ParticleIndex start,
+    const int64_t count,char* values) const
+{
+    assert(attribute.attributeIndex>=0 && attribute.attributeIndex<(int)attributes.size());
+    assert(start+count<=(ParticleIndex)particleCount);
+
+    int bytes=attributeStrides[attribute.attributeIndex];
+    memcpy(values,attributeData[attribute.attributeIndex]+start*bytes,(size_t)count*bytes);
+}
+
+void ParticlesSimple::
+dataWriteInternalRange(const ParticleAttribute& attribute,const ParticleIndex start,
+    const int64_t count,const char* values)
+{
+    assert(attribute.attributeIndex>=0 && attribute.attributeIndex<(int)attributes.size());
+    assert(start+count<=(ParticleIndex)particleCount);
+
+    int bytes=attributeStrides[attribute.attributeIndex];
+    memcpy(attributeData[attribute.attributeIndex]+start*bytes,values,(size_t)count*bytes);
+}
+
+void* ParticlesSimple::
+dataInternalContiguous(const ParticleAttribute& attribute) const
+{
+    assert(attribute.attributeIndex>=0 && attribute.attributeIndex<(int)attributes.size());
+    return attributeData[attribute.attributeIndex];
+}
+
 void ParticlesSimple::
 dataAsFloat(const ParticleAttribute& attribute,const int indexCount,
     const ParticleIndex* particleIndices,const bool sorted,float* values) const
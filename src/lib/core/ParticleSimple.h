@@ -42,6 +42,9 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
 namespace Partio{
 
 template<int d> class KdTree;
+class HashGrid;
+class AttributeTree;
+class SphereBVH;
 
 class ParticlesSimple:public ParticlesDataMutable,
                       public Provider
@@ -57,7 +60,7 @@ public:
     ParticlesSimple();
 
     int numAttributes() const;
-    int numParticles() const;
+    int64_t numParticles() const;
     bool attributeInfo(const char* attributeName,ParticleAttribute& attribute) const;
     bool attributeInfo(const int attributeInfo,ParticleAttribute& attribute) const;
     void dataAsFloat(const ParticleAttribute& attribute,const int indexCount,
@@ -66,15 +69,49 @@ public:
     int lookupIndexedStr(const ParticleAttribute& attribute,const char* str) const;
     const std::vector<std::string>& indexedStrs(const ParticleAttribute& attr) const;
     void sort();
+    void sort(const SortOptions& options);
+    void sort(const char* attributeName);
+    void sortSpheres(const char* radiusAttribute);
+    void reorder();
+    void updateSort();
     void findPoints(const float bboxMin[3],const float bboxMax[3],std::vector<ParticleIndex>& points) const;
+    void findPointsInConvex(const float* planes,const int nPlanes,std::vector<ParticleIndex>& points) const;
     float findNPoints(const float center[3],int nPoints,const float maxRadius,
         std::vector<ParticleIndex>& points,std::vector<float>& pointDistancesSquared) const;
     int findNPoints(const float center[3],int nPoints,const float maxRadius,
         ParticleIndex *points, float *pointDistancesSquared, float *finalRadius2) const;
+    int findNPoints(const float center[3],int nPoints,const float maxRadius,const PointFilter& filter,
+        ParticleIndex *points,float *pointDistancesSquared,float *finalRadius2) const;
+    void findNPointsBatch(const float* centers,const int nQueries,const int nPoints,
+        const float maxRadius,ParticleIndex* points,float* pointDistancesSquared,int* pointCounts) const;
+    int findNPointsApproximate(const float center[3],int nPoints,const float maxRadius,
+        const float epsilon,const int maxVisits,ParticleIndex *points,float *pointDistancesSquared,
+        float *finalRadius2) const;
+    void findNPointsBatchApproximate(const float* centers,const int nQueries,const int nPoints,
+        const float maxRadius,const float epsilon,const int maxVisits,ParticleIndex* points,
+        float* pointDistancesSquared,int* pointCounts) const;
+    bool visitPointsInRadius(const float center[3],const float radius,PointVisitor& visitor) const;
+    void findPoints(const char* attributeName,const float* bboxMin,const float* bboxMax,
+        std::vector<ParticleIndex>& points) const;
+    int findNPoints(const char* attributeName,const float* center,int nPoints,const float maxRadius,
+        ParticleIndex *points,float *pointDistancesSquared,float *finalRadius2) const;
+    void findSpheresContaining(const float point[3],std::vector<ParticleIndex>& points) const;
+    void findSpheresOverlapping(const float bboxMin[3],const float bboxMax[3],std::vector<ParticleIndex>& points) const;
+    void findPointsAlongRay(const float origin[3],const float direction[3],const float tMin,
+        const float tMax,const float radius,const int maxHits,std::vector<ParticleIndex>& points,
+        std::vector<float>& t) const;
+    void findPointsAlongRays(const float* origins,const float* directions,const int nRays,
+        const float tMin,const float tMax,const float radius,const int maxHits,
+        ParticleIndex* points,float* t,int* hitCounts) const;
+    void findSpheresAlongRay(const float origin[3],const float direction[3],const float tMin,
+        const float tMax,const int maxHits,std::vector<ParticleIndex>& points,std::vector<float>& t) const;
+    void findSpheresAlongRays(const float* origins,const float* directions,const int nRays,
+        const float tMin,const float tMax,const int maxHits,ParticleIndex* points,float* t,
+        int* hitCounts) const;
 
     ParticleAttribute addAttribute(const char* attribute,ParticleAttributeType type,const int count);
     ParticleIndex addParticle();
-    iterator addParticles(const int count);
+    iterator addParticles(const int64_t count);
 
 
     iterator setupIterator();
@@ -83,14 +120,62 @@ public:
     void setupIteratorNextBlock(Partio::ParticleIterator<true>& iterator) const;
     void setupAccessor(Partio::ParticleIterator<false>& iterator,ParticleAccessor& accessor);
     void setupAccessor(Partio::ParticleIterator<true>& iterator,ParticleAccessor& accessor) const;
+
+    //! Bytes held by attribute data and the KD-Tree
+    size_t memorySize() const;
+    //! Frees attribute data and the KD-Tree but keeps the attribute definitions
+    void freeData();
+    //! Takes over the data of other, which must have the same particles and attributes
+    bool takeData(ParticlesSimple& other);
+    //! Saves the KD-Tree as the sort index of filename, see Partio::writeSortIndex()
+    bool writeSortIndex(const char* filename) const;
 private:
+    //! The spatial indices sort() publishes
+    struct Index
+    {
+        KdTree<3>* kdtree;
+        HashGrid* grid; // built instead of kdtree by sort(SortOptions(HASHGRID,cellSize))
+        std::map<std::string,AttributeTree*> trees; // built by sort(attributeName)
+        SphereBVH* spheres; // built by sortSpheres()
+        std::string sphereRadius; // the radius attribute spheres was built with
+        Index(KdTree<3>* kdtree,HashGrid* grid);
+        ~Index();
+        //! Shares the attribute trees and spheres of other, if there is one
+        void shareAttributeIndices(const Index* other);
+    };
+    //! Registers a query as reading the current index for its lifetime
+    class IndexReader;
+
+    //! Builds an index over the current positions, or reports why not and returns null
+    Index* buildIndex(const SortOptions& options);
+    //! Builds the default index unless there already is one
+    void ensureIndex();
+    //! Builds a tree over the named attribute, or reports why not and returns null
+    AttributeTree* buildAttributeTree(const char* attributeName);
+    //! Builds the tree over the named attribute unless there already is one
+    void ensureAttributeTree(const char* attributeName);
+    //! Publishes newIndex and returns the old one once no query can still be reading it.
+    //! Callers hold kdtree_mutex
+    Index* exchangeIndex(Index* newIndex);
+    //! Publishes updated, which may share parts of the current index, and frees the
+    //! parts it doesn't share once no query can still be reading them. Callers hold kdtree_mutex
+    void publishIndex(Index* updated);
+    //! Publishes tree as the one over attributeName. Callers hold kdtree_mutex
+    void publishAttributeTree(const char* attributeName,AttributeTree* tree);
+    //! Drops a tree that reads positions in place before they are reallocated
+    void releaseInPlaceTree();
     void* dataInternal(const ParticleAttribute& attribute,const ParticleIndex particleIndex) const;
     void dataInternalMultiple(const ParticleAttribute& attribute,const int indexCount,
         const ParticleIndex* particleIndices,const bool sorted,char* values) const;
+    void dataInternalRange(const ParticleAttribute& attribute,const ParticleIndex start,
+        const int64_t count,char* values) const;
+    void dataWriteInternalRange(const ParticleAttribute& attribute,const ParticleIndex start,
+        const int64_t count,const char* values);
+    void* dataInternalContiguous(const ParticleAttribute& attribute) const;
 
 private:
-    int particleCount;
-    int allocatedCount;
+    int64_t particleCount;
+    int64_t allocatedCount;
     std::vector<char*> attributeData; // Inside is data of appropriate type
     std::vector<size_t> attributeOffsets; // Inside is data of appropriate type
     struct IndexedStrTable{
@@ -102,8 +187,11 @@ private:
     std::vector<int> attributeStrides;
     std::map<std::string,int> nameToAttribute;
 
-    PartioMutex kdtree_mutex;
-    KdTree<3>* kdtree;
+    // Queries never lock, they count themselves in indexReaders and a writer replacing
+    // the index waits for them to drain before freeing the old one
+    PartioMutex kdtree_mutex; // serializes writers of index
+    Index* volatile index;
+    ReaderEpoch indexReaders;
 };
 
 }
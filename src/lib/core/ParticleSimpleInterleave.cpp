@@ -68,7 +68,7 @@ release() const
 }
 
 
-int ParticlesSimpleInterleave::
+int64_t ParticlesSimpleInterleave::
 numParticles() const
 {
     return particleCount;
@@ -127,6 +127,37 @@ sort()
 #endif
 }
 
+void ParticlesSimpleInterleave::
+sort(const SortOptions& options)
+{
+    sort();
+}
+
+void ParticlesSimpleInterleave::
+sort(const char* attributeName)
+{
+    sort();
+}
+
+void ParticlesSimpleInterleave::
+sortSpheres(const char* radiusAttribute)
+{
+    sort();
+}
+
+void ParticlesSimpleInterleave::
+reorder()
+{
+    // spatial queries aren't supported on interleaved data yet, see sort()
+    sort();
+}
+
+void ParticlesSimpleInterleave::
+updateSort()
+{
+    sort();
+}
+
 void ParticlesSimpleInterleave::
 findPoints(const float bboxMin[3],const float bboxMax[3],std::vector<ParticleIndex>& points) const
 {
@@ -145,6 +176,12 @@ findPoints(const float bboxMin[3],const float bboxMax[3],std::vector<ParticleInd
 #endif
 }
 
+void ParticlesSimpleInterleave::
+findPointsInConvex(const float* planes,const int nPlanes,std::vector<ParticleIndex>& points) const
+{
+    // TODO: I guess they don't support this lookup here
+}
+
 float ParticlesSimpleInterleave::
 findNPoints(const float center[3],const int nPoints,const float maxRadius,std::vector<ParticleIndex>& points,
     std::vector<float>& pointDistancesSquared) const
@@ -171,6 +208,99 @@ findNPoints(const float center[3],int nPoints,const float maxRadius, ParticleInd
     return 0;
 }
 
+int ParticlesSimpleInterleave::
+findNPoints(const float center[3],int nPoints,const float maxRadius,const PointFilter& filter,
+    ParticleIndex *points,float *pointDistancesSquared,float *finalRadius2) const
+{
+    // TODO: I guess they don't support this lookup here
+    return 0;
+}
+
+void ParticlesSimpleInterleave::
+findNPointsBatch(const float* centers,const int nQueries,const int nPoints,const float maxRadius,
+    ParticleIndex* points,float* pointDistancesSquared,int* pointCounts) const
+{
+    // TODO: I guess they don't support this lookup here
+    for(int q=0;q<nQueries;q++) pointCounts[q]=0;
+}
+
+int ParticlesSimpleInterleave::
+findNPointsApproximate(const float center[3],int nPoints,const float maxRadius,const float epsilon,
+    const int maxVisits,ParticleIndex *points,float *pointDistancesSquared,float *finalRadius2) const
+{
+    // TODO: I guess they don't support this lookup here
+    return 0;
+}
+
+void ParticlesSimpleInterleave::
+findNPointsBatchApproximate(const float* centers,const int nQueries,const int nPoints,const float maxRadius,
+    const float epsilon,const int maxVisits,ParticleIndex* points,float* pointDistancesSquared,int* pointCounts) const
+{
+    // TODO: I guess they don't support this lookup here
+    for(int q=0;q<nQueries;q++) pointCounts[q]=0;
+}
+
+bool ParticlesSimpleInterleave::
+visitPointsInRadius(const float center[3],const float radius,PointVisitor& visitor) const
+{
+    // TODO: I guess they don't support this lookup here
+    return true;
+}
+
+void ParticlesSimpleInterleave::
+findPoints(const char* attributeName,const float* bboxMin,const float* bboxMax,std::vector<ParticleIndex>& points) const
+{
+    // TODO: I guess they don't support this lookup here
+}
+
+int ParticlesSimpleInterleave::
+findNPoints(const char* attributeName,const float* center,int nPoints,const float maxRadius,
+    ParticleIndex *points,float *pointDistancesSquared,float *finalRadius2) const
+{
+    // TODO: I guess they don't support this lookup here
+    return 0;
+}
+
+void ParticlesSimpleInterleave::
+findSpheresContaining(const float point[3],std::vector<ParticleIndex>& points) const
+{
+    // TODO: I guess they don't support this lookup here
+}
+
+void ParticlesSimpleInterleave::
+findSpheresOverlapping(const float bboxMin[3],const float bboxMax[3],std::vector<ParticleIndex>& points) const
+{
+    // TODO: I guess they don't support this lookup here
+}
+
+void ParticlesSimpleInterleave::
+findPointsAlongRay(const float origin[3],const float direction[3],const float tMin,const float tMax,
+    const float radius,const int maxHits,std::vector<ParticleIndex>& points,std::vector<float>& t) const
+{
+    // TODO: I guess they don't support this lookup here
+}
+
+void ParticlesSimpleInterleave::
+findPointsAlongRays(const float* origins,const float* directions,const int nRays,const float tMin,
+    const float tMax,const float radius,const int maxHits,ParticleIndex* points,float* t,int* hitCounts) const
+{
+    // TODO: I guess they don't support this lookup here
+}
+
+void ParticlesSimpleInterleave::
+findSpheresAlongRay(const float origin[3],const float direction[3],const float tMin,const float tMax,
+    const int maxHits,std::vector<ParticleIndex>& points,std::vector<float>& t) const
+{
+    // TODO: I guess they don't support this lookup here
+}
+
+void ParticlesSimpleInterleave::
+findSpheresAlongRays(const float* origins,const float* directions,const int nRays,const float tMin,
+    const float tMax,const int maxHits,ParticleIndex* points,float* t,int* hitCounts) const
+{
+    // TODO: I guess they don't support this lookup here
+}
+
 
 ParticleAttribute ParticlesSimpleInterleave::
 addAttribute(const char* attribute,ParticleAttributeType type,const int count)
@@ -195,7 +325,7 @@ addAttribute(const char* attribute,ParticleAttributeType type,const int count)
     if(data){
         char* ptrNew=newData;
         char* ptrOld=data;
-        for(int i=0;i<particleCount;i++){
+        for(int64_t i=0;i<particleCount;i++){
             memcpy(ptrNew,ptrOld,oldStride);
             ptrNew+=newStride;
             ptrOld+=oldStride;
@@ -214,18 +344,18 @@ ParticleIndex ParticlesSimpleInterleave::
 addParticle()
 {
     if(allocatedCount==particleCount){
-        allocatedCount=std::max(10,std::max(allocatedCount*3/2,particleCount));
+        allocatedCount=std::max((int64_t)10,std::max(allocatedCount*3/2,particleCount));
         data=(char*)realloc(data,(size_t)stride*(size_t)allocatedCount);
     }
     return particleCount++;
 }
 
 ParticlesDataMutable::iterator ParticlesSimpleInterleave::
-addParticles(const int countToAdd)
+addParticles(const int64_t countToAdd)
 {
     if(particleCount+countToAdd>allocatedCount){
         while(allocatedCount<particleCount+countToAdd)
-            allocatedCount=std::max(10,std::max(allocatedCount*3/2,particleCount));
+            allocatedCount=std::max((int64_t)10,std::max(allocatedCount*3/2,particleCount));
         data=(char*)realloc(data,(size_t)stride*(size_t)allocatedCount);
     }
     // int offset=particleCount;
@@ -296,6 +426,50 @@ dataInternalMultiple(const ParticleAttribute& attribute,const int indexCount,
 #endif
 }
 
+void ParticlesSimpleInterleave::
+dataInternalRange(const ParticleAttribute& attribute,const ParticleIndex start,
+    const int64_t count,char* values) const
+{
+    assert(attribute.attributeIndex>=0 && attribute.attributeIndex<(int)attributes.size());
+    assert(start+count<=(ParticleIndex)particleCount);
+
+    // every attribute type is 32 bits wide, so gather words rather than bytes
+    // which lets the compiler unroll the inner loop for the common counts
+    const int words=attribute.count;
+    const int wordStride=stride/sizeof(int);
+    const int* src=(const int*)(data+start*stride+attributeOffsets[attribute.attributeIndex]);
+    int* dest=(int*)values;
+    if(words==1) for(int64_t i=0;i<count;i++) dest[i]=src[i*wordStride];
+    else if(words==3) for(int64_t i=0;i<count;i++){
+        const int* s=src+i*wordStride;
+        dest[3*i]=s[0];dest[3*i+1]=s[1];dest[3*i+2]=s[2];
+    }
+    else for(int64_t i=0;i<count;i++) for(int k=0;k<words;k++) dest[i*words+k]=src[i*wordStride+k];
+}
+
+void ParticlesSimpleInterleave::
+dataWriteInternalRange(const ParticleAttribute& attribute,const ParticleIndex start,
+    const int64_t count,const char* values)
+{
+    assert(attribute.attributeIndex>=0 && attribute.attributeIndex<(int)attributes.size());
+    assert(start+count<=(ParticleIndex)particleCount);
+
+    const int words=attribute.count;
+    const int wordStride=stride/sizeof(int);
+    int* dest=(int*)(data+start*stride+attributeOffsets[attribute.attributeIndex]);
+    const int* src=(const int*)values;
+    for(int64_t i=0;i<count;i++) for(int k=0;k<words;k++) dest[i*wordStride+k]=src[i*words+k];
+}
+
+void* ParticlesSimpleInterleave::
+dataInternalContiguous(const ParticleAttribute& attribute) const
+{
+    assert(attribute.attributeIndex>=0 && attribute.attributeIndex<(int)attributes.size());
+    // only packed when this attribute is the whole record
+    if(stride!=TypeSize(attribute.type)*attribute.count) return 0;
+    return data+attributeOffsets[attribute.attributeIndex];
+}
+
 void ParticlesSimpleInterleave::
 dataAsFloat(const ParticleAttribute& attribute,const int indexCount,
     const ParticleIndex* particleIndices,const bool sorted,float* values) const
@@ -59,7 +59,7 @@ public:
     ParticlesSimpleInterleave();
 
     int numAttributes() const;
-    int numParticles() const;
+    int64_t numParticles() const;
     bool attributeInfo(const char* attributeName,ParticleAttribute& attribute) const;
     bool attributeInfo(const int attributeInfo,ParticleAttribute& attribute) const;
 
@@ -70,15 +70,49 @@ public:
     const std::vector<std::string>& indexedStrs(const ParticleAttribute& attr) const;
 
     void sort();
+    void sort(const SortOptions& options);
+    void sort(const char* attributeName);
+    void sortSpheres(const char* radiusAttribute);
+    void reorder();
+    void updateSort();
     void findPoints(const float bboxMin[3],const float bboxMax[3],std::vector<ParticleIndex>& points) const;
+    void findPointsInConvex(const float* planes,const int nPlanes,std::vector<ParticleIndex>& points) const;
     float findNPoints(const float center[3],int nPoints,const float maxRadius,
         std::vector<ParticleIndex>& points,std::vector<float>& pointDistancesSquared) const;
     int findNPoints(const float center[3],int nPoints,const float maxRadius,
         ParticleIndex *points, float *pointDistancesSquared, float *finalRadius2) const;
+    int findNPoints(const float center[3],int nPoints,const float maxRadius,const PointFilter& filter,
+        ParticleIndex *points,float *pointDistancesSquared,float *finalRadius2) const;
+    void findNPointsBatch(const float* centers,const int nQueries,const int nPoints,
+        const float maxRadius,ParticleIndex* points,float* pointDistancesSquared,int* pointCounts) const;
+    int findNPointsApproximate(const float center[3],int nPoints,const float maxRadius,
+        const float epsilon,const int maxVisits,ParticleIndex *points,float *pointDistancesSquared,
+        float *finalRadius2) const;
+    void findNPointsBatchApproximate(const float* centers,const int nQueries,const int nPoints,
+        const float maxRadius,const float epsilon,const int maxVisits,ParticleIndex* points,
+        float* pointDistancesSquared,int* pointCounts) const;
+    bool visitPointsInRadius(const float center[3],const float radius,PointVisitor& visitor) const;
+    void findPoints(const char* attributeName,const float* bboxMin,const float* bboxMax,
+        std::vector<ParticleIndex>& points) const;
+    int findNPoints(const char* attributeName,const float* center,int nPoints,const float maxRadius,
+        ParticleIndex *points,float *pointDistancesSquared,float *finalRadius2) const;
+    void findSpheresContaining(const float point[3],std::vector<ParticleIndex>& points) const;
+    void findSpheresOverlapping(const float bboxMin[3],const float bboxMax[3],std::vector<ParticleIndex>& points) const;
+    void findPointsAlongRay(const float origin[3],const float direction[3],const float tMin,
+        const float tMax,const float radius,const int maxHits,std::vector<ParticleIndex>& points,
+        std::vector<float>& t) const;
+    void findPointsAlongRays(const float* origins,const float* directions,const int nRays,
+        const float tMin,const float tMax,const float radius,const int maxHits,
+        ParticleIndex* points,float* t,int* hitCounts) const;
+    void findSpheresAlongRay(const float origin[3],const float direction[3],const float tMin,
+        const float tMax,const int maxHits,std::vector<ParticleIndex>& points,std::vector<float>& t) const;
+    void findSpheresAlongRays(const float* origins,const float* directions,const int nRays,
+        const float tMin,const float tMax,const int maxHits,ParticleIndex* points,float* t,
+        int* hitCounts) const;
 
     ParticleAttribute addAttribute(const char* attribute,ParticleAttributeType type,const int count);
     ParticleIndex addParticle();
-    iterator addParticles(const int count);
+    iterator addParticles(const int64_t count);
 
 
     iterator setupIterator();
@@ -91,10 +125,15 @@ private:
     void* dataInternal(const ParticleAttribute& attribute,const ParticleIndex particleIndex) const;
     void dataInternalMultiple(const ParticleAttribute& attribute,const int indexCount,
         const ParticleIndex* particleIndices,const bool sorted,char* values) const;
+    void dataInternalRange(const ParticleAttribute& attribute,const ParticleIndex start,
+        const int64_t count,char* values) const;
+    void dataWriteInternalRange(const ParticleAttribute& attribute,const ParticleIndex start,
+        const int64_t count,const char* values);
+    void* dataInternalContiguous(const ParticleAttribute& attribute) const;
 
 private:
-    int particleCount;
-    int allocatedCount;
+    int64_t particleCount;
+    int64_t allocatedCount;
     char* data;
     int stride;
 	struct IndexedStrTable{
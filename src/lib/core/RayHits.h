@@ -0,0 +1,228 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+#ifndef _RayHits_h_
+#define _RayHits_h_
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#include "../Partio.h"
+#include "Parallel.h"
+
+namespace Partio{
+
+//! The hits of one ray origin+t*direction with tMin<=t<=tMax, nearest first
+/*!
+  Keeps at most maxHits of them (all if maxHits<=0) in a heap on t, so a
+  traversal can skip anything that starts beyond limit(). The direction
+  needn't be unit length, t is in units of it.
+*/
+class RayHits
+{
+public:
+    float origin[3],direction[3];
+    float tMin,tMax;
+
+    RayHits(const float origin_in[3],const float direction_in[3],const float tMin,const float tMax,
+        const int maxHits)
+        :tMin(tMin),tMax(tMax),_maxHits(maxHits),_limit(tMax)
+    {
+        float length2=0;
+        for(int k=0;k<3;k++){
+            origin[k]=origin_in[k];direction[k]=direction_in[k];
+            length2+=direction[k]*direction[k];
+        }
+        _invLength2=length2>0 ? 1/length2 : 0;
+    }
+
+    //! Hits beyond this t would not be kept
+    float limit() const {return _limit;}
+
+    void add(const ParticleIndex particle,const float t)
+    {
+        if(t>_limit) return;
+        if(_maxHits<=0 || (int)_hits.size()<_maxHits){
+            _hits.push_back(std::make_pair(t,particle));
+            if((int)_hits.size()==_maxHits){
+                std::make_heap(_hits.begin(),_hits.end());
+                _limit=_hits[0].first;
+            }
+        }else if(std::make_pair(t,particle)<_hits[0]){ // equal t go to the lower index
+            std::pop_heap(_hits.begin(),_hits.end());
+            _hits.back()=std::make_pair(t,particle);
+            std::push_heap(_hits.begin(),_hits.end());
+            _limit=_hits[0].first;
+        }
+    }
+
+    //! Whether p is closer than radius to the segment, t is the segment's nearest point
+    bool pointHit(const float p[3],const float radiusSquared,float& t) const
+    {
+        float v[3],dot=0;
+        for(int k=0;k<3;k++){v[k]=p[k]-origin[k];dot+=v[k]*direction[k];}
+        t=std::min(std::max(dot*_invLength2,tMin),tMax);
+        if(t>_limit) return false;
+        float d2=0;
+        for(int k=0;k<3;k++){const float d=v[k]-t*direction[k];d2+=d*d;}
+        return d2<radiusSquared;
+    }
+
+    //! Adds the particle at p if it is closer than radius to the segment
+    void addPoint(const ParticleIndex particle,const float p[3],const float radiusSquared)
+    {
+        float t;
+        if(pointHit(p,radiusSquared,t)) add(particle,t);
+    }
+
+    //! Adds the particle of sphere xyz,radius s if the segment reaches it, at the
+    //! t where it enters, or tMin if it starts inside
+    void addSphere(const ParticleIndex particle,const float s[4])
+    {
+        if(_invLength2==0) return;
+        // |v-t*direction|^2=r^2 with v from origin to center
+        float v[3],dot=0,v2=0;
+        for(int k=0;k<3;k++){v[k]=s[k]-origin[k];dot+=v[k]*direction[k];v2+=v[k]*v[k];}
+        const float tCenter=dot*_invLength2;
+        const float miss2=v2-dot*tCenter; // squared distance from the center to the line
+        const float r2=s[3]*s[3];
+        if(miss2>r2) return;
+        const float halfChord=sqrtf((r2-miss2)*_invLength2);
+        if(tCenter+halfChord<tMin) return;
+        const float t=std::max(tCenter-halfChord,tMin);
+        if(t<=tMax) add(particle,t);
+    }
+
+    //! Clips [t0,t1] to the part of the ray inside the box, false if nothing is left
+    bool clip(const float boxMin[3],const float boxMax[3],float& t0,float& t1) const
+    {
+        for(int k=0;k<3;k++){
+            if(direction[k]==0){
+                if(origin[k]<boxMin[k] || origin[k]>boxMax[k]) return false;
+                continue;
+            }
+            const float inverse=1/direction[k];
+            float enter=(boxMin[k]-origin[k])*inverse,leave=(boxMax[k]-origin[k])*inverse;
+            if(enter>leave) std::swap(enter,leave);
+            t0=std::max(t0,enter);t1=std::min(t1,leave);
+        }
+        return t0<=t1;
+    }
+
+    //! Moves the hits into points and t nearest first, returns how many there were
+    int finish(ParticleIndex* points,float* t)
+    {
+        std::sort(_hits.begin(),_hits.end());
+        for(size_t i=0;i<_hits.size();i++){points[i]=_hits[i].second;t[i]=_hits[i].first;}
+        return (int)_hits.size();
+    }
+
+    //! Appends the hits to points and t nearest first
+    void finish(std::vector<ParticleIndex>& points,std::vector<float>& t)
+    {
+        std::sort(_hits.begin(),_hits.end());
+        for(size_t i=0;i<_hits.size();i++){points.push_back(_hits[i].second);t.push_back(_hits[i].first);}
+    }
+
+private:
+    int _maxHits;
+    float _limit;
+    float _invLength2; // 1/|direction|^2, or 0 for a point
+    std::vector<std::pair<float,ParticleIndex> > _hits; // a max heap once maxHits are kept
+};
+
+//! Traces one block of the rays of traceRays() per task
+template<class TRACE> class RayBatchTask
+{
+    const TRACE& trace;
+    const float *origins,*directions;
+    const int nRays,packetSize;
+    const float tMin,tMax;
+    const int maxHits;
+    ParticleIndex* points;
+    float* t;
+    int* hitCounts;
+
+public:
+    //! rays per task, a few packets so fetching tasks costs little
+    static const int blockSize=256;
+
+    RayBatchTask(const TRACE& trace,const float* origins,const float* directions,const int nRays,
+        const int packetSize,const float tMin,const float tMax,const int maxHits,
+        ParticleIndex* points,float* t,int* hitCounts)
+        :trace(trace),origins(origins),directions(directions),nRays(nRays),packetSize(packetSize),
+        tMin(tMin),tMax(tMax),maxHits(maxHits),points(points),t(t),hitCounts(hitCounts)
+    {}
+
+    void operator()(int block)
+    {
+        const int end=std::min(nRays,(block+1)*blockSize);
+        std::vector<RayHits> hits;
+        for(int first=block*blockSize;first<end;first+=packetSize){
+            const int count=std::min(packetSize,end-first);
+            hits.clear();
+            for(int r=first;r<first+count;r++)
+                hits.push_back(RayHits(origins+3*(size_t)r,directions+3*(size_t)r,tMin,tMax,maxHits));
+            trace(&hits[0],count);
+            for(int r=0;r<count;r++){
+                const size_t offset=(size_t)(first+r)*maxHits;
+                hitCounts[first+r]=hits[r].finish(points+offset,t+offset);
+            }
+        }
+    }
+};
+
+//! Traces nRays rays in packets of packetSize on numThreads threads
+/*!
+  trace(hits,count) adds the hits of one packet of neighbouring rays. Ray r
+  keeps its maxHits nearest hits starting at points[r*maxHits] and
+  t[r*maxHits], and their number in hitCounts[r].
+*/
+template<class TRACE> void traceRays(const TRACE& trace,const float* origins,const float* directions,
+    const int nRays,const int packetSize,const float tMin,const float tMax,const int maxHits,
+    ParticleIndex* points,float* t,int* hitCounts,const int numThreads)
+{
+    if(maxHits<=0){
+        for(int r=0;r<nRays;r++) hitCounts[r]=0;
+        return;
+    }
+    typedef RayBatchTask<TRACE> Task;
+    Task task(trace,origins,directions,nRays,packetSize,tMin,tMax,maxHits,points,t,hitCounts);
+    parallelFor((nRays+Task::blockSize-1)/Task::blockSize,task,numThreads);
+}
+
+}
+#endif
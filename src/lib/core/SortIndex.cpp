@@ -0,0 +1,185 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+
+#ifdef PARTIO_WIN32
+#    define NOMINMAX
+#endif
+
+#include "SortIndex.h"
+#include "ParticleSimple.h"
+#include "ParticleMapped.h"
+#include "../io/PartioEndian.h"
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+namespace Partio{
+
+namespace
+{
+    const int SORT_INDEX_MAGIC=((((('X'<<8)|'D')<<8)|'K')<<8)|'P'; // "PKDX" on disk
+    const int SORT_INDEX_VERSION=1;
+
+    //! Size and modification time an index is keyed to
+    bool fileKey(const char* filename,int64_t& size,int64_t& time)
+    {
+#ifndef PARTIO_WIN32
+        struct stat info;
+        if(stat(filename,&info)!=0) return false;
+#else
+        struct __stat64 info;
+        if(_stat64(filename,&info)!=0) return false;
+#endif
+        size=(int64_t)info.st_size;
+        time=(int64_t)info.st_mtime;
+        return true;
+    }
+
+    template<class ID> bool readIds(std::istream& input,KdTree<3>& tree,const float* p,const int64_t n,
+        const BBox<3>& bbox,const bool compact,const int numThreads)
+    {
+        std::vector<ID> ids(n);
+        if(n) input.read((char*)&ids[0],sizeof(ID)*n);
+        if(!input) return false;
+        if(big_endian) for(int64_t i=0;i<n;i++) endianSwap(ids[i]);
+        return tree.setOrder(p,n,n ? &ids[0] : (ID*)0,bbox,compact,numThreads);
+    }
+
+    template<class ID> void writeIds(std::ostream& output,const KdTree<3>& tree)
+    {
+        const int64_t chunkSize=1<<16;
+        std::vector<ID> ids(chunkSize);
+        for(int64_t start=0;start<tree.size();start+=chunkSize){
+            const int64_t count=std::min(chunkSize,tree.size()-start);
+            for(int64_t i=0;i<count;i++){
+                ids[i]=(ID)tree.id(start+i);
+                LITEND::swap(ids[i]);
+            }
+            output.write((char*)&ids[0],sizeof(ID)*count);
+        }
+    }
+}
+
+std::string sortIndexFilename(const char* filename)
+{
+    return std::string(filename)+".kdtree";
+}
+
+bool saveSortIndex(const char* filename,const KdTree<3>& tree)
+{
+    int64_t size,time;
+    if(!fileKey(filename,size,time)){
+        std::cerr<<"Partio: Can't find particle file "<<filename<<" to save its sort index"<<std::endl;
+        return false;
+    }
+
+    // written aside and renamed into place, so readers never load a partial index
+    const std::string indexName=sortIndexFilename(filename);
+    const std::string tempName=indexName+".tmp";
+    {
+        std::ofstream output(tempName.c_str(),std::ios::out|std::ios::binary);
+        if(!output){
+            std::cerr<<"Partio: Can't open sort index "<<tempName<<" for writing"<<std::endl;
+            return false;
+        }
+        const int idBytes=tree.size()<=(int64_t)std::numeric_limits<uint32_t>::max() ? 4 : 8;
+        write<LITEND>(output,SORT_INDEX_MAGIC,SORT_INDEX_VERSION,size,time,tree.size(),idBytes);
+        for(int axis=0;axis<3;axis++) write<LITEND>(output,tree.bbox().min[axis]);
+        for(int axis=0;axis<3;axis++) write<LITEND>(output,tree.bbox().max[axis]);
+        if(idBytes==4) writeIds<uint32_t>(output,tree);
+        else writeIds<uint64_t>(output,tree);
+        if(!output){
+            std::cerr<<"Partio: Failed writing sort index "<<tempName<<std::endl;
+            output.close();
+            std::remove(tempName.c_str());
+            return false;
+        }
+    }
+#ifdef PARTIO_WIN32
+    std::remove(indexName.c_str()); // rename doesn't replace files on windows
+#endif
+    if(std::rename(tempName.c_str(),indexName.c_str())!=0){
+        std::cerr<<"Partio: Can't move sort index into place at "<<indexName<<std::endl;
+        std::remove(tempName.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool loadSortIndex(const char* filename,KdTree<3>& tree,const float* p,const int64_t n,
+    const bool compact,const int numThreads)
+{
+    int64_t size,time;
+    if(!fileKey(filename,size,time)) return false;
+    std::ifstream input(sortIndexFilename(filename).c_str(),std::ios::in|std::ios::binary);
+    if(!input) return false;
+
+    int magic=0,version=0,idBytes=0;
+    int64_t indexSize=0,indexTime=0,count=0;
+    BBox<3> bbox;
+    read<LITEND>(input,magic,version);
+    if(!input || magic!=SORT_INDEX_MAGIC || version!=SORT_INDEX_VERSION) return false;
+    read<LITEND>(input,indexSize,indexTime,count,idBytes);
+    for(int axis=0;axis<3;axis++) read<LITEND>(input,bbox.min[axis]);
+    for(int axis=0;axis<3;axis++) read<LITEND>(input,bbox.max[axis]);
+    if(!input || indexSize!=size || indexTime!=time || count!=n) return false;
+
+    // a file rewritten within the same second at the same size, or positions
+    // changed after reading, show up as a different bbox
+    BBox<3> actual;
+    if(n) actual.set(p);
+    for(int64_t i=1;i<n;i++) actual.grow(p+3*i);
+    for(int axis=0;axis<3;axis++)
+        if(actual.min[axis]!=bbox.min[axis] || actual.max[axis]!=bbox.max[axis]) return false;
+
+    if(idBytes==4) return readIds<uint32_t>(input,tree,p,n,bbox,compact,numThreads);
+    else if(idBytes==8) return readIds<uint64_t>(input,tree,p,n,bbox,compact,numThreads);
+    return false;
+}
+
+bool writeSortIndex(const char* filename,const ParticlesData& particles)
+{
+    if(const ParticlesSimple* simple=dynamic_cast<const ParticlesSimple*>(&particles))
+        return simple->writeSortIndex(filename);
+    if(const ParticlesMapped* mapped=dynamic_cast<const ParticlesMapped*>(&particles))
+        return mapped->writeSortIndex(filename);
+    std::cerr<<"Partio: writeSortIndex only supports particles from read() or readMapped()"<<std::endl;
+    return false;
+}
+
+}
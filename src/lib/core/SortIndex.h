@@ -0,0 +1,64 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+
+#ifndef _SortIndex_h_
+#define _SortIndex_h_
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cassert>
+#include <float.h>
+#include <string.h>
+#include "../Partio.h"
+#include "KdTree.h"
+
+namespace Partio{
+
+//! Name of the file the KD-Tree of a particle file is saved in, next to it
+std::string sortIndexFilename(const char* filename);
+
+//! Saves the node order and bbox of a sorted tree of the particles of filename.
+//! The index is keyed to the size and modification time filename has now.
+bool saveSortIndex(const char* filename,const KdTree<3>& tree);
+
+//! Makes tree a sorted tree of the n positions p read from filename, from the
+//! index saved for it. Returns false, leaving tree to be sorted normally, if
+//! there is no index or it doesn't match the file or the positions.
+bool loadSortIndex(const char* filename,KdTree<3>& tree,const float* p,const int64_t n,
+    const bool compact,const int numThreads);
+
+}
+#endif
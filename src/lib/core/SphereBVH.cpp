@@ -0,0 +1,493 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+
+#ifdef PARTIO_WIN32
+#    define NOMINMAX
+#    include <intrin.h>
+#endif
+
+#include "SphereBVH.h"
+#include "RayHits.h"
+#include "Parallel.h"
+#include <math.h>
+
+namespace Partio{
+
+namespace
+{
+    const int64_t chunkSize=1<<14;
+    const uint64_t cellMax=(1<<18)-1; // Morton cells per axis of the sphere centers
+
+    inline int64_t chunkCount(const int64_t n)
+    {return (n+chunkSize-1)/chunkSize;}
+
+    inline int leadingZeros(const uint64_t x)
+    {
+        if(!x) return 64;
+#ifndef PARTIO_WIN32
+        return __builtin_clzll(x);
+#else
+        unsigned long bit;
+        _BitScanReverse64(&bit,x);
+        return 63-(int)bit;
+#endif
+    }
+
+    //! Spreads the low 21 bits of x out to every third bit
+    inline uint64_t spreadBits(uint64_t x)
+    {
+        x&=0x1fffff;
+        x=(x|x<<32)&0x1f00000000ffffULL;
+        x=(x|x<<16)&0x1f0000ff0000ffULL;
+        x=(x|x<<8)&0x100f00f00f00f00fULL;
+        x=(x|x<<4)&0x10c30c30c30c30c3ULL;
+        x=(x|x<<2)&0x1249249249249249ULL;
+        return x;
+    }
+
+    //! Point containment, for findSpheresContaining()
+    struct ContainsPoint
+    {
+        const float* p;
+        ContainsPoint(const float* p):p(p){}
+
+        bool box(const float* min,const float* max) const
+        {
+            for(int k=0;k<3;k++) if(p[k]<min[k] || p[k]>max[k]) return false;
+            return true;
+        }
+
+        bool sphere(const float* s) const
+        {
+            float d2=0;
+            for(int k=0;k<3;k++) d2+=(p[k]-s[k])*(p[k]-s[k]);
+            return d2<=s[3]*s[3];
+        }
+    };
+
+    //! Box overlap, for findSpheresOverlapping()
+    struct OverlapsBox
+    {
+        const BBox<3>& query;
+        OverlapsBox(const BBox<3>& query):query(query){}
+
+        bool box(const float* min,const float* max) const
+        {
+            for(int k=0;k<3;k++) if(max[k]<query.min[k] || min[k]>query.max[k]) return false;
+            return true;
+        }
+
+        bool sphere(const float* s) const
+        {
+            // squared distance from the center to the closest point of the box
+            float d2=0;
+            for(int k=0;k<3;k++){
+                float d=s[k]<query.min[k] ? query.min[k]-s[k] : s[k]>query.max[k] ? s[k]-query.max[k] : 0;
+                d2+=d*d;
+            }
+            return d2<=s[3]*s[3];
+        }
+    };
+}
+
+//! Sort keys of the spheres, one chunk of keys per task
+/*!
+  The top bits hold how many octaves below the largest radius a sphere's
+  radius is and the rest a Morton code of its center, so the top of the
+  hierarchy splits by size. A few large spheres then inflate only the boxes
+  of their own subtrees instead of every box near them.
+*/
+struct SphereBVH::CodeTask
+{
+    std::vector<SortKey>& keys;
+    const float* centers;
+    const float* radii;
+    float maxRadius;
+    float origin[3],scale[3];
+
+    CodeTask(std::vector<SortKey>& keys,const float* centers,const float* radii,const BBox<3>& box,
+        const float maxRadius)
+        :keys(keys),centers(centers),radii(radii),maxRadius(maxRadius)
+    {
+        for(int k=0;k<3;k++){
+            float extent=box.max[k]-box.min[k];
+            origin[k]=box.min[k];
+            scale[k]=extent>0 ? (float)cellMax/extent : 0;
+        }
+    }
+
+    void operator()(int chunk)
+    {
+        int64_t end=std::min((int64_t)keys.size(),(chunk+1)*chunkSize);
+        for(int64_t i=chunk*chunkSize;i<end;i++){
+            int octave=31;
+            float ratio=radii[i]>0 ? maxRadius/radii[i] : FLT_MAX;
+            if(ratio<FLT_MAX){
+                frexp(ratio,&octave);
+                octave=std::max(0,std::min(31,octave-1));
+            }
+            uint64_t code=(uint64_t)octave<<54;
+            for(int k=0;k<3;k++){
+                float cell=(centers[3*i+k]-origin[k])*scale[k];
+                uint64_t bits=cell>0 ? std::min((uint64_t)cell,cellMax) : 0;
+                code|=spreadBits(bits)<<(2-k);
+            }
+            keys[i].code=code;
+            keys[i].id=i;
+        }
+    }
+};
+
+//! Sorts one chunk of keys
+struct SphereBVH::SortTask
+{
+    std::vector<SortKey>& keys;
+    SortTask(std::vector<SortKey>& keys):keys(keys){}
+
+    void operator()(int chunk)
+    {
+        int64_t end=std::min((int64_t)keys.size(),(chunk+1)*chunkSize);
+        std::sort(keys.begin()+chunk*chunkSize,keys.begin()+end);
+    }
+};
+
+//! Merges pairs of neighboring sorted runs of width keys
+struct SphereBVH::MergeTask
+{
+    std::vector<SortKey>& keys;
+    int64_t width;
+    MergeTask(std::vector<SortKey>& keys,const int64_t width):keys(keys),width(width){}
+
+    void operator()(int pair)
+    {
+        int64_t n=keys.size();
+        int64_t start=pair*2*width;
+        int64_t middle=std::min(n,start+width),end=std::min(n,start+2*width);
+        std::inplace_merge(keys.begin()+start,keys.begin()+middle,keys.begin()+end);
+    }
+};
+
+//! Copies the spheres into Morton order
+struct SphereBVH::GatherTask
+{
+    SphereBVH& bvh;
+    const std::vector<SortKey>& keys;
+    const float* centers;
+    const float* radii;
+
+    GatherTask(SphereBVH& bvh,const std::vector<SortKey>& keys,const float* centers,const float* radii)
+        :bvh(bvh),keys(keys),centers(centers),radii(radii)
+    {}
+
+    void operator()(int chunk)
+    {
+        int64_t end=std::min((int64_t)keys.size(),(chunk+1)*chunkSize);
+        for(int64_t i=chunk*chunkSize;i<end;i++){
+            uint64_t id=keys[i].id;
+            float* sphere=&bvh._spheres[4*i];
+            for(int k=0;k<3;k++) sphere[k]=centers[3*id+k];
+            sphere[3]=radii[id]>0 ? radii[id] : 0;
+            bvh._ids[i]=id;
+            bvh._codes[i]=keys[i].code;
+        }
+    }
+};
+
+//! Emits one chunk of internal nodes
+struct SphereBVH::HierarchyTask
+{
+    SphereBVH& bvh;
+    HierarchyTask(SphereBVH& bvh):bvh(bvh){}
+
+    void operator()(int chunk)
+    {
+        int64_t end=std::min((int64_t)bvh._nodes.size(),(chunk+1)*chunkSize);
+        for(int64_t i=chunk*chunkSize;i<end;i++) bvh.emitNode(i);
+    }
+};
+
+//! Refits the boxes above one chunk of leaves
+struct SphereBVH::RefitTask
+{
+    SphereBVH& bvh;
+    RefitTask(SphereBVH& bvh):bvh(bvh){}
+
+    void operator()(int chunk)
+    {
+        int64_t end=std::min(bvh.size(),(chunk+1)*chunkSize);
+        for(int64_t i=chunk*chunkSize;i<end;i++) bvh.refitFrom(i);
+    }
+};
+
+SphereBVH::
+SphereBVH()
+{}
+
+size_t SphereBVH::
+memorySize() const
+{
+    return _nodes.capacity()*sizeof(Node)+_spheres.capacity()*sizeof(float)+_ids.capacity()*sizeof(ParticleIndex);
+}
+
+void SphereBVH::
+build(const float* centers,const float* radii,const int64_t n,const int numThreads)
+{
+    std::vector<Node>().swap(_nodes);
+    _spheres.resize(4*n);
+    _ids.resize(n);
+    _bbox.clear();
+    if(!n) return;
+
+    BBox<3> centerBox(centers);
+    float maxRadius=radii[0];
+    for(int64_t i=1;i<n;i++){
+        centerBox.grow(centers+3*i);
+        maxRadius=std::max(maxRadius,radii[i]);
+    }
+
+    // sort along the Morton curve, chunks in parallel then merged pairwise
+    {
+        std::vector<SortKey> keys(n);
+        CodeTask codeTask(keys,centers,radii,centerBox,maxRadius);
+        parallelFor(chunkCount(n),codeTask,numThreads);
+        SortTask sortTask(keys);
+        parallelFor(chunkCount(n),sortTask,numThreads);
+        for(int64_t width=chunkSize;width<n;width*=2){
+            MergeTask mergeTask(keys,width);
+            parallelFor((n+2*width-1)/(2*width),mergeTask,numThreads);
+        }
+        _codes.resize(n);
+        GatherTask gatherTask(*this,keys,centers,radii);
+        parallelFor(chunkCount(n),gatherTask,numThreads);
+    }
+
+    if(n==1){
+        for(int k=0;k<3;k++){
+            _bbox.min[k]=_spheres[k]-_spheres[3];
+            _bbox.max[k]=_spheres[k]+_spheres[3];
+        }
+    }else{
+        _nodes.resize(n-1);
+        _parents.resize(2*n-1);
+        HierarchyTask hierarchyTask(*this);
+        parallelFor(chunkCount(n-1),hierarchyTask,numThreads);
+        _visits.assign(n-1,0);
+        RefitTask refitTask(*this);
+        parallelFor(chunkCount(n),refitTask,numThreads);
+        const Node& root=_nodes[0];
+        for(int k=0;k<3;k++){
+            _bbox.min[k]=std::min(root.childMin[0][k],root.childMin[1][k]);
+            _bbox.max[k]=std::max(root.childMax[0][k],root.childMax[1][k]);
+        }
+    }
+    std::vector<uint64_t>().swap(_codes);
+    std::vector<int64_t>().swap(_parents);
+    std::vector<int>().swap(_visits);
+}
+
+int SphereBVH::
+delta(const int64_t i,const int64_t j) const
+{
+    if(j<0 || j>=size()) return -1;
+    // equal codes are told apart by leaf index, as if it were appended to the code
+    if(_codes[i]==_codes[j]) return 64+leadingZeros((uint64_t)(i^j));
+    return leadingZeros(_codes[i]^_codes[j]);
+}
+
+void SphereBVH::
+emitNode(const int64_t i)
+{
+    // the node's range of leaves extends from i towards the neighbor sharing more prefix
+    const int64_t direction=delta(i,i+1)>delta(i,i-1) ? 1 : -1;
+    const int minDelta=delta(i,i-direction);
+    int64_t maxLength=2;
+    while(delta(i,i+maxLength*direction)>minDelta) maxLength*=2;
+    int64_t length=0;
+    for(int64_t t=maxLength/2;t>=1;t/=2)
+        if(delta(i,i+(length+t)*direction)>minDelta) length+=t;
+    const int64_t j=i+length*direction;
+
+    // split where the prefix shared by the whole range ends
+    const int nodeDelta=delta(i,j);
+    int64_t split=0;
+    for(int64_t t=length;t>1;){
+        t=(t+1)/2;
+        if(delta(i,i+(split+t)*direction)>nodeDelta) split+=t;
+    }
+    const int64_t gamma=i+split*direction+std::min(direction,(int64_t)0);
+
+    const int64_t n=size();
+    Node& node=_nodes[i];
+    if(std::min(i,j)==gamma){
+        node.child[0]=~gamma;
+        _parents[n-1+gamma]=i;
+    }else{
+        node.child[0]=gamma;
+        _parents[gamma]=i;
+    }
+    if(std::max(i,j)==gamma+1){
+        node.child[1]=~(gamma+1);
+        _parents[n+gamma]=i;
+    }else{
+        node.child[1]=gamma+1;
+        _parents[gamma+1]=i;
+    }
+}
+
+void SphereBVH::
+refitFrom(const int64_t leaf)
+{
+    const float* sphere=&_spheres[4*leaf];
+    float boxMin[3],boxMax[3];
+    for(int k=0;k<3;k++){
+        boxMin[k]=sphere[k]-sphere[3];
+        boxMax[k]=sphere[k]+sphere[3];
+    }
+    int64_t child=~leaf;
+    int64_t node=_parents[size()-1+leaf];
+    for(;;){
+        Node& parent=_nodes[node];
+        const int side=parent.child[0]==child ? 0 : 1;
+        for(int k=0;k<3;k++){
+            parent.childMin[side][k]=boxMin[k];
+            parent.childMax[side][k]=boxMax[k];
+        }
+        // the first child in leaves the parent to the second, which sees both boxes
+        if(atomicIncrement(&_visits[node])==1) return;
+        for(int k=0;k<3;k++){
+            boxMin[k]=std::min(parent.childMin[0][k],parent.childMin[1][k]);
+            boxMax[k]=std::max(parent.childMax[0][k],parent.childMax[1][k]);
+        }
+        if(node==0) return;
+        child=node;
+        node=_parents[node];
+    }
+}
+
+template<class Test> void SphereBVH::
+traverse(std::vector<ParticleIndex>& points,const Test& test) const
+{
+    if(_ids.empty()) return;
+    if(_nodes.empty()){
+        if(test.sphere(&_spheres[0])) points.push_back(_ids[0]);
+        return;
+    }
+
+    // keys are at most 128 bits with the leaf index, so no path is deeper than
+    // that and each level leaves at most one sibling on the stack
+    int64_t stack[130];
+    int stackSize=0;
+    int64_t node=0;
+    for(;;){
+        const Node& current=_nodes[node];
+        for(int side=0;side<2;side++){
+            if(!test.box(current.childMin[side],current.childMax[side])) continue;
+            const int64_t child=current.child[side];
+            if(child<0){
+                if(test.sphere(&_spheres[4*~child])) points.push_back(_ids[~child]);
+            }else stack[stackSize++]=child;
+        }
+        if(!stackSize) return;
+        node=stack[--stackSize];
+    }
+}
+
+void SphereBVH::
+findSpheresContaining(std::vector<ParticleIndex>& points,const float p[3]) const
+{
+    traverse(points,ContainsPoint(p));
+}
+
+void SphereBVH::
+findSpheresOverlapping(std::vector<ParticleIndex>& points,const BBox<3>& bbox) const
+{
+    traverse(points,OverlapsBox(bbox));
+}
+
+void SphereBVH::
+findSpheresAlongRays(RayHits* hits,const int nRays) const
+{
+    assert(nRays<=rayPacketSize);
+    if(_ids.empty() || nRays<=0) return;
+    if(_nodes.empty()){
+        for(int r=0;r<nRays;r++) hits[r].addSphere(_ids[0],&_spheres[0]);
+        return;
+    }
+
+    // entries remember where each ray entered them, so rays whose limit
+    // shrank below that since they were pushed drop out
+    struct Entry{int64_t node;unsigned active;float enter[rayPacketSize];};
+    Entry stack[130];
+    int top=0;
+    Entry& root=stack[top++];
+    root.node=0;root.active=(1u<<nRays)-1;
+    for(int r=0;r<nRays;r++) root.enter[r]=hits[r].tMin;
+
+    while(top){
+        const Entry e=stack[--top];
+        unsigned active=0;
+        for(int r=0;r<nRays;r++)
+            if((e.active>>r&1) && e.enter[r]<=hits[r].limit()) active|=1u<<r;
+        if(!active) continue;
+
+        const Node& current=_nodes[e.node];
+        Entry children[2];
+        float nearest[2]={FLT_MAX,FLT_MAX};
+        for(int side=0;side<2;side++){
+            Entry& child=children[side];
+            child.node=current.child[side];
+            child.active=0;
+            for(int r=0;r<nRays;r++){
+                if(!(active>>r&1)) continue;
+                float t0=hits[r].tMin,t1=hits[r].limit();
+                if(!hits[r].clip(current.childMin[side],current.childMax[side],t0,t1)) continue;
+                child.active|=1u<<r;
+                child.enter[r]=t0;
+                nearest[side]=std::min(nearest[side],t0);
+            }
+            if(child.node<0){
+                for(int r=0;r<nRays;r++)
+                    if(child.active>>r&1) hits[r].addSphere(_ids[~child.node],&_spheres[4*~child.node]);
+                child.active=0;
+            }
+        }
+        // farther child first, so the nearer one is popped next
+        const int nearSide=nearest[1]<nearest[0];
+        if(children[1-nearSide].active) stack[top++]=children[1-nearSide];
+        if(children[nearSide].active) stack[top++]=children[nearSide];
+    }
+}
+
+}
@@ -0,0 +1,123 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+
+#ifndef _SphereBVH_h_
+#define _SphereBVH_h_
+
+#include <vector>
+#include <algorithm>
+#include <cassert>
+#include <float.h>
+#include <string.h>
+#include "../Partio.h"
+#include "KdTree.h"
+
+namespace Partio{
+
+class RayHits;
+
+//! Bounding volume hierarchy over one sphere per particle
+/*!
+  Built as a linear BVH: the spheres are sorted by size octave and then along
+  a Morton curve of their centers, the binary radix tree over the sorted
+  codes is emitted one internal node per task, and boxes are refit bottom
+  up, with the second child to finish carrying on to the parent. Every step
+  runs in parallel. Each internal node stores the boxes of both its
+  children, so a traversal step tests both from one cache line. All results
+  are particle indices, no remapping is needed.
+*/
+class SphereBVH
+{
+public:
+    SphereBVH();
+
+    //! Builds the hierarchy over n spheres with xyz centers and one radius each
+    void build(const float* centers,const float* radii,const int64_t n,const int numThreads);
+
+    int64_t size() const {return (int64_t)_ids.size();}
+    const BBox<3>& bbox() const {return _bbox;}
+    size_t memorySize() const;
+
+    //! Appends the particles whose sphere contains p
+    void findSpheresContaining(std::vector<ParticleIndex>& points,const float p[3]) const;
+    //! Appends the particles whose sphere overlaps bbox
+    void findSpheresOverlapping(std::vector<ParticleIndex>& points,const BBox<3>& bbox) const;
+    //! Most rays findSpheresAlongRays() takes at once
+    static const int rayPacketSize=8;
+    //! Adds the spheres each ray of the packet reaches to its hits, nearer subtrees
+    //! first. The rays descend together, so they should be coherent
+    void findSpheresAlongRays(RayHits* hits,const int nRays) const;
+
+private:
+    //! Internal node, children below zero are leaves ~child
+    struct Node
+    {
+        float childMin[2][3];
+        float childMax[2][3];
+        int64_t child[2];
+    };
+
+    struct SortKey
+    {
+        uint64_t code;
+        uint64_t id;
+        bool operator<(const SortKey& other) const
+        {return code<other.code || (code==other.code && id<other.id);}
+    };
+
+    struct CodeTask;
+    struct SortTask;
+    struct MergeTask;
+    struct GatherTask;
+    struct HierarchyTask;
+    struct RefitTask;
+
+    //! Common prefix length of the keys of leaves i and j, -1 outside the leaves
+    int delta(const int64_t i,const int64_t j) const;
+    void emitNode(const int64_t i);
+    void refitFrom(const int64_t leaf);
+    template<class Test> void traverse(std::vector<ParticleIndex>& points,const Test& test) const;
+
+    BBox<3> _bbox;
+    std::vector<Node> _nodes; // internal nodes, the root is 0
+    std::vector<float> _spheres; // xyz and radius of each leaf, in Morton order
+    std::vector<ParticleIndex> _ids; // particle of each leaf
+    std::vector<uint64_t> _codes; // Morton code of each leaf, only while building
+    std::vector<int64_t> _parents; // parents of internal nodes then leaves, only while building
+    std::vector<int> _visits; // children refit so far per internal node, only while building
+};
+
+}
+#endif
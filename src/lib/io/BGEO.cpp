@@ -36,12 +36,15 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
 #include "../Partio.h"
 #include "PartioEndian.h"
 #include "../core/ParticleHeaders.h"
+#include "../core/ParticleMapped.h"
 #include "ZIP.h"
+#include "ReadFilter.h"
 
 #include <iostream>
 #include <fstream>
 #include <string>
 #include <memory>
+#include <climits>
 
 namespace Partio
 {
@@ -55,8 +58,9 @@ void writeHoudiniStr(ostream& ostream,const string& s)
 }
 
 
-ParticlesDataMutable* readBGEO(const char* filename,const bool headersOnly, char** attributes, int percentage)
+ParticlesDataMutable* readBGEO(const char* filename,const bool headersOnly,char** attributes,int percentage)
 {
+    const ReadFilter filter(attributes,percentage);
     auto_ptr<istream> input(Gzip_In(filename,ios::in|ios::binary));
     if(!*input){
         cerr<<"Partio: Unable to open file "<<filename<<endl;
@@ -95,7 +99,7 @@ ParticlesDataMutable* readBGEO(const char* filename,const bool headersOnly, char
     if(headersOnly) simple=new ParticleHeaders;
     else simple=create();
 
-    simple->addParticles(nPoints);
+    simple->addParticles(filter.numKept(nPoints));
 
 
     // Read attribute definitions
@@ -103,9 +107,11 @@ ParticlesDataMutable* readBGEO(const char* filename,const bool headersOnly, char
     vector<int> attrOffsets; // offsets in # of 32 bit offsets
     vector<ParticleAttribute> attrHandles;
     vector<ParticleAccessor> accessors;
-    attrOffsets.push_back(0); // pull values from byte offset
-    attrHandles.push_back(simple->addAttribute("position",VECTOR,3)); // we always have one
-    accessors.push_back(ParticleAccessor(attrHandles[0]));
+    if(filter.wantAttribute("position")){
+        attrOffsets.push_back(0); // pull values from byte offset
+        attrHandles.push_back(simple->addAttribute("position",VECTOR,3)); // we always have one
+        accessors.push_back(ParticleAccessor(attrHandles[0]));
+    }
     
     for(int i=0;i<nPointAttrib;i++){
         unsigned short nameLength;
@@ -125,15 +131,21 @@ ParticlesDataMutable* readBGEO(const char* filename,const bool headersOnly, char
             if(houdiniType==0) type=FLOAT;
             else if(houdiniType==1) type=INT;
             else if(houdiniType==5) type=VECTOR;
-            attrHandles.push_back(simple->addAttribute(name,type,size));
-            accessors.push_back(ParticleAccessor(attrHandles.back()));
-            attrOffsets.push_back(particleSize);
+            if(filter.wantAttribute(name)){
+                attrHandles.push_back(simple->addAttribute(name,type,size));
+                accessors.push_back(ParticleAccessor(attrHandles.back()));
+                attrOffsets.push_back(particleSize);
+            }
             particleSize+=size;
         }else if(houdiniType==4){
-            ParticleAttribute attribute=simple->addAttribute(name,INDEXEDSTR,size);
-            attrHandles.push_back(attribute);
-            accessors.push_back(ParticleAccessor(attrHandles.back()));
-            attrOffsets.push_back(particleSize);
+            const bool wanted=filter.wantAttribute(name);
+            ParticleAttribute attribute;
+            if(wanted){
+                attribute=simple->addAttribute(name,INDEXEDSTR,size);
+                attrHandles.push_back(attribute);
+                accessors.push_back(ParticleAccessor(attrHandles.back()));
+                attrOffsets.push_back(particleSize);
+            }
             int numIndices=0;
             read<BIGEND>(*input,numIndices);
             for(int ii=0;ii<numIndices;ii++){
@@ -142,7 +154,7 @@ ParticlesDataMutable* readBGEO(const char* filename,const bool headersOnly, char
                 char* indexName=new char[indexNameLength+1];;
                 input->read(indexName,indexNameLength);
                 indexName[indexNameLength]=0;
-                int id=simple->registerIndexedStr(attribute,indexName);
+                int id=wanted ? simple->registerIndexedStr(attribute,indexName) : ii;
                 if(id != ii){
                     std::cerr<<"Partio: error on read, expected registeerIndexStr to return index "<<ii<<" but got "<<id<<" for string "<<indexName<<std::endl;
                 }
@@ -172,8 +184,15 @@ ParticlesDataMutable* readBGEO(const char* filename,const bool headersOnly, char
     ParticlesDataMutable::iterator iterator=simple->begin();
     for(size_t i=0;i<accessors.size();i++) iterator.addAccessor(accessors[i]);
 
-    for(ParticlesDataMutable::iterator end=simple->end();iterator!=end;++iterator){
-        //for(int i=0;i<nPoints;i++){
+    // skipped points are seeked over in runs between the kept ones
+    std::streamoff skipped=0;
+    for(int i=0;i<nPoints;i++){
+        if(filter.keptIndex(i)<0){
+            skipped+=particleSize*sizeof(int);
+            continue;
+        }
+        skipBytes(*input,skipped);
+        skipped=0;
         input->read((char*)buffer,particleSize*sizeof(int));
         for(unsigned int attrIndex=0;attrIndex<attrHandles.size();attrIndex++){
             ParticleAttribute& handle=attrHandles[attrIndex];
@@ -186,6 +205,7 @@ ParticlesDataMutable* readBGEO(const char* filename,const bool headersOnly, char
                 data[k]=buffer[attrOffsets[attrIndex]+k];
             }
         }
+        ++iterator;
     }
     delete [] buffer;
 
@@ -193,11 +213,111 @@ ParticlesDataMutable* readBGEO(const char* filename,const bool headersOnly, char
     return simple;
 }
 
-bool writeBGEO(const char* filename,const ParticlesData& p,const bool compressed)
+// Points are interleaved big endian records, so attributes are left in the
+// file and only byte swapped into their own arrays when first used
+ParticlesMapped* readBGEOMapped(const char* filename)
 {
+    ifstream input(filename,ios::in|ios::binary);
+    if(!input) return 0;
+
+    // header values
+    int magic;
+    char versionChar;
+    int version;
+    int nPoints;
+    int nPrims;
+    int nPointGroups;
+    int nPrimGroups;
+    int nPointAttrib;
+    int nVertexAttrib;
+    int nPrimAttrib;
+    int nAttrib;
+    read<BIGEND>(input,magic,versionChar,version,nPoints,nPrims,nPointGroups);
+    read<BIGEND>(input,nPrimGroups,nPointAttrib,nVertexAttrib,nPrimAttrib,nAttrib);
+
+    const int bgeo_magic=((((('B'<<8)|'g')<<8)|'e')<<8)|'o';
+    if(magic!=bgeo_magic || version!=5) return 0;
+
+    ParticlesMapped* mapped=new ParticlesMapped;
+    if(!mapped->open(filename)){
+        mapped->release();
+        return 0;
+    }
+    mapped->setNumParticles(nPoints);
+
+    // Read attribute definitions, offsets are in # of 32 bit values
+    int particleSize=4;
+    vector<string> names(1,"position");
+    vector<ParticleAttributeType> types(1,VECTOR);
+    vector<int> counts(1,3);
+    vector<int> attrOffsets(1,0);
+    vector<vector<string> > indexedStrs(1);
+
+    for(int i=0;i<nPointAttrib;i++){
+        unsigned short nameLength;
+        read<BIGEND>(input,nameLength);
+        string name(nameLength,' ');
+        if(nameLength) input.read(&name[0],nameLength);
+        unsigned short size;
+        int houdiniType;
+        read<BIGEND>(input,size,houdiniType);
+        ParticleAttributeType type=NONE;
+        if(houdiniType==0) type=FLOAT;
+        else if(houdiniType==1) type=INT;
+        else if(houdiniType==5) type=VECTOR;
+        else if(houdiniType==4) type=INDEXEDSTR;
+        else{
+            cerr<<"Partio: unsupported bgeo attribute type "<<houdiniType<<" in "<<filename<<endl;
+            mapped->release();
+            return 0;
+        }
+        names.push_back(name);
+        types.push_back(type);
+        counts.push_back(size);
+        attrOffsets.push_back(particleSize);
+        indexedStrs.push_back(vector<string>());
+        if(type==INDEXEDSTR){
+            int numIndices=0;
+            read<BIGEND>(input,numIndices);
+            for(int ii=0;ii<numIndices && input;ii++){
+                unsigned short indexNameLength;
+                read<BIGEND>(input,indexNameLength);
+                string indexName(indexNameLength,' ');
+                if(indexNameLength) input.read(&indexName[0],indexNameLength);
+                indexedStrs.back().push_back(indexName);
+            }
+        }else{
+            // skip default values
+            input.seekg(size*sizeof(int),ios::cur);
+        }
+        particleSize+=size;
+    }
+
+    size_t pointsOffset=input.tellg();
+    int recordSize=particleSize*sizeof(int);
+    if(!input || pointsOffset+(size_t)nPoints*recordSize>mapped->mappedSize()){
+        cerr<<"Partio: Unexpected end of file in "<<filename<<endl;
+        mapped->release();
+        return 0;
+    }
+
+    for(size_t i=0;i<names.size();i++){
+        ParticleAttribute attr=mapped->addAttribute(names[i].c_str(),types[i],counts[i],
+            pointsOffset+attrOffsets[i]*sizeof(int),recordSize,!big_endian);
+        for(size_t ii=0;ii<indexedStrs[i].size();ii++) mapped->registerIndexedStr(attr,indexedStrs[i][ii].c_str());
+    }
+    return mapped;
+}
+
+bool writeBGEO(const char* filename,const ParticlesData& p,const bool compressed,const WriteOptions& options)
+{
+    if(p.numParticles()>INT_MAX){
+        cerr<<"Partio: BGEO stores a 32 bit point count, can't write "<<p.numParticles()<<" particles to "<<filename<<endl;
+        return false;
+    }
     auto_ptr<ostream> output(
         compressed ? 
-        Gzip_Out(filename,ios::out|ios::binary)
+        Gzip_Out(filename,ios::out|ios::binary,options.compressionLevel,options.numThreads)
         :new ofstream(filename,ios::out|ios::binary));
 
     if(!*output){
@@ -208,7 +328,7 @@ bool writeBGEO(const char* filename,const ParticlesData& p,const bool compressed
     int magic=((((('B'<<8)|'g')<<8)|'e')<<8)|'o';
     char versionChar='V';
     int version=5;
-    int nPoints=p.numParticles();
+    int nPoints=(int)p.numParticles();
     int nPrims=1;
     int nPointGroups=0;
     int nPrimGroups=0;
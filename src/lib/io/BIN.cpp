@@ -42,11 +42,13 @@ Modifications from: github user: redpawfx (redpawFX@gmail.com)  and Luma Picture
 #include "../core/ParticleHeaders.h"
 #include "PartioEndian.h"
 #include "ZIP.h"
+#include "ReadFilter.h"
 
 #include <iostream>
 #include <fstream>
 #include <string>
 #include <memory>
+#include <climits>
 
 namespace Partio{
 
@@ -74,7 +76,7 @@ typedef struct{
 } BIN_HEADER;
 
 
-ParticlesDataMutable* readBIN(const char* filename, const bool headersOnly){
+ParticlesDataMutable* readBIN(const char* filename,const bool headersOnly,char** attributes,int percentage){
 
     auto_ptr<istream> input(new ifstream(filename,ios::in|ios::binary));
 
@@ -253,11 +255,16 @@ ParticlesDataMutable* readBIN(const char* filename, const bool headersOnly){
 
     }
 
-    return simple;
+    // this format is not filtered while it is parsed, so filter the result
+    return headersOnly ? simple : filterParticles(simple,ReadFilter(attributes,percentage));
 }
 
-bool writeBIN(const char* filename,const ParticlesData& p,const bool /*compressed*/)
+bool writeBIN(const char* filename,const ParticlesData& p,const bool /*compressed*/,const WriteOptions& /*options*/)
 {
+    if(p.numParticles()>INT_MAX){
+        cerr<<"Partio: BIN stores a 32 bit particle count, can't write "<<p.numParticles()<<" particles to "<<filename<<endl;
+        return false;
+    }
 
     auto_ptr<ostream> output(
     new ofstream(filename,ios::out|ios::binary));
@@ -280,7 +287,7 @@ bool writeBIN(const char* filename,const ParticlesData& p,const bool /*compresse
     header.version =  11; // version (11 is most current)
     header.frameNumber =  1; // frame number
     header.elapsedSimulationTime = 0.0416666; //   time elapsed (in seconds)
-    header.numParticles = p.numParticles(); // number of particles
+    header.numParticles = (int)p.numParticles(); // number of particles
     header.radius = 0.1; // radius of emitter
     header.pressure[0] = 1.0; // max, min, and avg pressure
     header.pressure[1] = 1.0;
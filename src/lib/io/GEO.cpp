@@ -36,6 +36,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
 #include "../Partio.h"
 #include "../core/ParticleHeaders.h"
 #include "ZIP.h"
+#include "ReadFilter.h"
 
 #include <iostream>
 #include <fstream>
@@ -107,14 +108,15 @@ string scanString(istream& input)
     return string(buf);
 }
 
-ParticlesDataMutable* readGEO(const char* filename,const bool headersOnly)
+ParticlesDataMutable* readGEO(const char* filename,const bool headersOnly,char** attributes,int percentage)
 {
     auto_ptr<istream> input(Gzip_In(filename,ios::in));
     if(!*input){
         cerr<<"Partio: Can't open particle data file: "<<filename<<endl;
         return 0;
     }
-    int NPoints=0, NPointAttrib=0;
+    int64_t NPoints=0;
+    int NPointAttrib=0;
 
     ParticlesDataMutable* simple=0;
     if(headersOnly) simple=new ParticleHeaders;
@@ -219,7 +221,8 @@ ParticlesDataMutable* readGEO(const char* filename,const bool headersOnly)
         *input >> paren;
         if (paren != ')') break;
     }
-    return simple;
+    // this format is not filtered while it is parsed, so filter the result
+    return filterParticles(simple,ReadFilter(attributes,percentage));
 }
 
 
@@ -234,11 +237,11 @@ void writeType(ostream& output,const ParticlesData& p,const ParticleAttribute& a
     }
 }
 
-bool writeGEO(const char* filename,const ParticlesData& p,const bool compressed)
+bool writeGEO(const char* filename,const ParticlesData& p,const bool compressed,const WriteOptions& options)
 {
     auto_ptr<ostream> output(
         compressed ? 
-        Gzip_Out(filename,ios::out)
+        Gzip_Out(filename,ios::out,options.compressionLevel,options.numThreads)
         :new ofstream(filename,ios::out));
 
     *output<<"PGEOMETRY V5"<<endl;
@@ -317,7 +320,7 @@ bool writeGEO(const char* filename,const ParticlesData& p,const bool compressed)
     *output<<"PrimitiveAttrib"<<endl;
     *output<<"generator 1 index 1 papi"<<endl;
     *output<<"Part "<<p.numParticles();
-    for(int i=0;i<p.numParticles();i++)
+    for(int64_t i=0;i<p.numParticles();i++)
         *output<<" "<<i;
     *output<<" [0]\nbeginExtra"<<endl;
     *output<<"endExtra"<<endl;
@@ -41,6 +41,7 @@ Modifications from: github user: redpawfx (redpawFX@gmail.com)  and Luma Picture
 #include "../core/ParticleHeaders.h"
 #include "PartioEndian.h" // read/write big-endian file
 #include "ZIP.h" // for zip file
+#include "ReadFilter.h"
 
 #include <iostream>
 #include <fstream>
@@ -103,33 +104,12 @@ bool ReadAttrHeader(std::istream& input, Attribute_Header& attribute){
     return true;
 }
 
-int CharArrayLen(char** charArray){
-    int i = 0;
-    if(charArray != false){
-        while(charArray[i] != '\0'){
-            i++;
-        }
-    }
-    return i;
-}
-
-bool IsStringInCharArray(std::string target, char** list){
-    //std::cout << "Is " << target << " in ";
-    for(int i = 0; i < CharArrayLen(list); i++){
-        //std::cout << std::string(list[i]) << " ";
-        if(target == std::string(list[i])){
-            //std::cout << "? (YES)" << std::endl;
-            return true;
-        }
-    }
-    //std::cout << "? (NO)" << std::endl;
-    return false;
-}
-
 static const int MC_MAGIC = ((((('F'<<8)|'O')<<8)|'R')<<8)|'4';
 static const int HEADER_SIZE = 56;
 
-ParticlesDataMutable* readMC(const char* filename, const bool headersOnly){
+ParticlesDataMutable* readMC(const char* filename,const bool headersOnly,char** attributes,int percentage){
+
+    const ReadFilter filter(attributes,percentage);
 
     std::auto_ptr<std::istream> input(Gzip_In(filename,std::ios::in|std::ios::binary));
     if(!*input){
@@ -168,7 +148,7 @@ ParticlesDataMutable* readMC(const char* filename, const bool headersOnly){
         simple=create();
     }
 
-    int numParticles = 0;
+    int64_t numParticles = 0;
     input->read(tag, 4); // MYCH
     while(((int)input->tellg()-HEADER_SIZE) < blockSize){
         Attribute_Header attrHeader;
@@ -182,12 +162,10 @@ ParticlesDataMutable* readMC(const char* filename, const bool headersOnly){
             input->seekg((int)input->tellg() + attrHeader.blocksize);
             continue;
         }
-#if 0 // TODO: if we ever put back attributes re-enable this
-        if(attributes && (IsStringInCharArray(attrHeader.name, attributes)==false)){
+        if(!filter.wantAttribute(attrHeader.name.c_str())){
             input->seekg((int)input->tellg() + attrHeader.blocksize);
             continue;
         }
-#endif
 
         if(attrHeader.type == std::string("FVCA")){
             input->seekg((int)input->tellg() + attrHeader.blocksize);
@@ -208,7 +186,7 @@ ParticlesDataMutable* readMC(const char* filename, const bool headersOnly){
             std::cerr << "Partio: Attribute '" << attrHeader.name << " " << attrHeader.type << "' cannot map type" << std::endl;
         }
     }
-    simple->addParticles(numParticles);
+    simple->addParticles(filter.numKept(numParticles));
 
     // If all we care about is headers, then return.--
     if(headersOnly){
@@ -237,30 +215,36 @@ ParticlesDataMutable* readMC(const char* filename, const bool headersOnly){
         it.addAccessor(accessor);
 
 		//std::cout << attrHeader.name << std::endl;
+        // values of skipped particles are seeked over in runs
+        std::streamoff skipped=0;
         if (attrHeader.type == std::string("DBLA")){
-			if  (attrHeader.name == "id")
-			{
-				for (int i = 0; i < simple->numParticles(); i++)
-				{
-                double tmp;
-                read<BIGEND>(*input, tmp);
-                int* data = simple->dataWrite<int>(attrHandle, i);
-                data[0] = (int)tmp;
-				}
-			}
-			else{
-				for (int i = 0; i < simple->numParticles(); i++){
-					double tmp;
-					read<BIGEND>(*input, tmp);
-					float* data = simple->dataWrite<float>(attrHandle, i);
-					data[0] = (float)tmp;
+			for (int64_t fileIndex = 0; fileIndex < numParticles; fileIndex++){
+				const int64_t i = filter.keptIndex(fileIndex);
+				if(i < 0){
+					skipped += sizeof(double);
+					continue;
 				}
+				skipBytes(*input, skipped);
+				skipped = 0;
+				double tmp;
+				read<BIGEND>(*input, tmp);
+				if  (attrHeader.name == "id") simple->dataWrite<int>(attrHandle, i)[0] = (int)tmp;
+				else simple->dataWrite<float>(attrHandle, i)[0] = (float)tmp;
 			}
+			skipBytes(*input, skipped);
         }
         else if(attrHeader.type == std::string("FVCA")){
-            for(Partio::ParticlesDataMutable::iterator end = simple->end(); it != end; ++it){
+            for(int64_t fileIndex = 0; fileIndex < numParticles; fileIndex++){
+                if(filter.keptIndex(fileIndex) < 0){
+                    skipped += sizeof(float)*attrHandle.count;
+                    continue;
+                }
+                skipBytes(*input, skipped);
+                skipped = 0;
                 input->read(accessor.raw<char>(it), sizeof(float)*attrHandle.count);
+                ++it;
             }
+            skipBytes(*input, skipped);
             it = simple->begin();
             for(Partio::ParticlesDataMutable::iterator end = simple->end(); it != end; ++it){
                 float* data = accessor.raw<float>(it);
@@ -35,6 +35,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
 #include "../Partio.h"
 #include "../core/ParticleHeaders.h"
 #include "ZIP.h"
+#include "ReadFilter.h"
 
 #include <iostream>
 #include <fstream>
@@ -49,8 +50,9 @@ using namespace std;
 
 // TODO: convert this to use iterators like the rest of the readers/writers
 
-ParticlesDataMutable* readPDA(const char* filename,const bool headersOnly,char** attributes, int percentage)
+ParticlesDataMutable* readPDA(const char* filename,const bool headersOnly,char** attributes,int percentage)
 {
+    const ReadFilter filter(attributes,percentage);
     auto_ptr<istream> input(Gzip_In(filename,ios::in|ios::binary));
     if(!*input){
         cerr<<"Partio: Can't open particle data file: "<<filename<<endl;
@@ -71,6 +73,7 @@ ParticlesDataMutable* readPDA(const char* filename,const bool headersOnly,char**
 
     vector<string> attrNames;
     vector<ParticleAttribute> attrs;
+    vector<bool> attrWanted; // unwanted attributes are parsed but not stored
 
     while(input->good()){
         *input>>word;
@@ -85,21 +88,27 @@ ParticlesDataMutable* readPDA(const char* filename,const bool headersOnly,char**
 
         if(index>=attrNames.size()) continue;
 
+        ParticleAttribute attr;
+        attr.name=attrNames[index];
+        attr.attributeIndex=-1;
         if(word=="V"){
-            attrs.push_back(simple->addAttribute(attrNames[index].c_str(),Partio::VECTOR,3));
+            attr.type=Partio::VECTOR;attr.count=3;
         }else if("R"){
-            attrs.push_back(simple->addAttribute(attrNames[index].c_str(),Partio::FLOAT,1));
+            attr.type=Partio::FLOAT;attr.count=1;
         }else if("I"){
-            attrs.push_back(simple->addAttribute(attrNames[index].c_str(),Partio::INT,1));
+            attr.type=Partio::INT;attr.count=1;
         }
+        attrWanted.push_back(filter.wantAttribute(attr.name.c_str()));
+        if(attrWanted.back()) attr=simple->addAttribute(attr.name.c_str(),attr.type,attr.count);
+        attrs.push_back(attr);
 
         index++;
     }
 
-    unsigned int num=0;
+    int64_t num=0;
     if(input->good()){
         *input>>num;
-        simple->addParticles(num);
+        simple->addParticles(filter.numKept(num));
         if(headersOnly) return simple; // escape before we try to touch data
     }else{
         simple->release();
@@ -118,17 +127,21 @@ ParticlesDataMutable* readPDA(const char* filename,const bool headersOnly,char**
 
     // Read actual particle data
     if(!input->good()){simple->release();return 0;}
-    for(unsigned int particleIndex=0;input->good() && particleIndex<num; particleIndex++) {
+    // text values have to be parsed even when they are not kept
+    int ibuf[3];float fbuf[3];
+    for(int64_t fileIndex=0;input->good() && fileIndex<num; fileIndex++) {
+        const int64_t particleIndex=filter.keptIndex(fileIndex);
         for(unsigned int attrIndex=0;attrIndex<attrs.size();attrIndex++){
+            const bool store=particleIndex>=0 && attrWanted[attrIndex];
             if(attrs[attrIndex].type==Partio::INT){
-                int* data=simple->dataWrite<int>(attrs[attrIndex],particleIndex);
+                int* data=store ? simple->dataWrite<int>(attrs[attrIndex],particleIndex) : ibuf;
                 for(int count=0;count<attrs[attrIndex].count;count++){
                     int ival;
                     *input>>ival;
                     data[count]=ival;
                 }
             }else if(attrs[attrIndex].type==Partio::FLOAT || attrs[attrIndex].type==Partio::VECTOR){
-                float* data=simple->dataWrite<float>(attrs[attrIndex],particleIndex);
+                float* data=store ? simple->dataWrite<float>(attrs[attrIndex],particleIndex) : fbuf;
                 for(int count=0;count<attrs[attrIndex].count;count++){
                     float fval;
                     *input>>fval;
@@ -141,11 +154,11 @@ ParticlesDataMutable* readPDA(const char* filename,const bool headersOnly,char**
     return simple;
 }
 
-bool writePDA(const char* filename,const ParticlesData& p,const bool compressed)
+bool writePDA(const char* filename,const ParticlesData& p,const bool compressed,const WriteOptions& options)
 {
     auto_ptr<ostream> output(
         compressed ? 
-        Gzip_Out(filename,ios::out|ios::binary)
+        Gzip_Out(filename,ios::out|ios::binary,options.compressionLevel,options.numThreads)
         :new ofstream(filename,ios::out|ios::binary));
 
     *output<<"ATTRIBUTES"<<endl;
@@ -174,7 +187,7 @@ bool writePDA(const char* filename,const ParticlesData& p,const bool compressed)
     *output<<"NUMBER_OF_PARTICLES: "<<p.numParticles()<<endl;
     *output<<"BEGIN DATA"<<endl;
 
-    for(int particleIndex=0;particleIndex<p.numParticles();particleIndex++){
+    for(int64_t particleIndex=0;particleIndex<p.numParticles();particleIndex++){
         for(unsigned int attrIndex=0;attrIndex<attrs.size();attrIndex++){
             if(attrs[attrIndex].type==Partio::INT || attrs[attrIndex].type==Partio::INDEXEDSTR){
                 const int* data=p.data<int>(attrs[attrIndex],particleIndex);
@@ -37,16 +37,19 @@ This code is partially based on the Gifts/readpdb directory of Autodesk Maya
 
 #include "../Partio.h"
 #include "../core/ParticleHeaders.h"
+#include "../core/ParticleMapped.h"
 namespace PDB{
 #include "pdb.h"
 }
 #include "PartioEndian.h"
 #include "ZIP.h"
+#include "ReadFilter.h"
 #include <iostream>
 #include <fstream>
 #include <string>
 #include <cassert>
 #include <memory>
+#include <climits>
 #include <string.h>
 namespace Partio
 {
@@ -89,7 +92,7 @@ string GetString(istream& input,bool& error)
 }
 
 
-template<int bits> ParticlesDataMutable* readPDBHelper(const char* filename,const bool headersOnly)
+template<int bits> ParticlesDataMutable* readPDBHelper(const char* filename,const bool headersOnly,const ReadFilter& filter)
 {
 
     auto_ptr<istream> input(Gzip_In(filename,ios::in|ios::binary));
@@ -112,7 +115,7 @@ template<int bits> ParticlesDataMutable* readPDBHelper(const char* filename,cons
         return 0;
     }
 
-    simple->addParticles(header.data_size);
+    simple->addParticles(filter.numKept(header.data_size));
     
     for(unsigned int i=0;i<header.num_data;i++){
         typename PDB_POLICY<bits>::CHANNEL_IO channelIOHeader;
@@ -137,35 +140,36 @@ template<int bits> ParticlesDataMutable* readPDBHelper(const char* filename,cons
             case PDB_LONG: type=INT;break;
             default: type=NONE;break;
         }
-        int size=header.data_size*channelData.datasize;
+        std::streamoff size=(std::streamoff)header.data_size*channelData.datasize;
 
         // Read data or skip if we haven't found appropriate type handle
         if(type==NONE){
-            char buf[1024];
-            int toSkip=size;
-            while(toSkip>0){
-                input->read(buf,min(toSkip,1024));
-                toSkip-=1024;
-            }
+            skipBytes(*input,size);
             cerr<<"Partio: Attribute '"<<name<<"' cannot map type"<<endl;
+        }else if(!filter.wantAttribute(name.c_str())){
+            skipBytes(*input,size); // channels are stored one after another
         }else{
             int count=channelData.datasize/TypeSize(type);
             ParticleAttribute attrHandle=simple->addAttribute(name.c_str(),type,count);
             if(headersOnly){
-                char buf[1024];
-                int toSkip=size;
-                while(toSkip>0){
-                    input->read(buf,min(toSkip,1024));
-                    toSkip-=1024;
-                }
+                skipBytes(*input,size);
             }else{
                 Partio::ParticlesDataMutable::iterator it=simple->begin();
                 Partio::ParticleAccessor accessor(attrHandle);
                 it.addAccessor(accessor);
 
-                for(Partio::ParticlesDataMutable::iterator end=simple->end();it!=end;++it){
+                std::streamoff skipped=0;
+                for(unsigned int i=0;i<(unsigned int)header.data_size;i++){
+                    if(filter.keptIndex(i)<0){
+                        skipped+=channelData.datasize;
+                        continue;
+                    }
+                    skipBytes(*input,skipped);
+                    skipped=0;
                     input->read(accessor.raw<char>(it),sizeof(float)*attrHandle.count);
+                    ++it;
                 }
+                skipBytes(*input,skipped);
             }
         }
     }
@@ -173,11 +177,15 @@ template<int bits> ParticlesDataMutable* readPDBHelper(const char* filename,cons
 }
 
 template<int bits>
-bool writePDBHelper(const char* filename,const ParticlesData& p,const bool compressed)
+bool writePDBHelper(const char* filename,const ParticlesData& p,const bool compressed,const WriteOptions& options)
 {
+    if(p.numParticles()>UINT_MAX){
+        cerr<<"Partio: PDB stores a 32 bit particle count, can't write "<<p.numParticles()<<" particles to "<<filename<<endl;
+        return false;
+    }
     auto_ptr<ostream> output(
         compressed ? 
-        Gzip_Out(filename,ios::out|ios::binary)
+        Gzip_Out(filename,ios::out|ios::binary,options.compressionLevel,options.numThreads)
         :new ofstream(filename,ios::out|ios::binary));
 
     if(!*output){
@@ -191,7 +199,7 @@ bool writePDBHelper(const char* filename,const ParticlesData& p,const bool compr
     h32.swap=1;
     h32.version=1.0;
     h32.time=0.0;
-    h32.data_size=p.numParticles();
+    h32.data_size=(unsigned int)p.numParticles();
     h32.num_data=p.numAttributes();
     for(int k=0;k<32;k++) h32.padding[k]=0;
     h32.data=0;
@@ -235,7 +243,7 @@ bool writePDBHelper(const char* filename,const ParticlesData& p,const bool compr
         output->write(attr.name.c_str(),attr.name.length()*sizeof(char)+1);
         data_header.type=channel.type;
         data_header.datasize=attr.count*sizeof(float);
-        data_header.blocksize=p.numParticles();
+        data_header.blocksize=(unsigned int)p.numParticles();
         data_header.num_blocks=1;
         data_header.block=0;
         output->write((char*)&data_header,sizeof(data_header));
@@ -251,19 +259,20 @@ bool writePDBHelper(const char* filename,const ParticlesData& p,const bool compr
     return true;
 }
 
-ParticlesDataMutable* readPDB32(const char* filename,const bool headersOnly, char** attributes, int percentage)
-{return readPDBHelper<32>(filename,headersOnly);}
+ParticlesDataMutable* readPDB32(const char* filename,const bool headersOnly,char** attributes,int percentage)
+{return readPDBHelper<32>(filename,headersOnly,ReadFilter(attributes,percentage));}
 
-ParticlesDataMutable* readPDB64(const char* filename,const bool headersOnly, char** attributes, int percentage)
-{return readPDBHelper<64>(filename,headersOnly);}
+ParticlesDataMutable* readPDB64(const char* filename,const bool headersOnly,char** attributes,int percentage)
+{return readPDBHelper<64>(filename,headersOnly,ReadFilter(attributes,percentage));}
 
-bool writePDB32(const char* filename,const ParticlesData& p,const bool compressed)
-{return writePDBHelper<32>(filename,p,compressed);}
+bool writePDB32(const char* filename,const ParticlesData& p,const bool compressed,const WriteOptions& options)
+{return writePDBHelper<32>(filename,p,compressed,options);}
 
-bool writePDB64(const char* filename,const ParticlesData& p,const bool compressed)
-{return writePDBHelper<64>(filename,p,compressed);}
+bool writePDB64(const char* filename,const ParticlesData& p,const bool compressed,const WriteOptions& options)
+{return writePDBHelper<64>(filename,p,compressed,options);}
 
-ParticlesDataMutable* readPDB(const char* filename,const bool headersOnly, char** attributes, int percentage)
+//! Works out whether a pdb was written with 32 or 64 bit pointers, returns 0 on error
+int PDBBits(const char* filename)
 {
     auto_ptr<istream> input(Gzip_In(filename,ios::in|ios::binary));
     if(!*input){
@@ -283,13 +292,87 @@ ParticlesDataMutable* readPDB(const char* filename,const bool headersOnly, char*
     input->read((char*)&channelIOHeader,sizeof(channelIOHeader));
     //cout<<"we got channel io as "<<int(channelIOHeader.type)<<" swap is "<<channelIOHeader.swap<<endl;
     if(channelIOHeader.type > 5  || channelIOHeader.type < 0 || (channelIOHeader.swap != 1 && channelIOHeader.swap != 0)){
-        return readPDBHelper<32>(filename,headersOnly);
+        return 32;
     }else{
-        return readPDBHelper<64>(filename,headersOnly);
+        return 64;
+    }
+}
+
+ParticlesDataMutable* readPDB(const char* filename,const bool headersOnly,char** attributes,int percentage)
+{
+    switch(PDBBits(filename)){
+        case 32: return readPDBHelper<32>(filename,headersOnly,ReadFilter(attributes,percentage));
+        case 64: return readPDBHelper<64>(filename,headersOnly,ReadFilter(attributes,percentage));
+        default: return 0;
+    }
+}
+
+// Each pdb channel is one contiguous block of native floats/ints, so apart
+// from the headers nothing has to be read
+template<int bits> ParticlesMapped* readPDBMappedHelper(const char* filename)
+{
+    ifstream input(filename,ios::in|ios::binary);
+    if(!input) return 0;
+
+    typename PDB_POLICY<bits>::HEADER header;
+    input.read((char*)&header,sizeof(typename PDB_POLICY<bits>::HEADER));
+    if(header.magic != PDB_MAGIC) return 0;
+
+    ParticlesMapped* mapped=new ParticlesMapped;
+    if(!mapped->open(filename)){
+        mapped->release();
+        return 0;
+    }
+    mapped->setNumParticles(header.data_size);
+
+    for(unsigned int i=0;i<header.num_data;i++){
+        typename PDB_POLICY<bits>::CHANNEL_IO channelIOHeader;
+        input.read((char*)&channelIOHeader,sizeof(channelIOHeader));
+        typename PDB_POLICY<bits>::CHANNEL channelHeader;
+        input.read((char*)&channelHeader,sizeof(channelHeader));
+        bool error;
+        string name=GetString(input,error);
+        typename PDB_POLICY<bits>::CHANNEL_DATA channelData;
+        input.read((char*)&channelData,sizeof(channelData));
+
+        size_t offset=input.tellg();
+        size_t size=(size_t)header.data_size*channelData.datasize;
+        if(error || !input || offset+size>mapped->mappedSize()){
+            cerr<<"Partio: Unexpected end of file in "<<filename<<endl;
+            mapped->release();
+            return 0;
+        }
+
+        ParticleAttributeType type;
+        switch(channelHeader.type){
+            case PDB_VECTOR: type=VECTOR;break;
+            case PDB_REAL: type=FLOAT;break;
+            case PDB_LONG: type=INT;break;
+            default: type=NONE;break;
+        }
+        if(type==NONE) cerr<<"Partio: Attribute '"<<name<<"' cannot map type"<<endl;
+        else mapped->addAttribute(name.c_str(),type,channelData.datasize/TypeSize(type),offset,channelData.datasize,false);
+        input.seekg(size,ios::cur);
+    }
+    return mapped;
+}
+
+ParticlesMapped* readPDB32Mapped(const char* filename)
+{return readPDBMappedHelper<32>(filename);}
+
+ParticlesMapped* readPDB64Mapped(const char* filename)
+{return readPDBMappedHelper<64>(filename);}
+
+ParticlesMapped* readPDBMapped(const char* filename)
+{
+    switch(PDBBits(filename)){
+        case 32: return readPDBMappedHelper<32>(filename);
+        case 64: return readPDBMappedHelper<64>(filename);
+        default: return 0;
     }
 }
 
-bool writePDB(const char* filename,const ParticlesData& p,const bool compressed)
-{return writePDBHelper<32>(filename,p,compressed);}
+bool writePDB(const char* filename,const ParticlesData& p,const bool compressed,const WriteOptions& options)
+{return writePDBHelper<32>(filename,p,compressed,options);}
 
 }
@@ -41,11 +41,13 @@ Modifications from: github user: redpawfx (redpawFX@gmail.com)  and Luma Picture
 #include "../core/ParticleHeaders.h"
 #include "PartioEndian.h"
 #include "ZIP.h"
+#include "ReadFilter.h"
 
 #include <iostream>
 #include <fstream>
 #include <string>
 #include <memory>
+#include <climits>
 
 namespace Partio{
 
@@ -73,7 +75,9 @@ string readName(istream& input){
     return result;
 }
 
-ParticlesDataMutable* readPDC(const char* filename, const bool headersOnly){
+ParticlesDataMutable* readPDC(const char* filename,const bool headersOnly,char** attributes,int percentage){
+
+    const ReadFilter filter(attributes,percentage);
 
     auto_ptr<istream> input(Gzip_In(filename,std::ios::in|std::ios::binary));
     if(!*input){
@@ -92,7 +96,7 @@ ParticlesDataMutable* readPDC(const char* filename, const bool headersOnly){
     BIGEND::swap(header.numAttrs);
 
     ParticlesDataMutable* simple = headersOnly ? new ParticleHeaders: create();
-    simple->addParticles(header.numParticles);
+    simple->addParticles(filter.numKept(header.numParticles));
 
     for(int attrIndex = 0; attrIndex < header.numAttrs; attrIndex++){
         // add attribute
@@ -100,36 +104,51 @@ ParticlesDataMutable* readPDC(const char* filename, const bool headersOnly){
         string attrName = readName(*input);
         int type;
         read<BIGEND>(*input, type);
+        const bool wanted = filter.wantAttribute(attrName.c_str());
         if(type == 3){
-            attr = simple->addAttribute(attrName.c_str(), FLOAT, 1);
+            attr.type = FLOAT; attr.count = 1;
         }
         else if(type == 5){
-            attr = simple->addAttribute(attrName.c_str(), VECTOR, 3);
+            attr.type = VECTOR; attr.count = 3;
         }
+        if(wanted) attr = simple->addAttribute(attrName.c_str(), attr.type, attr.count);
 
-        // if headersOnly, skip
-        if(headersOnly){
-            input->seekg((int)input->tellg() + header.numParticles*sizeof(double)*attr.count);
+        // if headersOnly or not requested, skip
+        if(headersOnly || !wanted){
+            skipBytes(*input, (std::streamoff)header.numParticles*sizeof(double)*attr.count);
             continue;
         }
         else{
             double tmp[3];
-            for(int partIndex = 0; partIndex < simple->numParticles(); partIndex++){
+            std::streamoff skipped = 0;
+            for(int fileIndex = 0; fileIndex < header.numParticles; fileIndex++){
+                const int64_t partIndex = filter.keptIndex(fileIndex);
+                if(partIndex < 0){
+                    skipped += sizeof(double)*attr.count;
+                    continue;
+                }
+                skipBytes(*input, skipped);
+                skipped = 0;
                 for(int dim = 0; dim < attr.count; dim++){
                     read<BIGEND>(*input, tmp[dim]);
                     simple->dataWrite<float>(attr, partIndex)[dim] = (float)tmp[dim];
                 }
             }
+            skipBytes(*input, skipped);
         }
     }
 
     return simple;
 }
 
-bool writePDC(const char* filename,const ParticlesData& p,const bool compressed){
+bool writePDC(const char* filename,const ParticlesData& p,const bool compressed,const WriteOptions& options){
+    if(p.numParticles()>INT_MAX){
+        cerr<<"Partio: PDC stores a 32 bit particle count, can't write "<<p.numParticles()<<" particles to "<<filename<<endl;
+        return false;
+    }
     auto_ptr<ostream> output(
         compressed ?
-        Gzip_Out(filename,ios::out|ios::binary)
+        Gzip_Out(filename,ios::out|ios::binary,options.compressionLevel,options.numThreads)
         :new std::ofstream(filename,ios::out|ios::binary));
 
     if(!*output){
@@ -162,7 +181,7 @@ bool writePDC(const char* filename,const ParticlesData& p,const bool compressed)
         write<BIGEND>(*output, (int)(count+2));
 
         // write data
-        for(int partIndex = 0; partIndex < p.numParticles(); partIndex++){
+        for(int64_t partIndex = 0; partIndex < p.numParticles(); partIndex++){
             const float* data = p.data<float>(attr, partIndex);
             for(int dim = 0; dim < count; dim++){
                 write<BIGEND>(*output, (double)data[dim]);
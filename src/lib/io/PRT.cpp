@@ -41,6 +41,7 @@ Modifications from: github user: redpawfx (redpawFX@gmail.com)  and Luma Picture
 #include "../Partio.h"
 #include "PartioEndian.h"
 #include "../core/ParticleHeaders.h"
+#include "ReadFilter.h"
 #include <string.h>
 
 
@@ -56,10 +57,14 @@ Modifications from: github user: redpawfx (redpawFX@gmail.com)  and Luma Picture
 #include <string>
 #include <memory>
 #include <zlib.h>
+#include <algorithm>
+#include <vector>
 
 namespace Partio{
 
-#define OUT_BUFSIZE		(4096)
+#define OUT_BUFSIZE		(1<<16)
+#define IN_BUFSIZE		(1<<16)
+#define CHUNK_BUFSIZE		(1<<20)  // bytes of particle records converted at a time
 
 typedef struct FileHeadder {
     unsigned char	magic[8];
@@ -101,7 +106,7 @@ static bool read_buffer(std::istream& is, z_stream& z, char* in_buf, void* p, si
         if ( z.avail_in == 0 ) {
             if (!is.eof()) {
                 z.next_in = (Bytef*)in_buf;
-                is.read((char*)z.next_in, OUT_BUFSIZE);
+                is.read((char*)z.next_in, IN_BUFSIZE);
                 if (is.bad()) {
                     std::cerr<<"read error "<<std::endl;;
                     return false;
@@ -138,8 +143,71 @@ static bool write_buffer(std::ostream& os, z_stream& z, char* out_buf, void* p,
 
 
 
-ParticlesDataMutable* readPRT(const char* filename,const bool headersOnly)
+//! Converts arity values of one PRT channel from the record into attribute data
+typedef void (*ChannelConverter)(const char* src,void* dst,const int arity);
+
+template<class TSRC,class TDST>
+static void convertChannel(const char* src,void* dst,const int arity)
+{
+    TDST* out=static_cast<TDST*>(dst);
+    for (int k=0;k<arity;k++) {
+        TSRC val;
+        memcpy(&val,src+k*sizeof(TSRC),sizeof(TSRC)); // records are packed, so unaligned
+        out[k]=(TDST)val;
+    }
+}
+
+static void convertHalf(const char* src,void* dst,const int arity)
 {
+    float* out=static_cast<float*>(dst);
+    for (int k=0;k<arity;k++) {
+#ifdef USE_ILMHALF
+        half val;
+        memcpy(&val,src+k*sizeof(half),sizeof(half));
+        out[k]=(float)val;
+#else
+        unsigned short val;
+        memcpy(&val,src+k*sizeof(val),sizeof(val));
+        out[k]=half2float[val].f;
+#endif
+    }
+}
+
+static ChannelConverter channelConverter(const unsigned int type)
+{
+    switch (type) {
+    case 0: return convertChannel<short,int>;
+    case 1: return convertChannel<int,int>;
+    case 2: return convertChannel<long long,int>;
+    case 3: return convertHalf;
+    case 4: return convertChannel<float,float>;
+    case 5: return convertChannel<double,float>;
+    case 6: return convertChannel<unsigned short,int>;
+    case 7: return convertChannel<unsigned int,int>;
+    case 8: return convertChannel<unsigned long long,int>;
+    case 9: return convertChannel<signed char,int>;
+    case 10: return convertChannel<unsigned char,int>;
+    default: return 0;
+    }
+}
+
+static int channelTypeSize(const unsigned int type)
+{
+    static const int sizes[11]={2,4,8,2,4,8,2,4,8,1,1};
+    return type<11 ? sizes[type] : 0;
+}
+
+struct ChannelDecoder
+{
+    ChannelConverter convert;
+    int offset;
+    int arity;
+    ParticleAttribute attr;
+};
+
+ParticlesDataMutable* readPRT(const char* filename,const bool headersOnly,char** attributes,int percentage)
+{
+    const ReadFilter filter(attributes,percentage);
     std::auto_ptr<std::istream> input(new std::ifstream(filename,std::ios::in|std::ios::binary));
     if (!*input) {
         std::cerr<<"Partio: Unable to open file "<<filename<<std::endl;
@@ -165,14 +233,15 @@ ParticlesDataMutable* readPRT(const char* filename,const bool headersOnly)
     read<LITEND>(*input,channels);		// number of channel
     read<LITEND>(*input,channelsize);	// size of channel
 
-    simple->addParticles((const int)header.numParticles);
+    simple->addParticles(filter.numKept((int64_t)header.numParticles));
 
-    std::vector<Channel> chans;
+    std::vector<Channel> allChans,chans;
     std::vector<ParticleAttribute> attrs;
 
     for (int i=0; i<channels; i++) {
         Channel ch;
         input->read((char*)&ch, sizeof(Channel));
+        allChans.push_back(ch);
         ParticleAttributeType type=NONE;
         switch (ch.type) {
         case 0:	// int16
@@ -205,6 +274,7 @@ ParticlesDataMutable* readPRT(const char* filename,const bool headersOnly)
             }
 #endif
             std::string name((char*)ch.name);
+            if (!filter.wantAttribute(name.c_str())) continue;
             ParticleAttribute attrHandle=simple->addAttribute(name.c_str(),type,ch.arity);
             chans.push_back(ch);
             attrs.push_back(attrHandle);
@@ -213,6 +283,22 @@ ParticlesDataMutable* readPRT(const char* filename,const bool headersOnly)
 
     if (headersOnly) return simple;
 
+    // locate each channel in the interleaved particle record
+    std::vector<ChannelDecoder> decoders;
+    int recordSize=0;
+    for (unsigned int attrIndex=0;attrIndex<attrs.size();attrIndex++) {
+        ChannelDecoder decoder;
+        decoder.convert=channelConverter(chans[attrIndex].type);
+        decoder.offset=chans[attrIndex].offset;
+        decoder.arity=chans[attrIndex].arity;
+        decoder.attr=attrs[attrIndex];
+        decoders.push_back(decoder);
+        recordSize=std::max(recordSize,decoder.offset+channelTypeSize(chans[attrIndex].type)*decoder.arity);
+    }
+    for (int i=0;i<(int)allChans.size();i++)
+        recordSize=std::max(recordSize,(int)(allChans[i].offset+channelTypeSize(allChans[i].type)*allChans[i].arity));
+    if (recordSize==0) return simple;
+
     z_stream z;
     z.zalloc = Z_NULL;z.zfree = Z_NULL;z.opaque = Z_NULL;
     if (inflateInit( &z ) != Z_OK) {
@@ -220,110 +306,30 @@ ParticlesDataMutable* readPRT(const char* filename,const bool headersOnly)
         return 0;
     }
 
-    char in_buf[OUT_BUFSIZE];
+    std::vector<char> in_buf(IN_BUFSIZE);
     z.next_in = 0;
     z.avail_in = 0;
 
-    for (unsigned int particleIndex=0;particleIndex<(unsigned int )simple->numParticles();particleIndex++) {
-        for (unsigned int attrIndex=0;attrIndex<attrs.size();attrIndex++) {
-            if (attrs[attrIndex].type==Partio::INT) {
-                int* data=simple->dataWrite<int>(attrs[attrIndex],particleIndex);
-                for (int count=0;count<attrs[attrIndex].count;count++) {
-                    int ival = 0;
-                    switch (chans[attrIndex].type) {
-                    case 0:	// int16
-                        {
-                            short val;
-                            read_buffer(*input, z, (char*)in_buf, &val, sizeof(short));
-                            ival = (int)val;
-                        }
-                        break;
-                    case 1:	// int32
-                        {
-                            read_buffer(*input, z, (char*)in_buf, &ival, sizeof(int));
-                        }
-                        break;
-                    case 2:	// int64
-                        {
-                            long long val;
-                            read_buffer(*input, z, (char*)in_buf, &val, sizeof(long long));
-                            ival = (int)val;
-                        }
-                        break;
-                    case 6:	// uint16
-                        {
-                            unsigned short val;
-                            read_buffer(*input, z, (char*)in_buf, &val, sizeof(unsigned short));
-                            ival = (int)val;
-                        }
-                        break;
-                    case 7:	// uint32
-                        {
-                            unsigned int val;
-                            read_buffer(*input, z, (char*)in_buf,  &val, sizeof(unsigned int));
-                            ival = (int)val;
-                        }
-                        break;
-                    case 8:	// uint64
-                        {
-                            unsigned long long val;
-                            read_buffer(*input, z, (char*)in_buf, &val, sizeof(unsigned long long));
-                            ival = (int)val;
-                        }
-                        break;
-                    case 9:	// int8
-                        {
-                            char val;
-                            read_buffer(*input, z, (char*)in_buf, &val, sizeof(char));
-                            ival = (int)val;
-                        }
-                        break;
-                    case 10:// uint8
-                        {
-                            unsigned char val;
-                            read_buffer(*input, z, (char*)in_buf, &val, sizeof(unsigned char));
-                            ival = (int)val;
-                        }
-                        break;
-                    }
-                    data[count]=ival;
-                }
-            }else if (attrs[attrIndex].type==Partio::FLOAT || attrs[attrIndex].type==Partio::VECTOR) {
-                float* data=simple->dataWrite<float>(attrs[attrIndex],particleIndex);
-                for (int count=0;count<attrs[attrIndex].count;count++) {
-                    float fval;
-                    switch (chans[attrIndex].type) {
-                    case 3:	// float16
-                        {
-#ifdef USE_ILMHALF
-                            half val;
-                            read_buffer(*input, z, (char*)in_buf, &val, sizeof(half));
-                            fval = (float)(val);
-#else
-                            unsigned short val;
-                            read_buffer(*input, z, (char*)in_buf, &val, sizeof(val));
-                            fval = half2float[val].f;
-#endif
-                        }
-                        break;
-                    case 4:	// float32
-                        {
-                            read_buffer(*input, z, (char*)in_buf, &fval, sizeof(float));
-                        }
-                        break;
-                    case 5:	// float64
-                        {
-                            double val;
-                            read_buffer(*input, z, (char*)in_buf, &val, sizeof(double));
-                            fval = (float)val;
-                        }
-                        break;
-                    }
-                    data[count]=fval;
-                }
+    // inflate whole records a chunk at a time and convert them channel by channel
+    const int64_t numParticles=(int64_t)header.numParticles;
+    const int chunkParticles=std::max(1,CHUNK_BUFSIZE/recordSize);
+    std::vector<char> records((size_t)chunkParticles*recordSize);
+    for (int64_t chunkStart=0;chunkStart<numParticles;chunkStart+=chunkParticles) {
+        const int chunkCount=(int)std::min((int64_t)chunkParticles,numParticles-chunkStart);
+        if (!read_buffer(*input, z, &in_buf[0], &records[0], (size_t)chunkCount*recordSize)) {
+            inflateEnd(&z);
+            simple->release();
+            return 0;
+        }
+        for (unsigned int d=0;d<decoders.size();d++) {
+            const ChannelDecoder& decoder=decoders[d];
+            const char* src=&records[0]+decoder.offset;
+            for (int i=0;i<chunkCount;i++,src+=recordSize) {
+                const int64_t kept=filter.keptIndex(chunkStart+i);
+                if (kept>=0) decoder.convert(src,simple->dataWrite<void>(decoder.attr,kept),decoder.arity);
             }
-		}
-	}
+        }
+    }
     if (inflateEnd( &z ) != Z_OK) {
         std::cerr<<"Zlib inflateEnd error"<<std::endl;
         return 0;
@@ -333,10 +339,10 @@ ParticlesDataMutable* readPRT(const char* filename,const bool headersOnly)
     return simple;
 }
 
-bool writePRT(const char* filename,const ParticlesData& p,const bool /*compressed*/)
+bool writePRT(const char* filename,const ParticlesData& p,const bool /*compressed*/,const WriteOptions& /*options*/)
 {
 	/// Krakatoa pukes on 0 particle files for some reason so don't export at all....
-    int numParts = p.numParticles();
+    int64_t numParts = p.numParticles();
     if (numParts)
     {
         std::auto_ptr<std::ostream> output(
@@ -361,6 +367,7 @@ bool writePRT(const char* filename,const ParticlesData& p,const bool /*compresse
         write<LITEND>(*output, reserve);
 
         std::vector<ParticleAttribute> attrs;
+        std::vector<int> attrOffsets;
         int offset = 0;
         for (int i=0;i<p.numAttributes();i++) {
             ParticleAttribute attr;
@@ -384,6 +391,7 @@ bool writePRT(const char* filename,const ParticlesData& p,const bool /*compresse
     #endif
                 output->write((char*)&ch,sizeof(Channel));
                 attrs.push_back(attr);
+                attrOffsets.push_back(ch.offset);
             }
         }
 
@@ -394,21 +402,23 @@ bool writePRT(const char* filename,const ParticlesData& p,const bool /*compresse
             return false;
         }
 
-        char out_buf[OUT_BUFSIZE+10];
-        for (int particleIndex=0;particleIndex<p.numParticles();particleIndex++) {
+        // gather whole interleaved records a chunk at a time and deflate them together
+        std::vector<char> out_buf(OUT_BUFSIZE+10);
+        const int recordSize=offset;
+        const int chunkParticles=std::max(1,CHUNK_BUFSIZE/std::max(1,recordSize));
+        std::vector<char> records((size_t)chunkParticles*recordSize);
+        for (int64_t chunkStart=0;chunkStart<numParts && recordSize;chunkStart+=chunkParticles) {
+            const int chunkCount=(int)std::min((int64_t)chunkParticles,numParts-chunkStart);
             for (unsigned int attrIndex=0;attrIndex<attrs.size();attrIndex++) {
-                if (attrs[attrIndex].type==Partio::INT) {
-                    const int* data=p.data<int>(attrs[attrIndex],particleIndex);
-                    if (!write_buffer(*output, z, (char*)out_buf, (void*)data, sizeof(int)*attrs[attrIndex].count, false))
-                        return false;
-                } else if (attrs[attrIndex].type==Partio::FLOAT || attrs[attrIndex].type==Partio::VECTOR) {
-                    const float* data=p.data<float>(attrs[attrIndex],particleIndex);
-                    if (!write_buffer(*output, z, (char*)out_buf, (void*)data, sizeof(int)*attrs[attrIndex].count, false))
-                        return false;
-                }
+                const int size=TypeSize(attrs[attrIndex].type)*attrs[attrIndex].count;
+                char* dst=&records[0]+attrOffsets[attrIndex];
+                for (int i=0;i<chunkCount;i++,dst+=recordSize)
+                    memcpy(dst,p.data<void>(attrs[attrIndex],chunkStart+i),size);
             }
+            if (!write_buffer(*output, z, &out_buf[0], &records[0], (size_t)chunkCount*recordSize, false))
+                return false;
         }
-        write_buffer(*output, z, (char*)out_buf, 0, 0, true);
+        write_buffer(*output, z, &out_buf[0], 0, 0, true);
         if (deflateEnd( &z ) != Z_OK) {
             std::cerr<<"Zlib deflateEnd error"<<std::endl;
             return false;
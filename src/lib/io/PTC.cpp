@@ -39,8 +39,10 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
 #include "../core/ParticleHeaders.h"
 #include "PartioEndian.h"
 #include "ZIP.h"
+#include "ReadFilter.h"
 
 #include <iostream>
+#include <set>
 #include <fstream>
 #include <string>
 #include <cfloat>
@@ -79,8 +81,9 @@ bool ParseSpec(const string& spec,string& typeName,string& name)
     return true;
 }
 
-ParticlesDataMutable* readPTC(const char* filename,const bool headersOnly,char** attributes, int percentage)
+ParticlesDataMutable* readPTC(const char* filename,const bool headersOnly,char** attributes,int percentage)
 {
+    const ReadFilter filter(attributes,percentage);
     auto_ptr<istream> input(Gzip_In(filename,ios::in|ios::binary));
     if(!*input){
         cerr<<"Partio: Unable to open file "<<filename<<endl;
@@ -133,17 +136,24 @@ ParticlesDataMutable* readPTC(const char* filename,const bool headersOnly,char**
     ParticlesDataMutable* simple=0;
     if(headersOnly) simple=new ParticleHeaders;
     else simple=create();
-    simple->addParticles((int)nPoints);
+    simple->addParticles(filter.numKept((int64_t)nPoints));
 
     // PTC files always have something for these items, so allocate the data
     vector<ParticleAttribute> attrHandles;
-    ParticleAttribute positionHandle=simple->addAttribute("position",VECTOR,3);
-    ParticleAttribute normalHandle=simple->addAttribute("normal",VECTOR,3);
-    ParticleAttribute radiusHandle=simple->addAttribute("radius",FLOAT,1);
+    vector<bool> attrWanted;
+    const bool wantPosition=filter.wantAttribute("position");
+    const bool wantNormal=filter.wantAttribute("normal");
+    const bool wantRadius=filter.wantAttribute("radius");
+    ParticleAttribute positionHandle,normalHandle,radiusHandle;
+    if(wantPosition) positionHandle=simple->addAttribute("position",VECTOR,3);
+    if(wantNormal) normalHandle=simple->addAttribute("normal",VECTOR,3);
+    if(wantRadius) radiusHandle=simple->addAttribute("radius",FLOAT,1);
     string typeName,name;
 
     // data types are "float", "point", "vector", "normal", "color", or "matrix"
     int parsedSize=0;
+    std::set<string> usedNames;
+    usedNames.insert("position");usedNames.insert("normal");usedNames.insert("radius");
     for(int chanNum=0;chanNum<nVars;chanNum++){
         ParseSpec(GetString(*input,'\n'),typeName,name);
 
@@ -170,14 +180,18 @@ ParticlesDataMutable* readPTC(const char* filename,const bool headersOnly,char**
         // make unqiue name
         int unique=1;
         string effectiveName=name;
-        ParticleAttribute info;
-        while(simple->attributeInfo(effectiveName.c_str(),info)){
+        while(usedNames.count(effectiveName)){
             ostringstream ss;
             ss<<name<<unique++;
             effectiveName=ss.str();
         }
+        usedNames.insert(effectiveName);
 
-        attrHandles.push_back(simple->addAttribute(effectiveName.c_str(),dataType,dataSize));
+        ParticleAttribute attr;
+        attr.type=dataType;attr.count=dataSize;attr.attributeIndex=-1;
+        attrWanted.push_back(filter.wantAttribute(effectiveName.c_str()));
+        if(attrWanted.back()) attr=simple->addAttribute(effectiveName.c_str(),dataType,dataSize);
+        attrHandles.push_back(attr);
         parsedSize+=dataSize;
     }
     if(dataSize!=parsedSize){
@@ -195,13 +209,25 @@ ParticlesDataMutable* readPTC(const char* filename,const bool headersOnly,char**
     // more weird input attributes
     if(version>=1) for(int i=0;i<2;i++) read<LITEND>(*input,dummy);
 
-    for(int pointIndex=0;pointIndex<nPoints;pointIndex++){
-        float* pos=simple->dataWrite<float>(positionHandle,pointIndex);
+    // points are fixed size records, skipped ones are seeked over in runs
+    const int pointSize=3*sizeof(float)+2*sizeof(unsigned short)+sizeof(float)+dataSize*sizeof(float);
+    std::streamoff skipped=0;
+    float scratch[16];
+    for(int64_t fileIndex=0;fileIndex<nPoints;fileIndex++){
+        const int64_t pointIndex=filter.keptIndex(fileIndex);
+        if(pointIndex<0){
+            skipped+=pointSize;
+            continue;
+        }
+        skipBytes(*input,skipped);
+        skipped=0;
+
+        float* pos=wantPosition ? simple->dataWrite<float>(positionHandle,pointIndex) : scratch;
         read<LITEND>(*input,pos[0],pos[1],pos[2]);
 
         unsigned short phi,z; // normal encoded
         read<LITEND>(*input,phi,z);
-        float* norm=simple->dataWrite<float>(normalHandle,pointIndex);
+        float* norm=wantNormal ? simple->dataWrite<float>(normalHandle,pointIndex) : scratch;
 
 	// Convert unsigned short (phi,nz) to xyz normal
         // This packing code is based on Per Christensen's rman forum post
@@ -218,12 +244,12 @@ ParticlesDataMutable* readPTC(const char* filename,const bool headersOnly,char**
 	     norm[0] = norm[1] = norm[2] = 0.0f;
 	}        
 
-        float* radius=simple->dataWrite<float>(radiusHandle,pointIndex);
+        float* radius=wantRadius ? simple->dataWrite<float>(radiusHandle,pointIndex) : scratch;
         read<LITEND>(*input,radius[0]);
 
 
         for(unsigned int i=0;i<attrHandles.size();i++){
-            float* data=simple->dataWrite<float>(attrHandles[i],pointIndex);
+            float* data=attrWanted[i] ? simple->dataWrite<float>(attrHandles[i],pointIndex) : scratch;
             for(int j=0;j<attrHandles[i].count;j++)
                 read<LITEND>(*input,data[j]);
         }
@@ -233,13 +259,13 @@ ParticlesDataMutable* readPTC(const char* filename,const bool headersOnly,char**
     return simple;
 }
 
-bool writePTC(const char* filename,const ParticlesData& p,const bool compressed)
+bool writePTC(const char* filename,const ParticlesData& p,const bool compressed,const WriteOptions& options)
 {
     //ofstream output(filename,ios::out|ios::binary);
 
     auto_ptr<ostream> output(
         compressed ? 
-        Gzip_Out(filename,ios::out|ios::binary)
+        Gzip_Out(filename,ios::out|ios::binary,options.compressionLevel,options.numThreads)
         :new ofstream(filename,ios::out|ios::binary));
 
     if(!*output){
@@ -252,7 +278,7 @@ bool writePTC(const char* filename,const ParticlesData& p,const bool compressed)
     write<LITEND>(*output,(int)0);
 
     // particle count
-    double numParticlesAsDouble=p.numParticles();
+    double numParticlesAsDouble=(double)p.numParticles();
     write<LITEND>(*output,numParticlesAsDouble);
 
     ParticleAttribute positionHandle,normalHandle,radiusHandle;
@@ -269,7 +295,7 @@ bool writePTC(const char* filename,const ParticlesData& p,const bool compressed)
 
     // compute bounding box
     float boxmin[3]={FLT_MAX,FLT_MAX,FLT_MAX},boxmax[3]={-FLT_MAX,-FLT_MAX,-FLT_MAX};
-    for(int i=0;i<p.numParticles();i++){
+    for(int64_t i=0;i<p.numParticles();i++){
         const float* pos=p.data<float>(positionHandle,i);
         for(int k=0;k<3;k++){
             boxmin[k]=min(pos[k],boxmin[k]);
@@ -328,7 +354,7 @@ bool writePTC(const char* filename,const ParticlesData& p,const bool compressed)
         output->write(specs[i].c_str(),specs[i].length());
     }
 
-    for(int pointIndex=0;pointIndex<p.numParticles();pointIndex++){
+    for(int64_t pointIndex=0;pointIndex<p.numParticles();pointIndex++){
         // write position
         const float* pos=p.data<float>(positionHandle,pointIndex);
         write<LITEND>(*output,pos[0],pos[1],pos[2]);
@@ -38,6 +38,7 @@ Some code for this format  was helped along  by referring to an implementation b
 #include "../Partio.h"
 #include "../core/ParticleHeaders.h"
 #include "ZIP.h"
+#include "ReadFilter.h"
 
 #include <iostream>
 #include <sstream>
@@ -54,7 +55,7 @@ using namespace std;
 
 // TODO: convert this to use iterators like the rest of the readers/writers
 
-ParticlesDataMutable* readPTS(const char* filename,const bool headersOnly)
+ParticlesDataMutable* readPTS(const char* filename,const bool headersOnly,char** attributes,int percentage)
 {
     auto_ptr<istream> input(Gzip_In(filename,ios::in|ios::binary));
     if (!*input)
@@ -156,7 +157,7 @@ ParticlesDataMutable* readPTS(const char* filename,const bool headersOnly)
 
     input->seekg(0,ios::beg);
 
-    unsigned int num=0;
+    int64_t num=0;
     simple->addParticles(num);
     if (headersOnly) return simple; // escape before we try to touch data
 
@@ -174,7 +175,7 @@ ParticlesDataMutable* readPTS(const char* filename,const bool headersOnly)
 
     // we have to read line by line, because data is not  clean and consistent so we skip any lines that dont' conform
 
-    for (unsigned int particleIndex=0;input->good();)
+    for (int64_t particleIndex=0;input->good();)
     {
         string token = "";
         char line[1024];
@@ -204,7 +205,7 @@ ParticlesDataMutable* readPTS(const char* filename,const bool headersOnly)
 					int* data=simple->dataWrite<int>(attrs[attrIndex],particleIndex);
 					if (attrs[attrIndex].name == "id")
 					{
-						data[0]=particleIndex;
+						data[0]=(int)particleIndex;
 					}
 					else
 					{
@@ -241,16 +242,17 @@ ParticlesDataMutable* readPTS(const char* filename,const bool headersOnly)
             particleIndex++;
         }
     }
-    return simple;
+    // this format is not filtered while it is parsed, so filter the result
+    return filterParticles(simple,ReadFilter(attributes,percentage));
 }
 
 /// THIS DOESENT WORK YET>>
 /*
-bool writePTS(const char* filename,const ParticlesData& p,const bool compressed)
+bool writePTS(const char* filename,const ParticlesData& p,const bool compressed,const WriteOptions& options)
 {
     auto_ptr<ostream> output(
         compressed ?
-        Gzip_Out(filename,ios::out|ios::binary)
+        Gzip_Out(filename,ios::out|ios::binary,options.compressionLevel,options.numThreads)
         :new ofstream(filename,ios::out|ios::binary));
 
     *output<<"ATTRIBUTES"<<endl;
@@ -279,7 +281,7 @@ bool writePTS(const char* filename,const ParticlesData& p,const bool compressed)
     *output<<"NUMBER_OF_PARTICLES: "<<p.numParticles()<<endl;
     *output<<"BEGIN DATA"<<endl;
 
-    for(int particleIndex=0;particleIndex<p.numParticles();particleIndex++){
+    for(int64_t particleIndex=0;particleIndex<p.numParticles();particleIndex++){
         for(unsigned int attrIndex=0;attrIndex<attrs.size();attrIndex++){
             if(attrs[attrIndex].type==Partio::INT || attrs[attrIndex].type==Partio::INDEXEDSTR){
                 const int* data=p.data<int>(attrs[attrIndex],particleIndex);
@@ -34,15 +34,18 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
 */
 
 #include <iostream>
+#include <fstream>
 #include "../Partio.h"
+#include "../core/ParticleMapped.h"
 #include "readers.h"
 
 namespace Partio{
 using namespace std;
 
 // reader and writer code
-typedef ParticlesDataMutable* (*READER_FUNCTION)(const char*,const bool);
-typedef bool (*WRITER_FUNCTION)(const char*,const ParticlesData&,const bool);
+typedef ParticlesDataMutable* (*READER_FUNCTION)(const char*,const bool,char**,int);
+typedef bool (*WRITER_FUNCTION)(const char*,const ParticlesData&,const bool,const WriteOptions&);
+typedef ParticlesMapped* (*MAPPED_READER_FUNCTION)(const char*);
 
 map<string,READER_FUNCTION>&
 readers()
@@ -71,6 +74,23 @@ readers()
     return data;
 }
 
+map<string,MAPPED_READER_FUNCTION>&
+mappedReaders()
+{
+    static map<string,MAPPED_READER_FUNCTION> data;
+    static bool initialized=false;
+    if(!initialized){
+        data["bgeo"]=readBGEOMapped;
+        data["bhclassic"]=readBGEOMapped;
+        data["pdb"]=readPDBMapped;
+        data["pdb32"]=readPDB32Mapped;
+        data["pdb64"]=readPDB64Mapped;
+        data["itbl"]=readBGEOMapped;
+        data["atbl"]=readBGEOMapped;
+    }
+    return data;
+}
+
 map<string,WRITER_FUNCTION>&
 writers()
 {
@@ -123,6 +143,12 @@ bool extensionIgnoringGz(const string& filename,string& ret,bool &endsWithGz)
 
 ParticlesDataMutable*
 read(const char* c_filename)
+{
+    return readPart(c_filename,0,100);
+}
+
+ParticlesDataMutable*
+readPart(const char* c_filename,char** attributes,int percentage)
 {
     string filename(c_filename);
     string extension;
@@ -133,7 +159,41 @@ read(const char* c_filename)
         cerr<<"Partio: No reader defined for extension "<<extension<<endl;
         return 0;
     }
-    return (*i->second)(c_filename,false);
+    return (*i->second)(c_filename,false,attributes,percentage);
+}
+
+//! Whether the file starts with the gzip magic number
+bool isGzipped(const char* filename)
+{
+    ifstream input(filename,ios::in|ios::binary);
+    unsigned char magic[2]={0,0};
+    input.read((char*)magic,2);
+    return input && magic[0]==0x1f && magic[1]==0x8b;
+}
+
+ParticlesData*
+readMapped(const char* c_filename,const bool sort)
+{
+    string filename(c_filename);
+    string extension;
+    bool endsWithGz;
+    if(!extensionIgnoringGz(filename,extension,endsWithGz)) return 0;
+    map<string,MAPPED_READER_FUNCTION>::iterator i=mappedReaders().find(extension);
+    if(i!=mappedReaders().end() && !endsWithGz && !isGzipped(c_filename)){
+        ParticlesMapped* mapped=(*i->second)(c_filename);
+        if(mapped){
+            if(sort) mapped->sort(c_filename);
+            return mapped;
+        }
+    }
+    // compressed or not mappable, so do a regular read
+    ParticlesDataMutable* p=read(c_filename);
+    if(p && sort){
+        SortOptions options;
+        options.sourceFile=c_filename;
+        p->sort(options);
+    }
+    return p;
 }
 
 ParticlesInfo*
@@ -148,11 +208,17 @@ readHeaders(const char* c_filename)
         cerr<<"Partio: No reader defined for extension "<<extension<<endl;
         return 0;
     }
-    return (*i->second)(c_filename,true);
+    return (*i->second)(c_filename,true,0,100);
 }
 
 void
 write(const char* c_filename,const ParticlesData& particles,const bool forceCompressed)
+{
+    write(c_filename,particles,WriteOptions(forceCompressed));
+}
+
+void
+write(const char* c_filename,const ParticlesData& particles,const WriteOptions& options)
 {
     string filename(c_filename);
     string extension;
@@ -163,7 +229,7 @@ write(const char* c_filename,const ParticlesData& particles,const bool forceComp
         cerr<<"Partio: No writer defined for extension "<<extension<<endl;
         return;
     }
-    (*i->second)(c_filename,particles,forceCompressed || endsWithGz);
+    (*i->second)(c_filename,particles,options.forceCompressed || endsWithGz,options);
 }
 
 } // namespace Partio
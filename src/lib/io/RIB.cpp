@@ -36,10 +36,10 @@ namespace Partio
 
 using namespace std;
 
-bool writeRIB(const char* filename, const ParticlesData& p, const bool compressed)
+bool writeRIB(const char* filename, const ParticlesData& p, const bool compressed,const WriteOptions& options)
 {
     auto_ptr<ostream> output(
-        compressed ? Gzip_Out(filename, ios::out | ios::binary)
+        compressed ? Gzip_Out(filename, ios::out | ios::binary, options.compressionLevel, options.numThreads)
         : new ofstream(filename, ios::out | ios::binary));
 
     ParticleAttribute dummy;
@@ -93,7 +93,7 @@ bool writeRIB(const char* filename, const ParticlesData& p, const bool compresse
             case Partio::FLOAT:
             case Partio::VECTOR:
 			{
-                for (int particleIndex = 0; particleIndex < p.numParticles(); ++particleIndex)
+                for (int64_t particleIndex = 0; particleIndex < p.numParticles(); ++particleIndex)
                 {
                     const float *data = p.data<float>(attr, particleIndex);
                     for (int count = 0; count < attr.count; ++count)
@@ -111,7 +111,7 @@ bool writeRIB(const char* filename, const ParticlesData& p, const bool compresse
 			}
             case Partio::INT:
 			{
-                for (int particleIndex = 0; particleIndex < p.numParticles(); ++particleIndex)
+                for (int64_t particleIndex = 0; particleIndex < p.numParticles(); ++particleIndex)
                 {
                     const int *data = p.data<int>(attr, particleIndex);
                     for (int count = 0; count < attr.count; ++count)
@@ -0,0 +1,69 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+#include "ReadFilter.h"
+#include <vector>
+
+namespace Partio{
+
+ParticlesDataMutable* filterParticles(ParticlesDataMutable* particles,const ReadFilter& filter)
+{
+    if(!particles || filter.all()) return particles;
+
+    ParticlesDataMutable* filtered=create();
+    std::vector<ParticleAttribute> from,to;
+    for(int i=0;i<particles->numAttributes();i++){
+        ParticleAttribute attr;
+        particles->attributeInfo(i,attr);
+        if(!filter.wantAttribute(attr.name.c_str())) continue;
+        from.push_back(attr);
+        to.push_back(filtered->addAttribute(attr.name.c_str(),attr.type,attr.count));
+        if(attr.type==INDEXEDSTR){
+            const std::vector<std::string>& strs=particles->indexedStrs(attr);
+            for(size_t s=0;s<strs.size();s++) filtered->registerIndexedStr(to.back(),strs[s].c_str());
+        }
+    }
+    filtered->addParticles(filter.numKept(particles->numParticles()));
+
+    for(int64_t i=0;i<particles->numParticles();i++){
+        const int64_t kept=filter.keptIndex(i);
+        if(kept<0) continue;
+        for(size_t a=0;a<from.size();a++)
+            memcpy(filtered->dataWrite<void>(to[a],kept),particles->data<void>(from[a],i),TypeSize(from[a].type)*from[a].count);
+    }
+    particles->release();
+    return filtered;
+}
+
+}
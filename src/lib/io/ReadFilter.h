@@ -0,0 +1,99 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+#ifndef _ReadFilter_h_
+#define _ReadFilter_h_
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include "../Partio.h"
+
+namespace Partio{
+
+//! Which attributes and particles a reader loads, see readPart()
+/*!
+  attributes is a null terminated list of names, null for all of them.
+  Particles are sampled with an even stride: particle i of the file is kept
+  when (i+1)*percentage/100 rounds down to more than i*percentage/100, so
+  repeated reads return the same particles spread over the whole file.
+*/
+class ReadFilter
+{
+    char** attributes;
+    int percentage;
+
+public:
+    ReadFilter(char** attributes=0,const int percentage=100)
+        :attributes(attributes),percentage(std::max(0,std::min(100,percentage)))
+    {}
+
+    //! Whether every attribute and particle is read
+    bool all() const
+    {return !attributes && percentage==100;}
+
+    bool wantAttribute(const char* name) const
+    {
+        if(!attributes) return true;
+        for(char** attribute=attributes;*attribute;attribute++)
+            if(!strcmp(*attribute,name)) return true;
+        return false;
+    }
+
+    //! Number of particles kept out of numParticles in the file
+    int64_t numKept(const int64_t numParticles) const
+    {return numParticles*percentage/100;}
+
+    //! Index the file's particle gets in the result, -1 if it is skipped
+    int64_t keptIndex(const int64_t index) const
+    {
+        const int64_t kept=index*percentage/100;
+        return (index+1)*percentage/100>kept ? kept : -1;
+    }
+};
+
+//! Skips bytes of input, seeking when the stream allows it
+inline void skipBytes(std::istream& input,const std::streamoff bytes)
+{
+    if(bytes<=0) return;
+    if(input.rdbuf()->pubseekoff(bytes,std::ios::cur,std::ios::in)==std::streampos(std::streamoff(-1)))
+        input.ignore(bytes);
+}
+
+//! Applies a filter to fully read particles for formats that cannot skip data
+//! while reading. Releases particles when it has to make a filtered copy.
+ParticlesDataMutable* filterParticles(ParticlesDataMutable* particles,const ReadFilter& filter);
+
+}
+#endif
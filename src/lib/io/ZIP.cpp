@@ -46,8 +46,11 @@ extern "C"{
 #include <stdexcept>
 #include <cstring>
 #include <string>
+#include <algorithm>
 
 #include "ZIP.h"
+#include "../Partio.h"
+#include "../core/Parallel.h"
 
 namespace Partio{
 
@@ -89,13 +92,15 @@ struct GZipFileHeader
     unsigned char os; // operating system 0xff for unknown
     unsigned short crc16; // crc check
     unsigned int crc32;
+    unsigned int block_size; // compressed size of a partio block member, 0 for other gzip files
 
     GZipFileHeader()
-        :magic0(0),magic1(0),flags(0),modtime(0),flags2(0),os(0),crc16(0),crc32(0)
+        :magic0(0),magic1(0),flags(0),modtime(0),flags2(0),os(0),crc16(0),crc32(0),block_size(0)
     {}
 
     bool Read(std::istream& istream)
-    {Read_Primitive(istream,magic0);
+    {block_size=0;
+    Read_Primitive(istream,magic0);
     Read_Primitive(istream,magic1);
     if(magic0 != 0x1f || magic1 != 0x8b){//std::cerr<<"gzip: did not find gzip magic 0x1f 0x8b"<<std::endl;
         return false;}
@@ -106,27 +111,37 @@ struct GZipFileHeader
     Read_Primitive(istream,flags2);
     Read_Primitive(istream,os);
     unsigned char dummyByte;
-    // read flags if necessary
-    if(flags&2){
+    // read extra field if present, looking for the partio block subfield
+    if(flags&4){
         unsigned short flgExtraLen;
         Read_Primitive(istream,flgExtraLen);
-        for(int k=0;k<flgExtraLen;k++) Read_Primitive(istream,dummyByte);}
+        for(int k=0;k+4<=flgExtraLen && istream;){
+            unsigned char si1,si2;unsigned short len;
+            Read_Primitive(istream,si1);Read_Primitive(istream,si2);Read_Primitive(istream,len);
+            if(si1=='P' && si2=='B' && len==4) Read_Primitive(istream,block_size);
+            else for(int j=0;j<len;j++) Read_Primitive(istream,dummyByte);
+            k+=4+len;}}
     // read filename/comment if present
-    int stringsToRead=((flags&8)?1:0) + ((flags&4)?1:0);
+    int stringsToRead=((flags&8)?1:0) + ((flags&16)?1:0);
     for(int i=0;i<stringsToRead;i++) 
         do{Read_Primitive(istream,dummyByte);}while(dummyByte!=0 && istream);
-    if(flags&1) Read_Primitive(istream,crc16);
+    if(flags&2) Read_Primitive(istream,crc16);
     if(!istream) {std::cerr<<"gzip: got to end of file after only reading gzip header"<<std::endl;return false;}
     return true;}
 
     void Write(std::ostream& ostream)
-    {magic0=0x1f;magic1=0x8b;cm=8;flags=0;os=0xff;
+    {magic0=0x1f;magic1=0x8b;cm=8;flags=block_size?4:0;os=0xff;
     Write_Primitive(ostream,magic0);Write_Primitive(ostream,magic1);
     Write_Primitive(ostream,cm);
     Write_Primitive(ostream,flags);
     Write_Primitive(ostream,modtime);
     Write_Primitive(ostream,flags2);
-    Write_Primitive(ostream,os);}
+    Write_Primitive(ostream,os);
+    if(block_size){
+        Write_Primitive(ostream,(unsigned short)8);
+        Write_Primitive(ostream,(unsigned char)'P');Write_Primitive(ostream,(unsigned char)'B');
+        Write_Primitive(ostream,(unsigned short)4);
+        Write_Primitive(ostream,block_size);}}
 
 //#####################################################################
 };
@@ -227,7 +242,7 @@ struct ZipFileHeader
 //#####################################################################
 class ZipStreambufDecompress:public std::streambuf
 {
-    static const unsigned int buffer_size=512;
+    static const unsigned int buffer_size=1<<16;
     std::istream& istream;
 
     z_stream strm;
@@ -239,12 +254,13 @@ class ZipStreambufDecompress:public std::streambuf
     bool own_istream;
     bool valid;
     bool compressed_data;
+    bool stream_end;
 
     static const unsigned short DEFLATE=8;
     static const unsigned short UNCOMPRESSED=0;
 public:
     ZipStreambufDecompress(std::istream& stream,bool part_of_zip_file_input)
-        :istream(stream),total_read(0),total_uncompressed(0),part_of_zip_file(part_of_zip_file_input),valid(true)
+        :istream(stream),total_read(0),total_uncompressed(0),part_of_zip_file(part_of_zip_file_input),valid(true),stream_end(false)
     {
         strm.zalloc=Z_NULL;strm.zfree=Z_NULL;strm.opaque=Z_NULL;strm.avail_in=0;strm.next_in=Z_NULL;
         setg((char*)in,(char*)in,(char*)in);
@@ -268,8 +284,20 @@ public:
     {if(compressed_data && valid) inflateEnd(&strm);
     if(!part_of_zip_file) delete &istream;}
 
+    // gzip files may hold several concatenated members, continue with the next one
+    bool next_member()
+    {if(stream_end) return false;
+    istream.clear();
+    istream.seekg(8-(std::streamoff)strm.avail_in,std::ios::cur); // skip crc32 and size
+    strm.avail_in=0;
+    GZipFileHeader member_header;
+    if(!member_header.Read(istream)){stream_end=true;return false;}
+    inflateReset(&strm);
+    return true;}
+
     int process()
     {if(!valid) return -1;
+    if(stream_end) return 0;
     if(compressed_data){
         strm.avail_out=buffer_size-4;
         strm.next_out=(Bytef*)(out+4);
@@ -289,7 +317,9 @@ public:
                 case Z_MEM_ERROR: 
                     std::cerr<<"gzip error "<<strm.msg<<std::endl;
                     valid=false;return -1;}
-            if(ret==Z_STREAM_END) break;}
+            if(ret==Z_STREAM_END){
+                if(part_of_zip_file || !next_member()) break;}
+            else if(strm.avail_in==0 && istream.eof()) break;} // truncated stream
         int unzip_count=buffer_size-strm.avail_out-4;
         total_uncompressed+=unzip_count;
         return unzip_count;}
@@ -391,13 +421,251 @@ protected:
     {if(pptr() && pptr()>pbase()) return process(false);return 0;}
 
     virtual int underflow()
-    {std::runtime_error("Attempt to read write only ostream");return 0;}
+    {throw std::runtime_error("Attempt to read write only ostream");}
 
     virtual int overflow(int c=EOF)
     {if(c!=EOF){*pptr()=c;pbump(1);}
     if(process(false)==EOF) return EOF;
     return c;}
 
+//#####################################################################
+};
+//#####################################################################
+// class GzipBlockStreambufDecompress
+//#####################################################################
+// Reads gzip files made of independent partio block members (see
+// GzipBlockStreambufCompress). The member headers form a block index, so
+// batches of blocks inflate in parallel and the stream can seek.
+struct GzipBlock
+{
+    std::streamoff offset; // of the deflate data in the file
+    unsigned int compressed_size,uncompressed_size,crc;
+    std::streamoff start; // of the block in the uncompressed stream
+};
+
+class GzipBlockStreambufDecompress:public std::streambuf
+{
+    std::istream& istream; // owned
+    std::vector<GzipBlock> blocks;
+    std::streamoff total_size;
+    std::vector<char> compressed,uncompressed;
+    size_t batch_begin,batch_end; // blocks currently held in uncompressed
+    bool valid;
+
+    struct InflateTask
+    {
+        GzipBlockStreambufDecompress& buf;
+        std::vector<char> good; // per block, each worker writes only its own
+        InflateTask(GzipBlockStreambufDecompress& buf,const int blocks):buf(buf),good(blocks,0){}
+
+        bool valid() const
+        {return std::find(good.begin(),good.end(),0)==good.end();}
+
+        void operator()(const int i)
+        {const GzipBlock& block=buf.blocks[buf.batch_begin+i];
+        const GzipBlock& first=buf.blocks[buf.batch_begin];
+        char* out=&buf.uncompressed[0]+(block.start-first.start);
+        z_stream strm;
+        strm.zalloc=Z_NULL;strm.zfree=Z_NULL;strm.opaque=Z_NULL;
+        strm.next_in=(Bytef*)&buf.compressed[0]+(block.offset-first.offset);
+        strm.avail_in=block.compressed_size;
+        strm.next_out=(Bytef*)out;
+        strm.avail_out=block.uncompressed_size;
+        bool ok=inflateInit2(&strm,-MAX_WBITS)==Z_OK;
+        if(ok){
+            ok=inflate(&strm,Z_FINISH)==Z_STREAM_END && strm.avail_out==0;
+            inflateEnd(&strm);}
+        if(ok) ok=crc32(0,(Bytef*)out,block.uncompressed_size)==block.crc;
+        good[i]=ok;}
+    };
+
+public:
+    GzipBlockStreambufDecompress(std::istream& stream,std::vector<GzipBlock>& blocks_input)
+        :istream(stream),total_size(0),batch_begin(0),batch_end(0),valid(true)
+    {
+        blocks.swap(blocks_input);
+        if(!blocks.empty()) total_size=blocks.back().start+blocks.back().uncompressed_size;
+        setg(0,0,0);
+        setp(0,0);
+    }
+
+    virtual ~GzipBlockStreambufDecompress()
+    {delete &istream;}
+
+    //! Walks the member headers of a partio block gzip file, false if it is not one
+    static bool Index(std::istream& istream,std::vector<GzipBlock>& blocks)
+    {std::streamoff start=0;
+    for(;;){
+        std::streamoff member=istream.tellg();
+        GZipFileHeader header;
+        if(!header.Read(istream)){
+            if(blocks.empty()) return false;
+            istream.clear();istream.seekg(member); // trailing garbage is only fine if it is not gzip
+            unsigned char magic=0;Read_Primitive(istream,magic);
+            return !istream || magic!=0x1f;}
+        if(!header.block_size) return false;
+        GzipBlock block;
+        block.offset=istream.tellg();
+        block.compressed_size=header.block_size;
+        block.start=start;
+        istream.seekg(block.offset+block.compressed_size);
+        Read_Primitive(istream,block.crc);
+        Read_Primitive(istream,block.uncompressed_size);
+        if(!istream) return false;
+        start+=block.uncompressed_size;
+        blocks.push_back(block);
+        if(istream.peek()==EOF){istream.clear();return true;}}}
+
+protected:
+    //! Reads and inflates the batch of blocks starting at first
+    bool decode(const size_t first)
+    {if(!valid) return false;
+    const int threads=numThreads();
+    size_t last=std::min(blocks.size(),first+std::max(1,2*threads));
+    const GzipBlock& begin=blocks[first];
+    const GzipBlock& end=blocks[last-1];
+    compressed.resize(end.offset+end.compressed_size-begin.offset);
+    uncompressed.resize(end.start+end.uncompressed_size-begin.start);
+    istream.clear();
+    istream.seekg(begin.offset);
+    if(!compressed.empty()) istream.read(&compressed[0],compressed.size());
+    if(!istream){std::cerr<<"gzip: failed to read compressed blocks"<<std::endl;valid=false;return false;}
+    batch_begin=first;batch_end=last;
+    InflateTask task(*this,(int)(last-first));
+    parallelFor((int)(last-first),task,threads);
+    if(!task.valid()){std::cerr<<"gzip: corrupt block in compressed stream"<<std::endl;valid=false;return false;}
+    char* base=uncompressed.empty() ? 0 : &uncompressed[0];
+    setg(base,base,base+uncompressed.size());
+    return true;}
+
+    //! Uncompressed position of the get pointer
+    std::streamoff position() const
+    {return batch_end>batch_begin ? blocks[batch_begin].start+(gptr()-eback()) : (batch_end ? total_size : 0);}
+
+    std::streampos seek(const std::streamoff target)
+    {if(!valid || target<0 || target>total_size) return std::streampos(std::streamoff(-1));
+    if(batch_end>batch_begin && target>=blocks[batch_begin].start && target<=blocks[batch_begin].start+(egptr()-eback())){
+        setg(eback(),eback()+(target-blocks[batch_begin].start),egptr());
+        return target;}
+    if(target==total_size){ // end of stream, nothing to decode
+        batch_begin=batch_end=blocks.size();setg(0,0,0);
+        return target;}
+    size_t block=0;
+    while(block+1<blocks.size() && blocks[block+1].start<=target) block++;
+    if(!decode(block)) return std::streampos(std::streamoff(-1));
+    setg(eback(),eback()+(target-blocks[block].start),egptr());
+    return target;}
+
+    virtual std::streampos seekoff(std::streamoff off,std::ios_base::seekdir dir,std::ios_base::openmode which)
+    {if(which&std::ios_base::out) return std::streampos(std::streamoff(-1));
+    if(dir==std::ios_base::cur) return off ? seek(position()+off) : std::streampos(position());
+    if(dir==std::ios_base::end) return seek(total_size+off);
+    return seek(off);}
+
+    virtual std::streampos seekpos(std::streampos pos,std::ios_base::openmode which)
+    {if(which&std::ios_base::out) return std::streampos(std::streamoff(-1));
+    return seek(pos);}
+
+    virtual int underflow()
+    {if(gptr() && (gptr()<egptr())) return traits_type::to_int_type(*gptr());
+    while(batch_end<blocks.size()){
+        if(!decode(batch_end)) return EOF;
+        if(gptr()<egptr()) return traits_type::to_int_type(*gptr());}
+    return EOF;}
+
+    virtual int overflow(int c=EOF)
+    {assert(false);return EOF;}
+
+//#####################################################################
+};
+
+//#####################################################################
+// class GzipBlockStreambufCompress
+//#####################################################################
+// Writes gzip as a series of independent members of block_size input bytes
+// each, deflating a batch of blocks on several threads at a time. Every
+// member records its compressed size in a 'PB' extra subfield so readers can
+// index the blocks without inflating them. Other gzip readers simply see a
+// multi-member gzip file.
+class GzipBlockStreambufCompress:public std::streambuf
+{
+    std::ostream& ostream; // owned
+    int level,threads;
+    std::vector<char> in; // batch of blocks waiting to be compressed
+    std::vector<std::vector<char> > out; // compressed member data per block
+    std::vector<unsigned int> out_size;
+    bool valid,wrote_member;
+
+    struct DeflateTask
+    {
+        GzipBlockStreambufCompress& buf;
+        const unsigned int size;
+        std::vector<char> good; // per block, each worker writes only its own
+        DeflateTask(GzipBlockStreambufCompress& buf,const unsigned int size,const int blocks)
+            :buf(buf),size(size),good(blocks,0){}
+
+        bool valid() const
+        {return std::find(good.begin(),good.end(),0)==good.end();}
+
+        void operator()(const int i)
+        {const unsigned int block_in=std::min((unsigned int)block_size,size-i*block_size);
+        z_stream strm;
+        strm.zalloc=Z_NULL;strm.zfree=Z_NULL;strm.opaque=Z_NULL;
+        if(deflateInit2(&strm,buf.level,Z_DEFLATED,-MAX_WBITS,8,Z_DEFAULT_STRATEGY)!=Z_OK) return;
+        std::vector<char>& out=buf.out[i];
+        out.resize(deflateBound(&strm,block_in));
+        strm.next_in=(Bytef*)&buf.in[0]+i*block_size;strm.avail_in=block_in;
+        strm.next_out=(Bytef*)&out[0];strm.avail_out=out.size();
+        good[i]=deflate(&strm,Z_FINISH)==Z_STREAM_END;
+        buf.out_size[i]=out.size()-strm.avail_out;
+        deflateEnd(&strm);}
+    };
+
+public:
+    static const int block_size=1<<20;
+
+    GzipBlockStreambufCompress(std::ostream& stream,const int compressionLevel,const int numThreads)
+        :ostream(stream),level(compressionLevel),threads(numThreads>0 ? numThreads : Partio::numThreads()),
+        valid(true),wrote_member(false)
+    {
+        in.resize((threads>1 ? 2*threads : 1)*(size_t)block_size);
+        setg(0,0,0);
+        setp(&in[0],&in[0]+in.size());
+    }
+
+    virtual ~GzipBlockStreambufCompress()
+    {if(pptr()>pbase() || !wrote_member) process(); // an empty stream still gets one member
+    delete &ostream;}
+
+protected:
+    int process()
+    {if(!valid) return -1;
+    const unsigned int size=pptr()-pbase();
+    const int blocks=std::max(1,(int)((size+block_size-1)/block_size));
+    out.resize(blocks);out_size.resize(blocks);
+    DeflateTask task(*this,size,blocks);
+    parallelFor(blocks,task,threads);
+    if(!task.valid()){std::cerr<<"gzip: gzip error during deflate"<<std::endl;valid=false;return -1;}
+    for(int i=0;i<blocks;i++){
+        const unsigned int block_in=std::min((unsigned int)block_size,size-i*block_size);
+        GZipFileHeader header;
+        header.block_size=out_size[i];
+        header.Write(ostream);
+        ostream.write(&out[i][0],out_size[i]);
+        Write_Primitive(ostream,(unsigned int)crc32(0,(Bytef*)&in[0]+i*block_size,block_in));
+        Write_Primitive(ostream,block_in);}
+    wrote_member=true;
+    setp(&in[0],&in[0]+in.size());
+    return 1;}
+
+    virtual int underflow()
+    {throw std::runtime_error("Attempt to read write only ostream");}
+
+    virtual int overflow(int c=EOF)
+    {if(process()==-1) return EOF;
+    if(c!=EOF){*pptr()=c;pbump(1);}
+    return c==EOF ? 0 : c;}
+
 //#####################################################################
 };
 //#####################################################################
@@ -432,6 +700,38 @@ public:
     virtual ~ZIP_FILE_OSTREAM()
     {}
 
+//#####################################################################
+};
+//#####################################################################
+// Class GZIP_BLOCK_ISTREAM
+//#####################################################################
+class GZIP_BLOCK_ISTREAM:public std::istream
+{
+    GzipBlockStreambufDecompress buf;
+public:
+    GZIP_BLOCK_ISTREAM(std::istream& istream,std::vector<GzipBlock>& blocks)
+        :std::istream(&buf),buf(istream,blocks)
+    {}
+
+    virtual ~GZIP_BLOCK_ISTREAM()
+    {}
+
+//#####################################################################
+};
+//#####################################################################
+// Class GZIP_BLOCK_OSTREAM
+//#####################################################################
+class GZIP_BLOCK_OSTREAM:public std::ostream
+{
+    GzipBlockStreambufCompress buf;
+public:
+    GZIP_BLOCK_OSTREAM(std::ostream& ostream,const int compressionLevel,const int numThreads)
+        :std::ostream(&buf),buf(ostream,compressionLevel,numThreads)
+    {}
+
+    virtual ~GZIP_BLOCK_OSTREAM()
+    {}
+
 //#####################################################################
 };
 //#####################################################################
@@ -572,16 +872,21 @@ Gzip_In(const std::string& filename,std::ios::openmode mode)
     bool zipped=header.Read(*infile);
     infile->seekg(0);
     if(!zipped) return infile;
-    else return new ZIP_FILE_ISTREAM(*infile,false);
+    std::vector<GzipBlock> blocks;
+    if(header.block_size && GzipBlockStreambufDecompress::Index(*infile,blocks))
+        return new GZIP_BLOCK_ISTREAM(*infile,blocks);
+    infile->clear();
+    infile->seekg(0);
+    return new ZIP_FILE_ISTREAM(*infile,false);
 }
 //#####################################################################
 // Function Gzip_Out
 //#####################################################################
 std::ostream* 
-Gzip_Out(const std::string& filename,std::ios::openmode mode)
+Gzip_Out(const std::string& filename,std::ios::openmode mode,const int compressionLevel,const int numThreads)
 {
     std::ofstream* outfile=new std::ofstream(filename.c_str(),mode);
-    return new ZIP_FILE_OSTREAM(0,*outfile);
+    return new GZIP_BLOCK_OSTREAM(*outfile,compressionLevel,numThreads);
 }
 //#####################################################################
 
@@ -608,7 +913,7 @@ Gzip_In(const std::string& filename,std::ios::openmode mode)
 // Function Gzip_Out
 //#####################################################################
 std::ostream* 
-Gzip_Out(const std::string& filename,std::ios::openmode mode)
+Gzip_Out(const std::string& filename,std::ios::openmode mode,const int compressionLevel,const int numThreads)
 {
     std::cerr<<"Partio: gzipped file write requested for '"<<filename<<"' but partio not compiled with zlib"<<std::endl;
     return 0;    
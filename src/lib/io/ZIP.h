@@ -48,7 +48,8 @@ struct ZipFileHeader;
 // Functions Gzip_Out/Gzip_In - Create streams that read/write .gz
 //#####################################################################
 std::istream* Gzip_In(const std::string& filename,std::ios::openmode mode);
-std::ostream* Gzip_Out(const std::string& filename,std::ios::openmode mode);
+// compressionLevel is zlib's (-1 for default), numThreads 0 uses Partio::numThreads()
+std::ostream* Gzip_Out(const std::string& filename,std::ios::openmode mode,const int compressionLevel=-1,const int numThreads=0);
 //#####################################################################
 // Class ZipFileWriter
 //#####################################################################
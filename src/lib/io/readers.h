@@ -36,30 +36,36 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
 #define _READERS_h_
 
 namespace Partio{
-ParticlesDataMutable* readBGEO(	const char* filename,const bool headersOnly);
-ParticlesDataMutable* readGEO(	const char* filename,const bool headersOnly);
-ParticlesDataMutable* readPDB(	const char* filename,const bool headersOnly);
-ParticlesDataMutable* readPDB32(const char* filename,const bool headersOnly);
-ParticlesDataMutable* readPDB64(const char* filename,const bool headersOnly);
-ParticlesDataMutable* readPDA(	const char* filename,const bool headersOnly);
-ParticlesDataMutable* readMC(	const char* filename,const bool headersOnly);
-ParticlesDataMutable* readPTC(	const char* filename,const bool headersOnly);
-ParticlesDataMutable* readPDC(	const char* filename,const bool headersOnly);
-ParticlesDataMutable* readPRT(	const char* filename,const bool headersOnly);
-ParticlesDataMutable* readBIN(	const char* filename,const bool headersOnly);
-ParticlesDataMutable* readPTS(  const char* filename,const bool headersOnly);
+ParticlesDataMutable* readBGEO(const char* filename,const bool headersOnly,char** attributes,int percentage);
+ParticlesDataMutable* readGEO(const char* filename,const bool headersOnly,char** attributes,int percentage);
+ParticlesDataMutable* readPDB(const char* filename,const bool headersOnly,char** attributes,int percentage);
+ParticlesDataMutable* readPDB32(const char* filename,const bool headersOnly,char** attributes,int percentage);
+ParticlesDataMutable* readPDB64(const char* filename,const bool headersOnly,char** attributes,int percentage);
+ParticlesDataMutable* readPDA(const char* filename,const bool headersOnly,char** attributes,int percentage);
+ParticlesDataMutable* readMC(const char* filename,const bool headersOnly,char** attributes,int percentage);
+ParticlesDataMutable* readPTC(const char* filename,const bool headersOnly,char** attributes,int percentage);
+ParticlesDataMutable* readPDC(const char* filename,const bool headersOnly,char** attributes,int percentage);
+ParticlesDataMutable* readPRT(const char* filename,const bool headersOnly,char** attributes,int percentage);
+ParticlesDataMutable* readBIN(const char* filename,const bool headersOnly,char** attributes,int percentage);
+ParticlesDataMutable* readPTS(const char* filename,const bool headersOnly,char** attributes,int percentage);
 
-bool writeBGEO(const char* filename,const ParticlesData& p,const bool compressed);
-bool writeGEO(const char* filename,const ParticlesData& p,const bool compressed);
-bool writePDB(const char* filename,const ParticlesData& p,const bool compressed);
-bool writePDB32(const char* filename,const ParticlesData& p,const bool compressed);
-bool writePDB64(const char* filename,const ParticlesData& p,const bool compressed);
-bool writePDA(const char* filename,const ParticlesData& p,const bool compressed);
-bool writePTC(const char* filename,const ParticlesData& p,const bool compressed);
-bool writeRIB(const char* filename,const ParticlesData& p,const bool compressed);
-bool writePDC(const char* filename,const ParticlesData& p,const bool compressed);
-bool writePRT(const char* filename,const ParticlesData& p,const bool compressed);
-bool writeBIN(const char* filename,const ParticlesData& p,const bool compressed);
+class ParticlesMapped;
+ParticlesMapped* readBGEOMapped(const char* filename);
+ParticlesMapped* readPDBMapped(const char* filename);
+ParticlesMapped* readPDB32Mapped(const char* filename);
+ParticlesMapped* readPDB64Mapped(const char* filename);
+
+bool writeBGEO(const char* filename,const ParticlesData& p,const bool compressed,const WriteOptions& options);
+bool writeGEO(const char* filename,const ParticlesData& p,const bool compressed,const WriteOptions& options);
+bool writePDB(const char* filename,const ParticlesData& p,const bool compressed,const WriteOptions& options);
+bool writePDB32(const char* filename,const ParticlesData& p,const bool compressed,const WriteOptions& options);
+bool writePDB64(const char* filename,const ParticlesData& p,const bool compressed,const WriteOptions& options);
+bool writePDA(const char* filename,const ParticlesData& p,const bool compressed,const WriteOptions& options);
+bool writePTC(const char* filename,const ParticlesData& p,const bool compressed,const WriteOptions& options);
+bool writeRIB(const char* filename,const ParticlesData& p,const bool compressed,const WriteOptions& options);
+bool writePDC(const char* filename,const ParticlesData& p,const bool compressed,const WriteOptions& options);
+bool writePRT(const char* filename,const ParticlesData& p,const bool compressed,const WriteOptions& options);
+bool writeBIN(const char* filename,const ParticlesData& p,const bool compressed,const WriteOptions& options);
 }
 
 #endif
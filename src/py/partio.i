@@ -91,6 +91,13 @@ public:
             (long)$1);
 }
 %apply uint64_t { ParticleIndex };
+%typemap(in) int64_t {
+	$1 = (int64_t) PyLong_AsLongLong($input);
+}
+%typemap(out) int64_t {
+	$result = PyLong_FromLongLong(
+            (long long)$1);
+}
 
 %typemap(in) fixedFloatArray
 {
@@ -134,7 +141,7 @@ class ParticlesInfo
 public:
     %feature("autodoc");
     %feature("docstring","Returns the number of particles in the set");
-    virtual int numParticles() const=0;
+    virtual int64_t numParticles() const=0;
 
     %feature("autodoc");
     %feature("docstring","Returns the number of particles in the set");
@@ -179,6 +186,22 @@ public:
        "attribute in the file with name 'position'");
     virtual void sort()=0;
 
+    %feature("docstring","Prepares data for N nearest neighbor searches in the space\n"
+       "of the named float or vector attribute of 1 to 4 components");
+    virtual void sort(const char* attributeName)=0;
+
+    %feature("docstring","Prepares data for sphere searches, with a sphere around each\n"
+       "particle's position whose radius is the named float attribute");
+    virtual void sortSpheres(const char* radiusAttribute)=0;
+
+    %feature("docstring","Like sort(), but also moves the particles into spatial\n"
+       "order so nearby particles are nearby in memory. Particle indices change.");
+    virtual void reorder()=0;
+
+    %feature("docstring","Updates the spatial index after positions moved a little,\n"
+       "cheaper than calling sort() again.");
+    virtual void updateSort()=0;
+
     %feature("autodoc");
     %feature("docstring","Adds a new attribute of given name, type and count. If type is\n"
         "partio.VECTOR, then count must be 3");
@@ -191,7 +214,7 @@ public:
 
     %feature("autodoc");
     %feature("docstring","Adds count particles and returns the offset to the first one");
-    virtual ParticleIterator<false> addParticles(const int count)=0;
+    virtual ParticleIterator<false> addParticles(const int64_t count)=0;
 };
 
 
@@ -221,6 +244,51 @@ public:
         return list;
     }
 
+    %feature("autodoc");
+    %feature("docstring","Like findNPoints, but leaves out the particle at excludedIndex,\n"
+        "e.g. the one the search is centered on");
+    PyObject* findNPointsExcluding(fixedFloatArray center,int nPoints,float maxRadius,ParticleIndex excludedIndex)
+    {
+        if(center.count!=3){
+            fprintf(stderr,"Need center to be a 3 tuple of floats\n");
+            return NULL;
+        }
+        std::vector<ParticleIndex> points(nPoints>0 ? nPoints : 0);
+        std::vector<float> pointDistancesSquared(points.size());
+        float finalRadius2;
+        int count=points.empty() ? 0 : $self->findNPoints(center.f,nPoints,maxRadius,
+            ExcludeIndexFilter(excludedIndex),&points[0],&pointDistancesSquared[0],&finalRadius2);
+
+        PyObject* list=PyList_New(count);
+        for(int i=0;i<count;i++){
+            PyObject* tuple=Py_BuildValue("(if)",points[i],pointDistancesSquared[i]);
+            PyList_SetItem(list,i,tuple); // tuple reference is stolen, so no decref needed
+        }
+        return list;
+    }
+
+    %feature("autodoc");
+    %feature("docstring","Returns (index,distanceSquared) tuples for all points\n"
+        "closer than radius to the center location.");
+    PyObject* findPointsInRadius(fixedFloatArray center,float radius)
+    {
+        if(center.count!=3){
+            fprintf(stderr,"Need center to be a 3 tuple of floats\n");
+            return NULL;
+        }
+        std::vector<ParticleIndex> points;
+        std::vector<float> pointDistancesSquared;
+        $self->findPointsInRadius(center.f,radius,points,pointDistancesSquared);
+
+        // build the python return type
+        PyObject* list=PyList_New(points.size());
+        for(unsigned int i=0;i<points.size();i++){
+            PyObject* tuple=Py_BuildValue("(Lf)",(long long)points[i],pointDistancesSquared[i]);
+            PyList_SetItem(list,i,tuple); // tuple reference is stolen, so no decref needed
+        }
+        return list;
+    }
+
     %feature("autodoc");
     %feature("docstring","Returns the indices of all points within the bounding\n"
         "box defined by the two cube corners bboxMin and bboxMax");
@@ -243,6 +311,110 @@ public:
         return list;
     }
 
+    %feature("autodoc");
+    %feature("docstring","Returns the indices of the points on the positive side\n"
+        "a*x+b*y+c*z+d>=0 of every plane, given as a sequence of (a,b,c,d) tuples.");
+    PyObject* findPointsInConvex(PyObject* planes)
+    {
+        if(!PySequence_Check(planes)){
+            PyErr_SetString(PyExc_TypeError,"Expecting a sequence of (a,b,c,d) planes");
+            return NULL;
+        }
+        int nPlanes=PyObject_Length(planes);
+        std::vector<float> abcd(4*nPlanes);
+        for(int i=0;i<nPlanes;i++){
+            PyObject* plane=PySequence_GetItem(planes,i);
+            bool ok=PySequence_Check(plane) && PyObject_Length(plane)==4;
+            for(int k=0;ok && k<4;k++){
+                PyObject* o=PySequence_GetItem(plane,k);
+                abcd[4*i+k]=PyFloat_AsDouble(o);
+                ok=!PyErr_Occurred();
+                Py_DECREF(o);
+            }
+            Py_DECREF(plane);
+            if(!ok){
+                PyErr_SetString(PyExc_ValueError,"Expecting planes of 4 floats");
+                return NULL;
+            }
+        }
+        std::vector<ParticleIndex> points;
+        $self->findPointsInConvex(nPlanes ? &abcd[0] : 0,nPlanes,points);
+
+        // build the python return type
+        PyObject* list=PyList_New(points.size());
+        for(unsigned int i=0;i<points.size();i++){
+            PyList_SetItem(list,i,PyInt_FromLong(points[i]));
+        }
+        return list;
+    }
+
+    %feature("autodoc");
+    %feature("docstring","Returns the indices of all particles whose sphere contains\n"
+        "point. Needs sortSpheres() first.");
+    PyObject* findSpheresContaining(fixedFloatArray point)
+    {
+        if(point.count!=3){
+            fprintf(stderr,"Need point to be a 3 tuple of floats\n");
+            return NULL;
+        }
+        std::vector<ParticleIndex> points;
+        $self->findSpheresContaining(point.f,points);
+
+        // build the python return type
+        PyObject* list=PyList_New(points.size());
+        for(unsigned int i=0;i<points.size();i++){
+            PyList_SetItem(list,i,PyInt_FromLong(points[i])); // tuple reference is stolen, so no decref needed
+        }
+        return list;
+    }
+
+    %feature("autodoc");
+    %feature("docstring","Returns (index,t) tuples, nearest first, for the points closer\n"
+        "than radius to the segment origin+t*direction with tMin<=t<=tMax. At most\n"
+        "maxHits are returned, all of them if maxHits is 0.");
+    PyObject* findPointsAlongRay(fixedFloatArray origin,fixedFloatArray direction,float tMin,float tMax,
+        float radius,int maxHits)
+    {
+        if(origin.count!=3 || direction.count!=3){
+            fprintf(stderr,"Need origin and direction to be 3 tuples of floats\n");
+            return NULL;
+        }
+        std::vector<ParticleIndex> points;
+        std::vector<float> t;
+        $self->findPointsAlongRay(origin.f,direction.f,tMin,tMax,radius,maxHits,points,t);
+
+        // build the python return type
+        PyObject* list=PyList_New(points.size());
+        for(unsigned int i=0;i<points.size();i++){
+            PyObject* tuple=Py_BuildValue("(if)",points[i],t[i]);
+            PyList_SetItem(list,i,tuple); // tuple reference is stolen, so no decref needed
+        }
+        return list;
+    }
+
+    %feature("autodoc");
+    %feature("docstring","Returns (index,t) tuples, nearest first, for the particles whose\n"
+        "sphere the segment enters at t. Needs sortSpheres() first.");
+    PyObject* findSpheresAlongRay(fixedFloatArray origin,fixedFloatArray direction,float tMin,float tMax,
+        int maxHits)
+    {
+        if(origin.count!=3 || direction.count!=3){
+            fprintf(stderr,"Need origin and direction to be 3 tuples of floats\n");
+            return NULL;
+        }
+        std::vector<ParticleIndex> points;
+        std::vector<float> t;
+        $self->findSpheresAlongRay(origin.f,direction.f,tMin,tMax,maxHits,points,t);
+
+        // build the python return type
+        PyObject* list=PyList_New(points.size());
+        for(unsigned int i=0;i<points.size();i++){
+            PyObject* tuple=Py_BuildValue("(if)",points[i],t[i]);
+            PyList_SetItem(list,i,tuple); // tuple reference is stolen, so no decref needed
+        }
+        return list;
+    }
+
     %feature("autodoc");
     %feature("docstring","Gets attribute data for particleIndex'th particle");
     PyObject* get(const ParticleAttribute& attr,const ParticleIndex particleIndex)
@@ -380,6 +552,11 @@ ParticlesInfo* readHeaders(const char* filename);
 %feature("docstring","Writes a particle set to disk");
 void write(const char* filename,const ParticlesData&,const bool=false);
 
+%feature("autodoc");
+%feature("docstring","Saves the KD-Tree of particles read from filename next to the\n"
+   "file, so sorting the file again loads it instead of building it");
+bool writeSortIndex(const char* filename,const ParticlesData& particles);
+
 %feature("autodoc");
 %feature("docstring","Print a summary of particle file");
 void print(const ParticlesData* particles);
@@ -0,0 +1,201 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+#include <Partio.h>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+#include "Timer.h"
+
+#define TESTASSERT(x)\
+ if(!(x)) throw std::runtime_error(__FILE__ ": Test failed on " #x ); 
+
+// Benchmarks approximate nearest neighbor searches against the exact one, reporting
+// speedup and recall for a few epsilons and visit budgets, and checks the 1+epsilon
+// bound. Queries are at particles, as for density estimates.
+// usage: testapproxknn [particleFile] [nPoints] [nQueries]
+
+float randomFloat()
+{
+    return (float)rand()/RAND_MAX;
+}
+
+// Clumps of particles of varying density, when no cache is given
+Partio::ParticlesDataMutable* makeData(const int nParticles)
+{
+    Partio::ParticlesDataMutable* p=Partio::create();
+    Partio::ParticleAttribute positionAttr=p->addAttribute("position",Partio::VECTOR,3);
+    p->addParticles(nParticles);
+    const int nClumps=50;
+    std::vector<float> clumps(4*nClumps);
+    for(int c=0;c<nClumps;c++){
+        for(int k=0;k<3;k++) clumps[4*c+k]=randomFloat();
+        clumps[4*c+3]=.01f+.1f*randomFloat();
+    }
+    for(int i=0;i<nParticles;i++){
+        const float* clump=&clumps[4*(rand()%nClumps)];
+        float* pos=p->dataWrite<float>(positionAttr,i);
+        for(int k=0;k<3;k++){
+            // sum of uniforms, roughly normal
+            float offset=randomFloat()+randomFloat()+randomFloat()-1.5f;
+            pos[k]=clump[k]+clump[3]*offset;
+        }
+    }
+    return p;
+}
+
+struct Result
+{
+    std::vector<Partio::ParticleIndex> points;
+    std::vector<float> distancesSquared;
+    std::vector<int> counts;
+    double seconds;
+};
+
+Result search(const Partio::ParticlesData* p,const std::vector<float>& centers,const int nPoints,
+    const float maxRadius,const float epsilon,const int maxVisits,const char* name)
+{
+    const int nQueries=(int)centers.size()/3;
+    Result result;
+    result.points.resize((size_t)nQueries*nPoints);
+    result.distancesSquared.resize((size_t)nQueries*nPoints);
+    result.counts.resize(nQueries);
+    Timer timer(name);
+    p->findNPointsBatchApproximate(&centers[0],nQueries,nPoints,maxRadius,epsilon,maxVisits,
+        &result.points[0],&result.distancesSquared[0],&result.counts[0]);
+    result.seconds=timer.Stop_Time();
+    return result;
+}
+
+// Fraction of the exact neighbors found, and the worst ratio of the ith distance found
+// to the true ith distance
+void compare(const Result& exact,const Result& approximate,const int nPoints,double& recall,double& worstRatio)
+{
+    size_t found=0,total=0;
+    worstRatio=1;
+    std::vector<float> wanted,got;
+    for(size_t q=0;q<exact.counts.size();q++){
+        const size_t offset=q*nPoints;
+        std::vector<Partio::ParticleIndex> a(&exact.points[offset],&exact.points[offset]+exact.counts[q]);
+        std::vector<Partio::ParticleIndex> b(&approximate.points[offset],&approximate.points[offset]+approximate.counts[q]);
+        std::sort(a.begin(),a.end());std::sort(b.begin(),b.end());
+        std::vector<Partio::ParticleIndex> common;
+        std::set_intersection(a.begin(),a.end(),b.begin(),b.end(),std::back_inserter(common));
+        found+=common.size();total+=a.size();
+
+        wanted.assign(&exact.distancesSquared[offset],&exact.distancesSquared[offset]+exact.counts[q]);
+        got.assign(&approximate.distancesSquared[offset],&approximate.distancesSquared[offset]+approximate.counts[q]);
+        std::sort(wanted.begin(),wanted.end());std::sort(got.begin(),got.end());
+        for(size_t i=0;i<got.size() && i<wanted.size();i++)
+            if(wanted[i]>0) worstRatio=std::max(worstRatio,std::sqrt((double)got[i]/wanted[i]));
+    }
+    recall=total ? (double)found/total : 1;
+}
+
+int main(int argc,char *argv[])
+{
+    srand(7);
+    Partio::ParticlesDataMutable* p=0;
+    if(argc>1){
+        p=Partio::read(argv[1]);
+        if(!p){
+            std::cerr<<"Can't read "<<argv[1]<<std::endl;
+            return 1;
+        }
+    }else p=makeData(500000);
+    const int nPoints=argc>2 ? atoi(argv[2]) : 32;
+    const int nQueries=argc>3 ? atoi(argv[3]) : 20000;
+
+    Partio::ParticleAttribute positionAttr;
+    TESTASSERT(p->attributeInfo("position",positionAttr));
+    TESTASSERT(p->numParticles()>0);
+    p->sort();
+
+    std::vector<float> centers(3*nQueries);
+    for(int q=0;q<nQueries;q++){
+        const float* pos=p->data<float>(positionAttr,rand()%p->numParticles());
+        for(int k=0;k<3;k++) centers[3*q+k]=pos[k];
+    }
+    const float maxRadius=1e30f;
+
+    Result exact=search(p,centers,nPoints,maxRadius,0,0,"exact");
+    Result exactAgain=search(p,centers,nPoints,maxRadius,0,0,"exact again");
+    TESTASSERT(exact.points==exactAgain.points);
+    {
+        std::vector<Partio::ParticleIndex> points(nPoints);
+        std::vector<float> distancesSquared(nPoints);
+        float finalRadius2;
+        int count=p->findNPoints(&centers[0],nPoints,maxRadius,&points[0],&distancesSquared[0],&finalRadius2);
+        TESTASSERT(count==exact.counts[0]);
+        TESTASSERT(std::equal(points.begin(),points.begin()+count,exact.points.begin()));
+    }
+
+    std::cout<<"particles "<<p->numParticles()<<" queries "<<nQueries<<" neighbors "<<nPoints<<std::endl;
+    std::cout<<std::setw(8)<<"epsilon"<<std::setw(11)<<"maxVisits"<<std::setw(10)<<"seconds"
+             <<std::setw(9)<<"speedup"<<std::setw(9)<<"recall"<<std::setw(12)<<"worstRatio"<<std::endl;
+    const float epsilons[]={0,.1f,.25f,.5f,1,2};
+    const int budgets[]={0,nPoints*16,nPoints*4};
+    for(int b=0;b<3;b++)
+        for(int e=0;e<6;e++){
+            if(!epsilons[e] && !budgets[b]) continue;
+            Result approximate=search(p,centers,nPoints,maxRadius,epsilons[e],budgets[b],"approximate");
+            double recall,worstRatio;
+            compare(exact,approximate,nPoints,recall,worstRatio);
+            std::cout<<std::setw(8)<<epsilons[e]<<std::setw(11)<<budgets[b]<<std::setw(10)<<approximate.seconds
+                     <<std::setw(9)<<std::setprecision(3)<<exact.seconds/approximate.seconds
+                     <<std::setw(9)<<recall<<std::setw(12)<<worstRatio<<std::setprecision(6)<<std::endl;
+            if(!budgets[b]){
+                // the bound holds without a budget, up to rounding
+                TESTASSERT(approximate.counts==exact.counts);
+                TESTASSERT(worstRatio<=(1+epsilons[e])*1.0001);
+            }
+        }
+
+    std::cout<<"Checking the bound on a hash grid ..."<<std::endl;
+    p->sort(Partio::SortOptions(Partio::HASHGRID,.02f));
+    exact=search(p,centers,nPoints,maxRadius,0,0,"grid exact");
+    Result approximate=search(p,centers,nPoints,maxRadius,.5f,0,"grid approximate");
+    double recall,worstRatio;
+    compare(exact,approximate,nPoints,recall,worstRatio);
+    TESTASSERT(approximate.counts==exact.counts);
+    TESTASSERT(worstRatio<=1.5*1.0001);
+
+    p->release();
+    std::cout<<"Test passed"<<std::endl;
+    return 0;
+}
@@ -0,0 +1,186 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+#include <Partio.h>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+
+#define TESTASSERT(x)\
+ if(!(x)) throw std::runtime_error(__FILE__ ": Test failed on " #x ); 
+
+float randomFloat()
+{
+    return (float)rand()/RAND_MAX;
+}
+
+// Compares searches of the tree over attr against brute force, checking the
+// returned indices by the values they hold
+void testAttribute(const Partio::ParticlesData* p,const char* name)
+{
+    Partio::ParticleAttribute attr;
+    TESTASSERT(p->attributeInfo(name,attr));
+    const int dimension=attr.count;
+    const int nPoints=8;
+    const float maxRadius=.3f;
+    std::vector<Partio::ParticleIndex> points(nPoints);
+    std::vector<float> distances(nPoints);
+
+    for(int q=0;q<40;q++){
+        float center[4],bboxMin[4],bboxMax[4];
+        for(int k=0;k<dimension;k++){
+            center[k]=randomFloat();
+            bboxMin[k]=center[k]-.2f;
+            bboxMax[k]=center[k]+.2f;
+        }
+
+        std::vector<float> expected;
+        int expectedInBox=0;
+        for(int i=0;i<p->numParticles();i++){
+            const float* value=p->data<float>(attr,i);
+            float d2=0;
+            bool inBox=true;
+            for(int k=0;k<dimension;k++){
+                d2+=(value[k]-center[k])*(value[k]-center[k]);
+                inBox=inBox && value[k]>=bboxMin[k] && value[k]<=bboxMax[k];
+            }
+            if(d2<maxRadius*maxRadius) expected.push_back(d2);
+            if(inBox) expectedInBox++;
+        }
+        std::sort(expected.begin(),expected.end());
+        if((int)expected.size()>nPoints) expected.resize(nPoints);
+
+        float finalRadius2;
+        int count=p->findNPoints(name,center,nPoints,maxRadius,&points[0],&distances[0],&finalRadius2);
+        TESTASSERT(count==(int)expected.size());
+        std::vector<float> found(distances.begin(),distances.begin()+count);
+        std::sort(found.begin(),found.end());
+        TESTASSERT(found==expected);
+        for(int i=0;i<count;i++){
+            const float* value=p->data<float>(attr,points[i]);
+            float d2=0;
+            for(int k=0;k<dimension;k++) d2+=(value[k]-center[k])*(value[k]-center[k]);
+            TESTASSERT(d2==distances[i]);
+        }
+
+        std::vector<Partio::ParticleIndex> inBox;
+        p->findPoints(name,bboxMin,bboxMax,inBox);
+        TESTASSERT((int)inBox.size()==expectedInBox);
+        for(size_t i=0;i<inBox.size();i++){
+            const float* value=p->data<float>(attr,inBox[i]);
+            for(int k=0;k<dimension;k++) TESTASSERT(value[k]>=bboxMin[k] && value[k]<=bboxMax[k]);
+        }
+    }
+}
+
+Partio::ParticlesDataMutable* makeData(const int n)
+{
+    Partio::ParticlesDataMutable* p=Partio::create();
+    Partio::ParticleAttribute positionAttr=p->addAttribute("position",Partio::VECTOR,3);
+    Partio::ParticleAttribute velocityAttr=p->addAttribute("velocity",Partio::VECTOR,3);
+    Partio::ParticleAttribute ageAttr=p->addAttribute("age",Partio::FLOAT,1);
+    Partio::ParticleAttribute screenAttr=p->addAttribute("screen",Partio::FLOAT,2);
+    Partio::ParticleAttribute positionTimeAttr=p->addAttribute("positionTime",Partio::FLOAT,4);
+    Partio::ParticleAttribute idAttr=p->addAttribute("id",Partio::INT,1);
+    p->addParticles(n);
+    for(int i=0;i<n;i++){
+        float* position=p->dataWrite<float>(positionAttr,i);
+        float* velocity=p->dataWrite<float>(velocityAttr,i);
+        float* positionTime=p->dataWrite<float>(positionTimeAttr,i);
+        for(int k=0;k<3;k++){
+            position[k]=randomFloat();
+            velocity[k]=randomFloat();
+            positionTime[k]=position[k];
+        }
+        positionTime[3]=randomFloat();
+        p->dataWrite<float>(ageAttr,i)[0]=randomFloat();
+        p->dataWrite<float>(screenAttr,i)[0]=randomFloat();
+        p->dataWrite<float>(screenAttr,i)[1]=randomFloat();
+        p->dataWrite<int>(idAttr,i)[0]=i;
+    }
+    return p;
+}
+
+int main(int argc,char *argv[])
+{
+    srand(7);
+    const int n=20000;
+    Partio::ParticlesDataMutable* p=makeData(n);
+    Partio::ParticleAttribute velocityAttr;
+    p->attributeInfo("velocity",velocityAttr);
+
+    std::cout<<"Testing trees over 1 to 4 components ..."<<std::endl;
+    p->sort();
+    p->sort("velocity");
+    p->sort("age");
+    p->sort("screen");
+    p->sort("positionTime");
+    testAttribute(p,"position");
+    testAttribute(p,"velocity");
+    testAttribute(p,"age");
+    testAttribute(p,"screen");
+    testAttribute(p,"positionTime");
+
+    std::cout<<"Testing sorting one attribute keeps the others ..."<<std::endl;
+    for(int i=0;i<n;i++) p->dataWrite<float>(velocityAttr,i)[0]+=1;
+    p->sort("velocity");
+    p->sort();
+    testAttribute(p,"velocity");
+    testAttribute(p,"age");
+
+    std::cout<<"Testing reorder rebuilds the trees ..."<<std::endl;
+    p->reorder();
+    testAttribute(p,"velocity");
+    testAttribute(p,"screen");
+    testAttribute(p,"positionTime");
+
+    std::cout<<"Testing trees are built on first use ..."<<std::endl;
+    Partio::ParticlesDataMutable* unsorted=makeData(n);
+    testAttribute(unsorted,"screen");
+    testAttribute(unsorted,"position");
+    unsorted->release();
+
+    std::cout<<"Testing attributes that can't be searched ..."<<std::endl;
+    Partio::ParticleIndex point;
+    float distance,finalRadius2;
+    const float center[4]={0,0,0,0};
+    TESTASSERT(p->findNPoints("id",center,1,1.f,&point,&distance,&finalRadius2)==0);
+    TESTASSERT(p->findNPoints("missing",center,1,1.f,&point,&distance,&finalRadius2)==0);
+
+    p->release();
+    std::cout<<"Test passed"<<std::endl;
+    return 0;
+}
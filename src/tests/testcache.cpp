@@ -35,6 +35,10 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
 #include <Partio.h>
 #include <cassert>
 #include <iostream>
+#include <stdexcept>
+
+#define TESTASSERT(x)\
+ if(!(x)) throw std::runtime_error(__FILE__ ": Test failed on " #x ); 
 
 int main(int argc,char* argv[])
 {
@@ -54,5 +58,24 @@ int main(int argc,char* argv[])
     p3->release();
     //assert(p2!=p3);
 
+    // memory budget: unused data is evicted and transparently reloaded on access
+    Partio::setCacheBudget(1);
+    Partio::ParticlesData* p4=Partio::readCached("/tmp/test.bgeo",false);
+    Partio::CacheStats stats=Partio::cacheStats();
+    TESTASSERT(stats.evictions>0 && stats.residentBytes==0);
+    Partio::beginCachedAccess(p4);
+    Partio::ParticleAttribute posAttr;
+    TESTASSERT(p4->attributeInfo("position",posAttr));
+    const float* pos4=p4->data<float>(posAttr,0);
+    TESTASSERT(pos4[0]==1 && pos4[1]==2 && pos4[2]==3);
+    TESTASSERT(Partio::cacheStats().residentBytes>0);
+    Partio::endCachedAccess(p4);
+    TESTASSERT(Partio::cacheStats().residentBytes==0);
+    p4->release();
+    Partio::ParticlesData* p5=Partio::readCached("/tmp/test.bgeo",false);
+    TESTASSERT(p5==p4 && Partio::cacheStats().hits>stats.hits); // kept cached under the budget
+    p5->release();
+    Partio::setCacheBudget(0);
+
     return 0;
 }
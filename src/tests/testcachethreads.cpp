@@ -0,0 +1,166 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+#include <Partio.h>
+#include <iostream>
+#include <sstream>
+#include <cstdlib>
+#include <stdexcept>
+#include <vector>
+#include "Timer.h"
+#ifndef PARTIO_WIN32
+#include <pthread.h>
+#else
+#include <windows.h>
+#endif
+
+#define TESTASSERT(x)\
+ if(!(x)) throw std::runtime_error(__FILE__ ": Test failed on " #x ); 
+
+// Loads several frames through readCached() from one thread and then from
+// one thread per frame, and checks that concurrent requests of the same
+// file share one read.
+// usage: testcachethreads [numFiles] [numParticles]
+
+struct Load
+{
+    std::string filename;
+    Partio::ParticlesData* particles;
+};
+
+#ifndef PARTIO_WIN32
+void* loadEntry(void* data)
+#else
+DWORD WINAPI loadEntry(LPVOID data)
+#endif
+{
+    Load& load=*static_cast<Load*>(data);
+    load.particles=Partio::readCached(load.filename.c_str(),true);
+    return 0;
+}
+
+void loadAll(std::vector<Load>& loads)
+{
+#ifndef PARTIO_WIN32
+    std::vector<pthread_t> threads(loads.size());
+    for(size_t i=0;i<loads.size();i++) pthread_create(&threads[i],0,loadEntry,&loads[i]);
+    for(size_t i=0;i<loads.size();i++) pthread_join(threads[i],0);
+#else
+    std::vector<HANDLE> threads(loads.size());
+    for(size_t i=0;i<loads.size();i++) threads[i]=CreateThread(0,0,loadEntry,&loads[i],0,0);
+    for(size_t i=0;i<loads.size();i++){
+        WaitForSingleObject(threads[i],INFINITE);
+        CloseHandle(threads[i]);
+    }
+#endif
+}
+
+std::string frameName(const char* prefix,const int frame)
+{
+    std::ostringstream name;
+    name<<"/tmp/testcachethreads_"<<prefix<<frame<<".bgeo";
+    return name.str();
+}
+
+void writeFrame(const std::string& filename,const int nParticles,const int frame)
+{
+    Partio::ParticlesDataMutable* p=Partio::create();
+    Partio::ParticleAttribute posAttr=p->addAttribute("position",Partio::VECTOR,3);
+    Partio::ParticleAttribute idAttr=p->addAttribute("id",Partio::INT,1);
+    p->addParticles(nParticles);
+    srand(frame);
+    for(int i=0;i<nParticles;i++){
+        float* pos=p->dataWrite<float>(posAttr,i);
+        for(int c=0;c<3;c++) pos[c]=(float)rand()/RAND_MAX;
+        p->dataWrite<int>(idAttr,i)[0]=frame;
+    }
+    Partio::write(filename.c_str(),*p);
+    p->release();
+}
+
+int main(int argc,char *argv[])
+{
+    int nFiles=argc>1 ? atoi(argv[1]) : 16;
+    int nParticles=argc>2 ? atoi(argv[2]) : 200000;
+
+    // separate files for each pass so neither is answered from memory
+    for(int i=0;i<nFiles;i++){
+        writeFrame(frameName("serial",i),nParticles,i);
+        writeFrame(frameName("threaded",i),nParticles,i);
+    }
+
+    std::vector<Load> serial(nFiles),threaded(nFiles);
+    double serialTime,threadedTime;
+    {
+        Timer timer("serial load");
+        for(int i=0;i<nFiles;i++){
+            serial[i].filename=frameName("serial",i);
+            loadEntry(&serial[i]);
+        }
+        serialTime=timer.Stop_Time();
+    }
+    {
+        Timer timer("threaded load");
+        for(int i=0;i<nFiles;i++) threaded[i].filename=frameName("threaded",i);
+        loadAll(threaded);
+        threadedTime=timer.Stop_Time();
+    }
+    std::cout<<"files "<<nFiles<<" speedup "<<serialTime/threadedTime<<std::endl;
+
+    for(int i=0;i<nFiles;i++){
+        TESTASSERT(threaded[i].particles && threaded[i].particles->numParticles()==nParticles);
+        Partio::ParticleAttribute idAttr;
+        TESTASSERT(threaded[i].particles->attributeInfo("id",idAttr));
+        TESTASSERT(threaded[i].particles->data<int>(idAttr,0)[0]==i);
+    }
+
+    std::cout<<"Testing concurrent loads of one file ..."<<std::endl;
+    {
+        Partio::CacheStats before=Partio::cacheStats();
+        std::vector<Load> same(nFiles);
+        for(int i=0;i<nFiles;i++) same[i].filename=frameName("shared",0);
+        writeFrame(same[0].filename,nParticles,0);
+        loadAll(same);
+        for(int i=0;i<nFiles;i++) TESTASSERT(same[i].particles==same[0].particles);
+        TESTASSERT(Partio::cacheStats().misses==before.misses+1);
+        for(int i=0;i<nFiles;i++) same[i].particles->release();
+    }
+    std::cout<<"Test passed"<<std::endl;
+
+    for(int i=0;i<nFiles;i++){
+        serial[i].particles->release();
+        threaded[i].particles->release();
+    }
+    return 0;
+}
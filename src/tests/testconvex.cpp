@@ -0,0 +1,167 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+#include <Partio.h>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+
+#define TESTASSERT(x)\
+ if(!(x)) throw std::runtime_error(__FILE__ ": Test failed on " #x ); 
+
+float randomFloat()
+{
+    return (float)rand()/RAND_MAX;
+}
+
+Partio::ParticlesDataMutable* makeData(const int n)
+{
+    Partio::ParticlesDataMutable* p=Partio::create();
+    Partio::ParticleAttribute positionAttr=p->addAttribute("position",Partio::VECTOR,3);
+    p->addParticles(n);
+    for(int i=0;i<n;i++){
+        float* pos=p->dataWrite<float>(positionAttr,i);
+        for(int k=0;k<3;k++) pos[k]=randomFloat();
+    }
+    return p;
+}
+
+// A camera at z=-1 looking down z with the given half angle tangent, from near to far
+std::vector<float> frustum(const float x,const float y,const float tanHalf,const float near,const float far)
+{
+    const float planes[6][4]={
+        {0,0,1,1-near},{0,0,-1,far-1},
+        {-1,0,tanHalf,x+tanHalf},{1,0,tanHalf,tanHalf-x},
+        {0,-1,tanHalf,y+tanHalf},{0,1,tanHalf,tanHalf-y}};
+    return std::vector<float>(&planes[0][0],&planes[0][0]+24);
+}
+
+// Planes around a point at random distances, n of them
+std::vector<float> randomPolytope(const int n)
+{
+    std::vector<float> planes;
+    for(int i=0;i<n;i++){
+        float normal[3],length=0;
+        for(int k=0;k<3;k++){normal[k]=randomFloat()*2-1;length+=normal[k]*normal[k];}
+        length=std::sqrt(length);
+        float d=.1f+.4f*randomFloat();
+        for(int k=0;k<3;k++){normal[k]/=length;d-=normal[k]*.5f;planes.push_back(normal[k]);}
+        planes.push_back(d);
+    }
+    return planes;
+}
+
+void testRegion(const Partio::ParticlesData* p,const std::vector<float>& planes)
+{
+    Partio::ParticleAttribute positionAttr;
+    TESTASSERT(p->attributeInfo("position",positionAttr));
+    const int nPlanes=(int)planes.size()/4;
+
+    std::vector<Partio::ParticleIndex> expected;
+    for(int i=0;i<p->numParticles();i++){
+        const float* pos=p->data<float>(positionAttr,i);
+        bool inside=true;
+        for(int j=0;j<nPlanes;j++){
+            const float* plane=&planes[4*j];
+            if(plane[0]*pos[0]+plane[1]*pos[1]+plane[2]*pos[2]+plane[3]<0) inside=false;
+        }
+        if(inside) expected.push_back(i);
+    }
+
+    const Partio::ParticleIndex sentinel=(Partio::ParticleIndex)-1;
+    std::vector<Partio::ParticleIndex> points(1,sentinel); // not pre-cleared
+    p->findPointsInConvex(nPlanes ? &planes[0] : 0,nPlanes,points);
+    TESTASSERT(points[0]==sentinel);
+    points.erase(points.begin());
+    std::sort(points.begin(),points.end());
+    TESTASSERT(points==expected);
+}
+
+void testRegions(const Partio::ParticlesData* p)
+{
+    testRegion(p,frustum(.5f,.5f,.3f,.5f,1.8f));
+    testRegion(p,frustum(.1f,.8f,.1f,1.2f,1.4f));
+    testRegion(p,frustum(5,5,.1f,.5f,1.8f)); // misses
+    testRegion(p,std::vector<float>()); // everything
+    for(int n=1;n<8;n++) testRegion(p,randomPolytope(n));
+    testRegion(p,randomPolytope(70)); // more planes than the tree tracks
+}
+
+int main(int argc,char *argv[])
+{
+    srand(3);
+
+    std::cout<<"Testing convex regions in the KD-Tree ..."<<std::endl;
+    Partio::ParticlesDataMutable* p=makeData(50000);
+    p->sort();
+    testRegions(p);
+
+    std::cout<<"Testing a compact KD-Tree ..."<<std::endl;
+    p->sort(Partio::SortOptions(true));
+    testRegions(p);
+
+    std::cout<<"Testing a refit KD-Tree ..."<<std::endl;
+    p->sort();
+    Partio::ParticleAttribute positionAttr;
+    p->attributeInfo("position",positionAttr);
+    for(int i=0;i<p->numParticles();i++){
+        float* pos=p->dataWrite<float>(positionAttr,i);
+        for(int k=0;k<3;k++) pos[k]+=(randomFloat()-.5f)*.01f;
+    }
+    p->updateSort();
+    testRegions(p);
+
+    std::cout<<"Testing reordered particles ..."<<std::endl;
+    p->reorder();
+    testRegions(p);
+
+    std::cout<<"Testing the hash grid ..."<<std::endl;
+    p->sort(Partio::SortOptions(Partio::HASHGRID,.05f));
+    testRegions(p);
+    p->release();
+
+    std::cout<<"Testing tiny sets ..."<<std::endl;
+    for(int n=0;n<40;n++){
+        Partio::ParticlesDataMutable* small=makeData(n);
+        small->sort();
+        testRegions(small);
+        small->release();
+    }
+
+    std::cout<<"Test passed"<<std::endl;
+    return 0;
+}
@@ -0,0 +1,144 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+#include <Partio.h>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <cstdlib>
+#include <stdexcept>
+
+#define TESTASSERT(x)\
+ if(!(x)) throw std::runtime_error(__FILE__ ": Test failed on " #x ); 
+
+// Particles from two sources, some of them dead
+Partio::ParticlesDataMutable* makeData(const int n)
+{
+    Partio::ParticlesDataMutable* p=Partio::create();
+    Partio::ParticleAttribute positionAttr=p->addAttribute("position",Partio::VECTOR,3);
+    Partio::ParticleAttribute sourceAttr=p->addAttribute("source",Partio::INDEXEDSTR,1);
+    Partio::ParticleAttribute aliveAttr=p->addAttribute("alive",Partio::INT,1);
+    int sources[2]={p->registerIndexedStr(sourceAttr,"smoke"),p->registerIndexedStr(sourceAttr,"sparks")};
+    p->addParticles(n);
+    srand(5);
+    for(int i=0;i<n;i++){
+        float* pos=p->dataWrite<float>(positionAttr,i);
+        for(int k=0;k<3;k++) pos[k]=(float)rand()/RAND_MAX;
+        p->dataWrite<int>(sourceAttr,i)[0]=sources[rand()%4==0];
+        p->dataWrite<int>(aliveAttr,i)[0]=rand()%3!=0;
+    }
+    return p;
+}
+
+// The nPoints nearest particles filter accepts, by looking at all of them
+std::vector<Partio::ParticleIndex> bruteForce(const Partio::ParticlesData* p,const float center[3],
+    const int nPoints,const float maxRadius,const Partio::PointFilter& filter)
+{
+    Partio::ParticleAttribute positionAttr;
+    p->attributeInfo("position",positionAttr);
+    std::vector<std::pair<float,Partio::ParticleIndex> > found;
+    for(int i=0;i<p->numParticles();i++){
+        const float* pos=p->data<float>(positionAttr,i);
+        float d2=0;
+        for(int k=0;k<3;k++) d2+=(pos[k]-center[k])*(pos[k]-center[k]);
+        if(d2<maxRadius*maxRadius && filter.accept(i)) found.push_back(std::make_pair(d2,(Partio::ParticleIndex)i));
+    }
+    std::sort(found.begin(),found.end());
+    if((int)found.size()>nPoints) found.resize(nPoints);
+    std::vector<Partio::ParticleIndex> result;
+    for(size_t i=0;i<found.size();i++) result.push_back(found[i].second);
+    std::sort(result.begin(),result.end());
+    return result;
+}
+
+void checkQueries(const Partio::ParticlesData* p,const int nPoints,const float maxRadius)
+{
+    Partio::ParticleAttribute positionAttr,sourceAttr,aliveAttr;
+    TESTASSERT(p->attributeInfo("position",positionAttr));
+    TESTASSERT(p->attributeInfo("source",sourceAttr));
+    TESTASSERT(p->attributeInfo("alive",aliveAttr));
+    Partio::IndexedStrFilter sparks(*p,sourceAttr,"sparks");
+    Partio::IntAttributeFilter alive(*p,aliveAttr,1);
+
+    std::vector<Partio::ParticleIndex> points(nPoints);
+    std::vector<float> distancesSquared(nPoints);
+    for(int q=0;q<200;q++){
+        const Partio::ParticleIndex self=(q*7919)%p->numParticles();
+        const float* center=p->data<float>(positionAttr,self);
+        Partio::ExcludeIndexFilter notSelf(self);
+        Partio::BothFilters sparksNotSelf(sparks,notSelf);
+        Partio::BothFilters aliveSparksNotSelf(alive,sparksNotSelf);
+        const Partio::PointFilter* filters[]={&notSelf,&sparks,&alive,&aliveSparksNotSelf};
+        for(int f=0;f<4;f++){
+            float finalRadius2;
+            int count=p->findNPoints(center,nPoints,maxRadius,*filters[f],&points[0],&distancesSquared[0],&finalRadius2);
+            std::vector<Partio::ParticleIndex> found(points.begin(),points.begin()+count);
+            std::sort(found.begin(),found.end());
+            TESTASSERT(found==bruteForce(p,center,nPoints,maxRadius,*filters[f]));
+            for(int i=0;i<count;i++){
+                TESTASSERT(filters[f]->accept(points[i]));
+                TESTASSERT(distancesSquared[i]<=finalRadius2);
+            }
+        }
+        // the query particle is its own nearest neighbor unless excluded
+        float finalRadius2;
+        int count=p->findNPoints(center,1,maxRadius,&points[0],&distancesSquared[0],&finalRadius2);
+        TESTASSERT(count==1 && distancesSquared[0]==0);
+        count=p->findNPoints(center,1,maxRadius,notSelf,&points[0],&distancesSquared[0],&finalRadius2);
+        TESTASSERT(count==1 && points[0]!=self);
+    }
+
+    // a string no particle has accepts nothing
+    Partio::IndexedStrFilter rain(*p,sourceAttr,"rain");
+    float finalRadius2;
+    const float center[3]={.5f,.5f,.5f};
+    TESTASSERT(p->findNPoints(center,nPoints,maxRadius,rain,&points[0],&distancesSquared[0],&finalRadius2)==0);
+}
+
+int main(int argc,char *argv[])
+{
+    Partio::ParticlesDataMutable* p=makeData(20000);
+    p->sort();
+    std::cout<<"KD-Tree ..."<<std::endl;
+    checkQueries(p,12,.2f);
+    checkQueries(p,12,10);
+    p->sort(Partio::SortOptions(Partio::HASHGRID,.05f));
+    std::cout<<"Hash grid ..."<<std::endl;
+    checkQueries(p,12,.2f);
+    checkQueries(p,12,10);
+    p->release();
+    std::cout<<"Test passed"<<std::endl;
+    return 0;
+}
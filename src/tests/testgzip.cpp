@@ -0,0 +1,138 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+#include <Partio.h>
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+#include <stdexcept>
+#include <vector>
+#include <zlib.h>
+#include "Timer.h"
+
+#define TESTASSERT(x)\
+ if(!(x)) throw std::runtime_error(__FILE__ ": Test failed on " #x ); 
+
+// Round trips a large bgeo.gz through the threaded block gzip writer and
+// checks the reader still handles ordinary single and multi member gzip files.
+// usage: testgzip [numParticles]
+
+void compare(const Partio::ParticlesData* expected,const Partio::ParticlesData* actual)
+{
+    TESTASSERT(actual && actual->numParticles()==expected->numParticles());
+    Partio::ParticleAttribute expectedPos,actualPos,actualId;
+    TESTASSERT(expected->attributeInfo("position",expectedPos));
+    TESTASSERT(actual->attributeInfo("position",actualPos));
+    TESTASSERT(actual->attributeInfo("id",actualId));
+    for(int i=0;i<expected->numParticles();i++){
+        const float* a=expected->data<float>(expectedPos,i);
+        const float* b=actual->data<float>(actualPos,i);
+        TESTASSERT(a[0]==b[0] && a[1]==b[1] && a[2]==b[2]);
+        TESTASSERT(actual->data<int>(actualId,i)[0]==i);
+    }
+}
+
+// recompresses a file with zlib's own writer, splitting it into members at split bytes
+void regzip(const char* from,const char* to,const size_t split)
+{
+    std::ifstream input(from,std::ios::in|std::ios::binary);
+    std::vector<char> data((std::istreambuf_iterator<char>(input)),std::istreambuf_iterator<char>());
+    std::ofstream(to,std::ios::out|std::ios::binary); // truncate
+    for(size_t start=0;start<data.size();start+=split){
+        gzFile file=gzopen(to,"ab");
+        gzwrite(file,&data[start],(unsigned)std::min(split,data.size()-start));
+        gzclose(file);
+    }
+}
+
+int main(int argc,char *argv[])
+{
+    int nParticles=argc>1 ? atoi(argv[1]) : 1000000;
+
+    Partio::ParticlesDataMutable* p=Partio::create();
+    Partio::ParticleAttribute posAttr=p->addAttribute("position",Partio::VECTOR,3);
+    Partio::ParticleAttribute idAttr=p->addAttribute("id",Partio::INT,1);
+    p->addParticles(nParticles);
+    srand(1);
+    for(int i=0;i<nParticles;i++){
+        float* pos=p->dataWrite<float>(posAttr,i);
+        for(int c=0;c<3;c++) pos[c]=(float)(rand()%1000);
+        p->dataWrite<int>(idAttr,i)[0]=i;
+    }
+    Partio::write("/tmp/testgzip.bgeo",*p);
+    {
+        Timer timer("block gzip write");
+        Partio::write("/tmp/testgzip.bgeo.gz",*p);
+    }
+
+    std::cout<<"Testing block gzip ..."<<std::endl;
+    {
+        Timer timer("block gzip read");
+        Partio::ParticlesDataMutable* read=Partio::read("/tmp/testgzip.bgeo.gz");
+        timer.Stop_Time();
+        compare(p,read);
+        read->release();
+    }
+    std::cout<<"Testing write options ..."<<std::endl;
+    {
+        Timer timer("fast block gzip write");
+        Partio::write("/tmp/testgzip_fast.bgeo",*p,Partio::WriteOptions(true,1,2));
+        timer.Stop_Time();
+        std::ifstream compressed("/tmp/testgzip_fast.bgeo",std::ios::in|std::ios::binary);
+        TESTASSERT(compressed.get()==0x1f && compressed.get()==0x8b);
+        Partio::ParticlesDataMutable* read=Partio::read("/tmp/testgzip_fast.bgeo");
+        compare(p,read);
+        read->release();
+    }
+    std::cout<<"Testing single member gzip ..."<<std::endl;
+    {
+        regzip("/tmp/testgzip.bgeo","/tmp/testgzip_single.bgeo.gz",size_t(-1)/2);
+        Timer timer("single member gzip read");
+        Partio::ParticlesDataMutable* read=Partio::read("/tmp/testgzip_single.bgeo.gz");
+        timer.Stop_Time();
+        compare(p,read);
+        read->release();
+    }
+    std::cout<<"Testing multi member gzip ..."<<std::endl;
+    {
+        regzip("/tmp/testgzip.bgeo","/tmp/testgzip_multi.bgeo.gz",1000001);
+        Partio::ParticlesDataMutable* read=Partio::read("/tmp/testgzip_multi.bgeo.gz");
+        compare(p,read);
+        read->release();
+    }
+    std::cout<<"Test passed"<<std::endl;
+
+    p->release();
+    return 0;
+}
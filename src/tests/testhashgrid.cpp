@@ -0,0 +1,170 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+#include <Partio.h>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+
+#define TESTASSERT(x)\
+ if(!(x)) throw std::runtime_error(__FILE__ ": Test failed on " #x ); 
+
+Partio::ParticlesDataMutable* makeData(const int n)
+{
+    Partio::ParticlesDataMutable* p=Partio::create();
+    Partio::ParticleAttribute positionAttr=p->addAttribute("position",Partio::VECTOR,3);
+    p->addParticles(n);
+    srand(5);
+    for(int i=0;i<n;i++){
+        float* pos=p->dataWrite<float>(positionAttr,i);
+        // half uniform, half in a tight clump so buckets are uneven
+        const float scale=i%2 ? 1.f : .05f;
+        for(int k=0;k<3;k++) pos[k]=scale*(float)rand()/RAND_MAX;
+    }
+    return p;
+}
+
+int main(int argc,char *argv[])
+{
+    // enough points for the grid build to split into several chunks
+    const int n=200000;
+    const float h=0.02f;
+    Partio::setNumThreads(4);
+    Partio::ParticlesDataMutable* tree=makeData(n);
+    Partio::ParticlesDataMutable* grid=makeData(n);
+    tree->sort();
+    grid->sort(Partio::SortOptions(Partio::HASHGRID,h));
+
+    const int nQueries=300,nPoints=12;
+    std::vector<float> centers(3*nQueries);
+    for(int q=0;q<nQueries;q++)
+        for(int k=0;k<3;k++) centers[3*q+k]=((q*37+k*11)%130)/100.f-0.15f;
+
+    std::cout<<"Testing nearest points ..."<<std::endl;
+    for(int q=0;q<nQueries;q++){
+        const float radius=q%3 ? h : 4*h;
+        std::vector<Partio::ParticleIndex> treePoints,gridPoints;
+        std::vector<float> treeDists,gridDists;
+        tree->findNPoints(&centers[3*q],nPoints,radius,treePoints,treeDists);
+        grid->findNPoints(&centers[3*q],nPoints,radius,gridPoints,gridDists);
+        TESTASSERT(treePoints.size()==gridPoints.size());
+        std::sort(treeDists.begin(),treeDists.end());
+        std::sort(gridDists.begin(),gridDists.end());
+        TESTASSERT(treeDists==gridDists);
+    }
+
+    std::cout<<"Testing batched nearest points ..."<<std::endl;
+    {
+        std::vector<Partio::ParticleIndex> points(nQueries*nPoints);
+        std::vector<float> dists(nQueries*nPoints);
+        std::vector<int> counts(nQueries);
+        grid->findNPointsBatch(&centers[0],nQueries,nPoints,h,&points[0],&dists[0],&counts[0]);
+        for(int q=0;q<nQueries;q++){
+            Partio::ParticleIndex single[nPoints];
+            float singleDists[nPoints],finalRadius2;
+            TESTASSERT(counts[q]==grid->findNPoints(&centers[3*q],nPoints,h,single,singleDists,&finalRadius2));
+            for(int i=0;i<counts[q];i++){
+                TESTASSERT(points[q*nPoints+i]==single[i]);
+                TESTASSERT(dists[q*nPoints+i]==singleDists[i]);
+            }
+        }
+    }
+
+    std::cout<<"Testing box and radius queries ..."<<std::endl;
+    for(int q=0;q<nQueries;q++){
+        const float* c=&centers[3*q];
+        const float bboxMin[3]={c[0]-h,c[1]-2*h,c[2]-h},bboxMax[3]={c[0]+2*h,c[1]+h,c[2]+h};
+        std::vector<Partio::ParticleIndex> treePoints,gridPoints;
+        tree->findPoints(bboxMin,bboxMax,treePoints);
+        grid->findPoints(bboxMin,bboxMax,gridPoints);
+        std::sort(treePoints.begin(),treePoints.end());
+        std::sort(gridPoints.begin(),gridPoints.end());
+        TESTASSERT(treePoints==gridPoints);
+
+        std::vector<float> treeDists,gridDists;
+        treePoints.clear();gridPoints.clear();
+        tree->findPointsInRadius(c,h,treePoints,treeDists);
+        grid->findPointsInRadius(c,h,gridPoints,gridDists);
+        std::sort(treePoints.begin(),treePoints.end());
+        std::sort(gridPoints.begin(),gridPoints.end());
+        TESTASSERT(treePoints==gridPoints);
+    }
+
+    tree->release();
+    grid->release();
+
+    std::cout<<"Testing queries far from the points ..."<<std::endl;
+    {
+        // one outlier stretches the grid over a huge number of empty cells
+        const float outlier[3]={1000,1000,1000};
+        tree=makeData(100000);
+        grid=makeData(100000);
+        Partio::ParticleAttribute positionAttr;
+        TESTASSERT(tree->attributeInfo("position",positionAttr));
+        for(int k=0;k<3;k++){
+            tree->dataWrite<float>(positionAttr,0)[k]=outlier[k];
+            grid->dataWrite<float>(positionAttr,0)[k]=outlier[k];
+        }
+        tree->sort();
+        grid->sort(Partio::SortOptions(Partio::HASHGRID,h));
+        const float farCenters[][3]={{500,500,500},{2,2,2},{999,1000,1000},{-50,.5f,.5f},{1e6f,0,0},{.5f,.5f,.5f}};
+        for(int q=0;q<6;q++){
+            std::vector<Partio::ParticleIndex> treePoints,gridPoints;
+            std::vector<float> treeDists,gridDists;
+            tree->findNPoints(farCenters[q],8,1e30f,treePoints,treeDists);
+            grid->findNPoints(farCenters[q],8,1e30f,gridPoints,gridDists);
+            TESTASSERT(gridPoints.size()==8);
+            std::sort(treeDists.begin(),treeDists.end());
+            std::sort(gridDists.begin(),gridDists.end());
+            TESTASSERT(treeDists==gridDists);
+        }
+        tree->release();
+        grid->release();
+    }
+
+    // an empty set still sorts and answers queries
+    Partio::ParticlesDataMutable* empty=makeData(0);
+    empty->sort(Partio::SortOptions(Partio::HASHGRID,h));
+    std::vector<Partio::ParticleIndex> points;
+    std::vector<float> dists;
+    const float center[3]={0,0,0};
+    empty->findNPoints(center,nPoints,h,points,dists);
+    TESTASSERT(points.empty());
+    empty->release();
+
+    std::cout<<"Test passed"<<std::endl;
+    return 0;
+}
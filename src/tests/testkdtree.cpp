@@ -38,6 +38,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
 #include <iostream>
 #include <cmath>
 #include <stdexcept>
+#include <algorithm>
 #define GRIDN 9
 
 
@@ -123,6 +124,57 @@ int main(int argc,char *argv[])
 
         std::cout << "Test passed\n";
     }
+    std::cout << "Testing batched lookup ...\n";
+    {
+        const int nQueries=1000,nPoints=5;
+        std::vector<float> centers(3*nQueries);
+        for (int q = 0; q < nQueries; q++)
+            for (int c = 0; c < 3; c++) centers[3*q+c] = ((q*7+c*13)%101) / 100.f;
+        std::vector<uint64_t> indices(nQueries*nPoints);
+        std::vector<float> dists(nQueries*nPoints);
+        std::vector<int> counts(nQueries);
+        foo->findNPointsBatch(&centers[0], nQueries, nPoints, 0.15f, &indices[0], &dists[0], &counts[0]);
+
+        for (int q = 0; q < nQueries; q++) {
+            uint64_t single[nPoints];
+            float singleDists[nPoints];
+            float finalDist;
+            int returned=foo->findNPoints(&centers[3*q], nPoints, 0.15f, single, singleDists, &finalDist);
+            TESTASSERT (counts[q] == returned);
+            for (int i = 0; i < returned; i++) {
+                TESTASSERT (indices[q*nPoints+i] == single[i]);
+                TESTASSERT (dists[q*nPoints+i] == singleDists[i]);
+            }
+        }
+        std::cout << "Test passed\n";
+    }
+    std::cout << "Testing against brute force ...\n";
+    {
+        const int nPoints=20;
+        const float radius=0.3f;
+        for (int q = 0; q < 200; q++) {
+            float point[3];
+            for (int c = 0; c < 3; c++) point[c] = ((q*31+c*17)%113) / 100.f - 0.05f;
+            std::vector<uint64_t> indices;
+            std::vector<float> dists;
+            foo->findNPoints(point, nPoints, radius, indices, dists);
+
+            // every returned point is within the final distance and nothing closer was missed
+            float maxDist=0;
+            for (size_t i = 0; i < dists.size(); i++) maxDist=std::max(maxDist,dists[i]);
+            int closer=0;
+            for (int i = 0; i < foo->numParticles(); i++) {
+                const float* pos = foo->data<float>(posAttr, i);
+                float d2=0;
+                for (int c = 0; c < 3; c++) d2 += (pos[c]-point[c])*(pos[c]-point[c]);
+                if (d2 < maxDist) closer++;
+                if (d2 < radius*radius && (int)indices.size() < nPoints)
+                    TESTASSERT (std::find(indices.begin(), indices.end(), (uint64_t)i) != indices.end());
+            }
+            TESTASSERT (closer < (int)indices.size());
+        }
+        std::cout << "Test passed\n";
+    }
     foo->release();
 
     return 0;
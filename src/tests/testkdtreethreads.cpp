@@ -0,0 +1,108 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+
+#include <Partio.h>
+#include <iostream>
+#include <cstdlib>
+#include <stdexcept>
+#include "Timer.h"
+
+#define TESTASSERT(x)\
+ if(!(x)) throw std::runtime_error(__FILE__ ": Test failed on " #x ); 
+
+// Compares the serial kd-tree build against the threaded one on random points
+// usage: testkdtreethreads [numParticles] [numThreads]
+
+Partio::ParticlesDataMutable* makeData(const int nParticles)
+{
+    Partio::ParticlesDataMutable* foo=Partio::create();
+    Partio::ParticleAttribute positionAttr=foo->addAttribute("position",Partio::VECTOR,3);
+    foo->addParticles(nParticles);
+    srand(1);
+    for(int i=0;i<nParticles;i++){
+        float* pos=foo->dataWrite<float>(positionAttr,i);
+        for(int c=0;c<3;c++) pos[c]=(float)rand()/RAND_MAX;
+    }
+    return foo;
+}
+
+int main(int argc,char *argv[])
+{
+    int nParticles=argc>1 ? atoi(argv[1]) : 2000000;
+    int nThreads=argc>2 ? atoi(argv[2]) : 0;
+
+    Partio::ParticlesDataMutable* serial=makeData(nParticles);
+    Partio::ParticlesDataMutable* threaded=makeData(nParticles);
+
+    double serialTime,threadedTime;
+    {
+        Partio::setNumThreads(1);
+        Timer timer("serial sort");
+        serial->sort();
+        serialTime=timer.Stop_Time();
+    }
+    {
+        Partio::setNumThreads(nThreads);
+        Timer timer("threaded sort");
+        threaded->sort();
+        threadedTime=timer.Stop_Time();
+    }
+    std::cout<<"threads "<<Partio::numThreads()<<" speedup "<<serialTime/threadedTime<<std::endl;
+
+    std::cout<<"Comparing lookups ..."<<std::endl;
+    srand(2);
+    for(int q=0;q<1000;q++){
+        float point[3];
+        for(int c=0;c<3;c++) point[c]=(float)rand()/RAND_MAX;
+        std::vector<Partio::ParticleIndex> serialIndices,threadedIndices;
+        std::vector<float> serialDists,threadedDists;
+        serial->findNPoints(point,10,.1f,serialIndices,serialDists);
+        threaded->findNPoints(point,10,.1f,threadedIndices,threadedDists);
+        TESTASSERT(serialIndices==threadedIndices);
+        TESTASSERT(serialDists==threadedDists);
+
+        float bboxMin[3]={point[0]-.01f,point[1]-.01f,point[2]-.01f};
+        float bboxMax[3]={point[0]+.01f,point[1]+.01f,point[2]+.01f};
+        serialIndices.clear();threadedIndices.clear();
+        serial->findPoints(bboxMin,bboxMax,serialIndices);
+        threaded->findPoints(bboxMin,bboxMax,threadedIndices);
+        TESTASSERT(serialIndices==threadedIndices);
+    }
+    std::cout<<"Test passed"<<std::endl;
+
+    serial->release();
+    threaded->release();
+    return 0;
+}
@@ -0,0 +1,79 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+#include <Partio.h>
+#include <iostream>
+#include <stdexcept>
+#include <climits>
+#include <cstdio>
+#include <fstream>
+
+#define TESTASSERT(x)\
+ if(!(x)) throw std::runtime_error(__FILE__ ": Test failed on " #x ); 
+
+// Particle sets with no attributes don't allocate any storage, so counts
+// past 2^31 can be checked without needing that much memory
+void testCount(Partio::ParticlesDataMutable* p)
+{
+    const int64_t count=(int64_t)INT_MAX+10;
+    p->addParticles(count);
+    TESTASSERT(p->numParticles()==count);
+    p->addParticles(5);
+    TESTASSERT(p->numParticles()==count+5);
+    TESTASSERT(p->addParticle()==(Partio::ParticleIndex)(count+5));
+
+    // formats with 32 bit counts refuse before creating the file instead of truncating
+    remove("testlargecount.pdc");
+    Partio::write("testlargecount.pdc",*p);
+    TESTASSERT(!std::ifstream("testlargecount.pdc"));
+    p->release();
+}
+
+int main(int argc,char *argv[])
+{
+    testCount(Partio::create());
+    testCount(Partio::createInterleave());
+
+    // small sets still read back through the int API
+    Partio::ParticlesDataMutable* p=Partio::create();
+    Partio::ParticleAttribute idAttr=p->addAttribute("id",Partio::INT,1);
+    p->addParticles(3);
+    for(int i=0;i<3;i++) p->dataWrite<int>(idAttr,i)[0]=i;
+    int n=p->numParticles();
+    TESTASSERT(n==3);
+    p->release();
+
+    std::cout<<"Test passed"<<std::endl;
+    return 0;
+}
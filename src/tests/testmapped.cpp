@@ -0,0 +1,115 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+
+#include <Partio.h>
+#include <iostream>
+#include <stdexcept>
+
+#define TESTASSERT(x)\
+ if(!(x)) throw std::runtime_error(__FILE__ ": Test failed on " #x ); 
+
+Partio::ParticlesDataMutable* makeData()
+{
+    Partio::ParticlesDataMutable& foo=*Partio::create();
+    Partio::ParticleAttribute positionAttr=foo.addAttribute("position",Partio::VECTOR,3);
+    Partio::ParticleAttribute lifeAttr=foo.addAttribute("life",Partio::FLOAT,2);
+    Partio::ParticleAttribute idAttr=foo.addAttribute("id",Partio::INT,1);
+
+    for(int i=0;i<1000;i++){
+        Partio::ParticleIndex index=foo.addParticle();
+        float* pos=foo.dataWrite<float>(positionAttr,index);
+        float* life=foo.dataWrite<float>(lifeAttr,index);
+        int* id=foo.dataWrite<int>(idAttr,index);
+        pos[0]=.1*(i%10);
+        pos[1]=.1*((i/10)%10);
+        pos[2]=.1*(i/100);
+        life[0]=-1.2+i;
+        life[1]=10.;
+        id[0]=index;
+    }
+    return &foo;
+}
+
+void testMapped(const Partio::ParticlesData* original,const char* filename)
+{
+    std::cerr<<"Testing mapped read of file '"<<filename<<"'"<<std::endl;
+    Partio::write(filename,*original);
+    Partio::ParticlesData* mapped=Partio::readMapped(filename,true);
+    TESTASSERT(mapped);
+    TESTASSERT(mapped->numParticles()==original->numParticles());
+    TESTASSERT(mapped->numAttributes()==original->numAttributes());
+
+    const char* names[3]={"position","life","id"};
+    for(int a=0;a<3;a++){
+        Partio::ParticleAttribute originalAttr,mappedAttr;
+        TESTASSERT(original->attributeInfo(names[a],originalAttr));
+        TESTASSERT(mapped->attributeInfo(names[a],mappedAttr));
+        TESTASSERT(originalAttr.type==mappedAttr.type && originalAttr.count==mappedAttr.count);
+
+        Partio::ParticlesData::const_iterator it=mapped->begin();
+        Partio::ParticleAccessor accessor(mappedAttr);
+        it.addAccessor(accessor);
+        for(int i=0;it!=mapped->end();++it,++i){
+            const int* values=original->data<int>(originalAttr,i);
+            for(int k=0;k<mappedAttr.count;k++){
+                TESTASSERT(mapped->data<int>(mappedAttr,i)[k]==values[k]);
+                TESTASSERT(accessor.raw<int>(it)[k]==values[k]);
+            }
+        }
+    }
+
+    std::vector<Partio::ParticleIndex> points;
+    std::vector<float> distances;
+    float center[3]={.5,.5,.5};
+    mapped->findNPoints(center,1,.01f,points,distances);
+    TESTASSERT(points.size()==1);
+    Partio::ParticleAttribute positionAttr;
+    mapped->attributeInfo("position",positionAttr);
+    const float* position=mapped->data<float>(positionAttr,points[0]);
+    TESTASSERT(position[0]==.5f && position[1]==.5f && position[2]==.5f);
+    mapped->release();
+}
+
+int main(int argc,char *argv[])
+{
+    Partio::ParticlesDataMutable* foo=makeData();
+    testMapped(foo,"testmapped.bgeo");
+    testMapped(foo,"testmapped.pdb32");
+    testMapped(foo,"testmapped.pdb64");
+    testMapped(foo,"testmapped.bgeo.gz");
+    foo->release();
+    std::cout<<"Test passed"<<std::endl;
+    return 0;
+}
@@ -0,0 +1,130 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+#include <Partio.h>
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <stdexcept>
+
+#define TESTASSERT(x)\
+ if(!(x)) throw std::runtime_error(__FILE__ ": Test failed on " #x ); 
+
+Partio::ParticlesDataMutable* makeData(const int n)
+{
+    Partio::ParticlesDataMutable* p=Partio::create();
+    Partio::ParticleAttribute positionAttr=p->addAttribute("position",Partio::VECTOR,3);
+    p->addParticles(n);
+    srand(11);
+    for(int i=0;i<n;i++){
+        float* pos=p->dataWrite<float>(positionAttr,i);
+        for(int k=0;k<3;k++) pos[k]=(float)rand()/RAND_MAX;
+    }
+    return p;
+}
+
+struct CountVisitor:public Partio::PointVisitor
+{
+    int count,limit;
+    CountVisitor(int limit):count(0),limit(limit){}
+    bool visit(const Partio::ParticleIndex particleIndex,const float distanceSquared)
+    {
+        count++;
+        return count<limit;
+    }
+};
+
+// checks the radius search against a brute force scan of the unsorted positions
+void testAgainstBruteForce(const Partio::ParticlesData& p,const std::vector<float>& positions)
+{
+    const int n=(int)positions.size()/3;
+    std::vector<Partio::ParticleIndex> points;
+    std::vector<float> dists;
+    for(int q=0;q<50;q++){
+        const float center[3]={(q%5)/4.f,((q/5)%5)/4.f,(q%7)/6.f};
+        const float radius=0.05f+0.01f*(q%10);
+        points.clear();dists.clear();
+        p.findPointsInRadius(center,radius,points,dists);
+        TESTASSERT(points.size()==dists.size());
+
+        std::vector<int> hit(n,0);
+        for(size_t i=0;i<points.size();i++){
+            TESTASSERT(points[i]<(Partio::ParticleIndex)n);
+            TESTASSERT(dists[i]<radius*radius);
+            hit[points[i]]++;
+        }
+        for(int i=0;i<n;i++){
+            float d2=0;
+            for(int k=0;k<3;k++) d2+=(positions[3*i+k]-center[k])*(positions[3*i+k]-center[k]);
+            // leave float slack on the boundary
+            if(d2<radius*radius*0.999f) TESTASSERT(hit[i]==1);
+            if(d2>radius*radius*1.001f) TESTASSERT(hit[i]==0);
+            TESTASSERT(hit[i]<=1);
+        }
+    }
+}
+
+int main(int argc,char *argv[])
+{
+    const int n=20000;
+    Partio::ParticlesDataMutable* p=makeData(n);
+    Partio::ParticlesDataMutable* compact=makeData(n);
+    Partio::ParticleAttribute positionAttr;
+    TESTASSERT(p->attributeInfo("position",positionAttr));
+    std::vector<float> positions(3*n);
+    p->getRange(positionAttr,0,n,&positions[0]);
+
+    p->sort();
+    compact->sort(Partio::SortOptions(true));
+
+    std::cout<<"Testing radius search ..."<<std::endl;
+    testAgainstBruteForce(*p,positions);
+    testAgainstBruteForce(*compact,positions);
+
+    std::cout<<"Testing early termination ..."<<std::endl;
+    {
+        const float center[3]={.5f,.5f,.5f};
+        CountVisitor all(n+1);
+        TESTASSERT(p->visitPointsInRadius(center,2.f,all));
+        TESTASSERT(all.count==n);
+        CountVisitor first(10);
+        TESTASSERT(!p->visitPointsInRadius(center,2.f,first));
+        TESTASSERT(first.count==10);
+    }
+
+    p->release();
+    compact->release();
+    std::cout<<"Test passed"<<std::endl;
+    return 0;
+}
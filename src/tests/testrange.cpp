@@ -0,0 +1,129 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+#include <Partio.h>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#define TESTASSERT(x)\
+ if(!(x)) throw std::runtime_error(__FILE__ ": Test failed on " #x ); 
+
+void fillData(Partio::ParticlesDataMutable* foo)
+{
+    Partio::ParticleAttribute positionAttr=foo->addAttribute("position",Partio::VECTOR,3);
+    Partio::ParticleAttribute lifeAttr=foo->addAttribute("life",Partio::FLOAT,2);
+    Partio::ParticleAttribute idAttr=foo->addAttribute("id",Partio::INT,1);
+    foo->addParticles(1000);
+
+    for(int i=0;i<1000;i++){
+        float* pos=foo->dataWrite<float>(positionAttr,i);
+        float* life=foo->dataWrite<float>(lifeAttr,i);
+        int* id=foo->dataWrite<int>(idAttr,i);
+        pos[0]=i;pos[1]=2*i;pos[2]=3*i;
+        life[0]=-1.2+i;life[1]=10.;
+        id[0]=i;
+    }
+}
+
+void testRange(Partio::ParticlesDataMutable* foo,const bool contiguous)
+{
+    Partio::ParticleAttribute positionAttr,lifeAttr,idAttr;
+    TESTASSERT(foo->attributeInfo("position",positionAttr));
+    TESTASSERT(foo->attributeInfo("life",lifeAttr));
+    TESTASSERT(foo->attributeInfo("id",idAttr));
+
+    // extract
+    std::vector<float> pos(3*100),life(2*100);
+    std::vector<int> ids(100);
+    foo->getRange(positionAttr,250,100,&pos[0]);
+    foo->getRange(lifeAttr,250,100,&life[0]);
+    foo->getRange(idAttr,250,100,&ids[0]);
+    for(int i=0;i<100;i++){
+        TESTASSERT(pos[3*i]==250+i && pos[3*i+1]==2*(250+i) && pos[3*i+2]==3*(250+i));
+        TESTASSERT(life[2*i]==(float)(-1.2+(250+i)) && life[2*i+1]==10.f);
+        TESTASSERT(ids[i]==250+i);
+    }
+
+    // fill, then make sure neighbors were not touched
+    for(int i=0;i<100;i++){ids[i]=-i;pos[3*i]=pos[3*i+1]=pos[3*i+2]=.5f*i;}
+    foo->setRange(idAttr,500,100,&ids[0]);
+    foo->setRange(positionAttr,500,100,&pos[0]);
+    for(int i=0;i<1000;i++){
+        const int id=*foo->data<int>(idAttr,i);
+        const float* p=foo->data<float>(positionAttr,i);
+        const float* l=foo->data<float>(lifeAttr,i);
+        if(i>=500 && i<600){
+            TESTASSERT(id==-(i-500));
+            TESTASSERT(p[0]==.5f*(i-500) && p[2]==.5f*(i-500));
+        }else{
+            TESTASSERT(id==i);
+            TESTASSERT(p[0]==i && p[2]==3*i);
+        }
+        TESTASSERT(l[0]==(float)(-1.2+i) && l[1]==10.f);
+    }
+
+    const int* idPointer=foo->contiguousPointer<int>(idAttr);
+    TESTASSERT((idPointer!=0)==contiguous);
+    if(idPointer){
+        TESTASSERT(idPointer==foo->data<int>(idAttr,0));
+        TESTASSERT(idPointer[999]==999 && idPointer[550]==-50);
+        TESTASSERT(foo->contiguousPointerWrite<int>(idAttr)==idPointer);
+    }
+}
+
+int main(int argc,char *argv[])
+{
+    Partio::ParticlesDataMutable* simple=Partio::create();
+    fillData(simple);
+    testRange(simple,true);
+    simple->release();
+
+    Partio::ParticlesDataMutable* interleave=Partio::createInterleave();
+    fillData(interleave);
+    testRange(interleave,false);
+    interleave->release();
+
+    // a single attribute interleaved layout is packed
+    Partio::ParticlesDataMutable* single=Partio::createInterleave();
+    Partio::ParticleAttribute idAttr=single->addAttribute("id",Partio::INT,1);
+    single->addParticles(10);
+    for(int i=0;i<10;i++) *single->dataWrite<int>(idAttr,i)=i;
+    const int* ids=single->contiguousPointer<int>(idAttr);
+    TESTASSERT(ids && ids[0]==0 && ids[9]==9);
+    single->release();
+
+    std::cout<<"Test passed"<<std::endl;
+    return 0;
+}
@@ -0,0 +1,226 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+#include <Partio.h>
+#include <iostream>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <float.h>
+#include <stdexcept>
+
+#define TESTASSERT(x)\
+ if(!(x)) throw std::runtime_error(__FILE__ ": Test failed on " #x ); 
+
+typedef std::vector<std::pair<float,Partio::ParticleIndex> > Hits;
+
+float randomFloat()
+{
+    return (float)rand()/RAND_MAX;
+}
+
+// Particles with radii spread over two orders of magnitude, some sharing a position
+Partio::ParticlesDataMutable* makeData(const int n)
+{
+    Partio::ParticlesDataMutable* p=Partio::create();
+    Partio::ParticleAttribute positionAttr=p->addAttribute("position",Partio::VECTOR,3);
+    Partio::ParticleAttribute radiusAttr=p->addAttribute("radius",Partio::FLOAT,1);
+    p->addParticles(n);
+    for(int i=0;i<n;i++){
+        float* pos=p->dataWrite<float>(positionAttr,i);
+        if(i%10==9) for(int k=0;k<3;k++) pos[k]=p->data<float>(positionAttr,i-1)[k];
+        else for(int k=0;k<3;k++) pos[k]=randomFloat();
+        p->dataWrite<float>(radiusAttr,i)[0]=.001f*std::pow(100.f,randomFloat());
+    }
+    return p;
+}
+
+// Rays from around the unit cube, some along an axis or degenerate, and segments
+void makeRay(const int q,float origin[3],float direction[3],float& tMax)
+{
+    for(int k=0;k<3;k++){
+        origin[k]=randomFloat()*1.4f-.2f;
+        direction[k]=randomFloat()*2-1;
+    }
+    if(q%7==1) direction[0]=direction[1]=0;
+    if(q%23==2) direction[0]=direction[1]=direction[2]=0;
+    tMax=q%3 ? FLT_MAX : .5f;
+}
+
+// Hits of a ray by brute force, nearest first, at most maxHits unless that is 0
+Hits expectedHits(const Partio::ParticlesData* p,const float origin[3],const float direction[3],
+    const float tMax,const float radius,const bool spheres,const int maxHits)
+{
+    Partio::ParticleAttribute positionAttr,radiusAttr;
+    p->attributeInfo("position",positionAttr);
+    p->attributeInfo("radius",radiusAttr);
+    float length2=0;
+    for(int k=0;k<3;k++) length2+=direction[k]*direction[k];
+
+    Hits hits;
+    for(int i=0;i<p->numParticles();i++){
+        const float* pos=p->data<float>(positionAttr,i);
+        float v[3],dot=0,v2=0;
+        for(int k=0;k<3;k++){v[k]=pos[k]-origin[k];dot+=v[k]*direction[k];v2+=v[k]*v[k];}
+        if(spheres){
+            if(length2==0) continue;
+            const float r=p->data<float>(radiusAttr,i)[0];
+            const float tCenter=dot*(1/length2),miss2=v2-dot*tCenter;
+            if(miss2>r*r) continue;
+            const float halfChord=std::sqrt((r*r-miss2)*(1/length2));
+            const float t=std::max(tCenter-halfChord,0.f);
+            if(tCenter+halfChord>=0 && t<=tMax) hits.push_back(std::make_pair(t,(Partio::ParticleIndex)i));
+        }else{
+            const float t=std::min(std::max(length2>0 ? dot*(1/length2) : 0,0.f),tMax);
+            float d2=0;
+            for(int k=0;k<3;k++) d2+=(v[k]-t*direction[k])*(v[k]-t*direction[k]);
+            if(d2<radius*radius) hits.push_back(std::make_pair(t,(Partio::ParticleIndex)i));
+        }
+    }
+    std::sort(hits.begin(),hits.end());
+    if(maxHits>0 && (int)hits.size()>maxHits) hits.resize(maxHits);
+    return hits;
+}
+
+// The same particles nearest first, allowing for rounding in t
+void checkHits(const Hits& expected,const Partio::ParticleIndex* points,const float* t,const int count)
+{
+    TESTASSERT(count==(int)expected.size());
+    for(int i=0;i<count;i++){
+        TESTASSERT(std::fabs(t[i]-expected[i].first)<=1e-4f*std::max(1.f,std::fabs(t[i])));
+        TESTASSERT(i==0 || t[i]>=t[i-1]);
+    }
+    std::vector<Partio::ParticleIndex> found(points,points+count),wanted;
+    for(int i=0;i<count;i++) wanted.push_back(expected[i].second);
+    std::sort(found.begin(),found.end());
+    std::sort(wanted.begin(),wanted.end());
+    TESTASSERT(found==wanted);
+}
+
+void testRays(const Partio::ParticlesData* p,const bool spheres)
+{
+    const float radius=.02f;
+    for(int q=0;q<60;q++){
+        float origin[3],direction[3],tMax;
+        makeRay(q,origin,direction,tMax);
+        const int maxHits=q%2 ? 0 : 5;
+        const Hits expected=expectedHits(p,origin,direction,tMax,radius,spheres,maxHits);
+
+        std::vector<Partio::ParticleIndex> points;
+        std::vector<float> t;
+        if(spheres) p->findSpheresAlongRay(origin,direction,0,tMax,maxHits,points,t);
+        else p->findPointsAlongRay(origin,direction,0,tMax,radius,maxHits,points,t);
+        TESTASSERT(points.size()==t.size());
+        checkHits(expected,points.empty() ? 0 : &points[0],t.empty() ? 0 : &t[0],(int)points.size());
+    }
+
+    // a camera's rays fanning out over a small grid, traced as packets
+    const int width=13,height=11,nRays=width*height,maxHits=4;
+    std::vector<float> origins(3*nRays),directions(3*nRays);
+    for(int y=0;y<height;y++)
+        for(int x=0;x<width;x++){
+            float* o=&origins[3*(y*width+x)];
+            float* d=&directions[3*(y*width+x)];
+            o[0]=.5f;o[1]=.5f;o[2]=-1;
+            d[0]=(x-width/2)*.05f;d[1]=(y-height/2)*.05f;d[2]=1;
+        }
+    std::vector<Partio::ParticleIndex> points(nRays*maxHits);
+    std::vector<float> t(nRays*maxHits);
+    std::vector<int> counts(nRays);
+    if(spheres) p->findSpheresAlongRays(&origins[0],&directions[0],nRays,0,FLT_MAX,maxHits,&points[0],&t[0],&counts[0]);
+    else p->findPointsAlongRays(&origins[0],&directions[0],nRays,0,FLT_MAX,radius,maxHits,&points[0],&t[0],&counts[0]);
+    for(int r=0;r<nRays;r++){
+        const Hits expected=expectedHits(p,&origins[3*r],&directions[3*r],FLT_MAX,radius,spheres,maxHits);
+        checkHits(expected,&points[r*maxHits],&t[r*maxHits],counts[r]);
+    }
+}
+
+int main(int argc,char *argv[])
+{
+    srand(5);
+    Partio::setNumThreads(4);
+
+    std::cout<<"Testing rays through the KD-Tree ..."<<std::endl;
+    Partio::ParticlesDataMutable* p=makeData(20000);
+    p->sort();
+    testRays(p,false);
+
+    std::cout<<"Testing rays through a compact KD-Tree ..."<<std::endl;
+    p->sort(Partio::SortOptions(true));
+    testRays(p,false);
+
+    std::cout<<"Testing rays through the hash grid ..."<<std::endl;
+    p->sort(Partio::SortOptions(Partio::HASHGRID,.02f));
+    testRays(p,false);
+
+    std::cout<<"Testing rays through a hash grid stretched by an outlier ..."<<std::endl;
+    {
+        Partio::ParticlesDataMutable* stretched=makeData(20000);
+        Partio::ParticleAttribute positionAttr;
+        TESTASSERT(stretched->attributeInfo("position",positionAttr));
+        const float outlier[3]={1e6f,.5f,.5f};
+        for(int k=0;k<3;k++) stretched->dataWrite<float>(positionAttr,0)[k]=outlier[k];
+        stretched->sort(Partio::SortOptions(Partio::HASHGRID,.02f));
+        testRays(stretched,false);
+        // across the empty space to the outlier
+        const float origin[3]={.5f,.5f,.5f},direction[3]={1,0,0};
+        std::vector<Partio::ParticleIndex> points;
+        std::vector<float> t;
+        stretched->findPointsAlongRay(origin,direction,0,FLT_MAX,.02f,0,points,t);
+        const Hits expected=expectedHits(stretched,origin,direction,FLT_MAX,.02f,false,0);
+        TESTASSERT(!points.empty() && points.back()==0);
+        checkHits(expected,&points[0],&t[0],(int)points.size());
+        stretched->release();
+    }
+
+    std::cout<<"Testing rays through the spheres ..."<<std::endl;
+    p->sortSpheres("radius");
+    testRays(p,true);
+    p->release();
+
+    std::cout<<"Testing tiny sets ..."<<std::endl;
+    for(int n=0;n<20;n++){
+        Partio::ParticlesDataMutable* small=makeData(n);
+        small->sort();
+        testRays(small,false);
+        small->sortSpheres("radius");
+        testRays(small,true);
+        small->release();
+    }
+
+    std::cout<<"Test passed"<<std::endl;
+    return 0;
+}
@@ -0,0 +1,102 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+#include <Partio.h>
+#include <iostream>
+#include <string>
+#include <stdexcept>
+
+#define TESTASSERT(x)\
+ if(!(x)) throw std::runtime_error(__FILE__ ": Test failed on " #x ); 
+
+// Writes a particle set in several formats and reads back an attribute
+// subset of a percentage of the particles with readPart()
+
+Partio::ParticlesDataMutable* makeData(const int nParticles)
+{
+    Partio::ParticlesDataMutable* p=Partio::create();
+    Partio::ParticleAttribute posAttr=p->addAttribute("position",Partio::VECTOR,3);
+    Partio::ParticleAttribute densityAttr=p->addAttribute("density",Partio::FLOAT,1);
+    Partio::ParticleAttribute velAttr=p->addAttribute("v",Partio::VECTOR,3);
+    p->addParticles(nParticles);
+    for(int i=0;i<nParticles;i++){
+        float* pos=p->dataWrite<float>(posAttr,i);
+        float* vel=p->dataWrite<float>(velAttr,i);
+        for(int c=0;c<3;c++){pos[c]=(float)(i+c);vel[c]=-(float)c;}
+        p->dataWrite<float>(densityAttr,i)[0]=(float)i;
+    }
+    return p;
+}
+
+void testFormat(const Partio::ParticlesData* p,const std::string& filename)
+{
+    std::cout<<"Testing readPart of "<<filename<<" ..."<<std::endl;
+    Partio::write(filename.c_str(),*p);
+
+    // density is stored as the file index, so sampled particles can be identified
+    char density[]="density";
+    char* attributes[]={density,0};
+    const int percentage=5;
+    Partio::ParticlesDataMutable* part=Partio::readPart(filename.c_str(),attributes,percentage);
+    TESTASSERT(part);
+    TESTASSERT(part->numAttributes()==1);
+    TESTASSERT(part->numParticles()==p->numParticles()*percentage/100);
+    Partio::ParticleAttribute densityAttr;
+    TESTASSERT(part->attributeInfo("density",densityAttr));
+    int kept=0;
+    for(int i=0;i<p->numParticles();i++){
+        if((i+1)*percentage/100==i*percentage/100) continue;
+        TESTASSERT(part->data<float>(densityAttr,kept)[0]==(float)i);
+        kept++;
+    }
+    TESTASSERT(kept==part->numParticles());
+    part->release();
+
+    // no filter reads everything
+    Partio::ParticlesDataMutable* full=Partio::readPart(filename.c_str(),0,100);
+    TESTASSERT(full && full->numParticles()==p->numParticles());
+    TESTASSERT(full->attributeInfo("density",densityAttr));
+    TESTASSERT(full->data<float>(densityAttr,p->numParticles()-1)[0]==(float)(p->numParticles()-1));
+    full->release();
+}
+
+int main(int argc,char *argv[])
+{
+    Partio::ParticlesDataMutable* p=makeData(10000);
+    const char* extensions[]={"bgeo","bgeo.gz","pdb32","pdb64","ptc","pda","pdc","prt","geo",0};
+    for(int i=0;extensions[i];i++) testFormat(p,std::string("/tmp/testreadpart.")+extensions[i]);
+    std::cout<<"Test passed"<<std::endl;
+    p->release();
+    return 0;
+}
@@ -0,0 +1,171 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+#include <Partio.h>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+
+#define TESTASSERT(x)\
+ if(!(x)) throw std::runtime_error(__FILE__ ": Test failed on " #x ); 
+
+Partio::ParticlesDataMutable* makeData(const int n)
+{
+    Partio::ParticlesDataMutable* p=Partio::create();
+    Partio::ParticleAttribute positionAttr=p->addAttribute("position",Partio::VECTOR,3);
+    Partio::ParticleAttribute idAttr=p->addAttribute("id",Partio::INT,1);
+    Partio::ParticleAttribute lifeAttr=p->addAttribute("life",Partio::FLOAT,2);
+    p->addParticles(n);
+    srand(7);
+    for(int i=0;i<n;i++){
+        float* pos=p->dataWrite<float>(positionAttr,i);
+        for(int k=0;k<3;k++) pos[k]=(float)rand()/RAND_MAX;
+        p->dataWrite<int>(idAttr,i)[0]=i;
+        float* life=p->dataWrite<float>(lifeAttr,i);
+        life[0]=pos[0]+pos[1];life[1]=(float)i;
+    }
+    return p;
+}
+
+int main(int argc,char *argv[])
+{
+    const int n=20000;
+    Partio::ParticlesDataMutable* sorted=makeData(n);
+    Partio::ParticlesDataMutable* reordered=makeData(n);
+    Partio::ParticlesDataMutable* compact=makeData(n);
+    sorted->sort();
+    reordered->reorder();
+    compact->sort(Partio::SortOptions(true));
+
+    Partio::ParticleAttribute positionAttr,idAttr,lifeAttr;
+    TESTASSERT(reordered->attributeInfo("position",positionAttr));
+    TESTASSERT(reordered->attributeInfo("id",idAttr));
+    TESTASSERT(reordered->attributeInfo("life",lifeAttr));
+
+    // every particle is still there and its attributes moved together
+    std::vector<bool> seen(n,false);
+    for(int i=0;i<n;i++){
+        const int id=reordered->data<int>(idAttr,i)[0];
+        TESTASSERT(id>=0 && id<n && !seen[id]);
+        seen[id]=true;
+        const float* pos=reordered->data<float>(positionAttr,i);
+        const float* life=reordered->data<float>(lifeAttr,i);
+        TESTASSERT(life[0]==pos[0]+pos[1] && life[1]==(float)id);
+        const float* original=sorted->data<float>(positionAttr,id);
+        TESTASSERT(pos[0]==original[0] && pos[1]==original[1] && pos[2]==original[2]);
+    }
+
+    // queries find the same particles, now indexing storage directly
+    std::cout<<"Testing queries ..."<<std::endl;
+    srand(11);
+    for(int q=0;q<200;q++){
+        float center[3];
+        for(int k=0;k<3;k++) center[k]=(float)rand()/RAND_MAX;
+        std::vector<Partio::ParticleIndex> a,b;
+        std::vector<float> da,db;
+        sorted->findNPoints(center,8,.2f,a,da);
+        reordered->findNPoints(center,8,.2f,b,db);
+        TESTASSERT(a.size()==b.size());
+        std::vector<int> idsA,idsB;
+        for(size_t i=0;i<a.size();i++){
+            idsA.push_back((int)a[i]);
+            idsB.push_back(reordered->data<int>(idAttr,b[i])[0]);
+        }
+        std::sort(idsA.begin(),idsA.end());
+        std::sort(idsB.begin(),idsB.end());
+        TESTASSERT(idsA==idsB);
+
+        // compact trees keep the original indices
+        std::vector<Partio::ParticleIndex> c;
+        std::vector<float> dc;
+        compact->findNPoints(center,8,.2f,c,dc);
+        std::vector<int> idsC(c.begin(),c.end());
+        std::sort(idsC.begin(),idsC.end());
+        TESTASSERT(idsA==idsC);
+
+        float bmin[3]={center[0]-.05f,center[1]-.05f,center[2]-.05f};
+        float bmax[3]={center[0]+.05f,center[1]+.05f,center[2]+.05f};
+        a.clear();b.clear();
+        sorted->findPoints(bmin,bmax,a);
+        reordered->findPoints(bmin,bmax,b);
+        TESTASSERT(a.size()==b.size());
+        c.clear();
+        compact->findPoints(bmin,bmax,c);
+        std::sort(a.begin(),a.end());
+        std::sort(c.begin(),c.end());
+        TESTASSERT(a==c);
+    }
+
+    // growing storage drops the tree that read positions in place, and the
+    // next query builds a new one over the grown set
+    Partio::ParticleAttribute compactPositionAttr;
+    TESTASSERT(compact->attributeInfo("position",compactPositionAttr));
+    reordered->addParticles(100000);
+    compact->addParticles(100000);
+    for(int i=n;i<n+100000;i++){
+        float* pos=reordered->dataWrite<float>(positionAttr,i);
+        pos[0]=pos[1]=pos[2]=10.f;
+        pos=compact->dataWrite<float>(compactPositionAttr,i);
+        pos[0]=pos[1]=pos[2]=10.f;
+    }
+    std::vector<Partio::ParticleIndex> points;
+    std::vector<float> distances;
+    float center[3]={.5f,.5f,.5f};
+    reordered->findNPoints(center,4,1.f,points,distances);
+    TESTASSERT(points.size()==4);
+    compact->findNPoints(center,4,1.f,points,distances);
+    TESTASSERT(points.size()==4);
+
+    // positions a KD-Tree can't be built over, with an index over another attribute
+    Partio::ParticlesDataMutable* flat=Partio::create();
+    Partio::ParticleAttribute flatPositionAttr=flat->addAttribute("position",Partio::FLOAT,1);
+    Partio::ParticleAttribute velocityAttr=flat->addAttribute("velocity",Partio::VECTOR,3);
+    flat->addParticles(100);
+    for(int i=0;i<100;i++){
+        flat->dataWrite<float>(flatPositionAttr,i)[0]=(float)i;
+        for(int k=0;k<3;k++) flat->dataWrite<float>(velocityAttr,i)[k]=(float)rand()/RAND_MAX;
+    }
+    flat->sort("velocity");
+    flat->reorder();
+    TESTASSERT(flat->data<float>(flatPositionAttr,7)[0]==7.f); // left as it was
+    flat->release();
+
+    sorted->release();
+    reordered->release();
+    compact->release();
+    std::cout<<"Test passed"<<std::endl;
+    return 0;
+}
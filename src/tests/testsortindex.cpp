@@ -0,0 +1,157 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+#include <Partio.h>
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+
+#define TESTASSERT(x)\
+ if(!(x)) throw std::runtime_error(__FILE__ ": Test failed on " #x ); 
+
+Partio::ParticlesDataMutable* makeData(const int n,const unsigned int seed)
+{
+    Partio::ParticlesDataMutable* p=Partio::create();
+    Partio::ParticleAttribute positionAttr=p->addAttribute("position",Partio::VECTOR,3);
+    p->addParticles(n);
+    srand(seed);
+    for(int i=0;i<n;i++){
+        float* pos=p->dataWrite<float>(positionAttr,i);
+        for(int k=0;k<3;k++) pos[k]=(float)rand()/RAND_MAX-.5f;
+    }
+    return p;
+}
+
+// Compares the neighbors found in particles against a brute force search of original
+void testQueries(const Partio::ParticlesData* particles,const Partio::ParticlesData* original)
+{
+    Partio::ParticleAttribute positionAttr;
+    TESTASSERT(original->attributeInfo("position",positionAttr));
+    const int nPoints=10;
+    const float maxRadius=.2f;
+    for(int q=0;q<50;q++){
+        const float center[3]={(q%5)*.2f-.4f,((q/5)%5)*.2f-.4f,(q/25)*.4f-.2f};
+        std::vector<Partio::ParticleIndex> points;
+        std::vector<float> distances;
+        particles->findNPoints(center,nPoints,maxRadius,points,distances);
+        std::sort(distances.begin(),distances.end());
+
+        std::vector<float> expected;
+        for(int i=0;i<original->numParticles();i++){
+            const float* pos=original->data<float>(positionAttr,i);
+            float d2=0;
+            for(int k=0;k<3;k++) d2+=(pos[k]-center[k])*(pos[k]-center[k]);
+            if(d2<maxRadius*maxRadius) expected.push_back(d2);
+        }
+        std::sort(expected.begin(),expected.end());
+        if((int)expected.size()>nPoints) expected.resize(nPoints);
+        TESTASSERT(distances==expected);
+        for(size_t i=0;i<points.size();i++) TESTASSERT(points[i]<(Partio::ParticleIndex)original->numParticles());
+    }
+}
+
+bool exists(const char* filename)
+{
+    std::ifstream file(filename);
+    return (bool)file;
+}
+
+int main(int argc,char *argv[])
+{
+    const char* filename="testsortindex.bgeo";
+    const char* indexFilename="testsortindex.bgeo.kdtree";
+    Partio::ParticlesDataMutable* original=makeData(20000,3);
+    Partio::write(filename,*original);
+    std::remove(indexFilename);
+
+    std::cout<<"Testing writing the index ..."<<std::endl;
+    {
+        Partio::ParticlesDataMutable* p=Partio::read(filename);
+        TESTASSERT(p);
+        TESTASSERT(Partio::writeSortIndex(filename,*p)); // sorts first
+        TESTASSERT(exists(indexFilename));
+        // a reordered set is no longer in the file's order
+        p->reorder();
+        TESTASSERT(!Partio::writeSortIndex(filename,*p));
+        p->release();
+    }
+
+    std::cout<<"Testing sorts that load the index ..."<<std::endl;
+    {
+        Partio::ParticlesDataMutable* p=Partio::read(filename);
+        Partio::SortOptions options;
+        options.sourceFile=filename;
+        p->sort(options);
+        testQueries(p,original);
+        options.compact=true;
+        p->sort(options);
+        testQueries(p,original);
+        p->release();
+
+        Partio::ParticlesData* cached=Partio::readCached(filename,true);
+        testQueries(cached,original);
+        cached->release();
+
+        Partio::ParticlesData* mapped=Partio::readMapped(filename,true);
+        testQueries(mapped,original);
+        mapped->release();
+    }
+
+    std::cout<<"Testing a stale index is ignored ..."<<std::endl;
+    {
+        Partio::ParticlesDataMutable* changed=makeData(15000,4);
+        Partio::write(filename,*changed);
+        Partio::ParticlesData* cached=Partio::readCached(filename,true);
+        testQueries(cached,changed);
+        cached->release();
+
+        // same count so same size, possibly the same modification time too
+        changed->release();
+        changed=makeData(20000,5);
+        Partio::write(filename,*changed);
+        Partio::ParticlesData* mapped=Partio::readMapped(filename,true);
+        testQueries(mapped,changed);
+        mapped->release();
+        changed->release();
+    }
+
+    std::remove(filename);
+    std::remove(indexFilename);
+    original->release();
+    std::cout<<"Test passed"<<std::endl;
+    return 0;
+}
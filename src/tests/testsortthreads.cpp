@@ -0,0 +1,211 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+#include <Partio.h>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+#ifndef PARTIO_WIN32
+#include <pthread.h>
+#else
+#include <windows.h>
+#endif
+
+#define TESTASSERT(x)\
+ if(!(x)) throw std::runtime_error(__FILE__ ": Test failed on " #x ); 
+
+// Queries from several threads while the main thread keeps sorting the same
+// set, and queries a set that was never sorted from several threads at once,
+// both in memory and mapped.
+
+const int nQueries=64,nPoints=8;
+const float maxRadius=0.1f;
+
+struct Query
+{
+    const Partio::ParticlesData* particles;
+    const std::vector<float>* expected; // sorted distances for every query
+    volatile bool* stop;
+    int rounds,failures;
+};
+
+void queryAll(Query& query)
+{
+    std::vector<Partio::ParticleIndex> points;
+    std::vector<float> distances;
+    for(int q=0;q<nQueries;q++){
+        const float center[3]={(q%4)/3.f,((q/4)%4)/3.f,(q/16)/3.f};
+        query.particles->findNPoints(center,nPoints,maxRadius,points,distances);
+        std::sort(distances.begin(),distances.end());
+        const std::vector<float>& expected=query.expected[q];
+        if(distances!=expected) query.failures++;
+    }
+    query.rounds++;
+}
+
+#ifndef PARTIO_WIN32
+void* queryEntry(void* data)
+#else
+DWORD WINAPI queryEntry(LPVOID data)
+#endif
+{
+    Query& query=*static_cast<Query*>(data);
+    do queryAll(query); while(!*query.stop);
+    return 0;
+}
+
+void runQueries(std::vector<Query>& queries,void (*work)(void*),void* workData)
+{
+#ifndef PARTIO_WIN32
+    std::vector<pthread_t> threads(queries.size());
+    for(size_t i=0;i<queries.size();i++) pthread_create(&threads[i],0,queryEntry,&queries[i]);
+    work(workData);
+    *queries[0].stop=true;
+    for(size_t i=0;i<queries.size();i++) pthread_join(threads[i],0);
+#else
+    std::vector<HANDLE> threads(queries.size());
+    for(size_t i=0;i<queries.size();i++) threads[i]=CreateThread(0,0,queryEntry,&queries[i],0,0);
+    work(workData);
+    *queries[0].stop=true;
+    for(size_t i=0;i<queries.size();i++){
+        WaitForSingleObject(threads[i],INFINITE);
+        CloseHandle(threads[i]);
+    }
+#endif
+}
+
+Partio::ParticlesDataMutable* makeData(const int n)
+{
+    Partio::ParticlesDataMutable* p=Partio::create();
+    Partio::ParticleAttribute positionAttr=p->addAttribute("position",Partio::VECTOR,3);
+    p->addParticles(n);
+    srand(9);
+    for(int i=0;i<n;i++){
+        float* pos=p->dataWrite<float>(positionAttr,i);
+        for(int k=0;k<3;k++) pos[k]=(float)rand()/RAND_MAX;
+    }
+    return p;
+}
+
+void resortRepeatedly(void* data)
+{
+    Partio::ParticlesDataMutable* p=static_cast<Partio::ParticlesDataMutable*>(data);
+    for(int i=0;i<30;i++){
+        if(i%3==0) p->sort();
+        else if(i%3==1) p->sort(Partio::SortOptions(true));
+        else p->sort(Partio::SortOptions(Partio::HASHGRID,maxRadius));
+    }
+}
+
+void nothing(void*)
+{}
+
+int main(int argc,char *argv[])
+{
+    const int n=50000,nThreads=4;
+    Partio::setNumThreads(2);
+
+    // expected answers from a set sorted up front
+    std::vector<float> expected[nQueries];
+    {
+        Partio::ParticlesDataMutable* reference=makeData(n);
+        reference->sort();
+        bool stop=true;
+        Query query={reference,expected,&stop,0,0};
+        std::vector<Partio::ParticleIndex> points;
+        for(int q=0;q<nQueries;q++){
+            const float center[3]={(q%4)/3.f,((q/4)%4)/3.f,(q/16)/3.f};
+            reference->findNPoints(center,nPoints,maxRadius,points,expected[q]);
+            std::sort(expected[q].begin(),expected[q].end());
+        }
+        queryAll(query);
+        TESTASSERT(query.failures==0);
+        reference->release();
+    }
+
+    std::cout<<"Testing queries during sort ..."<<std::endl;
+    {
+        Partio::ParticlesDataMutable* p=makeData(n);
+        p->sort();
+        bool stop=false;
+        std::vector<Query> queries(nThreads);
+        for(int t=0;t<nThreads;t++){
+            Query query={p,expected,&stop,0,0};
+            queries[t]=query;
+        }
+        runQueries(queries,resortRepeatedly,p);
+        for(int t=0;t<nThreads;t++){
+            TESTASSERT(queries[t].rounds>0);
+            TESTASSERT(queries[t].failures==0);
+        }
+        p->release();
+    }
+
+    std::cout<<"Testing first queries on an unsorted set ..."<<std::endl;
+    {
+        Partio::ParticlesDataMutable* p=makeData(n);
+        bool stop=true;
+        std::vector<Query> queries(nThreads);
+        for(int t=0;t<nThreads;t++){
+            Query query={p,expected,&stop,0,0};
+            queries[t]=query;
+        }
+        runQueries(queries,nothing,0);
+        for(int t=0;t<nThreads;t++) TESTASSERT(queries[t].failures==0);
+        p->release();
+    }
+
+    std::cout<<"Testing first queries on an unsorted mapped set ..."<<std::endl;
+    {
+        Partio::ParticlesDataMutable* p=makeData(n);
+        Partio::write("testsortthreads.bgeo",*p);
+        p->release();
+        Partio::ParticlesData* mapped=Partio::readMapped("testsortthreads.bgeo",false);
+        TESTASSERT(mapped);
+        bool stop=true;
+        std::vector<Query> queries(nThreads);
+        for(int t=0;t<nThreads;t++){
+            Query query={mapped,expected,&stop,0,0};
+            queries[t]=query;
+        }
+        runQueries(queries,nothing,0);
+        for(int t=0;t<nThreads;t++) TESTASSERT(queries[t].failures==0);
+        mapped->release();
+    }
+
+    std::cout<<"Test passed"<<std::endl;
+    return 0;
+}
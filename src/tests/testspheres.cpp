@@ -0,0 +1,139 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+#include <Partio.h>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+
+#define TESTASSERT(x)\
+ if(!(x)) throw std::runtime_error(__FILE__ ": Test failed on " #x ); 
+
+float randomFloat()
+{
+    return (float)rand()/RAND_MAX;
+}
+
+// Particles with radii spread over two orders of magnitude, some sharing a position
+Partio::ParticlesDataMutable* makeData(const int n)
+{
+    Partio::ParticlesDataMutable* p=Partio::create();
+    Partio::ParticleAttribute positionAttr=p->addAttribute("position",Partio::VECTOR,3);
+    Partio::ParticleAttribute radiusAttr=p->addAttribute("radius",Partio::FLOAT,1);
+    p->addParticles(n);
+    for(int i=0;i<n;i++){
+        float* pos=p->dataWrite<float>(positionAttr,i);
+        if(i%10==9) for(int k=0;k<3;k++) pos[k]=p->data<float>(positionAttr,i-1)[k];
+        else for(int k=0;k<3;k++) pos[k]=randomFloat();
+        p->dataWrite<float>(radiusAttr,i)[0]=.001f*std::pow(100.f,randomFloat());
+    }
+    return p;
+}
+
+// Compares sphere searches against brute force, checking the returned indices by their values
+void testQueries(const Partio::ParticlesData* p)
+{
+    Partio::ParticleAttribute positionAttr,radiusAttr;
+    TESTASSERT(p->attributeInfo("position",positionAttr));
+    TESTASSERT(p->attributeInfo("radius",radiusAttr));
+
+    for(int q=0;q<100;q++){
+        float point[3],bboxMin[3],bboxMax[3];
+        for(int k=0;k<3;k++){
+            point[k]=randomFloat();
+            bboxMin[k]=point[k]-.02f;
+            bboxMax[k]=point[k]+.03f;
+        }
+
+        std::vector<Partio::ParticleIndex> expectedContaining,expectedOverlapping;
+        for(int i=0;i<p->numParticles();i++){
+            const float* pos=p->data<float>(positionAttr,i);
+            const float r=p->data<float>(radiusAttr,i)[0];
+            float d2=0,boxD2=0;
+            for(int k=0;k<3;k++){
+                d2+=(pos[k]-point[k])*(pos[k]-point[k]);
+                float d=std::max(std::max(bboxMin[k]-pos[k],pos[k]-bboxMax[k]),0.f);
+                boxD2+=d*d;
+            }
+            if(d2<=r*r) expectedContaining.push_back(i);
+            if(boxD2<=r*r) expectedOverlapping.push_back(i);
+        }
+
+        std::vector<Partio::ParticleIndex> containing,overlapping;
+        p->findSpheresContaining(point,containing);
+        p->findSpheresOverlapping(bboxMin,bboxMax,overlapping);
+        std::sort(containing.begin(),containing.end());
+        std::sort(overlapping.begin(),overlapping.end());
+        TESTASSERT(containing==expectedContaining);
+        TESTASSERT(overlapping==expectedOverlapping);
+    }
+}
+
+int main(int argc,char *argv[])
+{
+    srand(11);
+
+    std::cout<<"Testing sphere queries ..."<<std::endl;
+    Partio::setNumThreads(4);
+    Partio::ParticlesDataMutable* p=makeData(100000);
+    p->sortSpheres("radius");
+    testQueries(p);
+
+    std::cout<<"Testing a single threaded build ..."<<std::endl;
+    Partio::setNumThreads(1);
+    p->sortSpheres("radius");
+    testQueries(p);
+    Partio::setNumThreads(0);
+
+    std::cout<<"Testing sort and reorder keep the spheres ..."<<std::endl;
+    p->sort();
+    testQueries(p);
+    p->reorder();
+    testQueries(p);
+    p->release();
+
+    std::cout<<"Testing tiny sets ..."<<std::endl;
+    for(int n=0;n<20;n++){
+        Partio::ParticlesDataMutable* small=makeData(n);
+        small->sortSpheres("radius");
+        testQueries(small);
+        small->release();
+    }
+
+    std::cout<<"Test passed"<<std::endl;
+    return 0;
+}
@@ -0,0 +1,167 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+#include <Partio.h>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+
+#define TESTASSERT(x)\
+ if(!(x)) throw std::runtime_error(__FILE__ ": Test failed on " #x ); 
+
+Partio::ParticlesDataMutable* makeData(const int n)
+{
+    Partio::ParticlesDataMutable* p=Partio::create();
+    Partio::ParticleAttribute positionAttr=p->addAttribute("position",Partio::VECTOR,3);
+    p->addParticles(n);
+    srand(3);
+    for(int i=0;i<n;i++){
+        float* pos=p->dataWrite<float>(positionAttr,i);
+        for(int k=0;k<3;k++) pos[k]=(float)rand()/RAND_MAX;
+    }
+    return p;
+}
+
+// moves every particle by up to amount along each axis
+void jitter(Partio::ParticlesDataMutable* p,const float amount,const int seed)
+{
+    Partio::ParticleAttribute positionAttr;
+    TESTASSERT(p->attributeInfo("position",positionAttr));
+    srand(seed);
+    for(int i=0;i<p->numParticles();i++){
+        float* pos=p->dataWrite<float>(positionAttr,i);
+        for(int k=0;k<3;k++) pos[k]+=amount*(2.f*rand()/RAND_MAX-1.f);
+    }
+}
+
+// same positions, sorted from scratch
+void compareWithFreshSort(Partio::ParticlesDataMutable* updated)
+{
+    Partio::ParticleAttribute positionAttr;
+    TESTASSERT(updated->attributeInfo("position",positionAttr));
+    const int n=(int)updated->numParticles();
+    Partio::ParticlesDataMutable* fresh=Partio::create();
+    Partio::ParticleAttribute freshAttr=fresh->addAttribute("position",Partio::VECTOR,3);
+    fresh->addParticles(n);
+    for(int i=0;i<n;i++){
+        const float* pos=updated->data<float>(positionAttr,i);
+        float* freshPos=fresh->dataWrite<float>(freshAttr,i);
+        for(int k=0;k<3;k++) freshPos[k]=pos[k];
+    }
+    fresh->sort();
+
+    for(int q=0;q<200;q++){
+        const float center[3]={(q%7)/6.f,((q/7)%5)/4.f,(q%11)/10.f};
+        std::vector<Partio::ParticleIndex> points,freshPoints;
+        std::vector<float> dists,freshDists;
+        updated->findNPoints(center,10,0.1f,points,dists);
+        fresh->findNPoints(center,10,0.1f,freshPoints,freshDists);
+        std::sort(dists.begin(),dists.end());
+        std::sort(freshDists.begin(),freshDists.end());
+        TESTASSERT(dists==freshDists);
+
+        const float bboxMin[3]={center[0]-.05f,center[1]-.05f,center[2]-.05f};
+        const float bboxMax[3]={center[0]+.05f,center[1]+.05f,center[2]+.05f};
+        points.clear();freshPoints.clear();
+        updated->findPoints(bboxMin,bboxMax,points);
+        fresh->findPoints(bboxMin,bboxMax,freshPoints);
+        std::sort(points.begin(),points.end());
+        std::sort(freshPoints.begin(),freshPoints.end());
+        TESTASSERT(points==freshPoints);
+    }
+    fresh->release();
+}
+
+int main(int argc,char *argv[])
+{
+    const int n=50000;
+    Partio::setNumThreads(2);
+
+    std::cout<<"Testing small and large motion ..."<<std::endl;
+    {
+        Partio::ParticlesDataMutable* p=makeData(n);
+        p->sort();
+        for(int frame=0;frame<3;frame++){
+            jitter(p,0.001f,frame);
+            p->updateSort();
+            compareWithFreshSort(p);
+        }
+        // a few particles move far, only the subtrees around them are sorted again
+        Partio::ParticleAttribute positionAttr;
+        TESTASSERT(p->attributeInfo("position",positionAttr));
+        for(int i=0;i<n;i+=500) p->dataWrite<float>(positionAttr,i)[0]+=0.05f;
+        p->updateSort();
+        compareWithFreshSort(p);
+        // moves most splits, falls back to a full sort
+        jitter(p,0.5f,10);
+        p->updateSort();
+        compareWithFreshSort(p);
+        p->release();
+    }
+
+    std::cout<<"Testing compact tree ..."<<std::endl;
+    {
+        Partio::ParticlesDataMutable* p=makeData(n);
+        p->sort(Partio::SortOptions(true));
+        jitter(p,0.002f,20);
+        p->updateSort();
+        compareWithFreshSort(p);
+        p->release();
+    }
+
+    std::cout<<"Testing reordered particles ..."<<std::endl;
+    {
+        Partio::ParticlesDataMutable* p=makeData(n);
+        p->reorder();
+        jitter(p,0.002f,30);
+        p->updateSort();
+        compareWithFreshSort(p);
+        p->release();
+    }
+
+    std::cout<<"Testing changed particle count ..."<<std::endl;
+    {
+        Partio::ParticlesDataMutable* p=makeData(n);
+        p->sort();
+        p->addParticles(10);
+        p->updateSort();
+        compareWithFreshSort(p);
+        p->release();
+    }
+
+    std::cout<<"Test passed"<<std::endl;
+    return 0;
+}
@@ -50,7 +50,7 @@ int main(int argc,char *argv[])
         Partio::ParticleAttribute attrhandle;
         p->attributeInfo(argv[2], attrhandle);
 
-        for(int i = 0; i < std::min(10, p->numParticles()); i++){
+        for(int i = 0; i < std::min((int64_t)10, p->numParticles()); i++){
             const float* data = p->data<float>(attrhandle,i);
             std::cout << argv[2] << i << " ";
             for(int j = 0; j < attrhandle.count; j++){
@@ -0,0 +1,85 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+#include <Partio.h>
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <stdlib.h>
+
+// Replaces the run of #'s in pattern with frame, zero padded to the run's length
+std::string frameFilename(const std::string& pattern,const int frame)
+{
+    size_t start=pattern.find('#');
+    if(start==std::string::npos) return pattern;
+    size_t end=pattern.find_first_not_of('#',start);
+    if(end==std::string::npos) end=pattern.size();
+    std::ostringstream name;
+    name<<pattern.substr(0,start)<<std::setfill('0')<<std::setw(end-start)<<frame<<pattern.substr(end);
+    return name.str();
+}
+
+int main(int argc,char *argv[])
+{
+    if(argc!=2 && argc!=4){
+        std::cerr<<"Usage is: "<<argv[0]<<" <filename> [<first frame> <last frame>]"<<std::endl;
+        std::cerr<<"  Saves the KD-Tree of a particle file next to it, so sorting it loads the tree"<<std::endl;
+        std::cerr<<"  instead of building it. With a frame range the #'s in filename are replaced"<<std::endl;
+        std::cerr<<"  by each frame number, e.g. "<<argv[0]<<" fluid.####.bgeo 1 240"<<std::endl;
+        return 1;
+    }
+    const std::string pattern=argv[1];
+    int first=0,last=0;
+    if(argc==4){
+        first=atoi(argv[2]);
+        last=atoi(argv[3]);
+    }
+
+    int failed=0;
+    for(int frame=first;frame<=last;frame++){
+        const std::string filename=frameFilename(pattern,frame);
+        Partio::ParticlesDataMutable* p=Partio::read(filename.c_str());
+        if(!p){
+            failed++;
+            continue;
+        }
+        p->sort();
+        if(Partio::writeSortIndex(filename.c_str(),*p))
+            std::cout<<filename<<": indexed "<<p->numParticles()<<" particles"<<std::endl;
+        else failed++;
+        p->release();
+    }
+    return failed ? 1 : 0;
+}
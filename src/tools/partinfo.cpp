@@ -60,7 +60,7 @@ int main(int argc,char *argv[])
         Partio::ParticleAttribute positionhandle;
         p->attributeInfo("position",positionhandle);
         if(argc==2){
-            for(int i=0;i<std::min(10,p->numParticles());i++){
+            for(int i=0;i<std::min((int64_t)10,p->numParticles());i++){
                 const float* data=p->data<float>(positionhandle,i);;
                 std::cout<<"particle "<<i<<" data "<<data[0]<<" "<<data[1]<<" "<<data[2]<<std::endl;
             }
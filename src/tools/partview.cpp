@@ -197,7 +197,7 @@ static void render()
     sprintf(fovString,"FOV:%i",(int)fov);
     renderBitmapString(5,20,0,GLUT_BITMAP_HELVETICA_18,fovString);
     char pointCountString[50];
-    sprintf(pointCountString,"PointCount:%i",particles->numParticles());
+    sprintf(pointCountString,"PointCount:%lld",(long long)particles->numParticles());
     renderBitmapString(5,40,0,GLUT_BITMAP_HELVETICA_18,pointCountString);
 
     char frameNumString[50];